@@ -0,0 +1,32 @@
+/*-------------------------------------------------------------------------
+ *
+ * connection_cache.h
+ *	  definition of the cache of idle connections for running jobs
+ *
+ * Copyright (c) 2016, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef CONNECTION_CACHE_H
+#define CONNECTION_CACHE_H
+
+
+#include "libpq-fe.h"
+#include "utils/timestamp.h"
+
+
+/* global settings */
+extern int CronConnectionCacheTimeout;
+
+
+extern void InitializeConnectionCache(int maxConnections);
+extern PGconn * GetCachedConnection(char *nodeName, int nodePort,
+									char *database, char *userName);
+extern void ReleaseConnection(PGconn *connection, char *nodeName, int nodePort,
+							  char *database, char *userName,
+							  TimestampTz currentTime);
+extern void CloseIdleConnections(TimestampTz currentTime);
+
+
+#endif
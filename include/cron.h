@@ -68,7 +68,6 @@ static inline int getrlimit(int resource, struct rlimit *rlp) { return 0; }
 #include <sys/param.h>
 
 #include <stdio.h>
-#include <bitstring.h>
 #if SYS_TIME_H
 # include <sys/time.h>
 #else
@@ -129,17 +128,6 @@ static inline int getrlimit(int resource, struct rlimit *rlp) { return 0; }
 
 #define Is_Blank(c) ((c) == '\t' || (c) == ' ')
 
-#define	Skip_Blanks(c, f) \
-			while (Is_Blank(c)) \
-				c = get_char(f);
-
-#define	Skip_Nonblanks(c, f) \
-			while (c!='\t' && c!=' ' && c!='\n' && c != EOF && c != '\0') \
-				c = get_char(f);
-
-#define	Skip_Line(c, f) \
-			do {c = get_char(f);} while (c != '\n' && c != EOF);
-
 #if DEBUGGING
 # define Debug(mask, message) \
 			if ( (DebugFlags & (mask) )  ) \
@@ -151,9 +139,6 @@ static inline int getrlimit(int resource, struct rlimit *rlp) { return 0; }
 
 #define	MkLower(ch)	(isupper(ch) ? tolower(ch) : ch)
 #define	MkUpper(ch)	(islower(ch) ? toupper(ch) : ch)
-#define	Set_LineNum(ln)	{Debug(DPARS|DEXT,("linenum=%d\n",ln)); \
-			 LineNumber = ln; \
-			}
 
 typedef int time_min;
 
@@ -184,35 +169,27 @@ typedef int time_min;
 #define	LAST_DOW	7
 #define	DOW_COUNT	(LAST_DOW - FIRST_DOW + 1)
 
-			/* each user's crontab will be held as a list of
-			 * the following structure.
-			 *
-			 * These are the cron commands.
+			/* a parsed schedule, packed such that it fits in
+			 * a few words.  bit N of a field is set when the
+			 * schedule includes value FIRST_<field> + N.  day
+			 * of week 0 and 7 are both Sunday and always set
+			 * together.
 			 */
 
 typedef	struct _entry {
-	struct _entry	*next;
-    #if defined(_WIN32)
-	unsigned int 	uid;
-	unsigned int 	gid;
-	#else
-	uid_t		uid;
-	gid_t		gid;
-	#endif
-	char		**envp;
-	int         secondsInterval;
-	bitstr_t	bit_decl(minute, MINUTE_COUNT);
-	bitstr_t	bit_decl(hour,   HOUR_COUNT);
-	bitstr_t	bit_decl(dom,    DOM_COUNT);
-	bitstr_t	bit_decl(month,  MONTH_COUNT);
-	bitstr_t	bit_decl(dow,    DOW_COUNT);
-	int		flags;
+	uint64		minute;
+	uint32		hour;
+	uint32		dom;
+	uint16		month;
+	uint8		dow;
+	uint8		flags;
 #define	DOM_STAR	0x01
 #define	DOW_STAR	0x02
 #define	WHEN_REBOOT	0x04
 #define MIN_STAR	0x08
 #define HR_STAR		0x10
 #define DOM_LAST	0x20
+	int         secondsInterval;
 } entry;
 
 			/* the crontab database will be a list of the
@@ -248,27 +225,7 @@ typedef struct _orphan {
 	char            *tabname;
 } orphan;
 
-/*
- * Buffer used to mimick getc(FILE*) and ungetc(FILE*)
- */
-#define MAX_FILE_BUFFER_LENGTH 1000
-
-typedef struct _file_buffer {
-	char 		data[MAX_FILE_BUFFER_LENGTH];
-	int			length;
-	int			pointer;
-	char		unget_data[MAX_FILE_BUFFER_LENGTH];
-	int			unget_count;
-} file_buffer;
-
-void	unget_char(int, FILE *),
-		free_entry(entry *),
-		skip_comments(FILE *);
-
-int		get_char(FILE *),
-		get_string(char *, int, FILE *, char *);
-
-entry * parse_cron_entry(char *);
+bool	ParseCronSchedule(const char *, entry *);
 
 				/* in the C tradition, we only create
 				 * variables for the main program, just
@@ -277,4 +234,3 @@ entry * parse_cron_entry(char *);
 
 extern	char *MonthNames[];
 extern	char *DowNames[];
-extern	int	LineNumber;
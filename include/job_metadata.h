@@ -16,6 +16,7 @@
 #if (PG_VERSION_NUM < 120000)
 #include "datatype/timestamp.h"
 #endif
+#include "shared_state.h"
 
 typedef enum
 {
@@ -27,12 +28,45 @@ typedef enum
 	CRON_STATUS_FAILED
 } CronStatus;
 
+/*
+ * Parsed schedule, shared by all jobs that have the same schedule text. The
+ * next run time is memoized such that it is computed once per schedule
+ * rather than once per job.
+ */
+typedef struct CronSchedule
+{
+	char *scheduleText;
+	entry schedule;
+	bool isValid;
+	int refCount;
+
+	/* result of the last NextRunTime call, see ScheduleNextRunTime */
+	TimestampTz runTimeAfter;
+	TimestampTz nextRunTime;
+} CronSchedule;
+
 /* job metadata data structure */
+/* which runs of a job are written to cron.job_run_details */
+typedef enum
+{
+	/* all runs */
+	CRON_LOG_MODE_ALL,
+
+	/* only runs that failed */
+	CRON_LOG_MODE_FAILURES,
+
+	/* one in every log_sample_rate runs, and runs that failed */
+	CRON_LOG_MODE_SAMPLE,
+
+	/* runs that failed, and per-minute counts in cron.job_run_rollups */
+	CRON_LOG_MODE_ROLLUP
+} CronLogMode;
+
 typedef struct CronJob
 {
 	int64 jobId;
 	char *scheduleText;
-	entry schedule;
+	CronSchedule *schedule;
 	char *command;
 	char *nodeName;
 	int nodePort;
@@ -40,6 +74,8 @@ typedef struct CronJob
 	char *userName;
 	bool active;
 	char *jobName;
+	CronLogMode logMode;
+	int logSampleRate;
 } CronJob;
 
 
@@ -47,19 +83,43 @@ typedef struct CronJob
 extern char *CronHost;
 extern bool CronJobCacheValid;
 extern bool EnableSuperuserJobs;
+extern int JobRefreshDelay;
+extern int CronLogRunBatchSize;
+extern int CronLogRunFlushInterval;
+extern bool CronLogRunSynchronousCommit;
+extern int CronRunDetailsRetention;
+extern int CronRunDetailsPurgeBatchSize;
+extern int CronRunDetailsPurgeDelay;
 
 
 /* functions for retrieving job metadata */
 extern void InitializeJobMetadataCache(void);
 extern void ResetJobMetadataCache(void);
+extern void ForceJobCacheReload(void);
+extern bool JobCacheRefreshDue(TimestampTz currentTime);
+extern void MarkJobCacheValid(void);
 extern List * LoadCronJobList(void);
+extern bool LoadChangedCronJobs(List **changedJobIdList);
 extern CronJob * GetCronJob(int64 jobId);
 
 extern void InsertJobRunDetail(int64 runId, int64 *jobId, char *database, char *username, char *command, char *status);
+extern void DeferJobRunDetail(int64 runId, int64 jobId, char *database,
+							  char *username, char *command, bool rollup);
+extern void FinishDeferredJobRunDetail(int64 runId);
 extern void UpdateJobRunDetail(int64 runId, int32 *job_pid, char *status, char *return_message, TimestampTz *start_time,
 									TimestampTz *end_time);
+extern void WriteJobRunDetailInsert(int64 runId, int64 *jobId, char *database,
+									char *username, char *command, char *status);
+extern void WriteJobRunDetailUpdate(int64 runId, int32 *job_pid, char *status,
+									char *return_message, TimestampTz *start_time,
+									TimestampTz *end_time, CronRunLatency *latency);
+extern void FlushJobRunDetails(void);
+extern void FlushJobRunDetailsIfDue(TimestampTz currentTime);
+extern TimestampTz JobRunDetailsFlushTime(void);
+extern void FlushJobRunRollupsIfDue(TimestampTz currentTime);
 extern int64 NextRunId(void);
 extern void MarkPendingRunsAsFailed(void);
+extern void PurgeJobRunDetailsIfDue(TimestampTz currentTime);
 extern char *GetCronStatus(CronStatus cronstatus);
 
 extern void InvalidateJobCacheCallback(Datum argument, Oid relationId);
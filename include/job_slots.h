@@ -0,0 +1,29 @@
+/*-------------------------------------------------------------------------
+ *
+ * job_slots.h
+ *	  definition of the preallocated shared memory for background workers
+ *
+ * Copyright (c) 2016, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef JOB_SLOTS_H
+#define JOB_SLOTS_H
+
+
+#include "storage/dsm.h"
+
+
+/* global settings */
+extern int CronJobSlotCount;
+
+
+extern void InitializeJobSlots(int slotCount);
+extern int AcquireJobSlot(Size size);
+extern void ReleaseJobSlot(int slot);
+extern dsm_segment * JobSlotSegment(void);
+extern Size JobSlotOffset(int slot);
+
+
+#endif
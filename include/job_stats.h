@@ -0,0 +1,31 @@
+/*-------------------------------------------------------------------------
+ *
+ * job_stats.h
+ *	  definition of the cumulative statistics of jobs in shared memory
+ *
+ * Copyright (c) 2016, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef JOB_STATS_H
+#define JOB_STATS_H
+
+
+#include "shared_state.h"
+#include "utils/timestamp.h"
+
+
+/* global settings */
+extern int CronMaxJobStats;
+
+
+extern void JobStatsShmemRequest(void);
+extern void JobStatsShmemStartup(void);
+extern void RecordJobRunStats(int64 jobId, char *userName,
+							  TimestampTz startTime, TimestampTz endTime,
+							  bool failed, bool timedOut, int64 rowCount,
+							  CronRunLatency *latency);
+
+
+#endif
@@ -15,5 +15,7 @@
 /* global settings */
 extern char *CronTableDatabaseName;
 extern bool LaunchActiveJobs;
+extern bool CronDomDowAndLogic;
+extern char *cron_timezone;
 
 #endif
@@ -0,0 +1,34 @@
+/*-------------------------------------------------------------------------
+ *
+ * run_logger.h
+ *	  definition of the background worker that writes job run details
+ *
+ * Copyright (c) 2016, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef RUN_LOGGER_H
+#define RUN_LOGGER_H
+
+
+#include "shared_state.h"
+#include "utils/timestamp.h"
+
+
+/* global settings */
+extern bool CronUseRunLogger;
+extern int CronRunLoggerQueueSize;
+
+
+extern void RunLoggerShmemRequest(void);
+extern void RunLoggerShmemStartup(void);
+extern void RegisterRunLogger(void);
+extern bool SendRunInsertEvent(int64 runId, int64 jobId, char *database,
+							   char *userName, char *command, char *status);
+extern bool SendRunUpdateEvent(int64 runId, int32 *jobPid, char *status,
+							   char *returnMessage, TimestampTz *startTime,
+							   TimestampTz *endTime, CronRunLatency *latency);
+
+
+#endif
@@ -0,0 +1,39 @@
+/*-------------------------------------------------------------------------
+ *
+ * schedule.h
+ *	  definition of functions for evaluating cron schedules
+ *
+ * Copyright (c) 2016, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+
+#include "datatype/timestamp.h"
+
+
+/*
+ * CalendarMinute describes a minute on the wall clock in cron.timezone, as
+ * needed to match it against a schedule.
+ */
+typedef struct CalendarMinute
+{
+	int minute;
+	int hour;
+	int dayOfMonth;
+	int month;
+	int dayOfWeek;
+	bool isLastDayOfMonth;
+} CalendarMinute;
+
+
+extern void LoadCronTimezone(void);
+extern void GetCalendarMinute(TimestampTz time, CalendarMinute *calendarMinute);
+extern TimestampTz NextRunTime(entry *schedule, TimestampTz afterTime);
+extern int NextSetBit(uint64 mask, int position);
+
+
+#endif
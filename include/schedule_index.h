@@ -0,0 +1,25 @@
+/*-------------------------------------------------------------------------
+ *
+ * schedule_index.h
+ *	  definition of the index for matching many schedules at once
+ *
+ * Copyright (c) 2016, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SCHEDULE_INDEX_H
+#define SCHEDULE_INDEX_H
+
+
+extern void InitializeScheduleIndex(void);
+extern int AddScheduleSlot(void);
+extern void IndexSchedule(int slot, entry *schedule);
+extern entry * GetSlotSchedule(int slot);
+extern void RemoveScheduleSlot(int slot);
+extern uint64 * MatchingScheduleSlots(CalendarMinute *calendarMinute,
+									  bool doWild, bool doNonWild,
+									  int *wordCount);
+
+
+#endif
@@ -0,0 +1,143 @@
+/*-------------------------------------------------------------------------
+ *
+ * shared_state.h
+ *	  definition of the pg_cron state in shared memory
+ *
+ * Copyright (c) 2016, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SHARED_STATE_H
+#define SHARED_STATE_H
+
+
+#include "port/atomics.h"
+#include "storage/lwlock.h"
+#include "utils/timestamp.h"
+
+
+/* counters that are kept in shared memory */
+typedef enum
+{
+	/* times the launcher reloaded all jobs */
+	CRON_COUNTER_FULL_JOB_RELOADS = 0,
+
+	/* times the launcher only reloaded the jobs that changed */
+	CRON_COUNTER_INCREMENTAL_JOB_RELOADS,
+
+	/* invalidations that were handled by the reload for another one */
+	CRON_COUNTER_COALESCED_INVALIDATIONS,
+
+	/* schedule and alter_job calls that did not change the job */
+	CRON_COUNTER_SKIPPED_NOOP_UPDATES,
+
+	/* job runs that were handed to an idle pooled background worker */
+	CRON_COUNTER_POOL_HITS,
+
+	/* job runs for which no idle pooled background worker was available */
+	CRON_COUNTER_POOL_MISSES,
+
+	/* pooled background workers that were stopped after being idle */
+	CRON_COUNTER_POOL_RETIRED_WORKERS,
+
+	/* changes to cron.job_run_details that the run logger wrote */
+	CRON_COUNTER_LOGGED_RUN_EVENTS,
+
+	/* changes to cron.job_run_details that did not fit in the queue */
+	CRON_COUNTER_DROPPED_RUN_EVENTS,
+
+	CRON_COUNTER_COUNT
+} CronCounter;
+
+
+/* values that are kept in shared memory and go up and down */
+typedef enum
+{
+	/* pooled background workers, including the ones running a job */
+	CRON_GAUGE_POOL_WORKERS = 0,
+
+	/* pooled background workers that wait for a job */
+	CRON_GAUGE_IDLE_POOL_WORKERS,
+
+	CRON_GAUGE_COUNT
+} CronGauge;
+
+
+/*
+ * CronRunLatency is when a run was due according to the schedule of its job,
+ * and how the time until its command started is made up, in microseconds:
+ * waiting for the launcher to start it, connecting or starting a background
+ * worker, and sending the command.
+ */
+typedef struct CronRunLatency
+{
+	/* 0 if not known */
+	TimestampTz scheduledTime;
+
+	int64 queueWait;
+	int64 startupTime;
+	int64 sendTime;
+} CronRunLatency;
+
+
+/*
+ * CronRunProgress is a job run that the launcher started and that did not
+ * finish yet. cron.job_run_details is only written when a run starts and
+ * when it finishes, the states in between are only kept here.
+ */
+typedef struct CronRunProgress
+{
+	/* 0 if the slot is not in use */
+	int64 runId;
+	int64 jobId;
+	NameData database;
+	NameData userName;
+
+	/* a CronStatus */
+	int status;
+
+	/* 0 if not known yet */
+	int32 jobPid;
+	TimestampTz startTime;
+
+	/* scheduledTime is 0 until the command started */
+	CronRunLatency latency;
+} CronRunProgress;
+
+
+/*
+ * CronSharedState is the part of the pg_cron state that is visible to all
+ * backends, such that it can be inspected through SQL.
+ */
+typedef struct CronSharedState
+{
+	pg_atomic_uint64 counters[CRON_COUNTER_COUNT];
+	pg_atomic_uint64 gauges[CRON_GAUGE_COUNT];
+
+	/* runs in progress, only changed by the launcher */
+	LWLock *runProgressLock;
+	int runProgressCount;
+	CronRunProgress runProgress[FLEXIBLE_ARRAY_MEMBER];
+} CronSharedState;
+
+
+extern void InitializeSharedState(int maxRunningJobs);
+extern void CronSharedStateRequest(void);
+extern void CronSharedStateStartup(void);
+extern void IncrementCronCounter(CronCounter counter, uint64 amount);
+extern uint64 ReadCronCounter(CronCounter counter);
+extern void SetCronGauge(CronGauge gauge, uint64 value);
+extern uint64 ReadCronGauge(CronGauge gauge);
+extern void ResetRunProgress(void);
+extern bool StartRunProgress(int64 runId, int64 jobId, char *database,
+							 char *userName, int status);
+extern bool SetRunProgress(int64 runId, int status, int32 *jobPid,
+						   TimestampTz *startTime);
+extern bool SetRunLatency(int64 runId, CronRunLatency *latency);
+extern bool GetRunProgress(int64 runId, int32 *jobPid, TimestampTz *startTime,
+						   CronRunLatency *latency);
+extern void EndRunProgress(int64 runId);
+
+
+#endif
@@ -15,6 +15,7 @@
 #include "job_metadata.h"
 #include "libpq-fe.h"
 #include "postmaster/bgworker.h"
+#include "schedule.h"
 #include "storage/dsm.h"
 #include "storage/shm_mq.h"
 #include "utils/timestamp.h"
@@ -31,7 +32,8 @@ typedef enum
 	CRON_TASK_DONE = 6,
 	CRON_TASK_ERROR = 7,
 	CRON_TASK_BGW_START = 8,
-	CRON_TASK_BGW_RUNNING = 9
+	CRON_TASK_BGW_RUNNING = 9,
+	CRON_TASK_BGW_STARTING = 10
 } CronTaskState;
 
 struct BackgroundWorkerHandle
@@ -46,26 +48,81 @@ typedef struct CronTask
 	int64 runId;
 	CronTaskState state;
 	uint pendingRunCount;
+
+	/* when the oldest pending run was due, if there is one */
+	TimestampTz pendingRunTime;
+
+	/* runs started since the task was created, for sampling */
+	uint64 runCount;
+
+	/* whether the current run is logged from the start */
+	bool logRun;
+
+	/* outcome of the current run, for cron.job_stats */
+	bool runFailed;
+	bool runTimedOut;
+	int64 runRowCount;
+	TimestampTz runEndTime;
+
+	/* when the current run was due, started, and could send its command */
+	TimestampTz runScheduledTime;
+	TimestampTz runLaunchTime;
+	TimestampTz runConnectedTime;
+
+	/* scheduledTime is 0 until the command of the current run started */
+	CronRunLatency runLatency;
+
 	PGconn *connection;
 	PostgresPollingStatusType pollingStatus;
 	TimestampTz startDeadline;
+	TimestampTz nextStartAttempt;
+	int startRetryDelay;
 	TimestampTz lastStartTime;
+	TimestampTz nextRunTime;
+
+	/* version of the entry of the task in the task queue, 0 if none */
+	uint64 queueVersion;
+
+	char *scheduleText;
+	CronSchedule *schedule;
+	int scheduleSlot;
 	uint32 secondsInterval;
 	bool isSocketReady;
+
+	/* whether the task is on the list of tasks to handle on the next pass */
+	bool isReady;
+	pgsocket waitSocket;
+	uint32 waitEvents;
+	int waitEventPosition;
 	bool isActive;
 	char *errorMessage;
 	bool freeErrorMessage;
 	shm_mq_handle *sharedMemoryQueue;
 	dsm_segment *seg;
+	int jobSlot;
 	BackgroundWorkerHandle handle;
+
+	/* whether the worker of a canceled run was told to exit */
+	bool terminating;
+	struct CronPoolWorker *poolWorker;
 } CronTask;
 
 
 extern void InitializeTaskStateHash(void);
-extern void RefreshTaskHash(void);
+extern void RefreshTaskHash(TimestampTz lastMinute);
 extern List * CurrentTaskList(void);
+extern List * IntervalTaskList(void);
+extern List * ReadyTaskList(void);
+extern List * TakeReadyTaskList(void);
+extern void MarkTaskReady(CronTask *task);
 extern void InitializeCronTask(CronTask *task, int64 jobId);
 extern void RemoveTask(int64 jobId);
+extern void ResetTaskRunTimes(void);
+extern void RebuildTaskQueue(TimestampTz lastMinute);
+extern CronTask * PopDueTask(TimestampTz currentMinute);
+extern void QueueTask(CronTask *task, TimestampTz lastMinute);
+extern List * MatchingTaskList(CalendarMinute *calendarMinute, bool doWild,
+							   bool doNonWild);
 
 
 #endif
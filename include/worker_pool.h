@@ -0,0 +1,74 @@
+/*-------------------------------------------------------------------------
+ *
+ * worker_pool.h
+ *	  definition of the pool of background workers that run many jobs
+ *
+ * Copyright (c) 2016, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+
+#include "postmaster/bgworker.h"
+#include "storage/dsm.h"
+#include "storage/shm_mq.h"
+#include "utils/timestamp.h"
+
+#include "task_states.h"
+
+
+/* Table-of-contents constants for our dynamic shared memory segments. */
+#define PG_CRON_MAGIC				0x51028080
+#define PG_CRON_KEY_DATABASE		0
+#define PG_CRON_KEY_USERNAME		1
+#define PG_CRON_KEY_COMMAND			2
+#define PG_CRON_KEY_QUEUE			3
+#define PG_CRON_KEY_COMMAND_QUEUE	4
+#define PG_CRON_NKEYS				5
+
+/* size of the queues between the launcher and background workers */
+#define QUEUE_SIZE ((Size) 65536)
+
+
+/*
+ * CronPoolWorker is a background worker that stays around after running a
+ * job, such that it can run the next job for the same database and user
+ * without starting a new process. The launcher sends commands over the
+ * command queue and the worker replies over the response queue in the same
+ * way as a worker that runs a single job.
+ */
+typedef struct CronPoolWorker
+{
+	char *database;
+	char *userName;
+	dsm_segment *seg;
+	shm_mq_handle *commandQueue;
+	shm_mq_handle *responseQueue;
+	BackgroundWorkerHandle handle;
+	bool registered;
+	bool busy;
+	TimestampTz lastUsedTime;
+} CronPoolWorker;
+
+
+/* global settings */
+extern int CronWorkerPoolSize;
+extern int CronWorkerIdleTimeout;
+
+
+extern CronPoolWorker * GetIdlePoolWorker(char *database, char *userName);
+extern CronPoolWorker * CreatePoolWorker(char *database, char *userName);
+extern bool RegisterPoolWorker(CronPoolWorker *poolWorker);
+extern shm_mq_result SendPoolWorkerCommand(CronPoolWorker *poolWorker,
+										   char *command);
+extern void ReleasePoolWorker(CronPoolWorker *poolWorker,
+							  TimestampTz currentTime);
+extern void RemovePoolWorker(CronPoolWorker *poolWorker);
+extern bool RetireIdlePoolWorker(void);
+extern void RetireIdlePoolWorkers(TimestampTz currentTime);
+
+
+#endif
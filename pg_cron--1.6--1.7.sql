@@ -0,0 +1,199 @@
+CREATE FUNCTION cron.next_runs(schedule text, from_time timestamptz default now(), count int default 10)
+    RETURNS SETOF timestamptz
+    LANGUAGE C STABLE STRICT
+    AS 'MODULE_PATHNAME', $$cron_next_runs$$;
+COMMENT ON FUNCTION cron.next_runs(text,timestamptz,int)
+    IS 'get the next times at which a schedule runs';
+
+/*
+ * track which jobs changed, such that the launcher only reloads those; a job
+ * gets a row for every change, since an earlier row may already be taken by
+ * the launcher before the later change commits
+ */
+CREATE TABLE cron.job_changes (
+    changeid bigserial primary key,
+    jobid bigint not null
+);
+
+DROP TRIGGER cron_job_cache_invalidate ON cron.job;
+
+CREATE TRIGGER cron_job_cache_invalidate_insert
+    AFTER INSERT ON cron.job
+    REFERENCING NEW TABLE AS new_jobs
+    FOR EACH STATEMENT EXECUTE PROCEDURE cron.job_cache_invalidate();
+
+CREATE TRIGGER cron_job_cache_invalidate_update
+    AFTER UPDATE ON cron.job
+    REFERENCING OLD TABLE AS old_jobs NEW TABLE AS new_jobs
+    FOR EACH STATEMENT EXECUTE PROCEDURE cron.job_cache_invalidate();
+
+CREATE TRIGGER cron_job_cache_invalidate_delete
+    AFTER DELETE ON cron.job
+    REFERENCING OLD TABLE AS old_jobs
+    FOR EACH STATEMENT EXECUTE PROCEDURE cron.job_cache_invalidate();
+
+/* fires before the truncate, such that all truncated jobs are recorded */
+CREATE TRIGGER cron_job_cache_invalidate_truncate
+    BEFORE TRUNCATE ON cron.job
+    FOR EACH STATEMENT EXECUTE PROCEDURE cron.job_cache_invalidate();
+
+CREATE FUNCTION cron.job_cache_stats(OUT full_reloads bigint,
+                                     OUT incremental_reloads bigint,
+                                     OUT coalesced_invalidations bigint,
+                                     OUT skipped_noop_updates bigint)
+    RETURNS record
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$cron_job_cache_stats$$;
+COMMENT ON FUNCTION cron.job_cache_stats()
+    IS 'get counters for job reloads and the reloads that were avoided';
+
+CREATE FUNCTION cron.schedule_many(jobs jsonb)
+    RETURNS TABLE(jobname text, jobid bigint)
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$cron_schedule_many$$;
+COMMENT ON FUNCTION cron.schedule_many(jsonb)
+    IS 'schedule a JSON array of jobs in a single statement';
+
+/* admin should decide whether cron.schedule_many is safe by explicitly granting execute */
+REVOKE ALL ON FUNCTION cron.schedule_many(jsonb) FROM public;
+
+CREATE FUNCTION cron.unschedule_many(job_ids bigint[])
+    RETURNS bigint
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$cron_unschedule_many$$;
+COMMENT ON FUNCTION cron.unschedule_many(bigint[])
+    IS 'unschedule a list of pg_cron jobs';
+
+CREATE FUNCTION cron.unschedule_many(job_names text[])
+    RETURNS bigint
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$cron_unschedule_many_named$$;
+COMMENT ON FUNCTION cron.unschedule_many(text[])
+    IS 'unschedule a list of pg_cron jobs by name';
+
+CREATE FUNCTION cron.worker_pool_stats(OUT pool_workers int,
+                                       OUT idle_workers int,
+                                       OUT hits bigint,
+                                       OUT misses bigint,
+                                       OUT retired_workers bigint)
+    RETURNS record
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$cron_worker_pool_stats$$;
+COMMENT ON FUNCTION cron.worker_pool_stats()
+    IS 'get the size of the background worker pool and how often it was used';
+
+CREATE FUNCTION cron.job_run_progress(OUT jobid bigint,
+                                      OUT runid bigint,
+                                      OUT job_pid integer,
+                                      OUT database text,
+                                      OUT username text,
+                                      OUT status text,
+                                      OUT start_time timestamptz)
+    RETURNS SETOF record
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$cron_job_run_progress$$;
+COMMENT ON FUNCTION cron.job_run_progress()
+    IS 'get the job runs that are in progress';
+
+CREATE VIEW cron.job_run_progress AS
+    SELECT * FROM cron.job_run_progress();
+GRANT SELECT ON cron.job_run_progress TO public;
+
+/*
+ * Runs are inserted when they start and updated once when they finish. Leave
+ * room on each page such that the update can be a HOT update.
+ */
+ALTER TABLE cron.job_run_details SET (fillfactor = 80);
+
+/*
+ * The launcher reserves run IDs in blocks, every value of the sequence is
+ * the first of a block of 1000 run IDs.
+ */
+ALTER SEQUENCE cron.runid_seq INCREMENT BY 1000;
+
+CREATE FUNCTION cron.run_logger_stats(OUT queued_bytes bigint,
+                                      OUT logged_events bigint,
+                                      OUT dropped_events bigint)
+    RETURNS record
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$cron_run_logger_stats$$;
+COMMENT ON FUNCTION cron.run_logger_stats()
+    IS 'get the size of the queue of the run logger and how many changes it wrote or dropped';
+
+/* which runs of a job are written to cron.job_run_details */
+ALTER TABLE cron.job ADD COLUMN log_mode text NOT NULL DEFAULT 'all'
+    CHECK (log_mode IN ('all', 'failures', 'sample', 'rollup'));
+ALTER TABLE cron.job ADD COLUMN log_sample_rate int NOT NULL DEFAULT 10
+    CHECK (log_sample_rate > 0);
+
+CREATE FUNCTION cron.set_job_log_mode(job_id bigint,
+                                      log_mode text,
+                                      sample_rate int default null)
+    RETURNS void
+    LANGUAGE C
+    AS 'MODULE_PATHNAME', $$cron_set_job_log_mode$$;
+COMMENT ON FUNCTION cron.set_job_log_mode(bigint,text,int)
+    IS 'set which runs of a job are written to cron.job_run_details';
+
+/* number of runs per minute of jobs with log_mode rollup */
+CREATE TABLE cron.job_run_rollups (
+    jobid bigint not null,
+    period timestamptz not null,
+    succeeded bigint not null,
+    failed bigint not null,
+    total_duration interval not null,
+    primary key (jobid, period)
+);
+SELECT pg_catalog.pg_extension_config_dump('cron.job_run_rollups', '');
+GRANT SELECT ON cron.job_run_rollups TO public;
+GRANT DELETE ON cron.job_run_rollups TO public;
+ALTER TABLE cron.job_run_rollups ENABLE ROW LEVEL SECURITY;
+CREATE POLICY cron_job_run_rollups_policy ON cron.job_run_rollups
+    USING (jobid OPERATOR(pg_catalog.=) ANY (SELECT jobid FROM cron.job));
+
+CREATE FUNCTION cron.job_stats(OUT jobid bigint,
+                               OUT runs bigint,
+                               OUT succeeded bigint,
+                               OUT failed bigint,
+                               OUT timed_out bigint,
+                               OUT total_time double precision,
+                               OUT min_time double precision,
+                               OUT max_time double precision,
+                               OUT mean_time double precision,
+                               OUT duration_histogram bigint[],
+                               OUT last_start timestamptz,
+                               OUT last_end timestamptz,
+                               OUT rows bigint,
+                               OUT mean_queue_wait double precision,
+                               OUT mean_startup_time double precision,
+                               OUT mean_send_time double precision,
+                               OUT max_start_lag double precision,
+                               OUT queue_wait_histogram bigint[],
+                               OUT start_lag_histogram bigint[])
+    RETURNS SETOF record
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$cron_job_stats$$;
+COMMENT ON FUNCTION cron.job_stats()
+    IS 'get the cumulative statistics of the runs of each job';
+
+CREATE VIEW cron.job_stats AS
+    SELECT * FROM cron.job_stats();
+GRANT SELECT ON cron.job_stats TO public;
+
+CREATE FUNCTION cron.job_stats_reset(job_id bigint default null)
+    RETURNS void
+    LANGUAGE C
+    AS 'MODULE_PATHNAME', $$cron_job_stats_reset$$;
+COMMENT ON FUNCTION cron.job_stats_reset(bigint)
+    IS 'remove the statistics of a job, or of all jobs';
+REVOKE ALL ON FUNCTION cron.job_stats_reset(bigint) FROM public;
+
+/*
+ * When a run was due, and how long it took from then until its command
+ * started: waiting to be started, connecting or starting a background
+ * worker, and sending the command.
+ */
+ALTER TABLE cron.job_run_details ADD COLUMN scheduled_time timestamptz;
+ALTER TABLE cron.job_run_details ADD COLUMN queue_wait interval;
+ALTER TABLE cron.job_run_details ADD COLUMN startup_time interval;
+ALTER TABLE cron.job_run_details ADD COLUMN send_time interval;
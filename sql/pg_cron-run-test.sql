@@ -0,0 +1,52 @@
+-- jobs are only run in cron.database_name
+\c postgres
+
+CREATE FUNCTION wait_until(condition text) RETURNS bool LANGUAGE plpgsql AS $$
+DECLARE
+  satisfied bool;
+BEGIN
+  FOR attempt IN 1..600 LOOP
+    EXECUTE 'SELECT ' || condition INTO satisfied;
+    IF satisfied THEN
+      RETURN true;
+    END IF;
+    PERFORM pg_sleep(0.1);
+  END LOOP;
+  RETURN false;
+END;
+$$;
+
+-- runs are written to a 1.6 table, which does not have the latency columns
+CREATE EXTENSION pg_cron VERSION '1.6';
+SELECT cron.schedule('1 seconds', 'SELECT 1') AS jobid \gset
+SELECT wait_until($$(SELECT count(*) > 0 FROM cron.job_run_details WHERE status = 'succeeded')$$);
+
+-- once the extension is updated, the latency of runs is written as well
+ALTER EXTENSION pg_cron UPDATE;
+SELECT wait_until($$(SELECT count(*) > 0 FROM cron.job_run_details WHERE status = 'succeeded' AND queue_wait IS NOT NULL)$$);
+SELECT count(*) AS wrong_latency FROM cron.job_run_details
+WHERE queue_wait IS NOT NULL
+AND (scheduled_time IS NULL OR queue_wait < interval '0'
+     OR startup_time < interval '0' OR send_time < interval '0');
+SELECT wait_until($$(SELECT succeeded > 0 AND mean_queue_wait IS NOT NULL FROM cron.job_stats)$$);
+
+-- the launcher notices that a background worker finished its command right
+-- away rather than on its next wake-up, which would take about a second
+SELECT wait_until($$(SELECT count(*) >= 5 FROM cron.job_run_details WHERE status = 'succeeded')$$);
+SELECT percentile_cont(0.5) WITHIN GROUP (ORDER BY end_time - start_time) < interval '0.5 seconds' AS finished_quickly
+FROM cron.job_run_details WHERE status = 'succeeded';
+
+SELECT cron.unschedule(:jobid);
+
+-- a run shows up in cron.job_run_progress while it runs, and its row in
+-- cron.job_run_details is finished in place when it is done
+SELECT cron.schedule('1 seconds', 'SELECT pg_sleep(2)') AS slow_jobid \gset
+SELECT wait_until($$(SELECT count(*) > 0 FROM cron.job_run_progress WHERE status = 'running')$$);
+SELECT runid AS running_runid FROM cron.job_run_progress WHERE status = 'running' \gset
+SELECT wait_until('(SELECT status = ''succeeded'' FROM cron.job_run_details WHERE runid = ' || :running_runid || ')');
+SELECT wait_until('(SELECT count(*) = 0 FROM cron.job_run_progress WHERE runid = ' || :running_runid || ')');
+SELECT count(*), bool_and(start_time <= end_time) AS ordered FROM cron.job_run_details WHERE runid = :running_runid;
+SELECT cron.unschedule(:slow_jobid);
+
+DROP EXTENSION pg_cron;
+DROP FUNCTION wait_until(text);
@@ -180,6 +180,163 @@ SELECT jobid, jobname, schedule, command FROM cron.job ORDER BY jobid;
 -- invalid last of day job
 SELECT cron.schedule('bad-last-dom-job1', '0 11 $foo * *', 'VACUUM FULL');
 
+-- next run times of schedules
+SELECT to_char(run_time AT TIME ZONE 'GMT', 'YYYY-MM-DD HH24:MI:SS') AS run_time FROM cron.next_runs('0 10 * * *', '2024-02-27 10:00:00+00', 3) AS run_time;
+SELECT to_char(run_time AT TIME ZONE 'GMT', 'YYYY-MM-DD HH24:MI:SS') AS run_time FROM cron.next_runs('0 11 $ * *', '2024-01-15 00:00:00+00', 3) AS run_time;
+SELECT to_char(run_time AT TIME ZONE 'GMT', 'YYYY-MM-DD HH24:MI:SS') AS run_time FROM cron.next_runs('30 9 13 * 5', '2024-10-10 00:00:00+00', 3) AS run_time;
+SELECT to_char(run_time AT TIME ZONE 'GMT', 'YYYY-MM-DD HH24:MI:SS') AS run_time FROM cron.next_runs('10 seconds', '2024-01-01 00:00:00+00', 3) AS run_time;
+SELECT count(*) FROM cron.next_runs('0 0 31 2 *', '2024-01-01 00:00:00+00', 3);
+SELECT count(*) FROM cron.next_runs('@reboot', '2024-01-01 00:00:00+00', 3);
+SELECT cron.next_runs('* * *', '2024-01-01 00:00:00+00', 3);
+SELECT to_char(run_time AT TIME ZONE 'GMT', 'YYYY-MM-DD HH24:MI:SS') AS run_time FROM cron.next_runs('@yearly', '2024-03-01 00:00:00+00', 2) AS run_time;
+SELECT to_char(run_time AT TIME ZONE 'GMT', 'YYYY-MM-DD HH24:MI:SS') AS run_time FROM cron.next_runs('@annually', '2024-03-01 00:00:00+00', 1) AS run_time;
+SELECT to_char(run_time AT TIME ZONE 'GMT', 'YYYY-MM-DD HH24:MI:SS') AS run_time FROM cron.next_runs(repeat('0,', 600) || '0 10 * * *', '2024-02-27 10:00:00+00', 1) AS run_time;
+SELECT cron.schedule('4294967301 seconds', 'SELECT 1');
+
+-- a corpus of schedules in the syntax that Vixie cron accepted, with the first run after a Monday midnight
+CREATE FUNCTION first_run(schedule text) RETURNS text LANGUAGE plpgsql AS $$
+BEGIN
+  RETURN (SELECT to_char(run_time AT TIME ZONE 'GMT', 'YYYY-MM-DD HH24:MI:SS') FROM cron.next_runs(schedule, '2024-01-01 00:00:00+00', 1) AS run_time);
+EXCEPTION WHEN invalid_parameter_value THEN
+  RETURN 'invalid';
+END;
+$$;
+SELECT schedule, first_run(schedule) FROM unnest(ARRAY[
+  '* * * * *',
+  '*/15 * * * *',
+  '5,10,20 3 * * *',
+  '0 9-17/4 * * *',
+  '1-5/2 0 * * *',
+  '1,2,3-5,*/30 * * * *',
+  '30 2 1 * *',
+  '0 0 * * 0',
+  '0 0 * * 7',
+  '0 0 * * sun',
+  '0 0 * * mon-fri',
+  '0 0 1 feb *',
+  '0 12 * JAN-MAR/2 FRI',
+  '0 0 13 * 5',
+  '0 0 $ * *',
+  '59 23 31 12 *',
+  '0 0 30 2 *',
+  '  0   4  *  *  *  ',
+  '0 4 * * * ignored',
+  '@hourly',
+  '@daily',
+  '@weekly',
+  '@monthly',
+  '@yearly',
+  '30 seconds',
+  '1 second',
+  '60 * * * *',
+  '* 24 * * *',
+  '* * 0 * *',
+  '* * * 13 *',
+  '* * * * 8',
+  '*/0 * * * *',
+  '5/10 * * * *',
+  '* * * *',
+  '@every'
+]) WITH ORDINALITY AS corpus(schedule, position) ORDER BY position;
+DROP FUNCTION first_run(text);
+
+-- changed jobs are recorded for the launcher
+BEGIN;
+DELETE FROM cron.job_changes;
+SELECT cron.schedule('job-changes-test', '0 1 * * *', 'SELECT 1') AS change_job_id \gset
+SELECT count(*) FROM cron.job_changes WHERE jobid = :change_job_id;
+-- a job that already has a change is recorded again when it changes again
+SELECT cron.alter_job(:change_job_id, schedule := '0 2 * * *');
+SELECT count(*) FROM cron.job_changes WHERE jobid = :change_job_id;
+DELETE FROM cron.job_changes;
+SELECT cron.unschedule(:change_job_id);
+SELECT count(*) FROM cron.job_changes WHERE jobid = :change_job_id;
+DELETE FROM cron.job_changes;
+TRUNCATE cron.job;
+SELECT count(*) > 0 AS truncated_jobs_recorded FROM cron.job_changes;
+ROLLBACK;
+
+-- scheduling or altering a job without changing it is not recorded
+BEGIN;
+SELECT cron.schedule('noop-test', '0 2 * * *', 'SELECT 1') AS noop_job_id \gset
+DELETE FROM cron.job_changes;
+SELECT skipped_noop_updates AS skipped_before FROM cron.job_cache_stats() \gset
+SELECT cron.schedule('noop-test', '0 2 * * *', 'SELECT 1') = :noop_job_id AS same_job;
+SELECT cron.alter_job(:noop_job_id, schedule := '0 2 * * *', active := true);
+SELECT count(*) FROM cron.job_changes;
+SELECT skipped_noop_updates - :skipped_before AS skipped FROM cron.job_cache_stats();
+SELECT cron.alter_job(:noop_job_id, schedule := '0 3 * * *');
+SELECT count(*) FROM cron.job_changes WHERE jobid = :noop_job_id;
+ROLLBACK;
+
+-- schedule and unschedule many jobs at once
+SELECT * FROM cron.schedule_many('[{"job_name": "many-bad", "schedule": "bad", "command": "SELECT 1"}]');
+SELECT * FROM cron.schedule_many('[{"job_name": "many-bad", "schedule": "0 4 * * *"}]');
+SELECT cron.unschedule_many(ARRAY['many-missing']);
+SELECT * FROM cron.schedule_many('[
+  {"job_name": "many-dup", "schedule": "0 4 * * *", "command": "SELECT 1"},
+  {"job_name": "many-dup", "schedule": "0 5 * * *", "command": "SELECT 2"}
+]');
+BEGIN;
+SELECT jobname, jobid > 0 AS has_id FROM cron.schedule_many('[
+  {"job_name": "many-1", "schedule": "0 4 * * *", "command": "SELECT 1"},
+  {"job_name": "many-2", "schedule": "30 seconds", "command": "SELECT 2", "active": false},
+  {"schedule": "@daily", "command": "SELECT 3"}
+]') ORDER BY jobname;
+SELECT jobname, schedule, command, active FROM cron.job
+WHERE jobname LIKE 'many-%' OR command = 'SELECT 3' ORDER BY command;
+DELETE FROM cron.job_changes;
+SELECT count(*) FROM cron.schedule_many('[
+  {"job_name": "many-1", "schedule": "0 4 * * *", "command": "SELECT 1"},
+  {"job_name": "many-2", "schedule": "45 seconds", "command": "SELECT 2"}
+]');
+SELECT count(*) FROM cron.job_changes;
+SELECT cron.unschedule_many(ARRAY['many-1', 'many-2']);
+SELECT jobid AS many_job_id FROM cron.job WHERE command = 'SELECT 3' \gset
+SELECT cron.unschedule_many(ARRAY[:many_job_id]);
+SELECT count(*) FROM cron.job WHERE jobname LIKE 'many-%' OR command = 'SELECT 3';
+ROLLBACK;
+
+-- pooled background workers are only used with cron.use_background_workers
+SELECT pool_workers, idle_workers FROM cron.worker_pool_stats();
+
+-- job runs that are in progress are kept in shared memory
+SELECT count(*) FROM cron.job_run_progress
+WHERE status NOT IN ('starting', 'connecting', 'sending', 'running');
+
+-- users other than superusers only see their own runs in progress
+SET SESSION AUTHORIZATION pgcron_cront;
+SELECT count(*) FROM cron.job_run_progress WHERE username <> current_user;
+RESET SESSION AUTHORIZATION;
+
+-- finished runs are updated in place, so pages leave room for HOT updates
+SELECT reloptions FROM pg_class WHERE oid = 'cron.job_run_details'::regclass;
+
+-- changes to cron.job_run_details are only queued with cron.use_run_logger
+SELECT queued_bytes, dropped_events FROM cron.run_logger_stats();
+
+-- write only some runs of a job to cron.job_run_details
+BEGIN;
+SELECT cron.schedule('log-mode-test', '* * * * *', 'SELECT 1') AS log_mode_job_id \gset
+SELECT cron.set_job_log_mode(:log_mode_job_id, 'sample', 100);
+SELECT log_mode, log_sample_rate FROM cron.job WHERE jobid = :log_mode_job_id;
+SELECT cron.set_job_log_mode(:log_mode_job_id, 'sometimes');
+ROLLBACK;
+
+-- cumulative statistics of job runs are kept in shared memory
+SELECT count(*) FROM cron.job_stats WHERE runs <> succeeded + failed;
+SELECT cron.job_stats_reset();
+SELECT cron.job_stats_reset(1);
+
+-- other users can read statistics, but not reset them
+SET SESSION AUTHORIZATION pgcron_cront;
+SELECT count(*) FROM cron.job_stats;
+SELECT cron.job_stats_reset();
+RESET SESSION AUTHORIZATION;
+
+-- runs record when they were due and how long it took to start them
+\d cron.job_run_details
+
 -- cleaning
 DROP EXTENSION pg_cron;
 drop user pgcron_cront;
@@ -0,0 +1,304 @@
+/*-------------------------------------------------------------------------
+ *
+ * src/connection_cache.c
+ *
+ * Cache of idle connections that can run the next job for the same node,
+ * database and user.
+ *
+ * Opening a connection for every run means a socket handshake,
+ * authentication and starting a backend, which can take longer than the
+ * command of a frequent job. When cron.connection_cache_timeout is set, the
+ * launcher keeps the connection of a run that finished cleanly and sends
+ * DISCARD ALL over it, such that the next run for the same node, database
+ * and user can send its command right away. The result of DISCARD ALL is
+ * read when the connection is reused, or when the launcher checks on idle
+ * connections, so the launcher never waits for it.
+ *
+ * Copyright (c) 2016, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "connection_cache.h"
+
+#include "nodes/pg_list.h"
+#include "utils/memutils.h"
+
+
+/*
+ * CachedConnection is an idle connection that ran a job for the given node,
+ * database and user.
+ */
+typedef struct CachedConnection
+{
+	char *nodeName;
+	int nodePort;
+	char *database;
+	char *userName;
+	PGconn *connection;
+	TimestampTz releaseTime;
+} CachedConnection;
+
+
+/* forward declarations */
+static bool CachedConnectionIsReady(CachedConnection *cachedConnection,
+									bool *isBroken);
+static void CloseCachedConnection(CachedConnection *cachedConnection);
+
+
+/* global settings */
+int CronConnectionCacheTimeout = 0;
+
+/* global variables */
+static MemoryContext ConnectionCacheContext = NULL;
+
+/* idle connections, in the order in which they were released */
+static List *CachedConnections = NIL;
+static int MaxCachedConnections = 0;
+
+
+/*
+ * InitializeConnectionCache initializes an empty connection cache that holds
+ * at most maxConnections connections.
+ */
+void
+InitializeConnectionCache(int maxConnections)
+{
+	ConnectionCacheContext = AllocSetContextCreate(CurrentMemoryContext,
+												   "pg_cron connection cache context",
+												   ALLOCSET_DEFAULT_MINSIZE,
+												   ALLOCSET_DEFAULT_INITSIZE,
+												   ALLOCSET_DEFAULT_MAXSIZE);
+
+	MaxCachedConnections = maxConnections;
+}
+
+
+/*
+ * GetCachedConnection removes an idle connection for the given node,
+ * database and user from the cache and returns it, or returns NULL if there
+ * is none that is ready to run a command.
+ */
+PGconn *
+GetCachedConnection(char *nodeName, int nodePort, char *database,
+					char *userName)
+{
+	List *cachedConnections = list_copy(CachedConnections);
+	PGconn *connection = NULL;
+	ListCell *connectionCell = NULL;
+
+	foreach(connectionCell, cachedConnections)
+	{
+		CachedConnection *cachedConnection =
+			(CachedConnection *) lfirst(connectionCell);
+		bool isBroken = false;
+
+		if (cachedConnection->nodePort != nodePort ||
+			strcmp(cachedConnection->nodeName, nodeName) != 0 ||
+			strcmp(cachedConnection->database, database) != 0 ||
+			strcmp(cachedConnection->userName, userName) != 0)
+		{
+			continue;
+		}
+
+		if (!CachedConnectionIsReady(cachedConnection, &isBroken))
+		{
+			if (isBroken)
+			{
+				CloseCachedConnection(cachedConnection);
+			}
+
+			continue;
+		}
+
+		connection = cachedConnection->connection;
+		cachedConnection->connection = NULL;
+		CloseCachedConnection(cachedConnection);
+		break;
+	}
+
+	list_free(cachedConnections);
+
+	return connection;
+}
+
+
+/*
+ * ReleaseConnection adds the connection of a run that finished to the cache
+ * and resets its session, or closes it if it cannot be reused.
+ */
+void
+ReleaseConnection(PGconn *connection, char *nodeName, int nodePort,
+				  char *database, char *userName, TimestampTz currentTime)
+{
+	CachedConnection *cachedConnection = NULL;
+	MemoryContext oldContext = NULL;
+
+	/* do not reuse connections that are left in a transaction */
+	if (CronConnectionCacheTimeout <= 0 || MaxCachedConnections <= 0 ||
+		PQstatus(connection) != CONNECTION_OK ||
+		PQtransactionStatus(connection) != PQTRANS_IDLE)
+	{
+		PQfinish(connection);
+		return;
+	}
+
+	if (!PQsendQuery(connection, "DISCARD ALL"))
+	{
+		PQfinish(connection);
+		return;
+	}
+
+	if (list_length(CachedConnections) >= MaxCachedConnections)
+	{
+		/* make room by closing the connection that has been idle longest */
+		CloseCachedConnection((CachedConnection *) linitial(CachedConnections));
+	}
+
+	oldContext = MemoryContextSwitchTo(ConnectionCacheContext);
+
+	cachedConnection = palloc0(sizeof(CachedConnection));
+	cachedConnection->nodeName = pstrdup(nodeName);
+	cachedConnection->nodePort = nodePort;
+	cachedConnection->database = pstrdup(database);
+	cachedConnection->userName = pstrdup(userName);
+	cachedConnection->connection = connection;
+	cachedConnection->releaseTime = currentTime;
+
+	CachedConnections = lappend(CachedConnections, cachedConnection);
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * CloseIdleConnections closes connections that were idle for longer than
+ * cron.connection_cache_timeout, or that broke while they were idle.
+ */
+void
+CloseIdleConnections(TimestampTz currentTime)
+{
+	List *cachedConnections = NIL;
+	ListCell *connectionCell = NULL;
+
+	if (CachedConnections == NIL)
+	{
+		return;
+	}
+
+	cachedConnections = list_copy(CachedConnections);
+
+	foreach(connectionCell, cachedConnections)
+	{
+		CachedConnection *cachedConnection =
+			(CachedConnection *) lfirst(connectionCell);
+		bool isBroken = false;
+
+		if (CronConnectionCacheTimeout <= 0 ||
+			TimestampDifferenceExceeds(cachedConnection->releaseTime, currentTime,
+									   CronConnectionCacheTimeout))
+		{
+			CloseCachedConnection(cachedConnection);
+			continue;
+		}
+
+		/* read the result of DISCARD ALL and notice closed connections */
+		(void) CachedConnectionIsReady(cachedConnection, &isBroken);
+		if (isBroken)
+		{
+			CloseCachedConnection(cachedConnection);
+		}
+	}
+
+	list_free(cachedConnections);
+}
+
+
+/*
+ * CachedConnectionIsReady reads the result of resetting a cached connection,
+ * without blocking, and returns whether it can run a command. If it cannot
+ * be used anymore, isBroken is set to true.
+ */
+static bool
+CachedConnectionIsReady(CachedConnection *cachedConnection, bool *isBroken)
+{
+	PGconn *connection = cachedConnection->connection;
+	PGresult *result = NULL;
+	int flushResult = 0;
+
+	*isBroken = false;
+
+	if (PQstatus(connection) != CONNECTION_OK)
+	{
+		*isBroken = true;
+		return false;
+	}
+
+	/* make sure DISCARD ALL was sent */
+	flushResult = PQflush(connection);
+	if (flushResult != 0)
+	{
+		*isBroken = flushResult < 0;
+		return false;
+	}
+
+	if (!PQconsumeInput(connection))
+	{
+		*isBroken = true;
+		return false;
+	}
+
+	/*
+	 * Only take the results that arrived, since PQgetResult waits for the
+	 * socket when the rest of the reply to DISCARD ALL is still on its way.
+	 */
+	while (!PQisBusy(connection) && (result = PQgetResult(connection)) != NULL)
+	{
+		bool commandOK = PQresultStatus(result) == PGRES_COMMAND_OK;
+
+		PQclear(result);
+
+		if (!commandOK)
+		{
+			*isBroken = true;
+			return false;
+		}
+	}
+
+	if (PQisBusy(connection))
+	{
+		/* not ready until ReadyForQuery arrived */
+		return false;
+	}
+
+	if (PQtransactionStatus(connection) != PQTRANS_IDLE)
+	{
+		*isBroken = true;
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * CloseCachedConnection removes a connection from the cache and closes it,
+ * unless it was handed out.
+ */
+static void
+CloseCachedConnection(CachedConnection *cachedConnection)
+{
+	if (cachedConnection->connection != NULL)
+	{
+		PQfinish(cachedConnection->connection);
+	}
+
+	CachedConnections = list_delete_ptr(CachedConnections, cachedConnection);
+
+	pfree(cachedConnection->nodeName);
+	pfree(cachedConnection->database);
+	pfree(cachedConnection->userName);
+	pfree(cachedConnection);
+}
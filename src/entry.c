@@ -15,7 +15,9 @@
  * Paul Vixie          <paul@vix.com>          uunet!decwrl!vixie!paul
  */
 
-/* marco 04sep16 [integrated into pg_cron]
+/* pg_cron [rewrote load_entry as a single pass over the schedule string,
+ *	    added interval schedules]
+ * marco 04sep16 [integrated into pg_cron]
  * vix 26jan87 [RCS'd; rest of log is in RCS file]
  * vix 01jan87 [added line-level error recovery]
  * vix 31dec86 [added /step to the from-to range, per bob@acornrc]
@@ -25,11 +27,46 @@
 
 #include "postgres.h"
 
-#include "stdlib.h"
-#include "string.h"
+#include <ctype.h>
+#include <string.h>
+
 #include "cron.h"
 
 
+#define ALL_MINUTES ((UINT64CONST(1) << MINUTE_COUNT) - 1)
+#define ALL_HOURS ((UINT64CONST(1) << HOUR_COUNT) - 1)
+#define ALL_DOMS ((UINT64CONST(1) << DOM_COUNT) - 1)
+#define ALL_MONTHS ((UINT64CONST(1) << MONTH_COUNT) - 1)
+#define ALL_DOWS ((UINT64CONST(1) << DOW_COUNT) - 1)
+
+/* bits for Sunday, which is both 0 and 7 */
+#define SUNDAY_BITS ((UINT64CONST(1) << 0) | (UINT64CONST(1) << 7))
+
+/* numbers beyond this are out of range for every field */
+#define MAX_PARSED_NUMBER 1000
+
+
+/* schedule that an @ shorthand stands for */
+typedef struct SpecialSchedule
+{
+	const char *name;
+	entry schedule;
+} SpecialSchedule;
+
+
+/* forward declarations */
+static bool ParseCronEntry(const char *cursor, entry *schedule);
+static bool ParseSpecial(const char *cursor, entry *schedule);
+static bool ParseField(const char **cursorPointer, int low, int high,
+					   char *names[], uint64 *bits);
+static bool ParseRange(const char **cursorPointer, int low, int high,
+					   char *names[], uint64 *bits);
+static bool ParseNumber(const char **cursorPointer, int low, char *names[],
+						int *number);
+static bool ParseInterval(const char *cursor, entry *schedule);
+static const char * SkipComments(const char *cursor);
+
+
 char	*MonthNames[] = {
 		"Jan", "Feb", "Mar", "Apr", "May", "Jun",
 		"Jul", "Aug", "Sep", "Oct", "Nov", "Dec",
@@ -41,505 +78,460 @@ char	*DowNames[] = {
 		NULL
 	};
 
-# if DEBUGGING
-int	DebugFlags;
-char	*DebugFlagNames[] = {	/* sync with #defines */
-		"ext", "sch", "proc", "pars", "load", "misc", "test", "bit",
-		NULL		/* NULL must be last element */
-	};
-# endif /* DEBUGGING */
-
-typedef	enum ecode {
-	e_none, e_minute, e_hour, e_dom, e_month, e_dow,
-	e_cmd, e_timespec, e_username, e_cmd_len
-} ecode_e;
+static const SpecialSchedule SpecialSchedules[] = {
+	{"reboot", {0, 0, 0, 0, 0, WHEN_REBOOT, 0}},
+	{"restart", {0, 0, 0, 0, 0, WHEN_REBOOT, 0}},
+	{"yearly", {1, 1, 1, 1, ALL_DOWS, DOW_STAR, 0}},
+	{"annually", {1, 1, 1, 1, ALL_DOWS, DOW_STAR, 0}},
+	{"monthly", {1, 1, 1, ALL_MONTHS, ALL_DOWS, DOW_STAR, 0}},
+	{"weekly", {1, 1, ALL_DOMS, ALL_MONTHS, SUNDAY_BITS, DOW_STAR, 0}},
+	{"daily", {1, 1, ALL_DOMS, ALL_MONTHS, ALL_DOWS, 0, 0}},
+	{"midnight", {1, 1, ALL_DOMS, ALL_MONTHS, ALL_DOWS, 0, 0}},
+	{"hourly", {1, ALL_HOURS, ALL_DOMS, ALL_MONTHS, ALL_DOWS, HR_STAR, 0}}
+};
+
+
+/*
+ * ParseCronSchedule parses a cron schedule or an interval of the form
+ * <number> second[s] into the given entry and returns whether the text is
+ * a valid schedule. It reads the text once and does not allocate memory.
+ */
+bool
+ParseCronSchedule(const char *scheduleText, entry *schedule)
+{
+	memset(schedule, 0, sizeof(entry));
 
-static int	get_list(bitstr_t *, int, int, char *[], int, FILE *),
-		get_range(bitstr_t *, int, int, char *[], int, FILE *),
-		get_number(int *, int, char *[], int, FILE *);
-static int	set_element(bitstr_t *, int, int, int),
-		set_range(bitstr_t *, int, int, int, int, int);
+	if (ParseCronEntry(scheduleText, schedule))
+	{
+		return true;
+	}
 
+	memset(schedule, 0, sizeof(entry));
 
-void
-free_entry(entry *e)
-{
-	free(e);
+	return ParseInterval(scheduleText, schedule);
 }
 
 
-
-/* return NULL if eof or syntax error occurs;
- * otherwise return a pointer to a new entry.
+/*
+ * ParseCronEntry parses the schedule part of a crontab line, following the
+ * syntax of load_entry in Vixie cron:
+ *
+ *	minutes hours doms months dows [anything]
  *
- * Note: This function is a modified version of load_entry in Vixie
- * cron. It only parses the schedule part of a cron entry and uses
- * an in-memry buffer.
+ * or an @ shorthand. Leading blank and comment lines are skipped.
  */
-entry *
-parse_cron_entry(char *schedule)
+static bool
+ParseCronEntry(const char *cursor, entry *schedule)
 {
-	/* this function reads one crontab entry -- the next -- from a file.
-	 * it skips any leading blank lines, ignores comments, and returns
-	 * EOF if for any reason the entry can't be read and parsed.
-	 *
-	 * the entry is also parsed here.
-	 *
-	 * syntax:
-	 *   user crontab:
-	 *	minutes hours doms months dows cmd\n
-	 *   system crontab (/etc/crontab):
-	 *	minutes hours doms months dows USERNAME cmd\n
-	 */
-
-	ecode_e ecode = e_none;
-	entry *e = (entry *) calloc(sizeof(entry), sizeof(char));
-	int	ch = 0;
-	char cmd[MAX_COMMAND];
-	file_buffer buffer = {{},0,0,{},0};
-	FILE *file = (FILE *) &buffer;
-
-	int scheduleLength = strlen(schedule);
-	if (scheduleLength >= MAX_FILE_BUFFER_LENGTH)
-	{
-		ch = EOF;
-		ecode = e_cmd_len;
-		goto eof;
-	}
-
-	strcpy(buffer.data, schedule);
-	buffer.length = scheduleLength;
-	buffer.pointer = 0;
-
-	Debug(DPARS, ("load_entry()...about to eat comments\n"))
-
-	skip_comments(file);
-
-	ch = get_char(file);
-	if (ch == EOF)
-	{
-		free_entry(e);
-		return NULL;
-	}
-
-	/* ch is now the first useful character of a useful line.
-	 * it may be an @special or it may be the first character
-	 * of a list of minutes.
-	 */
-
-	if (ch == '@') {
-		/* all of these should be flagged and load-limited; i.e.,
-		 * instead of @hourly meaning "0 * * * *" it should mean
-		 * "close to the front of every hour but not 'til the
-		 * system load is low".  Problems are: how do you know
-		 * what "low" means? (save me from /etc/cron.conf!) and:
-		 * how to guarantee low variance (how low is low?), which
-		 * means how to we run roughly every hour -- seems like
-		 * we need to keep a history or let the first hour set
-		 * the schedule, which means we aren't load-limited
-		 * anymore.  too much for my overloaded brain. (vix, jan90)
-		 * HINT
-		 */
-		ch = get_string(cmd, MAX_COMMAND, file, " \t\n");
-		if (!strcmp("reboot", cmd) || !strcmp("restart", cmd)) {
-			e->flags |= WHEN_REBOOT;
-		} else if (!strcmp("yearly", cmd) || !strcmp("annually", cmd)){
-			set_element(e->minute, FIRST_MINUTE, LAST_MINUTE,
-				    FIRST_MINUTE);
-			set_element(e->hour, FIRST_HOUR, LAST_HOUR,
-				    FIRST_HOUR);
-			set_element(e->dom, FIRST_DOM, LAST_DOM,
-				    FIRST_DOM);
-			set_element(e->month, FIRST_MONTH, LAST_MONTH,
-				    FIRST_MINUTE);
-			set_range(e->dow, FIRST_DOW, LAST_DOW,
-				  FIRST_DOW, LAST_DOW, 1);
-			e->flags |= DOW_STAR;
-		} else if (!strcmp("monthly", cmd)) {
-			set_element(e->minute, FIRST_MINUTE, LAST_MINUTE,
-				    FIRST_MINUTE);
-			set_element(e->hour, FIRST_HOUR, LAST_HOUR,
-				    FIRST_HOUR);
-			set_element(e->dom, FIRST_DOM, LAST_DOM,
-				    FIRST_DOM);
-			set_range(e->month, FIRST_MONTH, LAST_MONTH,
-				  FIRST_MONTH, LAST_MONTH, 1);
-			set_range(e->dow, FIRST_DOW, LAST_DOW,
-				  FIRST_DOW, LAST_DOW, 1);
-			e->flags |= DOW_STAR;
-		} else if (!strcmp("weekly", cmd)) {
-			set_element(e->minute, FIRST_MINUTE, LAST_MINUTE,
-				    FIRST_MINUTE);
-			set_element(e->hour, FIRST_HOUR, LAST_HOUR,
-				    FIRST_HOUR);
-			set_range(e->dom, FIRST_DOM, LAST_DOM,
-				  FIRST_DOM, LAST_DOM, 1);
-			set_range(e->month, FIRST_MONTH, LAST_MONTH,
-				  FIRST_MONTH, LAST_MONTH, 1);
-			set_element(e->dow, FIRST_DOW, LAST_DOW,
-				    FIRST_DOW);
-			e->flags |= DOW_STAR;
-		} else if (!strcmp("daily", cmd) || !strcmp("midnight", cmd)) {
-			set_element(e->minute, FIRST_MINUTE, LAST_MINUTE,
-				    FIRST_MINUTE);
-			set_element(e->hour, FIRST_HOUR, LAST_HOUR,
-				    FIRST_HOUR);
-			set_range(e->dom, FIRST_DOM, LAST_DOM,
-				  FIRST_DOM, LAST_DOM, 1);
-			set_range(e->month, FIRST_MONTH, LAST_MONTH,
-				  FIRST_MONTH, LAST_MONTH, 1);
-			set_range(e->dow, FIRST_DOW, LAST_DOW,
-				  FIRST_DOW, LAST_DOW, 1);
-		} else if (!strcmp("hourly", cmd)) {
-			set_element(e->minute, FIRST_MINUTE, LAST_MINUTE,
-				    FIRST_MINUTE);
-			set_range(e->hour, FIRST_HOUR, LAST_HOUR,
-				  FIRST_HOUR, LAST_HOUR, 1);
-			set_range(e->dom, FIRST_DOM, LAST_DOM,
-				  FIRST_DOM, LAST_DOM, 1);
-			set_range(e->month, FIRST_MONTH, LAST_MONTH,
-				  FIRST_MONTH, LAST_MONTH, 1);
-			set_range(e->dow, FIRST_DOW, LAST_DOW,
-				  FIRST_DOW, LAST_DOW, 1);
-			e->flags |= HR_STAR;
-		} else {
-			ecode = e_timespec;
-			goto eof;
-		}
-	} else {
-		Debug(DPARS, ("load_entry()...about to parse numerics\n"))
-
-		if (ch == '*')
-			e->flags |= MIN_STAR;
-		ch = get_list(e->minute, FIRST_MINUTE, LAST_MINUTE,
-			      PPC_NULL, ch, file);
-		if (ch == EOF) {
-			ecode = e_minute;
-			goto eof;
-		}
+	uint64 minute = 0;
+	uint64 hour = 0;
+	uint64 dom = 0;
+	uint64 month = 0;
+	uint64 dow = 0;
+	int flags = 0;
+
+	cursor = SkipComments(cursor);
+	if (cursor == NULL)
+	{
+		return false;
+	}
 
-		/* hours
-		 */
+	if (*cursor == '@')
+	{
+		return ParseSpecial(cursor + 1, schedule);
+	}
 
-		if (ch == '*')
-			e->flags |= HR_STAR;
-		ch = get_list(e->hour, FIRST_HOUR, LAST_HOUR,
-			      PPC_NULL, ch, file);
-		if (ch == EOF) {
-			ecode = e_hour;
-			goto eof;
-		}
+	if (*cursor == '*')
+	{
+		flags |= MIN_STAR;
+	}
 
-		/* DOM (days of month)
-		 */
+	if (!ParseField(&cursor, FIRST_MINUTE, LAST_MINUTE, NULL, &minute))
+	{
+		return false;
+	}
 
-		if (ch == '$') {
-			ch = get_char(file);
-			if (!Is_Blank(ch)) {
-				ecode = e_dom;
-				goto eof;
-			}
-			Skip_Blanks(ch, file);
-			e->flags |= DOM_LAST;
-		} else {
-			if (ch == '*')
-				e->flags |= DOM_STAR;
-			ch = get_list(e->dom, FIRST_DOM, LAST_DOM,
-					PPC_NULL, ch, file);
+	if (*cursor == '*')
+	{
+		flags |= HR_STAR;
+	}
+
+	if (!ParseField(&cursor, FIRST_HOUR, LAST_HOUR, NULL, &hour))
+	{
+		return false;
+	}
+
+	if (*cursor == '$')
+	{
+		/* $ is the last day of the month and has to stand on its own */
+		cursor++;
+		if (!Is_Blank(*cursor))
+		{
+			return false;
 		}
 
-		if (ch == EOF) {
-			ecode = e_dom;
-			goto eof;
+		while (Is_Blank(*cursor))
+		{
+			cursor++;
 		}
 
-		/* month
-		 */
+		flags |= DOM_LAST;
+	}
+	else
+	{
+		if (*cursor == '*')
+		{
+			flags |= DOM_STAR;
+		}
 
-		ch = get_list(e->month, FIRST_MONTH, LAST_MONTH,
-			      MonthNames, ch, file);
-		if (ch == EOF) {
-			ecode = e_month;
-			goto eof;
+		if (!ParseField(&cursor, FIRST_DOM, LAST_DOM, NULL, &dom))
+		{
+			return false;
 		}
+	}
 
-		/* DOW (days of week)
-		 */
+	if (!ParseField(&cursor, FIRST_MONTH, LAST_MONTH, MonthNames, &month))
+	{
+		return false;
+	}
 
-		if (ch == '*')
-			e->flags |= DOW_STAR;
-		ch = get_list(e->dow, FIRST_DOW, LAST_DOW,
-			      DowNames, ch, file);
-		if (ch == EOF) {
-			ecode = e_month;
-			goto eof;
-		}
+	if (*cursor == '*')
+	{
+		flags |= DOW_STAR;
+	}
+
+	if (!ParseField(&cursor, FIRST_DOW, LAST_DOW, DowNames, &dow))
+	{
+		return false;
 	}
 
 	/* make sundays equivalent */
-	if (bit_test(e->dow, 0) || bit_test(e->dow, 7)) {
-		bit_set(e->dow, 0);
-		bit_set(e->dow, 7);
+	if ((dow & SUNDAY_BITS) != 0)
+	{
+		dow |= SUNDAY_BITS;
 	}
 
-	/* success, fini, return pointer to the entry we just created...
-	 */
-	return e;
+	/* whatever follows the day of week is the command in a crontab */
+	schedule->minute = minute;
+	schedule->hour = (uint32) hour;
+	schedule->dom = (uint32) dom;
+	schedule->month = (uint16) month;
+	schedule->dow = (uint8) dow;
+	schedule->flags = (uint8) flags;
 
- eof:
-	elog(DEBUG1, "failed to parse entry %d", ecode);
-	free_entry(e);
-	while (ch != EOF && ch != '\n')
-		ch = get_char(file);
-	return NULL;
+	return true;
 }
 
 
-static int
-get_list(bitstr_t *bits, int low, int high, char *names[], int ch, FILE *file)
-	/* bitstr_t	*bits; */		/* one bit per flag, default=FALSE */
-	/* int		low, high; */	/* bounds, impl. offset for bitstr */
-	/* char		*names[]; */	/* NULL or *[] of names for these elements */
-	/* int		ch; */		/* current character being processed */
-	/* FILE		*file; */		/* file being read */
+/*
+ * ParseSpecial parses the word after an @, which runs up to the next blank
+ * or newline. Anything after the word is ignored.
+ */
+static bool
+ParseSpecial(const char *cursor, entry *schedule)
 {
-	register int	done;
+	size_t nameLength = strcspn(cursor, " \t\n");
+	size_t specialIndex = 0;
 
-	/* we know that we point to a non-blank character here;
-	 * must do a Skip_Blanks before we exit, so that the
-	 * next call (or the code that picks up the cmd) can
-	 * assume the same thing.
-	 */
+	for (specialIndex = 0; specialIndex < lengthof(SpecialSchedules); specialIndex++)
+	{
+		const SpecialSchedule *special = &SpecialSchedules[specialIndex];
 
-	Debug(DPARS|DEXT, ("get_list()...entered\n"))
+		if (strlen(special->name) == nameLength &&
+			strncmp(special->name, cursor, nameLength) == 0)
+		{
+			*schedule = special->schedule;
+			return true;
+		}
+	}
 
-	/* list = range {"," range}
-	 */
+	return false;
+}
 
-	/* clear the bit string, since the default is 'off'.
-	 */
-	bit_nclear(bits, 0, (high-low));
 
-	/* process all ranges
-	 */
-	done = FALSE;
-	while (!done) {
-		ch = get_range(bits, low, high, names, ch, file);
-		if (ch == ',')
-			ch = get_char(file);
-		else
-			done = TRUE;
+/*
+ * ParseField parses a comma-separated list of ranges into bits, where bit 0
+ * stands for low. Like Vixie cron, we skip anything that follows the list up
+ * to the next blank, and then the blanks.
+ */
+static bool
+ParseField(const char **cursorPointer, int low, int high, char *names[],
+		   uint64 *bits)
+{
+	const char *cursor = *cursorPointer;
+
+	*bits = 0;
+
+	for (;;)
+	{
+		if (!ParseRange(&cursor, low, high, names, bits))
+		{
+			return false;
+		}
+
+		if (*cursor != ',')
+		{
+			break;
+		}
+
+		cursor++;
+	}
+
+	while (*cursor != '\0' && !Is_Blank(*cursor) && *cursor != '\n')
+	{
+		cursor++;
 	}
 
-	/* exiting.  skip to some blanks, then skip over the blanks.
-	 */
-	Skip_Nonblanks(ch, file)
-	Skip_Blanks(ch, file)
+	while (Is_Blank(*cursor))
+	{
+		cursor++;
+	}
 
-	Debug(DPARS|DEXT, ("get_list()...exiting w/ %02x\n", ch))
+	*cursorPointer = cursor;
 
-	return ch;
+	return true;
 }
 
 
-static int
-get_range(bitstr_t *bits, int low, int high, char *names[], int ch, FILE *file)
-	/* bitstr_t	*bits;		one bit per flag, default=FALSE */
-	/* int		low, high;	bounds, impl. offset for bitstr */
-	/* char		*names[];	NULL or names of elements */
-	/* int		ch;		current character being processed */
-	/* FILE 		*file;		file being read */
+/*
+ * ParseRange parses a single number, a range of the form number-number or
+ * a *, the latter two optionally followed by /step, and sets the bits for
+ * the values it covers.
+ */
+static bool
+ParseRange(const char **cursorPointer, int low, int high, char *names[],
+		   uint64 *bits)
 {
-	/* range = number | number "-" number [ "/" number ]
-	 */
-
-	auto int	num1, num2, num3;
-
-	Debug(DPARS|DEXT, ("get_range()...entering, exit won't show\n"))
-
-	if (ch == '*') {
-		/* '*' means "first-last" but can still be modified by /step
-		 */
-		num1 = low;
-		num2 = high;
-		ch = get_char(file);
-		if (ch == EOF)
-			return EOF;
-	} else {
-		if (EOF == (ch = get_number(&num1, low, names, ch, file)))
-			return EOF;
-
-		if (ch != '-') {
-			/* not a range, it's a single number.
-			 */
-
-			/* Unsupported syntax: Step specified without range,
-			   eg:   1/20 * * * * /bin/echo "this fails"
-			 */
-			if (ch == '/')
-				return EOF;
-
-			if (EOF == set_element(bits, low, high, num1))
-				return EOF;
-			return ch;
-		} else {
-			/* eat the dash
-			 */
-			ch = get_char(file);
-			if (ch == EOF)
-				return EOF;
-
-			/* get the number following the dash
-			 */
-			ch = get_number(&num2, low, names, ch, file);
-			if (ch == EOF)
-				return EOF;
+	const char *cursor = *cursorPointer;
+	int first = 0;
+	int last = 0;
+	int step = 1;
+	int value = 0;
+
+	if (*cursor == '*')
+	{
+		/* * means first-last but can still be modified by /step */
+		first = low;
+		last = high;
+		cursor++;
+	}
+	else
+	{
+		if (!ParseNumber(&cursor, low, names, &first))
+		{
+			return false;
 		}
+
+		if (*cursor != '-')
+		{
+			/* a step without a range (e.g. 1/20) is not supported */
+			if (*cursor == '/' || first < low || first > high)
+			{
+				return false;
+			}
+
+			*bits |= UINT64CONST(1) << (first - low);
+			*cursorPointer = cursor;
+
+			return true;
+		}
+
+		cursor++;
+
+		if (!ParseNumber(&cursor, low, names, &last))
+		{
+			return false;
+		}
+	}
+
+	if (*cursor == '/')
+	{
+		cursor++;
+
+		/* the step is a plain number, not an element of the field */
+		if (!ParseNumber(&cursor, 0, NULL, &step) || step <= 0)
+		{
+			return false;
+		}
+	}
+
+	if (first < low || first > high || last < low || last > high ||
+		step > high)
+	{
+		return false;
+	}
+
+	for (value = first; value <= last; value += step)
+	{
+		*bits |= UINT64CONST(1) << (value - low);
 	}
 
-	/* check for step size
-	 */
-	if (ch == '/') {
-		/* eat the slash
-		 */
-		ch = get_char(file);
-		if (ch == EOF)
-			return EOF;
-
-		/* get the step size -- note: we don't pass the
-		 * names here, because the number is not an
-		 * element id, it's a step size.  'low' is
-		 * sent as a 0 since there is no offset either.
-		 */
-		ch = get_number(&num3, 0, PPC_NULL, ch, file);
-		if (ch == EOF || num3 <= 0)
-			return EOF;
-	} else {
-		/* no step.  default==1.
-		 */
-		num3 = 1;
-	}
-
-	/* Explicitly check for sane values. Certain combinations of ranges and
-	 * steps which should return EOF don't get picked up by the code below,
-	 * eg:
-	 *	5-64/30 * * * *	touch /dev/null
-	 *
-	 * Code adapted from set_elements() where this error was probably intended
-	 * to be catched.
-	 */
-	if (num1 < low || num1 > high || num2 < low || num2 > high ||
-		num3 < 0 || num3 > high)
-		return EOF;
-
-	/* range. set all elements from num1 to num2, stepping
-	 * by num3.  (the step is a downward-compatible extension
-	 * proposed conceptually by bob@acornrc, syntactically
-	 * designed then implemented by paul vixie).
-	 */
-	if (EOF == set_range(bits, low, high, num1, num2, num3)) {
-		unget_char(ch, file);
-		return EOF;
-	}
-
-	return ch;
+	*cursorPointer = cursor;
+
+	return true;
 }
 
 
-static int
-get_number(int *numptr, int low, char *names[], int ch, FILE *file)
-	/* int	*numptr;	where does the result go? */
-	/* int	low;/		offset applied to result if symbolic enum used */
-	/* char	*names[];	symbolic names, if any, for enums */
-	/* int	ch;		current character */
-	/* FILE 		*file;		source */
+/*
+ * ParseNumber parses a run of letters and digits that is either one of the
+ * given names, in which case the number is its position plus low, or a
+ * decimal number.
+ */
+static bool
+ParseNumber(const char **cursorPointer, int low, char *names[], int *number)
 {
-	char	temp[MAX_TEMPSTR], *pc;
-	int	len, i, all_digits;
-
-	/* collect alphanumerics into our fixed-size temp array
-	 */
-	pc = temp;
-	len = 0;
-	/* keep compiler quiet */
-	*numptr = 0;
-	all_digits = TRUE;
-	while (isalnum(ch)) {
-		if (++len >= MAX_TEMPSTR)
-			return EOF;
-
-		*pc++ = ch;
-
-		if (!isdigit(ch))
-			all_digits = FALSE;
-
-		ch = get_char(file);
-	}
-	*pc = '\0';
-
-        if (len == 0) {
-            return EOF;
-        }
-
-	/* try to find the name in the name list
-	 */
-	if (names) {
-		for (i = 0;  names[i] != NULL;  i++) {
-			Debug(DPARS|DEXT,
-				("get_num, compare(%s,%s)\n", names[i], temp))
-			if (!strcasecmp(names[i], temp)) {
-				*numptr = i+low;
-				return ch;
+	const char *cursor = *cursorPointer;
+	const char *start = cursor;
+	bool allDigits = true;
+	int value = 0;
+	size_t length = 0;
+
+	while (isalnum((unsigned char) *cursor))
+	{
+		if (!isdigit((unsigned char) *cursor))
+		{
+			allDigits = false;
+		}
+		else if (value <= MAX_PARSED_NUMBER)
+		{
+			value = value * 10 + (*cursor - '0');
+		}
+
+		cursor++;
+	}
+
+	length = cursor - start;
+	if (length == 0)
+	{
+		return false;
+	}
+
+	if (names != NULL)
+	{
+		int nameIndex = 0;
+
+		for (nameIndex = 0; names[nameIndex] != NULL; nameIndex++)
+		{
+			if (strlen(names[nameIndex]) == length &&
+				pg_strncasecmp(names[nameIndex], start, length) == 0)
+			{
+				*number = nameIndex + low;
+				*cursorPointer = cursor;
+
+				return true;
 			}
 		}
 	}
 
-	/* no name list specified, or there is one and our string isn't
-	 * in it.  either way: if it's all digits, use its magnitude.
-	 * otherwise, it's an error.
-	 */
-	if (all_digits) {
-		*numptr = atoi(temp);
-		return ch;
+	if (!allDigits)
+	{
+		return false;
 	}
 
-	return EOF;
+	*number = value;
+	*cursorPointer = cursor;
+
+	return true;
 }
 
 
-static int
-set_element(bitstr_t *bits, int low, int high, int number)
-	/* bitstr_t	*bits; 		one bit per flag, default=FALSE */
-	/* int		low; */
-	/* int		high; */
-	/* int		number; */
+/*
+ * ParseInterval parses an interval of the form <number> second[s] with a
+ * number between 1 and 59, ignoring case and surrounding whitespace.
+ */
+static bool
+ParseInterval(const char *cursor, entry *schedule)
 {
-	Debug(DPARS|DEXT, ("set_element(?,%d,%d,%d)\n", low, high, number))
+	int seconds = 0;
 
-	if (number < low || number > high)
-		return EOF;
+	while (isspace((unsigned char) *cursor))
+	{
+		cursor++;
+	}
+
+	if (*cursor == '+')
+	{
+		cursor++;
+	}
+
+	if (!isdigit((unsigned char) *cursor))
+	{
+		return false;
+	}
+
+	while (isdigit((unsigned char) *cursor))
+	{
+		if (seconds < 60)
+		{
+			seconds = seconds * 10 + (*cursor - '0');
+		}
+
+		cursor++;
+	}
+
+	while (isspace((unsigned char) *cursor))
+	{
+		cursor++;
+	}
+
+	if (pg_strncasecmp(cursor, "second", strlen("second")) != 0)
+	{
+		return false;
+	}
 
-	number -= low;
+	cursor += strlen("second");
 
-	bit_set(bits, number);
-	return OK;
+	/* only "seconds" may be followed by whitespace */
+	if (*cursor == 's' || *cursor == 'S')
+	{
+		cursor++;
+
+		while (isspace((unsigned char) *cursor))
+		{
+			cursor++;
+		}
+	}
+
+	if (*cursor != '\0' || seconds <= 0 || seconds >= 60)
+	{
+		return false;
+	}
+
+	schedule->secondsInterval = seconds;
+
+	return true;
 }
 
-static int
-set_range(bitstr_t *bits, int low, int high, int start, int stop, int step) {
-	Debug(DPARS|DEXT, ("set_range(?,%d,%d,%d,%d,%d)\n",
-			   low, high, start, stop, step))
 
-	if (start < low || stop > high || step <= 0)
-		return EOF;
-	start -= low;
-	stop -= low;
+/*
+ * SkipComments skips blank lines and lines that start with #, and returns
+ * the start of the first other line. It returns NULL if the text ends in a
+ * comment.
+ */
+static const char *
+SkipComments(const char *cursor)
+{
+	for (;;)
+	{
+		while (Is_Blank(*cursor))
+		{
+			cursor++;
+		}
+
+		if (*cursor == '#')
+		{
+			cursor = strchr(cursor, '\n');
+			if (cursor == NULL)
+			{
+				return NULL;
+			}
+		}
+
+		if (*cursor != '\n')
+		{
+			return cursor;
+		}
 
-	if (step == 1) {
-		bit_nset(bits, start, stop);
-	} else {
-		for (int i = start; i <= stop; i += step)
-			bit_set(bits, i);
+		cursor++;
 	}
-	return OK;
 }
@@ -11,12 +11,16 @@
 
 #include "postgres.h"
 #include "fmgr.h"
+#include "funcapi.h"
 #include "miscadmin.h"
 
 #include "cron.h"
 #include "pg_cron.h"
 #include "job_metadata.h"
 #include "cron_job.h"
+#include "schedule.h"
+#include "run_logger.h"
+#include "shared_state.h"
 
 #include "access/genam.h"
 #include "access/hash.h"
@@ -31,16 +35,22 @@
 #endif
 #include "catalog/indexing.h"
 #include "catalog/namespace.h"
+#include "catalog/pg_class.h"
+#include "catalog/pg_inherits.h"
+#include "catalog/pg_partitioned_table.h"
 #include "commands/extension.h"
 #include "commands/sequence.h"
 #include "commands/trigger.h"
+#include "nodes/parsenodes.h"
 #include "postmaster/postmaster.h"
 #include "pgstat.h"
+#include "storage/lmgr.h"
 #include "storage/lock.h"
 #include "utils/acl.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/fmgroids.h"
-#include "utils/formatting.h"
+#include "utils/guc.h"
 #include "utils/inval.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
@@ -48,11 +58,13 @@
 #include "utils/relcache.h"
 #include "utils/snapmgr.h"
 #include "utils/syscache.h"
+#include "utils/tuplestore.h"
 #if (PG_VERSION_NUM >= 100000)
 #include "utils/varlena.h"
 #endif
 
 #include "executor/spi.h"
+#include "catalog/pg_sequence.h"
 #include "catalog/pg_type.h"
 #include "commands/dbcommands.h"
 #include "catalog/pg_authid.h"
@@ -68,16 +80,137 @@
 #define JOB_ID_INDEX_NAME "job_pkey"
 #define JOB_ID_SEQUENCE_NAME "cron.jobid_seq"
 #define JOB_RUN_DETAILS_TABLE_NAME "job_run_details"
+#define JOB_CHANGES_TABLE_NAME "job_changes"
 #define RUN_ID_SEQUENCE_NAME "cron.runid_seq"
 
+/* columns of the objects passed to cron.schedule_many */
+#define SCHEDULE_MANY_COLUMNS "job_name text, schedule text, command text, " \
+							  "database text, username text, active boolean"
+
+
+/* state of a cron.next_runs call across rows */
+typedef struct NextRunsState
+{
+	entry *schedule;
+	TimestampTz lastRunTime;
+} NextRunsState;
+
+/*
+ * A combination of user and database that passed the checks for scheduling
+ * a job, such that cron.schedule_many checks every combination only once.
+ */
+typedef struct JobOwnerCheck
+{
+	char *userName;
+	bool userNameGiven;
+	char *databaseName;
+	Oid userId;
+} JobOwnerCheck;
+
+
+/*
+ * JobRunDetailEvent is a change to the cron.job_run_details row of a run
+ * that was not written yet. All changes to the same run are merged, such
+ * that a run is written by at most one insert or one update per flush.
+ */
+typedef struct JobRunDetailEvent
+{
+	int64 runId;
+
+	/* whether the row still needs to be inserted */
+	bool isInsert;
+	int64 jobId;
+	char *database;
+	char *username;
+	char *command;
+
+	/* new values, or NULL / false to keep the current value */
+	bool hasJobPid;
+	int32 jobPid;
+	char *status;
+	char *returnMessage;
+	bool hasStartTime;
+	TimestampTz startTime;
+	bool hasEndTime;
+	TimestampTz endTime;
+	bool hasLatency;
+	CronRunLatency latency;
+} JobRunDetailEvent;
+
+
+/*
+ * DeferredRunDetail is a run that is only written to cron.job_run_details
+ * if it fails, because of the log mode of its job. The changes to the run
+ * are kept in memory until it is done.
+ */
+typedef struct DeferredRunDetail
+{
+	int64 runId;
+	int64 jobId;
+	char *database;
+	char *username;
+	char *command;
+
+	/* whether to count the run in cron.job_run_rollups */
+	bool rollup;
+
+	/* final state, or NULL if the run did not finish */
+	char *status;
+
+	bool hasJobPid;
+	int32 jobPid;
+	char *returnMessage;
+	bool hasStartTime;
+	TimestampTz startTime;
+	bool hasEndTime;
+	TimestampTz endTime;
+} DeferredRunDetail;
+
+
+/*
+ * JobRunRollup counts the runs of a job that finished within a minute, for
+ * jobs that are logged as rollups.
+ */
+typedef struct JobRunRollupKey
+{
+	int64 jobId;
+	TimestampTz period;
+} JobRunRollupKey;
+
+typedef struct JobRunRollup
+{
+	JobRunRollupKey key;
+	int64 succeeded;
+	int64 failed;
+
+	/* sum of the durations of the runs in microseconds */
+	int64 totalDuration;
+} JobRunRollup;
+
 
 /* forward declarations */
 static HTAB * CreateCronJobHash(void);
+static HTAB * CreateCronScheduleHash(void);
+static uint32 ScheduleTextHash(const void *key, Size keySize);
+static int ScheduleTextMatch(const void *key1, const void *key2, Size keySize);
+static CronSchedule * InternSchedule(char *scheduleText);
+static void ReleaseSchedule(CronSchedule *cronSchedule);
+static void LoadCronJob(Relation cronJobTable, Oid cronJobIndexId, int64 jobId);
+static void RemoveCachedJob(int64 jobId);
+static List * TakeChangedJobIds(void);
+static void RecordChangedJobs(TriggerData *triggerData);
+static void RecordChangedJob(int64 jobId);
+static void InsertJobChanges(char *query, TriggerData *triggerData);
+static bool TriggerChangedJobs(TriggerData *triggerData);
+static bool JobIsUnchanged(char *query, int argCount, Oid *argTypes,
+						   Datum *argValues, int64 *jobId);
+static Oid JobChangesRelationId(void);
 
 static int64 ScheduleCronJob(text *scheduleText, text *commandText,
 								text *databaseText, text *usernameText,
 								bool active, text *jobnameText);
 static Oid CronExtensionOwner(void);
+static int64 RunIdSequenceIncrement(Oid sequenceId);
 static void EnsureDeletePermission(Relation cronJobsTable, HeapTuple heapTuple);
 static void InvalidateJobCache(void);
 static Oid CronJobRelationId(void);
@@ -85,32 +218,158 @@ static Oid CronJobRelationId(void);
 static CronJob * TupleToCronJob(TupleDesc tupleDescriptor, HeapTuple heapTuple);
 static bool PgCronHasBeenLoaded(void);
 static bool JobRunDetailsTableExists(void);
+static Oid JobRunDetailsRelationId(void);
+static bool JobRunDetailsHaveLatency(void);
 static bool JobTableExists(void);
+static bool IsTransientRunStatus(char *status, CronStatus *cronStatus);
+static JobRunDetailEvent * BufferJobRunDetail(int64 runId);
+static void FlushJobRunDetailsIfFull(void);
+static SPIPlanPtr CachedRunDetailPlan(int planIndex);
+static SPIPlanPtr KeepRunDetailPlan(int planIndex, char *query, int argCount,
+									Oid *argTypes);
+static Datum MicrosecondsGetIntervalDatum(int64 microseconds);
+static Datum BuildRunDetailArray(Datum *values, bool *nulls, int count,
+								 Oid elementType);
+static void ResetJobRunDetailsBuffer(void);
+static void UpdateDeferredRunDetail(DeferredRunDetail *deferredRun, int32 *jobPid,
+									char *status, char *returnMessage,
+									TimestampTz *startTime, TimestampTz *endTime);
+static void AddJobRunRollup(int64 jobId, bool failed, TimestampTz startTime,
+							TimestampTz endTime);
+static CronLogMode ParseLogMode(char *logModeString, bool reportError);
+static bool DropExpiredRunDetailsPartition(Oid relationId, TimestampTz cutoffTime);
+static bool PartitionBoundExpired(Oid relationId, Oid partitionId,
+								  TimestampTz cutoffTime);
+static bool RunBeforeExpired(int64 runId, TimestampTz cutoffTime);
+static bool DeleteExpiredRunDetails(TimestampTz cutoffTime);
 
 static void AlterJob(int64 jobId, text *scheduleText, text *commandText,
-						text *databaseText, text *usernameText, bool *active);
+						text *databaseText, text *usernameText, bool *active,
+						text *logModeText, int32 *logSampleRate);
 
 static Oid GetRoleOidIfCanLogin(char *username);
-static entry * ParseSchedule(char *scheduleText);
-static bool TryParseInterval(char *scheduleText, uint32 *secondsInterval);
+static void EnsureCanConnect(Oid userId, char *databaseName);
+static void CheckJobOwner(char *userName, bool userNameGiven, char *databaseName,
+						  List **ownerCheckList);
+static int64 UnscheduleJobs(char *query, Oid arrayTypeId, Datum arrayDatum,
+							char **missingJob);
+static bool ParseSchedule(char *scheduleText, entry *schedule);
 
 
 /* SQL-callable functions */
 PG_FUNCTION_INFO_V1(cron_schedule);
 PG_FUNCTION_INFO_V1(cron_schedule_named);
+PG_FUNCTION_INFO_V1(cron_schedule_many);
 PG_FUNCTION_INFO_V1(cron_unschedule);
 PG_FUNCTION_INFO_V1(cron_unschedule_named);
+PG_FUNCTION_INFO_V1(cron_unschedule_many);
+PG_FUNCTION_INFO_V1(cron_unschedule_many_named);
 PG_FUNCTION_INFO_V1(cron_job_cache_invalidate);
 PG_FUNCTION_INFO_V1(cron_alter_job);
+PG_FUNCTION_INFO_V1(cron_set_job_log_mode);
+PG_FUNCTION_INFO_V1(cron_next_runs);
+PG_FUNCTION_INFO_V1(cron_job_cache_stats);
 
 
 /* global variables */
 static MemoryContext CronJobContext = NULL;
 static HTAB *CronJobHash = NULL;
+static HTAB *CronScheduleHash = NULL;
 static Oid CachedCronJobRelationId = InvalidOid;
+
+/*
+ * The cron.job and cron.job_changes relations at the time all jobs were
+ * loaded. Changed jobs can only be reloaded incrementally if both are the
+ * same, otherwise LoadCronJobList needs to be used.
+ */
+static Oid LoadedJobRelationId = InvalidOid;
+static Oid LoadedJobChangesRelationId = InvalidOid;
+
+/*
+ * Invalidations that arrived since the job cache was last refreshed. When
+ * cron.job_refresh_delay is set, the launcher waits for invalidations to
+ * stop arriving before refreshing, such that a burst of job changes only
+ * causes a single refresh.
+ */
+static TimestampTz FirstPendingInvalidationTime = 0;
+static TimestampTz LastPendingInvalidationTime = 0;
+static uint64 PendingInvalidationCount = 0;
+static bool JobCacheReloadForced = false;
+
+/* the first pending invalidation waits at most this many times the delay */
+#define MAX_REFRESH_DELAY_FACTOR 10
+
+/*
+ * Changes to cron.job_run_details that the launcher did not write yet, by
+ * run ID, and the time at which the oldest of them was made.
+ */
+static MemoryContext JobRunDetailsBufferContext = NULL;
+static HTAB *JobRunDetailsBuffer = NULL;
+static TimestampTz FirstBufferedEventTime = 0;
+
+/*
+ * The cron.runid_seq sequence and its owner, and the run IDs that the
+ * launcher reserved from it but did not hand out yet.
+ */
+static Oid CachedRunIdSequenceId = InvalidOid;
+static Oid CachedRunIdSequenceOwner = InvalidOid;
+static int64 NextReservedRunId = 0;
+static int64 LastReservedRunId = 0;
+
+/*
+ * Prepared statements for writing to cron.job_run_details, and the table
+ * for which they were prepared. Updates of single runs have a statement for
+ * every combination of updated columns, identified by a bit per column.
+ */
+#define RUN_DETAIL_INSERT_PLAN 0
+#define RUN_DETAIL_FLUSH_INSERT_PLAN 1
+#define RUN_DETAIL_FLUSH_UPDATE_PLAN 2
+#define RUN_DETAIL_UPDATE_PLAN 3
+#define RUN_DETAIL_PLAN_COUNT (RUN_DETAIL_UPDATE_PLAN + (1 << 6))
+
+static SPIPlanPtr RunDetailPlans[RUN_DETAIL_PLAN_COUNT];
+static Oid RunDetailPlansRelationId = InvalidOid;
+static bool RunDetailPlansHaveLatency = false;
+
+/*
+ * Whether cron.job_run_details has the latency columns, which are missing
+ * until the extension is updated to 1.7, and the table that was checked.
+ */
+static Oid LatencyCheckedRelationId = InvalidOid;
+static bool RunDetailsHaveLatency = false;
+
+/*
+ * Runs that are only written to cron.job_run_details if they fail, by run
+ * ID, and the counts of finished runs of jobs that are logged as rollups.
+ */
+static MemoryContext DeferredRunsContext = NULL;
+static HTAB *DeferredRuns = NULL;
+static HTAB *JobRunRollups = NULL;
+
+/*
+ * Progress of removing runs that are older than cron.run_details_retention.
+ * A purge round deletes batches of runs in run ID order, starting after the
+ * last run ID that the previous batch looked at, until it finds a run that
+ * finished within the retention period.
+ */
+static TimestampTz NextRunDetailsPurgeTime = 0;
+static int64 RunDetailsPurgePosition = 0;
+
+/* time in ms between purge rounds that found no more expired runs */
+#define RUN_DETAILS_PURGE_ROUND_INTERVAL 60000
+
+#define JOB_RUN_ROLLUPS_TABLE_NAME "job_run_rollups"
+
 bool CronJobCacheValid = false;
 char *CronHost = "localhost";
 bool EnableSuperuserJobs = true;
+int JobRefreshDelay = 0;
+int CronLogRunBatchSize = 100;
+int CronLogRunFlushInterval = 0;
+bool CronLogRunSynchronousCommit = true;
+int CronRunDetailsRetention = 0;
+int CronRunDetailsPurgeBatchSize = 1000;
+int CronRunDetailsPurgeDelay = 1000;
 
 
 /*
@@ -127,6 +386,7 @@ InitializeJobMetadataCache(void)
 											 ALLOCSET_DEFAULT_MAXSIZE);
 
 	CronJobHash = CreateCronJobHash();
+	CronScheduleHash = CreateCronScheduleHash();
 }
 
 
@@ -140,6 +400,76 @@ ResetJobMetadataCache(void)
 	MemoryContextReset(CronJobContext);
 
 	CronJobHash = CreateCronJobHash();
+	CronScheduleHash = CreateCronScheduleHash();
+
+	LoadedJobRelationId = InvalidOid;
+	LoadedJobChangesRelationId = InvalidOid;
+}
+
+
+/*
+ * ForceJobCacheReload ensures that the next refresh reloads all jobs rather
+ * than only the ones that changed, e.g. because settings that affect all
+ * jobs changed.
+ */
+void
+ForceJobCacheReload(void)
+{
+	CronJobCacheValid = false;
+	LoadedJobRelationId = InvalidOid;
+	JobCacheReloadForced = true;
+}
+
+
+/*
+ * JobCacheRefreshDue returns whether the launcher should refresh the invalid
+ * job cache now, or wait for more invalidations to arrive first.
+ */
+bool
+JobCacheRefreshDue(TimestampTz currentTime)
+{
+	if (CronJobCacheValid)
+	{
+		return false;
+	}
+
+	if (JobRefreshDelay <= 0 || JobCacheReloadForced ||
+		PendingInvalidationCount == 0)
+	{
+		return true;
+	}
+
+	/* refresh once no invalidation arrived for a while */
+	if (TimestampDifferenceExceeds(LastPendingInvalidationTime, currentTime,
+								   JobRefreshDelay))
+	{
+		return true;
+	}
+
+	/* do not postpone the refresh forever if invalidations keep arriving */
+	return TimestampDifferenceExceeds(FirstPendingInvalidationTime, currentTime,
+									  JobRefreshDelay * MAX_REFRESH_DELAY_FACTOR);
+}
+
+
+/*
+ * MarkJobCacheValid marks the job cache as valid before it is refreshed,
+ * and counts the invalidations that are handled by the refresh.
+ */
+void
+MarkJobCacheValid(void)
+{
+	if (PendingInvalidationCount > 1)
+	{
+		IncrementCronCounter(CRON_COUNTER_COALESCED_INVALIDATIONS,
+							 PendingInvalidationCount - 1);
+	}
+
+	CronJobCacheValid = true;
+	FirstPendingInvalidationTime = 0;
+	LastPendingInvalidationTime = 0;
+	PendingInvalidationCount = 0;
+	JobCacheReloadForced = false;
 }
 
 
@@ -166,6 +496,107 @@ CreateCronJobHash(void)
 }
 
 
+/*
+ * CreateCronScheduleHash creates the hash for interning parsed schedules,
+ * keyed by schedule text.
+ */
+static HTAB *
+CreateCronScheduleHash(void)
+{
+	HTAB *scheduleHash = NULL;
+	HASHCTL info;
+	int hashFlags = 0;
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(char *);
+	info.entrysize = sizeof(CronSchedule);
+	info.hash = ScheduleTextHash;
+	info.match = ScheduleTextMatch;
+	info.hcxt = CronJobContext;
+	hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_COMPARE | HASH_CONTEXT);
+
+	scheduleHash = hash_create("pg_cron schedules", 32, &info, hashFlags);
+
+	return scheduleHash;
+}
+
+
+/*
+ * ScheduleTextHash hashes a key of the schedule hash, which is a pointer to
+ * the schedule text.
+ */
+static uint32
+ScheduleTextHash(const void *key, Size keySize)
+{
+	const char *scheduleText = *((const char **) key);
+
+	return DatumGetUInt32(hash_any((const unsigned char *) scheduleText,
+								   strlen(scheduleText)));
+}
+
+
+/*
+ * ScheduleTextMatch compares two keys of the schedule hash by schedule text.
+ */
+static int
+ScheduleTextMatch(const void *key1, const void *key2, Size keySize)
+{
+	return strcmp(*((const char **) key1), *((const char **) key2));
+}
+
+
+/*
+ * InternSchedule returns the parsed schedule for the given schedule text,
+ * such that jobs with the same schedule share one CronSchedule. The
+ * schedule is only parsed the first time we see the text after the job
+ * metadata cache was reset.
+ */
+static CronSchedule *
+InternSchedule(char *scheduleText)
+{
+	CronSchedule *cronSchedule = NULL;
+	bool isPresent = false;
+
+	cronSchedule = hash_search(CronScheduleHash, &scheduleText, HASH_ENTER,
+							   &isPresent);
+	if (!isPresent)
+	{
+		cronSchedule->scheduleText = MemoryContextStrdup(CronJobContext,
+														 scheduleText);
+		cronSchedule->isValid = ParseSchedule(scheduleText,
+											  &cronSchedule->schedule);
+		cronSchedule->refCount = 0;
+		cronSchedule->runTimeAfter = 0;
+		cronSchedule->nextRunTime = 0;
+	}
+
+	cronSchedule->refCount++;
+
+	return cronSchedule;
+}
+
+
+/*
+ * ReleaseSchedule gives up a reference to an interned schedule and removes
+ * the schedule once no job refers to it anymore.
+ */
+static void
+ReleaseSchedule(CronSchedule *cronSchedule)
+{
+	char *scheduleText = cronSchedule->scheduleText;
+	bool isPresent = false;
+
+	cronSchedule->refCount--;
+	if (cronSchedule->refCount > 0)
+	{
+		return;
+	}
+
+	hash_search(CronScheduleHash, &scheduleText, HASH_REMOVE, &isPresent);
+	pfree(scheduleText);
+}
+
+
 /*
  * GetCronJob gets the cron job with the given id.
  */
@@ -188,13 +619,12 @@ static int64
 ScheduleCronJob(text *scheduleText, text *commandText, text *databaseText,
 					text *usernameText, bool active, text *jobnameText)
 {
-	entry *parsedSchedule = NULL;
+	entry parsedSchedule;
 	char *schedule;
 	char *command;
 	char *database_name;
 	char *jobName;
 	char *username;
-	AclResult aclresult;
 	Oid userIdcheckacl;
 
 	int64 jobId = 0;
@@ -218,9 +648,7 @@ ScheduleCronJob(text *scheduleText, text *commandText, text *databaseText,
 
 	/* check schedule is valid */
 	schedule = text_to_cstring(scheduleText);
-	parsedSchedule = ParseSchedule(schedule);
-
-	if (parsedSchedule == NULL)
+	if (!ParseSchedule(schedule, &parsedSchedule))
 	{
 		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
 						errmsg("invalid schedule: %s", schedule),
@@ -228,8 +656,6 @@ ScheduleCronJob(text *scheduleText, text *commandText, text *databaseText,
 								"format '[1-59] seconds'")));
 	}
 
-	free_entry(parsedSchedule);
-
 	initStringInfo(&querybuf);
 
 	appendStringInfo(&querybuf,
@@ -303,18 +729,7 @@ ScheduleCronJob(text *scheduleText, text *commandText, text *databaseText,
 	}
 
 	/* ensure the user that is used in the job can connect to the database */
-#if (PG_VERSION_NUM >= 160000)
-	aclresult = object_aclcheck(DatabaseRelationId,
-								get_database_oid(database_name, false),
-								userIdcheckacl, ACL_CONNECT);
-#else
-	aclresult = pg_database_aclcheck(get_database_oid(database_name, false),
-										userIdcheckacl, ACL_CONNECT);
-#endif
-
-	if (aclresult != ACLCHECK_OK)
-		elog(ERROR, "User %s does not have CONNECT privilege on %s",
-				GetUserNameFromId(userIdcheckacl, false), database_name);
+	EnsureCanConnect(userIdcheckacl, database_name);
 
 	argTypes[4] = TEXTOID;
 	argValues[4] = CStringGetTextDatum(database_name);
@@ -345,6 +760,42 @@ ScheduleCronJob(text *scheduleText, text *commandText, text *databaseText,
 		elog(ERROR, "SPI_connect failed");
 	}
 
+	/*
+	 * Scheduling a named job again with the same schedule, command and
+	 * database does not change it, in which case we skip the upsert such
+	 * that the launcher does not need to reload anything.
+	 */
+	if (jobnameText != NULL)
+	{
+		StringInfoData unchangedQuery;
+		bool jobIsUnchanged = false;
+
+		initStringInfo(&unchangedQuery);
+		appendStringInfo(&unchangedQuery,
+						 "select jobid from %s where jobname = $8 and username = $6 "
+						 "and schedule = $1 and command = $2 and database = $5 "
+						 "for update",
+						 quote_qualified_identifier(CRON_SCHEMA_NAME, JOBS_TABLE_NAME));
+
+		jobIsUnchanged = JobIsUnchanged(unchangedQuery.data, argCount, argTypes,
+										argValues, &jobId);
+
+		pfree(unchangedQuery.data);
+
+		if (jobIsUnchanged)
+		{
+			pfree(querybuf.data);
+
+			SPI_finish();
+
+			SetUserIdAndSecContext(savedUserId, savedSecurityContext);
+
+			IncrementCronCounter(CRON_COUNTER_SKIPPED_NOOP_UPDATES, 1);
+
+			return jobId;
+		}
+	}
+
 	if (SPI_execute_with_args(querybuf.data, argCount, argTypes, argValues, NULL,
 							  false, 1) != SPI_OK_INSERT_RETURNING)
 	{
@@ -374,6 +825,37 @@ ScheduleCronJob(text *scheduleText, text *commandText, text *databaseText,
 	return jobId;
 }
 
+/*
+ * JobIsUnchanged runs a query that returns the ID of a job if it already
+ * has the values that the caller wants to set, and locks the job such that
+ * it cannot change before the end of the transaction. If so, the job ID is
+ * written to jobId. The caller should have opened an SPI connection.
+ */
+static bool
+JobIsUnchanged(char *query, int argCount, Oid *argTypes, Datum *argValues,
+			   int64 *jobId)
+{
+	bool isNull = false;
+	Datum jobIdDatum = 0;
+
+	if (SPI_execute_with_args(query, argCount, argTypes, argValues, NULL,
+							  false, 1) != SPI_OK_SELECT)
+	{
+		elog(ERROR, "SPI_exec failed: %s", query);
+	}
+
+	if (SPI_processed <= 0)
+	{
+		return false;
+	}
+
+	jobIdDatum = SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1,
+							   &isNull);
+	*jobId = DatumGetInt64(jobIdDatum);
+
+	return true;
+}
+
 /*
  * GetRoleOidIfCanLogin
  * Checks user exist and can log in
@@ -409,6 +891,86 @@ GetRoleOidIfCanLogin(char *username)
 	return roleOid;
 }
 
+
+/*
+ * EnsureCanConnect throws an error if the given user does not have the
+ * CONNECT privilege on the given database, which is needed to run jobs.
+ */
+static void
+EnsureCanConnect(Oid userId, char *databaseName)
+{
+	AclResult aclresult;
+
+#if (PG_VERSION_NUM >= 160000)
+	aclresult = object_aclcheck(DatabaseRelationId,
+								get_database_oid(databaseName, false),
+								userId, ACL_CONNECT);
+#else
+	aclresult = pg_database_aclcheck(get_database_oid(databaseName, false),
+									 userId, ACL_CONNECT);
+#endif
+
+	if (aclresult != ACLCHECK_OK)
+		elog(ERROR, "User %s does not have CONNECT privilege on %s",
+			 GetUserNameFromId(userId, false), databaseName);
+}
+
+
+/*
+ * CheckJobOwner performs the same checks as ScheduleCronJob on the user and
+ * database of a job, unless they were already done for an earlier job in
+ * ownerCheckList. Each distinct role is only looked up once.
+ */
+static void
+CheckJobOwner(char *userName, bool userNameGiven, char *databaseName,
+			  List **ownerCheckList)
+{
+	JobOwnerCheck *ownerCheck = NULL;
+	ListCell *ownerCheckCell = NULL;
+	Oid userId = InvalidOid;
+
+	foreach(ownerCheckCell, *ownerCheckList)
+	{
+		JobOwnerCheck *earlierCheck = (JobOwnerCheck *) lfirst(ownerCheckCell);
+
+		if (earlierCheck->userNameGiven != userNameGiven ||
+			strcmp(earlierCheck->userName, userName) != 0)
+		{
+			continue;
+		}
+
+		if (strcmp(earlierCheck->databaseName, databaseName) == 0)
+		{
+			return;
+		}
+
+		userId = earlierCheck->userId;
+	}
+
+	if (userId == InvalidOid)
+	{
+		userId = userNameGiven ? GetRoleOidIfCanLogin(userName) : GetUserId();
+
+		if (!EnableSuperuserJobs && superuser_arg(userId))
+		{
+			ereport(ERROR, (errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+							errmsg("cannot schedule jobs as superuser"),
+							errdetail("Scheduling jobs as superuser is disallowed when "
+									  "cron.enable_superuser_jobs is set to off.")));
+		}
+	}
+
+	EnsureCanConnect(userId, databaseName);
+
+	ownerCheck = (JobOwnerCheck *) palloc0(sizeof(JobOwnerCheck));
+	ownerCheck->userName = userName;
+	ownerCheck->userNameGiven = userNameGiven;
+	ownerCheck->databaseName = databaseName;
+	ownerCheck->userId = userId;
+
+	*ownerCheckList = lappend(*ownerCheckList, ownerCheck);
+}
+
 /*
  * cron_alter_job alter a job
  */
@@ -443,34 +1005,182 @@ cron_alter_job(PG_FUNCTION_ARGS)
 		active = PG_GETARG_BOOL(5);
 
 	AlterJob(jobId, scheduleText, commandText, databaseText, usernameText,
-				PG_ARGISNULL(5) ? NULL : &active);
+				PG_ARGISNULL(5) ? NULL : &active, NULL, NULL);
 
 	PG_RETURN_VOID();
 }
 
 
 /*
- * cron_schedule schedule a job
+ * cron_set_job_log_mode changes which runs of a job are written to
+ * cron.job_run_details, and how often runs are sampled.
  */
 Datum
-cron_schedule(PG_FUNCTION_ARGS)
+cron_set_job_log_mode(PG_FUNCTION_ARGS)
 {
-	text *scheduleText = NULL;
-	text *commandText = NULL;
-	int64 jobId;
+	int64 jobId = 0;
+	text *logModeText = NULL;
+	int32 logSampleRate = 0;
 
 	if (PG_ARGISNULL(0))
-		ereport(ERROR, (errmsg("schedule can not be NULL")));
-	else
-		scheduleText = PG_GETARG_TEXT_P(0);
+		ereport(ERROR, (errmsg("job_id can not be NULL")));
 
 	if (PG_ARGISNULL(1))
-		ereport(ERROR, (errmsg("command can not be NULL")));
-	else
-		commandText = PG_GETARG_TEXT_P(1);
+		ereport(ERROR, (errmsg("log_mode can not be NULL")));
 
-	jobId = ScheduleCronJob(scheduleText, commandText, NULL,
-							NULL, true, NULL);
+	jobId = PG_GETARG_INT64(0);
+	logModeText = PG_GETARG_TEXT_P(1);
+
+	/* fails if the log mode is not known */
+	(void) ParseLogMode(text_to_cstring(logModeText), true);
+
+	if (!PG_ARGISNULL(2))
+	{
+		logSampleRate = PG_GETARG_INT32(2);
+
+		if (logSampleRate <= 0)
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							errmsg("sample_rate must be greater than 0")));
+	}
+
+	AlterJob(jobId, NULL, NULL, NULL, NULL, NULL, logModeText,
+			 PG_ARGISNULL(2) ? NULL : &logSampleRate);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * cron_next_runs returns the next count times at which the given schedule
+ * runs after the given time.
+ */
+Datum
+cron_next_runs(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *functionContext = NULL;
+	NextRunsState *state = NULL;
+	TimestampTz runTime = 0;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		char *schedule = text_to_cstring(PG_GETARG_TEXT_P(0));
+		TimestampTz fromTime = PG_GETARG_TIMESTAMPTZ(1);
+		int32 count = PG_GETARG_INT32(2);
+		entry parsedSchedule;
+		MemoryContext oldContext = NULL;
+
+		if (count < 0)
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							errmsg("count can not be negative")));
+		}
+
+		if (!ParseSchedule(schedule, &parsedSchedule))
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							errmsg("invalid schedule: %s", schedule),
+							errhint("Use cron format (e.g. 5 4 * * *), or interval "
+									"format '[1-59] seconds'")));
+		}
+
+		functionContext = SRF_FIRSTCALL_INIT();
+		oldContext = MemoryContextSwitchTo(functionContext->multi_call_memory_ctx);
+
+		/* copy the schedule such that it is freed along with the call */
+		state = palloc0(sizeof(NextRunsState));
+		state->schedule = palloc(sizeof(entry));
+		*state->schedule = parsedSchedule;
+		state->lastRunTime = fromTime;
+
+		/* reboot jobs do not have run times */
+		functionContext->max_calls =
+			(state->schedule->flags & WHEN_REBOOT) ? 0 : count;
+		functionContext->user_fctx = state;
+
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	functionContext = SRF_PERCALL_SETUP();
+	state = (NextRunsState *) functionContext->user_fctx;
+
+	if (functionContext->call_cntr >= functionContext->max_calls)
+	{
+		SRF_RETURN_DONE(functionContext);
+	}
+
+	if (state->schedule->secondsInterval > 0)
+	{
+		runTime = TimestampTzPlusMilliseconds(state->lastRunTime,
+											  state->schedule->secondsInterval * 1000);
+	}
+	else
+	{
+		runTime = NextRunTime(state->schedule, state->lastRunTime);
+		if (runTime == DT_NOEND)
+		{
+			/* schedule does not fire in the foreseeable future */
+			SRF_RETURN_DONE(functionContext);
+		}
+	}
+
+	state->lastRunTime = runTime;
+
+	SRF_RETURN_NEXT(functionContext, TimestampTzGetDatum(runTime));
+}
+
+
+/*
+ * cron_job_cache_stats returns counters for how often the launcher reloaded
+ * jobs and how many reloads were avoided.
+ */
+Datum
+cron_job_cache_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDescriptor = NULL;
+	Datum values[4];
+	bool isNulls[4];
+	HeapTuple heapTuple = NULL;
+
+	if (get_call_result_type(fcinfo, NULL, &tupleDescriptor) != TYPEFUNC_COMPOSITE)
+	{
+		elog(ERROR, "return type must be a row type");
+	}
+
+	memset(isNulls, false, sizeof(isNulls));
+
+	values[0] = Int64GetDatum(ReadCronCounter(CRON_COUNTER_FULL_JOB_RELOADS));
+	values[1] = Int64GetDatum(ReadCronCounter(CRON_COUNTER_INCREMENTAL_JOB_RELOADS));
+	values[2] = Int64GetDatum(ReadCronCounter(CRON_COUNTER_COALESCED_INVALIDATIONS));
+	values[3] = Int64GetDatum(ReadCronCounter(CRON_COUNTER_SKIPPED_NOOP_UPDATES));
+
+	heapTuple = heap_form_tuple(tupleDescriptor, values, isNulls);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heapTuple));
+}
+
+
+/*
+ * cron_schedule schedule a job
+ */
+Datum
+cron_schedule(PG_FUNCTION_ARGS)
+{
+	text *scheduleText = NULL;
+	text *commandText = NULL;
+	int64 jobId;
+
+	if (PG_ARGISNULL(0))
+		ereport(ERROR, (errmsg("schedule can not be NULL")));
+	else
+		scheduleText = PG_GETARG_TEXT_P(0);
+
+	if (PG_ARGISNULL(1))
+		ereport(ERROR, (errmsg("command can not be NULL")));
+	else
+		commandText = PG_GETARG_TEXT_P(1);
+
+	jobId = ScheduleCronJob(scheduleText, commandText, NULL,
+							NULL, true, NULL);
 
 	PG_RETURN_INT64(jobId);
 }
@@ -527,24 +1237,231 @@ cron_schedule_named(PG_FUNCTION_ARGS)
 
 	PG_RETURN_INT64(jobId);
 }
+
+
+/*
+ * cron_schedule_many schedules the jobs in a JSON array of objects with a
+ * schedule, command and optionally a job_name, database, username and
+ * active flag, and returns the name and ID of each job.
+ *
+ * All jobs are validated first and then inserted by a single statement,
+ * such that the job cache is invalidated once. Like cron.schedule, named
+ * jobs that already exist are updated, unless nothing changed.
+ */
+Datum
+cron_schedule_many(PG_FUNCTION_ARGS)
+{
+	Datum jobsDatum = PG_GETARG_DATUM(0);
+	ReturnSetInfo *resultInfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc tupleDescriptor = NULL;
+	Tuplestorestate *tupleStore = NULL;
+	MemoryContext oldContext = NULL;
+
+	bool isSuperuser = superuser();
+	char *userName = GetUserNameFromId(GetUserId(), false);
+	List *ownerCheckList = NIL;
+
+	StringInfoData querybuf;
+	Oid argTypes[5];
+	Datum argValues[5];
+	uint64 rowIndex = 0;
+	uint64 unchangedJobCount = 0;
+
+	Oid savedUserId = InvalidOid;
+	int savedSecurityContext = 0;
+
+	if (resultInfo == NULL || !IsA(resultInfo, ReturnSetInfo) ||
+		(resultInfo->allowedModes & SFRM_Materialize) == 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("set-valued function called in context that cannot "
+							   "accept a set")));
+	}
+
+	if (get_call_result_type(fcinfo, NULL, &tupleDescriptor) != TYPEFUNC_COMPOSITE)
+	{
+		elog(ERROR, "return type must be a row type");
+	}
+
+	oldContext = MemoryContextSwitchTo(resultInfo->econtext->ecxt_per_query_memory);
+	tupleDescriptor = CreateTupleDescCopy(tupleDescriptor);
+	tupleStore = tuplestore_begin_heap(true, false, work_mem);
+	MemoryContextSwitchTo(oldContext);
+
+	resultInfo->returnMode = SFRM_Materialize;
+	resultInfo->setResult = tupleStore;
+	resultInfo->setDesc = tupleDescriptor;
+
+	argTypes[0] = JSONBOID;
+	argValues[0] = jobsDatum;
+
+	argTypes[1] = TEXTOID;
+	argValues[1] = CStringGetTextDatum(CronHost);
+
+	argTypes[2] = INT4OID;
+	argValues[2] = Int32GetDatum(PostPortNumber);
+
+	argTypes[3] = TEXTOID;
+	argValues[3] = CStringGetTextDatum(CronTableDatabaseName);
+
+	argTypes[4] = TEXTOID;
+	argValues[4] = CStringGetTextDatum(userName);
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+	{
+		elog(ERROR, "SPI_connect failed");
+	}
+
+	/*
+	 * Check all jobs before changing anything. A job that appears twice for
+	 * the same user would make the upsert below affect the same row twice.
+	 */
+	initStringInfo(&querybuf);
+	appendStringInfo(&querybuf,
+					 "select schedule, command, database, username, job_name, "
+					 "job_name is not null and count(*) over "
+					 "(partition by job_name, coalesce(username, $5)) > 1 "
+					 "from jsonb_to_recordset($1) as jobs(%s)",
+					 SCHEDULE_MANY_COLUMNS);
+
+	if (SPI_execute_with_args(querybuf.data, 5, argTypes, argValues, NULL,
+							  true, 0) != SPI_OK_SELECT)
+	{
+		elog(ERROR, "SPI_exec failed: %s", querybuf.data);
+	}
+
+	for (rowIndex = 0; rowIndex < SPI_processed; rowIndex++)
+	{
+		HeapTuple jobRow = SPI_tuptable->vals[rowIndex];
+		TupleDesc jobRowDescriptor = SPI_tuptable->tupdesc;
+		char *schedule = SPI_getvalue(jobRow, jobRowDescriptor, 1);
+		char *command = SPI_getvalue(jobRow, jobRowDescriptor, 2);
+		char *jobDatabaseName = SPI_getvalue(jobRow, jobRowDescriptor, 3);
+		char *jobUserName = SPI_getvalue(jobRow, jobRowDescriptor, 4);
+		char *jobName = SPI_getvalue(jobRow, jobRowDescriptor, 5);
+		bool isNull = false;
+		bool isDuplicate = DatumGetBool(SPI_getbinval(jobRow, jobRowDescriptor,
+													  6, &isNull));
+		entry parsedSchedule;
+
+		if (schedule == NULL)
+			ereport(ERROR, (errmsg("schedule can not be NULL")));
+
+		if (command == NULL)
+			ereport(ERROR, (errmsg("command can not be NULL")));
+
+		if (!ParseSchedule(schedule, &parsedSchedule))
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							errmsg("invalid schedule: %s", schedule),
+							errhint("Use cron format (e.g. 5 4 * * *), or interval "
+									"format '[1-59] seconds'")));
+		}
+
+		if (jobUserName != NULL && !isSuperuser)
+			elog(ERROR, "must be superuser to create a job for another role");
+
+		if (isDuplicate)
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							errmsg("job '%s' appears more than once for the same user",
+								   jobName)));
+		}
+
+		CheckJobOwner(jobUserName != NULL ? jobUserName : userName,
+					  jobUserName != NULL,
+					  jobDatabaseName != NULL ? jobDatabaseName : CronTableDatabaseName,
+					  &ownerCheckList);
+	}
+
+	/*
+	 * Insert or update all jobs at once. Named jobs that are unchanged are
+	 * not updated, but we still return their ID.
+	 */
+	resetStringInfo(&querybuf);
+	appendStringInfo(&querybuf,
+					 "with jobs as ("
+					 "select * from jsonb_to_recordset($1) as jobs(%s)), "
+					 "upserted as ("
+					 "insert into %s as existing "
+					 "(schedule, command, nodename, nodeport, database, username, active, jobname) "
+					 "select schedule, command, $2, $3, coalesce(database, $4), "
+					 "coalesce(username, $5), coalesce(active, true), job_name from jobs "
+					 "on conflict on constraint jobname_username_uniq do update set "
+					 "schedule = EXCLUDED.schedule, command = EXCLUDED.command, "
+					 "database = EXCLUDED.database "
+					 "where (existing.schedule, existing.command, existing.database) "
+					 "is distinct from (EXCLUDED.schedule, EXCLUDED.command, EXCLUDED.database) "
+					 "returning jobname, jobid) "
+					 "select jobname, jobid, true from upserted "
+					 "union all "
+					 "select existing.jobname, existing.jobid, false "
+					 "from %s existing join jobs on existing.jobname = jobs.job_name "
+					 "and existing.username = coalesce(jobs.username, $5) "
+					 "where existing.jobid not in (select jobid from upserted)",
+					 SCHEDULE_MANY_COLUMNS,
+					 quote_qualified_identifier(CRON_SCHEMA_NAME, JOBS_TABLE_NAME),
+					 quote_qualified_identifier(CRON_SCHEMA_NAME, JOBS_TABLE_NAME));
+
+	GetUserIdAndSecContext(&savedUserId, &savedSecurityContext);
+	SetUserIdAndSecContext(CronExtensionOwner(), SECURITY_LOCAL_USERID_CHANGE);
+
+	if (SPI_execute_with_args(querybuf.data, 5, argTypes, argValues, NULL,
+							  false, 0) != SPI_OK_SELECT)
+	{
+		elog(ERROR, "SPI_exec failed: %s", querybuf.data);
+	}
+
+	for (rowIndex = 0; rowIndex < SPI_processed; rowIndex++)
+	{
+		HeapTuple jobRow = SPI_tuptable->vals[rowIndex];
+		TupleDesc jobRowDescriptor = SPI_tuptable->tupdesc;
+		Datum values[2];
+		bool isNulls[2];
+		bool isNull = false;
+
+		values[0] = SPI_getbinval(jobRow, jobRowDescriptor, 1, &isNulls[0]);
+		values[1] = SPI_getbinval(jobRow, jobRowDescriptor, 2, &isNulls[1]);
+
+		if (!DatumGetBool(SPI_getbinval(jobRow, jobRowDescriptor, 3, &isNull)))
+		{
+			unchangedJobCount++;
+		}
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	pfree(querybuf.data);
+
+	SPI_finish();
+
+	SetUserIdAndSecContext(savedUserId, savedSecurityContext);
+
+	IncrementCronCounter(CRON_COUNTER_SKIPPED_NOOP_UPDATES, unchangedJobCount);
+
+	return (Datum) 0;
+}
 /*
- * NextRunId draws a new run ID from cron.runid_seq.
+ * NextRunId hands out a new run ID. Run IDs are reserved in blocks from
+ * cron.runid_seq, which increments by the size of a block, such that only
+ * the first run of every block needs a transaction. Returns 0 if the
+ * cron.job_run_details table does not exist.
  */
 int64
 NextRunId(void)
 {
-	text *sequenceName = NULL;
-	Oid sequenceId = InvalidOid;
-	List *sequenceNameList = NIL;
-	RangeVar *sequenceVar = NULL;
-	Datum sequenceIdDatum = InvalidOid;
 	Oid savedUserId = InvalidOid;
 	int savedSecurityContext = 0;
 	Datum runIdDatum = 0;
 	int64 runId = 0;
-	bool failOK = true;
+	int64 runIdIncrement = 1;
 	MemoryContext originalContext = CurrentMemoryContext;
 
+	if (NextReservedRunId != 0 && NextReservedRunId <= LastReservedRunId)
+	{
+		return NextReservedRunId++;
+	}
+
 	StartTransactionCommand();
 	PushActiveSnapshot(GetTransactionSnapshot());
 
@@ -558,30 +1475,67 @@ NextRunId(void)
 		return 0;
 	}
 
-	/* resolve relationId from passed in schema and relation name */
-	sequenceName = cstring_to_text(RUN_ID_SEQUENCE_NAME);
-	sequenceNameList = textToQualifiedNameList(sequenceName);
-	sequenceVar = makeRangeVarFromNameList(sequenceNameList);
-	sequenceId = RangeVarGetRelid(sequenceVar, NoLock, failOK);
-	sequenceIdDatum = ObjectIdGetDatum(sequenceId);
+	if (CachedRunIdSequenceId == InvalidOid)
+	{
+		text *sequenceName = cstring_to_text(RUN_ID_SEQUENCE_NAME);
+		List *sequenceNameList = textToQualifiedNameList(sequenceName);
+		RangeVar *sequenceVar = makeRangeVarFromNameList(sequenceNameList);
+		bool failOK = true;
+
+		/* resolve relationId from passed in schema and relation name */
+		CachedRunIdSequenceId = RangeVarGetRelid(sequenceVar, NoLock, failOK);
+		CachedRunIdSequenceOwner = CronExtensionOwner();
+	}
 
 	GetUserIdAndSecContext(&savedUserId, &savedSecurityContext);
-	SetUserIdAndSecContext(CronExtensionOwner(), SECURITY_LOCAL_USERID_CHANGE);
+	SetUserIdAndSecContext(CachedRunIdSequenceOwner, SECURITY_LOCAL_USERID_CHANGE);
 
 	/* generate new and unique colocation id from sequence */
-	runIdDatum = DirectFunctionCall1(nextval_oid, sequenceIdDatum);
+	runIdDatum = DirectFunctionCall1(nextval_oid,
+									 ObjectIdGetDatum(CachedRunIdSequenceId));
 
 	SetUserIdAndSecContext(savedUserId, savedSecurityContext);
 
 	runId = DatumGetInt64(runIdDatum);
+	runIdIncrement = RunIdSequenceIncrement(CachedRunIdSequenceId);
 
 	PopActiveSnapshot();
 	CommitTransactionCommand();
 	MemoryContextSwitchTo(originalContext);
 
+	/* the IDs up to the next value of the sequence are ours to hand out */
+	if (runIdIncrement > 1)
+	{
+		NextReservedRunId = runId + 1;
+		LastReservedRunId = runId + runIdIncrement - 1;
+	}
+
 	return runId;
 }
 
+
+/*
+ * RunIdSequenceIncrement returns the increment of the sequence with the
+ * given oid, which is the number of run IDs that a call to nextval reserves.
+ */
+static int64
+RunIdSequenceIncrement(Oid sequenceId)
+{
+	HeapTuple sequenceTuple = SearchSysCache1(SEQRELID,
+											  ObjectIdGetDatum(sequenceId));
+	int64 increment = 1;
+
+	if (HeapTupleIsValid(sequenceTuple))
+	{
+		Form_pg_sequence sequenceForm = (Form_pg_sequence) GETSTRUCT(sequenceTuple);
+
+		increment = sequenceForm->seqincrement;
+		ReleaseSysCache(sequenceTuple);
+	}
+
+	return increment;
+}
+
 /*
  * CronExtensionOwner returns the name of the user that owns the
  * extension.
@@ -668,6 +1622,9 @@ cron_unschedule(PG_FUNCTION_ARGS)
 	table_close(cronJobsTable, NoLock);
 
 	CommandCounterIncrement();
+
+	/* simple_heap_delete does not fire triggers */
+	RecordChangedJob(jobId);
 	InvalidateJobCache();
 
 	PG_RETURN_BOOL(true);
@@ -683,6 +1640,8 @@ cron_unschedule_named(PG_FUNCTION_ARGS)
 	Datum jobNameDatum = PG_GETARG_DATUM(0);
 	char *jobName = NULL;
 	RegProcedure procedure;
+	int64 jobId = 0;
+	bool isNull = false;
 
 	Oid userId = GetUserId();
 	char *userName = GetUserNameFromId(userId, false);
@@ -734,12 +1693,18 @@ cron_unschedule_named(PG_FUNCTION_ARGS)
 
 	EnsureDeletePermission(cronJobsTable, heapTuple);
 
+	jobId = DatumGetInt64(heap_getattr(heapTuple, Anum_cron_job_jobid,
+									   RelationGetDescr(cronJobsTable), &isNull));
+
 	simple_heap_delete(cronJobsTable, &heapTuple->t_self);
 
 	systable_endscan(scanDescriptor);
 	table_close(cronJobsTable, NoLock);
 
 	CommandCounterIncrement();
+
+	/* simple_heap_delete does not fire triggers */
+	RecordChangedJob(jobId);
 	InvalidateJobCache();
 
 	PG_RETURN_BOOL(true);
@@ -747,74 +1712,395 @@ cron_unschedule_named(PG_FUNCTION_ARGS)
 
 
 /*
- * EnsureDeletePermission throws an error if the current user does
- * not have permission to delete the given cron.job tuple.
+ * cron_unschedule_many removes the jobs with the given IDs using a single
+ * statement and returns the number of removed jobs. Like cron.unschedule,
+ * users can only remove their own jobs unless they can delete from cron.job.
  */
-static void
-EnsureDeletePermission(Relation cronJobsTable, HeapTuple heapTuple)
+Datum
+cron_unschedule_many(PG_FUNCTION_ARGS)
 {
-	TupleDesc tupleDescriptor = RelationGetDescr(cronJobsTable);
+	ArrayType *jobIdArray = PG_GETARG_ARRAYTYPE_P(0);
+	Oid arrayTypeId = InvalidOid;
+	StringInfoData querybuf;
+	char *missingJob = NULL;
+	int64 unscheduledCount = 0;
 
-	/* check if the current user owns the row */
-	Oid userId = GetUserId();
+	if (array_contains_nulls(jobIdArray))
+	{
+		ereport(ERROR, (errmsg("job_ids can not contain NULL")));
+	}
 
-	bool isNull = false;
-	Datum ownerNameDatum = heap_getattr(heapTuple, Anum_cron_job_username,
-										tupleDescriptor, &isNull);
-	char *ownerName = TextDatumGetCString(ownerNameDatum);
-	Oid ownerId = get_role_oid(ownerName, true);
-	if (ownerId != userId)
+	initStringInfo(&querybuf);
+	appendStringInfo(&querybuf,
+					 "with ids as (select distinct jobid from unnest($1::bigint[]) as jobid), "
+					 "deleted as (delete from %s existing using ids "
+					 "where existing.jobid = ids.jobid",
+					 quote_qualified_identifier(CRON_SCHEMA_NAME, JOBS_TABLE_NAME));
+
+	if (pg_class_aclcheck(CronJobRelationId(), GetUserId(), ACL_DELETE) != ACLCHECK_OK)
 	{
-		/* otherwise, allow if the user has DELETE permission */
-		AclResult aclResult = pg_class_aclcheck(CronJobRelationId(), GetUserId(),
-												ACL_DELETE);
-		if (aclResult != ACLCHECK_OK)
-		{
-			aclcheck_error(aclResult,
-#if (PG_VERSION_NUM < 110000)
-						   ACL_KIND_CLASS,
-#else
-						   OBJECT_TABLE,
-#endif
-						   get_rel_name(CronJobRelationId()));
-		}
+		appendStringInfoString(&querybuf, " and existing.username = $2");
 	}
-}
 
+	appendStringInfoString(&querybuf,
+						   " returning existing.jobid) "
+						   "select (select count(*) from deleted), "
+						   "(select min(jobid) from ids "
+						   "where jobid not in (select jobid from deleted))::text");
 
-/*
- * cron_job_cache_invalidate invalidates the job cache in response to
- * a trigger.
- */
-Datum
-cron_job_cache_invalidate(PG_FUNCTION_ARGS)
-{
-	if (!CALLED_AS_TRIGGER(fcinfo))
+	arrayTypeId = get_fn_expr_argtype(fcinfo->flinfo, 0);
+	unscheduledCount = UnscheduleJobs(querybuf.data, arrayTypeId,
+									  PointerGetDatum(jobIdArray), &missingJob);
+	if (missingJob != NULL)
 	{
-		ereport(ERROR, (errcode(ERRCODE_E_R_I_E_TRIGGER_PROTOCOL_VIOLATED),
-						errmsg("must be called as trigger")));
+		ereport(ERROR, (errmsg("could not find valid entry for job %s",
+							   missingJob)));
 	}
 
-	InvalidateJobCache();
+	pfree(querybuf.data);
 
-	PG_RETURN_DATUM(PointerGetDatum(NULL));
+	PG_RETURN_INT64(unscheduledCount);
 }
 
 
 /*
- * Invalidate job cache ensures the job cache is reloaded on the next
- * iteration of pg_cron.
+ * cron_unschedule_many_named removes the jobs of the current user with the
+ * given names using a single statement and returns the number of removed
+ * jobs.
  */
-static void
-InvalidateJobCache(void)
+Datum
+cron_unschedule_many_named(PG_FUNCTION_ARGS)
 {
-	HeapTuple classTuple = NULL;
+	ArrayType *jobNameArray = PG_GETARG_ARRAYTYPE_P(0);
+	Oid arrayTypeId = InvalidOid;
+	StringInfoData querybuf;
+	char *missingJob = NULL;
+	int64 unscheduledCount = 0;
 
-	classTuple = SearchSysCache1(RELOID, ObjectIdGetDatum(CronJobRelationId()));
-	if (HeapTupleIsValid(classTuple))
+	if (array_contains_nulls(jobNameArray))
 	{
-		CacheInvalidateRelcacheByTuple(classTuple);
-		ReleaseSysCache(classTuple);
+		ereport(ERROR, (errmsg("job_names can not contain NULL")));
+	}
+
+	initStringInfo(&querybuf);
+	appendStringInfo(&querybuf,
+					 "with names as (select distinct jobname from unnest($1::text[]) as jobname), "
+					 "deleted as (delete from %s existing using names "
+					 "where existing.jobname = names.jobname and existing.username = $2 "
+					 "returning existing.jobname) "
+					 "select (select count(*) from deleted), "
+					 "(select min(jobname) from names "
+					 "where jobname not in (select jobname from deleted))",
+					 quote_qualified_identifier(CRON_SCHEMA_NAME, JOBS_TABLE_NAME));
+
+	arrayTypeId = get_fn_expr_argtype(fcinfo->flinfo, 0);
+	unscheduledCount = UnscheduleJobs(querybuf.data, arrayTypeId,
+									  PointerGetDatum(jobNameArray), &missingJob);
+	if (missingJob != NULL)
+	{
+		ereport(ERROR, (errmsg("could not find valid entry for job '%s'",
+							   missingJob)));
+	}
+
+	pfree(querybuf.data);
+
+	PG_RETURN_INT64(unscheduledCount);
+}
+
+
+/*
+ * UnscheduleJobs runs a query that deletes the jobs in an array as the
+ * extension owner, such that the triggers on cron.job fire once for all
+ * jobs. The query gets the array and the name of the current user as
+ * arguments, and returns the number of deleted jobs and one of the jobs
+ * that could not be found, if any, which is written to missingJob.
+ */
+static int64
+UnscheduleJobs(char *query, Oid arrayTypeId, Datum arrayDatum, char **missingJob)
+{
+	Oid argTypes[2];
+	Datum argValues[2];
+	int64 unscheduledCount = 0;
+	bool isNull = false;
+	char *userName = GetUserNameFromId(GetUserId(), false);
+	MemoryContext originalContext = CurrentMemoryContext;
+
+	Oid savedUserId = InvalidOid;
+	int savedSecurityContext = 0;
+
+	argTypes[0] = arrayTypeId;
+	argValues[0] = arrayDatum;
+
+	argTypes[1] = TEXTOID;
+	argValues[1] = CStringGetTextDatum(userName);
+
+	GetUserIdAndSecContext(&savedUserId, &savedSecurityContext);
+	SetUserIdAndSecContext(CronExtensionOwner(), SECURITY_LOCAL_USERID_CHANGE);
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+	{
+		elog(ERROR, "SPI_connect failed");
+	}
+
+	if (SPI_execute_with_args(query, 2, argTypes, argValues, NULL,
+							  false, 1) != SPI_OK_SELECT)
+	{
+		elog(ERROR, "SPI_exec failed: %s", query);
+	}
+
+	if (SPI_processed <= 0)
+	{
+		elog(ERROR, "query did not return any rows: %s", query);
+	}
+
+	unscheduledCount = DatumGetInt64(SPI_getbinval(SPI_tuptable->vals[0],
+												   SPI_tuptable->tupdesc, 1,
+												   &isNull));
+
+	*missingJob = SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 2);
+	if (*missingJob != NULL)
+	{
+		*missingJob = MemoryContextStrdup(originalContext, *missingJob);
+	}
+
+	SPI_finish();
+
+	SetUserIdAndSecContext(savedUserId, savedSecurityContext);
+
+	return unscheduledCount;
+}
+
+
+/*
+ * EnsureDeletePermission throws an error if the current user does
+ * not have permission to delete the given cron.job tuple.
+ */
+static void
+EnsureDeletePermission(Relation cronJobsTable, HeapTuple heapTuple)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(cronJobsTable);
+
+	/* check if the current user owns the row */
+	Oid userId = GetUserId();
+
+	bool isNull = false;
+	Datum ownerNameDatum = heap_getattr(heapTuple, Anum_cron_job_username,
+										tupleDescriptor, &isNull);
+	char *ownerName = TextDatumGetCString(ownerNameDatum);
+	Oid ownerId = get_role_oid(ownerName, true);
+	if (ownerId != userId)
+	{
+		/* otherwise, allow if the user has DELETE permission */
+		AclResult aclResult = pg_class_aclcheck(CronJobRelationId(), GetUserId(),
+												ACL_DELETE);
+		if (aclResult != ACLCHECK_OK)
+		{
+			aclcheck_error(aclResult,
+#if (PG_VERSION_NUM < 110000)
+						   ACL_KIND_CLASS,
+#else
+						   OBJECT_TABLE,
+#endif
+						   get_rel_name(CronJobRelationId()));
+		}
+	}
+}
+
+
+/*
+ * cron_job_cache_invalidate invalidates the job cache in response to
+ * a trigger, and records which jobs changed. Statements that did not
+ * change any jobs do not invalidate the cache.
+ */
+Datum
+cron_job_cache_invalidate(PG_FUNCTION_ARGS)
+{
+	TriggerData *triggerData = NULL;
+
+	if (!CALLED_AS_TRIGGER(fcinfo))
+	{
+		ereport(ERROR, (errcode(ERRCODE_E_R_I_E_TRIGGER_PROTOCOL_VIOLATED),
+						errmsg("must be called as trigger")));
+	}
+
+	triggerData = (TriggerData *) fcinfo->context;
+	if (!TriggerChangedJobs(triggerData))
+	{
+		PG_RETURN_DATUM(PointerGetDatum(NULL));
+	}
+
+	RecordChangedJobs(triggerData);
+	InvalidateJobCache();
+
+	PG_RETURN_DATUM(PointerGetDatum(NULL));
+}
+
+
+/*
+ * TriggerChangedJobs returns whether the statement that fired the trigger
+ * may have changed any jobs. Only statements with empty transition tables,
+ * such as an update that matched no rows, are known not to.
+ */
+static bool
+TriggerChangedJobs(TriggerData *triggerData)
+{
+	Trigger *trigger = triggerData->tg_trigger;
+
+	if (trigger->tgoldtable == NULL && trigger->tgnewtable == NULL)
+	{
+		return true;
+	}
+
+	if (triggerData->tg_oldtable != NULL &&
+		tuplestore_tuple_count(triggerData->tg_oldtable) > 0)
+	{
+		return true;
+	}
+
+	if (triggerData->tg_newtable != NULL &&
+		tuplestore_tuple_count(triggerData->tg_newtable) > 0)
+	{
+		return true;
+	}
+
+	return false;
+}
+
+
+/*
+ * RecordChangedJobs adds the IDs of the jobs that were changed by the
+ * statement that fired the trigger to cron.job_changes, such that the
+ * launcher only needs to reload those jobs. The IDs are taken from the
+ * transition tables of the trigger. Without transition tables, as is the
+ * case for TRUNCATE, we record all jobs, so that trigger should fire
+ * before the statement.
+ *
+ * A job that already has a row gets another one, since the launcher may
+ * take the earlier row and load the job before this change commits.
+ */
+static void
+RecordChangedJobs(TriggerData *triggerData)
+{
+	Trigger *trigger = triggerData->tg_trigger;
+	StringInfoData querybuf;
+
+	if (JobChangesRelationId() == InvalidOid)
+	{
+		/* changes are not tracked before 1.7, the launcher reloads all jobs */
+		return;
+	}
+
+	initStringInfo(&querybuf);
+
+	appendStringInfo(&querybuf, "insert into %s (jobid) ",
+					 quote_qualified_identifier(CRON_SCHEMA_NAME, JOB_CHANGES_TABLE_NAME));
+
+	if (trigger->tgoldtable != NULL && trigger->tgnewtable != NULL)
+	{
+		appendStringInfo(&querybuf,
+						 "select jobid from %s union select jobid from %s",
+						 quote_identifier(trigger->tgoldtable),
+						 quote_identifier(trigger->tgnewtable));
+	}
+	else if (trigger->tgoldtable != NULL)
+	{
+		appendStringInfo(&querybuf, "select jobid from %s",
+						 quote_identifier(trigger->tgoldtable));
+	}
+	else if (trigger->tgnewtable != NULL)
+	{
+		appendStringInfo(&querybuf, "select jobid from %s",
+						 quote_identifier(trigger->tgnewtable));
+	}
+	else
+	{
+		appendStringInfo(&querybuf, "select jobid from %s",
+						 quote_qualified_identifier(CRON_SCHEMA_NAME, JOBS_TABLE_NAME));
+	}
+
+	InsertJobChanges(querybuf.data, triggerData);
+
+	pfree(querybuf.data);
+}
+
+
+/*
+ * RecordChangedJob adds a single job ID to cron.job_changes, for changes
+ * that are made without firing triggers.
+ */
+static void
+RecordChangedJob(int64 jobId)
+{
+	StringInfoData querybuf;
+
+	if (JobChangesRelationId() == InvalidOid)
+	{
+		return;
+	}
+
+	initStringInfo(&querybuf);
+
+	appendStringInfo(&querybuf,
+					 "insert into %s (jobid) values (" INT64_FORMAT ")",
+					 quote_qualified_identifier(CRON_SCHEMA_NAME, JOB_CHANGES_TABLE_NAME),
+					 jobId);
+
+	InsertJobChanges(querybuf.data, NULL);
+
+	pfree(querybuf.data);
+}
+
+
+/*
+ * InsertJobChanges runs an insert into cron.job_changes as the extension
+ * owner, since the current user need not have access to it. If triggerData
+ * is given, its transition tables can be used in the query.
+ */
+static void
+InsertJobChanges(char *query, TriggerData *triggerData)
+{
+	Oid savedUserId = InvalidOid;
+	int savedSecurityContext = 0;
+
+	GetUserIdAndSecContext(&savedUserId, &savedSecurityContext);
+	SetUserIdAndSecContext(CronExtensionOwner(), SECURITY_LOCAL_USERID_CHANGE);
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+	{
+		elog(ERROR, "SPI_connect failed");
+	}
+
+	if (triggerData != NULL &&
+		SPI_register_trigger_data(triggerData) != SPI_OK_TD_REGISTER)
+	{
+		elog(ERROR, "SPI_register_trigger_data failed");
+	}
+
+	if (SPI_exec(query, 0) != SPI_OK_INSERT)
+	{
+		elog(ERROR, "SPI_exec failed: %s", query);
+	}
+
+	SPI_finish();
+
+	SetUserIdAndSecContext(savedUserId, savedSecurityContext);
+}
+
+
+/*
+ * Invalidate job cache ensures the job cache is reloaded on the next
+ * iteration of pg_cron.
+ */
+static void
+InvalidateJobCache(void)
+{
+	HeapTuple classTuple = NULL;
+
+	classTuple = SearchSysCache1(RELOID, ObjectIdGetDatum(CronJobRelationId()));
+	if (HeapTupleIsValid(classTuple))
+	{
+		CacheInvalidateRelcacheByTuple(classTuple);
+		ReleaseSysCache(classTuple);
 	}
 }
 
@@ -826,12 +2112,40 @@ InvalidateJobCache(void)
 void
 InvalidateJobCacheCallback(Datum argument, Oid relationId)
 {
+	if (relationId == CachedRunIdSequenceId || relationId == InvalidOid)
+	{
+		/*
+		 * The sequence may have been dropped and created again, so the run
+		 * IDs reserved from it may be handed out again.
+		 */
+		CachedRunIdSequenceId = InvalidOid;
+		CachedRunIdSequenceOwner = InvalidOid;
+		NextReservedRunId = 0;
+		LastReservedRunId = 0;
+	}
+
+	if (relationId == LatencyCheckedRelationId || relationId == InvalidOid)
+	{
+		/* columns may have been added by ALTER EXTENSION pg_cron UPDATE */
+		LatencyCheckedRelationId = InvalidOid;
+	}
+
 	if (relationId == CachedCronJobRelationId ||
 		relationId == InvalidOid ||
 		CachedCronJobRelationId == InvalidOid)
 	{
+		TimestampTz currentTime = GetCurrentTimestamp();
+
 		CronJobCacheValid = false;
 		CachedCronJobRelationId = InvalidOid;
+
+		if (PendingInvalidationCount == 0)
+		{
+			FirstPendingInvalidationTime = currentTime;
+		}
+
+		LastPendingInvalidationTime = currentTime;
+		PendingInvalidationCount++;
 	}
 }
 
@@ -868,6 +2182,8 @@ LoadCronJobList(void)
 	HeapTuple heapTuple = NULL;
 	TupleDesc tupleDescriptor = NULL;
 	MemoryContext originalContext = CurrentMemoryContext;
+	Oid jobRelationId = InvalidOid;
+	Oid jobChangesRelationId = InvalidOid;
 
 	SetCurrentStatementStartTimestamp();
 	StartTransactionCommand();
@@ -887,11 +2203,25 @@ LoadCronJobList(void)
 		return NIL;
 	}
 
-	cronJobTable = table_open(CronJobRelationId(), AccessShareLock);
+	jobRelationId = CronJobRelationId();
+	cronJobTable = table_open(jobRelationId, AccessShareLock);
+
+	/*
+	 * We load all jobs below, so forget about earlier changes. The scan
+	 * uses a new snapshot, such that it sees every change we remove.
+	 */
+	jobChangesRelationId = JobChangesRelationId();
+	if (jobChangesRelationId != InvalidOid)
+	{
+		TakeChangedJobIds();
+
+		PopActiveSnapshot();
+		PushActiveSnapshot(GetTransactionSnapshot());
+	}
 
 	scanDescriptor = systable_beginscan(cronJobTable,
 										InvalidOid, false,
-										NULL, scanKeyCount, scanKey);
+										GetActiveSnapshot(), scanKeyCount, scanKey);
 
 	tupleDescriptor = RelationGetDescr(cronJobTable);
 
@@ -921,27 +2251,248 @@ LoadCronJobList(void)
 	CommitTransactionCommand();
 	MemoryContextSwitchTo(originalContext);
 
+	LoadedJobRelationId = jobRelationId;
+	LoadedJobChangesRelationId = jobChangesRelationId;
+
+	IncrementCronCounter(CRON_COUNTER_FULL_JOB_RELOADS, 1);
+
 	return jobList;
 }
 
 
 /*
- * TupleToCronJob takes a heap tuple, converts it into a CronJob struct and
- * adds it to the CronJobHash if it satisfies EnableSuperuserJobs condition.
+ * LoadChangedCronJobs reloads the jobs whose ID was recorded in
+ * cron.job_changes since the jobs were last loaded, and sets
+ * changedJobIdList to their IDs. Jobs that were removed (or may no
+ * longer run) are removed from the cache, such that GetCronJob returns
+ * NULL for them.
+ *
+ * It returns false without changing the cache if all jobs need to be
+ * loaded using LoadCronJobList instead, because they were never loaded,
+ * the extension was recreated, or the installed version of the extension
+ * does not track changes.
  */
-static CronJob *
-TupleToCronJob(TupleDesc tupleDescriptor, HeapTuple heapTuple)
+bool
+LoadChangedCronJobs(List **changedJobIdList)
 {
-	CronJob *job = NULL;
-	int64 jobKey = 0;
-	bool isNull = false;
-	bool isPresent = false;
-	entry *parsedSchedule = NULL;
-	char *jobOwner;
-	Oid jobOwnerId;
+	List *jobIdList = NIL;
+	ListCell *jobIdCell = NULL;
+	Relation cronJobTable = NULL;
+	Oid cronJobIndexId = InvalidOid;
+	MemoryContext originalContext = CurrentMemoryContext;
 
-	Datum jobId = heap_getattr(heapTuple, Anum_cron_job_jobid,
-							   tupleDescriptor, &isNull);
+	if (LoadedJobRelationId == InvalidOid ||
+		LoadedJobChangesRelationId == InvalidOid)
+	{
+		return false;
+	}
+
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	if (!PgCronHasBeenLoaded() || RecoveryInProgress() ||
+		CronJobRelationId() != LoadedJobRelationId ||
+		JobChangesRelationId() != LoadedJobChangesRelationId)
+	{
+		PopActiveSnapshot();
+		CommitTransactionCommand();
+		MemoryContextSwitchTo(originalContext);
+
+		return false;
+	}
+
+	cronJobTable = table_open(LoadedJobRelationId, AccessShareLock);
+	cronJobIndexId = get_relname_relid(JOB_ID_INDEX_NAME,
+									   RelationGetNamespace(cronJobTable));
+
+	MemoryContextSwitchTo(originalContext);
+	jobIdList = TakeChangedJobIds();
+
+	/* use a new snapshot, such that we see every change we removed */
+	PopActiveSnapshot();
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	foreach(jobIdCell, jobIdList)
+	{
+		int64 jobId = *((int64 *) lfirst(jobIdCell));
+
+		RemoveCachedJob(jobId);
+		LoadCronJob(cronJobTable, cronJobIndexId, jobId);
+	}
+
+	table_close(cronJobTable, AccessShareLock);
+
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+	MemoryContextSwitchTo(originalContext);
+
+	*changedJobIdList = jobIdList;
+
+	IncrementCronCounter(CRON_COUNTER_INCREMENTAL_JOB_RELOADS, 1);
+
+	return true;
+}
+
+
+/*
+ * LoadCronJob adds the job with the given ID to the cache, if it exists.
+ */
+static void
+LoadCronJob(Relation cronJobTable, Oid cronJobIndexId, int64 jobId)
+{
+	SysScanDesc scanDescriptor = NULL;
+	ScanKeyData scanKey[1];
+	int scanKeyCount = 1;
+	bool indexOK = true;
+	HeapTuple heapTuple = NULL;
+
+	ScanKeyInit(&scanKey[0], Anum_cron_job_jobid,
+				BTEqualStrategyNumber, F_INT8EQ, Int64GetDatum(jobId));
+
+	scanDescriptor = systable_beginscan(cronJobTable,
+										cronJobIndexId, indexOK,
+										GetActiveSnapshot(), scanKeyCount, scanKey);
+
+	heapTuple = systable_getnext(scanDescriptor);
+	if (HeapTupleIsValid(heapTuple))
+	{
+		MemoryContext oldContext = MemoryContextSwitchTo(CronJobContext);
+
+		TupleToCronJob(RelationGetDescr(cronJobTable), heapTuple);
+
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	systable_endscan(scanDescriptor);
+}
+
+
+/*
+ * RemoveCachedJob removes the job with the given ID from the cache and
+ * frees its memory, if it is cached.
+ */
+static void
+RemoveCachedJob(int64 jobId)
+{
+	CronJob *job = NULL;
+	bool isPresent = false;
+
+	job = hash_search(CronJobHash, &jobId, HASH_FIND, &isPresent);
+	if (job == NULL)
+	{
+		return;
+	}
+
+	ReleaseSchedule(job->schedule);
+	pfree(job->command);
+	pfree(job->nodeName);
+	pfree(job->database);
+	pfree(job->userName);
+
+	if (job->jobName != NULL)
+	{
+		pfree(job->jobName);
+	}
+
+	hash_search(CronJobHash, &jobId, HASH_REMOVE, &isPresent);
+}
+
+
+/*
+ * TakeChangedJobIds removes the rows from cron.job_changes that are visible
+ * to the current snapshot and returns the distinct IDs of the jobs in them
+ * as a list of int64 pointers, allocated in the current memory context.
+ * Rows of changes that commit later are not removed, so they are taken by
+ * the next refresh.
+ */
+static List *
+TakeChangedJobIds(void)
+{
+	List *jobIdList = NIL;
+	MemoryContext callerContext = CurrentMemoryContext;
+	StringInfoData querybuf;
+	uint64 rowIndex = 0;
+	HTAB *jobIdHash = NULL;
+	HASHCTL info;
+
+	initStringInfo(&querybuf);
+
+	appendStringInfo(&querybuf, "delete from %s returning jobid",
+					 quote_qualified_identifier(CRON_SCHEMA_NAME, JOB_CHANGES_TABLE_NAME));
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+	{
+		elog(ERROR, "SPI_connect failed");
+	}
+
+	if (SPI_exec(querybuf.data, 0) != SPI_OK_DELETE_RETURNING)
+	{
+		elog(ERROR, "SPI_exec failed: %s", querybuf.data);
+	}
+
+	/* a job has a row for every change, but is only loaded once */
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(int64);
+	info.entrysize = sizeof(int64);
+	info.hash = tag_hash;
+	info.hcxt = CurrentMemoryContext;
+
+	jobIdHash = hash_create("pg_cron changed job IDs", (long) Max(SPI_processed, 16),
+							&info, HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+
+	for (rowIndex = 0; rowIndex < SPI_processed; rowIndex++)
+	{
+		bool isNull = false;
+		bool isPresent = false;
+		Datum jobIdDatum = SPI_getbinval(SPI_tuptable->vals[rowIndex],
+										 SPI_tuptable->tupdesc, 1, &isNull);
+		int64 jobIdKey = DatumGetInt64(jobIdDatum);
+		MemoryContext oldContext = NULL;
+		int64 *jobId = NULL;
+
+		hash_search(jobIdHash, &jobIdKey, HASH_ENTER, &isPresent);
+		if (isPresent)
+		{
+			continue;
+		}
+
+		oldContext = MemoryContextSwitchTo(callerContext);
+
+		jobId = palloc(sizeof(int64));
+		*jobId = jobIdKey;
+		jobIdList = lappend(jobIdList, jobId);
+
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	hash_destroy(jobIdHash);
+
+	SPI_finish();
+
+	pfree(querybuf.data);
+
+	return jobIdList;
+}
+
+
+/*
+ * TupleToCronJob takes a heap tuple, converts it into a CronJob struct and
+ * adds it to the CronJobHash if it satisfies EnableSuperuserJobs condition.
+ */
+static CronJob *
+TupleToCronJob(TupleDesc tupleDescriptor, HeapTuple heapTuple)
+{
+	CronJob *job = NULL;
+	int64 jobKey = 0;
+	bool isNull = false;
+	bool isPresent = false;
+	char *jobOwner;
+	Oid jobOwnerId;
+	char *scheduleText = NULL;
+
+	Datum jobId = heap_getattr(heapTuple, Anum_cron_job_jobid,
+							   tupleDescriptor, &isNull);
 	Datum schedule = heap_getattr(heapTuple, Anum_cron_job_schedule,
 								  tupleDescriptor, &isNull);
 	Datum command = heap_getattr(heapTuple, Anum_cron_job_command,
@@ -962,19 +2513,22 @@ TupleToCronJob(TupleDesc tupleDescriptor, HeapTuple heapTuple)
 	{
 		/*
 		 * Someone inserted a superuser into the metadata. Skip over the
-		 * job when cron.enable_superuser_jobs is disabled. The memory
-		 * will be cleaned up when CronJobContext is reset.
+		 * job when cron.enable_superuser_jobs is disabled.
 		 */
 		ereport(WARNING, (errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
 						  errmsg("skipping job " INT64_FORMAT " since superuser jobs "
 								 "are currently disallowed", jobKey)));
+		pfree(jobOwner);
 		return NULL;
 	}
 
 	job = hash_search(CronJobHash, &jobKey, HASH_ENTER, &isPresent);
 
 	job->jobId = DatumGetInt64(jobId);
-	job->scheduleText = TextDatumGetCString(schedule);
+	scheduleText = TextDatumGetCString(schedule);
+	job->schedule = InternSchedule(scheduleText);
+	job->scheduleText = job->schedule->scheduleText;
+	pfree(scheduleText);
 	job->command = TextDatumGetCString(command);
 	job->nodeName = TextDatumGetCString(nodeName);
 	job->nodePort = DatumGetInt32(nodePort);
@@ -993,6 +2547,8 @@ TupleToCronJob(TupleDesc tupleDescriptor, HeapTuple heapTuple)
 		job->active = true;
 	}
 
+	job->jobName = NULL;
+
 	if (tupleDescriptor->natts >= Anum_cron_job_jobname)
 	{
 		bool isJobNameNull = false;
@@ -1016,21 +2572,37 @@ TupleToCronJob(TupleDesc tupleDescriptor, HeapTuple heapTuple)
 		}
 	}
 
-	parsedSchedule = ParseSchedule(job->scheduleText);
-	if (parsedSchedule != NULL)
+	job->logMode = CRON_LOG_MODE_ALL;
+	job->logSampleRate = 1;
+
+	if (tupleDescriptor->natts >= Anum_cron_job_log_sample_rate)
 	{
-		/* copy the schedule and free the allocated memory immediately */
+		bool isLogModeNull = false;
+		bool isSampleRateNull = false;
+		Datum logMode = heap_getattr(heapTuple, Anum_cron_job_log_mode,
+									 tupleDescriptor, &isLogModeNull);
+		Datum logSampleRate = heap_getattr(heapTuple, Anum_cron_job_log_sample_rate,
+										   tupleDescriptor, &isSampleRateNull);
+
+		if (!isLogModeNull)
+		{
+			char *logModeString = TextDatumGetCString(logMode);
+
+			job->logMode = ParseLogMode(logModeString, false);
+			pfree(logModeString);
+		}
 
-		job->schedule = *parsedSchedule;
-		free_entry(parsedSchedule);
+		if (!isSampleRateNull && DatumGetInt32(logSampleRate) > 0)
+		{
+			job->logSampleRate = DatumGetInt32(logSampleRate);
+		}
 	}
-	else
+
+	if (!job->schedule->isValid)
 	{
+		/* ParseSchedule leaves a zeroed out schedule, which never runs */
 		ereport(LOG, (errmsg("invalid pg_cron schedule for job " INT64_FORMAT ": %s",
 							 job->jobId, job->scheduleText)));
-
-		/* a zeroed out schedule never runs */
-		memset(&job->schedule, 0, sizeof(entry));
 	}
 
 	return job;
@@ -1073,15 +2645,66 @@ PgCronHasBeenLoaded(void)
 	return extensionLoaded;
 }
 
+/*
+ * InsertJobRunDetail records that a run started, and adds it to
+ * cron.job_run_details through the run logger if there is one.
+ */
 void
 InsertJobRunDetail(int64 runId, int64 *jobId, char *database, char *username, char *command, char *status)
+{
+	/* keep the states of the run until it finishes in shared memory */
+	(void) StartRunProgress(runId, *jobId, database, username,
+							CRON_STATUS_STARTING);
+
+	if (SendRunInsertEvent(runId, *jobId, database, username, command, status))
+	{
+		return;
+	}
+
+	WriteJobRunDetailInsert(runId, jobId, database, username, command, status);
+}
+
+
+/*
+ * WriteJobRunDetailInsert adds a run to cron.job_run_details, or to the
+ * buffer of changes that are written together.
+ */
+void
+WriteJobRunDetailInsert(int64 runId, int64 *jobId, char *database, char *username,
+						char *command, char *status)
 {
 	StringInfoData querybuf;
 	const int argCount = 6;
 	Oid argTypes[6];
 	Datum argValues[6];
+	SPIPlanPtr plan = NULL;
 	MemoryContext originalContext = CurrentMemoryContext;
 
+	if (CronLogRunBatchSize > 0)
+	{
+		JobRunDetailEvent *event = NULL;
+
+		/* a run ID of 0 means there is no cron.job_run_details table */
+		if (runId == 0)
+		{
+			return;
+		}
+
+		event = BufferJobRunDetail(runId);
+		event->isInsert = true;
+		event->jobId = *jobId;
+		event->database = MemoryContextStrdup(JobRunDetailsBufferContext, database);
+		event->username = MemoryContextStrdup(JobRunDetailsBufferContext, username);
+		event->command = MemoryContextStrdup(JobRunDetailsBufferContext, command);
+		event->status = MemoryContextStrdup(JobRunDetailsBufferContext, status);
+
+		FlushJobRunDetailsIfFull();
+		return;
+	}
+
+	/* write buffered changes first, in case the batch size was just changed */
+	FlushJobRunDetails();
+
 	SetCurrentStatementStartTimestamp();
 	StartTransactionCommand();
 	PushActiveSnapshot(GetTransactionSnapshot());
@@ -1094,17 +2717,10 @@ InsertJobRunDetail(int64 runId, int64 *jobId, char *database, char *username, ch
 		return;
 	}
 
-	initStringInfo(&querybuf);
-
 	/* Open SPI context. */
 	if (SPI_connect() != SPI_OK_CONNECT)
 		elog(ERROR, "SPI_connect failed");
 
-
-	appendStringInfo(&querybuf,
-		"insert into %s.%s (jobid, runid, database, username, command, status) values ($1,$2,$3,$4,$5,$6)",
-		CRON_SCHEMA_NAME, JOB_RUN_DETAILS_TABLE_NAME);
-
 	/* jobId */
 	argTypes[0] = INT8OID;
 	argValues[0] = Int64GetDatum(*jobId);
@@ -1129,11 +2745,23 @@ InsertJobRunDetail(int64 runId, int64 *jobId, char *database, char *username, ch
 	argTypes[5] = TEXTOID;
 	argValues[5] = CStringGetTextDatum(status);
 
-	if(SPI_execute_with_args(querybuf.data,
-		argCount, argTypes, argValues, NULL, false, 1) != SPI_OK_INSERT)
-		elog(ERROR, "SPI_exec failed: %s", querybuf.data);
+	plan = CachedRunDetailPlan(RUN_DETAIL_INSERT_PLAN);
+	if (plan == NULL)
+	{
+		initStringInfo(&querybuf);
+		appendStringInfo(&querybuf,
+			"insert into %s.%s (jobid, runid, database, username, command, status) values ($1,$2,$3,$4,$5,$6)",
+			CRON_SCHEMA_NAME, JOB_RUN_DETAILS_TABLE_NAME);
 
-	pfree(querybuf.data);
+		plan = KeepRunDetailPlan(RUN_DETAIL_INSERT_PLAN, querybuf.data,
+								 argCount, argTypes);
+
+		pfree(querybuf.data);
+	}
+
+	if (SPI_execute_plan(plan, argValues, NULL, false, 1) != SPI_OK_INSERT)
+		elog(ERROR, "could not insert into %s.%s",
+			 CRON_SCHEMA_NAME, JOB_RUN_DETAILS_TABLE_NAME);
 
 	SPI_finish();
 	PopActiveSnapshot();
@@ -1141,320 +2769,2026 @@ InsertJobRunDetail(int64 runId, int64 *jobId, char *database, char *username, ch
 	MemoryContextSwitchTo(originalContext);
 }
 
+/*
+ * DeferJobRunDetail records that a run started, but only adds it to
+ * cron.job_run_details if it fails. If rollup is true, the run is counted
+ * in cron.job_run_rollups when it is done.
+ */
 void
-UpdateJobRunDetail(int64 runId, int32 *job_pid, char *status, char *return_message, TimestampTz *start_time,
-                                                                        TimestampTz *end_time)
+DeferJobRunDetail(int64 runId, int64 jobId, char *database, char *username,
+				  char *command, bool rollup)
 {
-	StringInfoData querybuf;
-	Oid argTypes[6];
-	Datum argValues[6];
-	int i;
-	MemoryContext originalContext = CurrentMemoryContext;
+	DeferredRunDetail *deferredRun = NULL;
+	bool isPresent = false;
 
-	SetCurrentStatementStartTimestamp();
-	StartTransactionCommand();
-	PushActiveSnapshot(GetTransactionSnapshot());
+	(void) StartRunProgress(runId, jobId, database, username,
+							CRON_STATUS_STARTING);
 
-	if (!PgCronHasBeenLoaded() || RecoveryInProgress() || !JobRunDetailsTableExists())
+	/* a run ID of 0 means there is no cron.job_run_details table */
+	if (runId == 0)
 	{
-		PopActiveSnapshot();
-		CommitTransactionCommand();
-		MemoryContextSwitchTo(originalContext);
 		return;
 	}
 
-	initStringInfo(&querybuf);
-	i = 0;
+	if (DeferredRunsContext == NULL)
+	{
+		DeferredRunsContext = AllocSetContextCreate(TopMemoryContext,
+													"pg_cron deferred runs",
+													ALLOCSET_DEFAULT_MINSIZE,
+													ALLOCSET_DEFAULT_INITSIZE,
+													ALLOCSET_DEFAULT_MAXSIZE);
+	}
 
-	/* Open SPI context. */
-	if (SPI_connect() != SPI_OK_CONNECT)
-		elog(ERROR, "SPI_connect failed");
+	if (DeferredRuns == NULL)
+	{
+		HASHCTL info;
+		int hashFlags = 0;
 
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(int64);
+		info.entrysize = sizeof(DeferredRunDetail);
+		info.hash = tag_hash;
+		info.hcxt = DeferredRunsContext;
+		hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
 
-	appendStringInfo(&querybuf,
-		"update %s.%s set", CRON_SCHEMA_NAME, JOB_RUN_DETAILS_TABLE_NAME);
+		DeferredRuns = hash_create("pg_cron deferred runs", 32, &info, hashFlags);
+	}
 
+	deferredRun = hash_search(DeferredRuns, &runId, HASH_ENTER, &isPresent);
+	memset(deferredRun, 0, sizeof(DeferredRunDetail));
+	deferredRun->runId = runId;
+	deferredRun->jobId = jobId;
+	deferredRun->database = MemoryContextStrdup(DeferredRunsContext, database);
+	deferredRun->username = MemoryContextStrdup(DeferredRunsContext, username);
+	deferredRun->command = MemoryContextStrdup(DeferredRunsContext, command);
+	deferredRun->rollup = rollup;
+}
 
-	/* add the fields to be updated */
-	if (job_pid != NULL) {
-		argTypes[i] = INT4OID;
-		argValues[i] = Int32GetDatum(*job_pid);
-		i++;
-		appendStringInfo(&querybuf, " job_pid = $%d,", i);
-	}
 
-	if (status != NULL)
+/*
+ * UpdateDeferredRunDetail records a change in the state of a run that is
+ * only written if it fails. States between start and finish only show in
+ * cron.job_run_progress, other changes are kept until the run is done.
+ */
+static void
+UpdateDeferredRunDetail(DeferredRunDetail *deferredRun, int32 *jobPid,
+						char *status, char *returnMessage,
+						TimestampTz *startTime, TimestampTz *endTime)
+{
+	CronStatus transientStatus = CRON_STATUS_STARTING;
+
+	if (IsTransientRunStatus(status, &transientStatus))
 	{
-		argTypes[i] = TEXTOID;
-		argValues[i] = CStringGetTextDatum(status);
-		i++;
+		(void) SetRunProgress(deferredRun->runId, transientStatus, jobPid,
+							  startTime);
+	}
+	else if (status != NULL)
+	{
+		if (deferredRun->status != NULL)
+		{
+			pfree(deferredRun->status);
+		}
 
-		appendStringInfo(&querybuf, " status = $%d,", i);
+		deferredRun->status = MemoryContextStrdup(DeferredRunsContext, status);
 	}
 
-        if (return_message != NULL)
+	if (jobPid != NULL)
 	{
-		argTypes[i] = TEXTOID;
-		argValues[i] = CStringGetTextDatum(return_message);
-		i++;
-
-		appendStringInfo(&querybuf, " return_message = $%d,", i);
+		deferredRun->jobPid = *jobPid;
+		deferredRun->hasJobPid = true;
 	}
 
-        if (start_time != NULL)
+	if (returnMessage != NULL)
 	{
-		argTypes[i] = TIMESTAMPTZOID;
-		argValues[i] = TimestampTzGetDatum(*start_time);
-		i++;
+		if (deferredRun->returnMessage != NULL)
+		{
+			pfree(deferredRun->returnMessage);
+		}
 
-		appendStringInfo(&querybuf, " start_time = $%d,", i);
+		deferredRun->returnMessage = MemoryContextStrdup(DeferredRunsContext,
+														 returnMessage);
 	}
 
-        if (end_time != NULL)
+	if (startTime != NULL)
 	{
-		argTypes[i] = TIMESTAMPTZOID;
-		argValues[i] = TimestampTzGetDatum(*end_time);
-		i++;
+		deferredRun->startTime = *startTime;
+		deferredRun->hasStartTime = true;
+	}
 
-		appendStringInfo(&querybuf, " end_time = $%d,", i);
+	if (endTime != NULL)
+	{
+		deferredRun->endTime = *endTime;
+		deferredRun->hasEndTime = true;
 	}
+}
 
-	argTypes[i] = INT8OID;
-	argValues[i] = Int64GetDatum(runId);
-	i++;
 
-	/* remove the last comma */
-	querybuf.len--;
-	querybuf.data[querybuf.len] = '\0';
+/*
+ * FinishDeferredJobRunDetail is called when a run is done. If the run is
+ * only written when it fails, it is counted in the rollups of its job and
+ * written to cron.job_run_details if it did not succeed.
+ */
+void
+FinishDeferredJobRunDetail(int64 runId)
+{
+	DeferredRunDetail deferredRun;
+	DeferredRunDetail *deferredRunEntry = NULL;
+	char *succeededStatus = GetCronStatus(CRON_STATUS_SUCCEEDED);
+	bool failed = false;
+
+	if (DeferredRuns == NULL)
+	{
+		return;
+	}
+
+	deferredRunEntry = hash_search(DeferredRuns, &runId, HASH_FIND, NULL);
+	if (deferredRunEntry == NULL)
+	{
+		return;
+	}
+
+	/* later changes to the run are written as usual */
+	deferredRun = *deferredRunEntry;
+	hash_search(DeferredRuns, &runId, HASH_REMOVE, NULL);
+
+	failed = deferredRun.status == NULL ||
+			 strcmp(deferredRun.status, succeededStatus) != 0;
+
+	if (deferredRun.rollup)
+	{
+		AddJobRunRollup(deferredRun.jobId, failed,
+						deferredRun.hasStartTime ? deferredRun.startTime : 0,
+						deferredRun.hasEndTime ? deferredRun.endTime :
+						GetCurrentTimestamp());
+	}
+
+	if (failed)
+	{
+		char *status = deferredRun.status != NULL ? deferredRun.status :
+					   GetCronStatus(CRON_STATUS_FAILED);
+
+		if (!SendRunInsertEvent(runId, deferredRun.jobId, deferredRun.database,
+								deferredRun.username, deferredRun.command,
+								GetCronStatus(CRON_STATUS_STARTING)))
+		{
+			WriteJobRunDetailInsert(runId, &deferredRun.jobId, deferredRun.database,
+									deferredRun.username, deferredRun.command,
+									GetCronStatus(CRON_STATUS_STARTING));
+		}
+
+		UpdateJobRunDetail(runId,
+						   deferredRun.hasJobPid ? &deferredRun.jobPid : NULL,
+						   status, deferredRun.returnMessage,
+						   deferredRun.hasStartTime ? &deferredRun.startTime : NULL,
+						   deferredRun.hasEndTime ? &deferredRun.endTime : NULL);
+	}
+
+	pfree(deferredRun.database);
+	pfree(deferredRun.username);
+	pfree(deferredRun.command);
+
+	if (deferredRun.status != NULL)
+	{
+		pfree(deferredRun.status);
+	}
+
+	if (deferredRun.returnMessage != NULL)
+	{
+		pfree(deferredRun.returnMessage);
+	}
+}
+
+
+/*
+ * AddJobRunRollup counts a run that is done in the rollup of its job for
+ * the minute in which it finished.
+ */
+static void
+AddJobRunRollup(int64 jobId, bool failed, TimestampTz startTime,
+				TimestampTz endTime)
+{
+	JobRunRollupKey rollupKey;
+	JobRunRollup *rollup = NULL;
+	bool isPresent = false;
+
+	if (JobRunRollups == NULL)
+	{
+		HASHCTL info;
+		int hashFlags = 0;
+
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(JobRunRollupKey);
+		info.entrysize = sizeof(JobRunRollup);
+		info.hash = tag_hash;
+		info.hcxt = DeferredRunsContext;
+		hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+
+		JobRunRollups = hash_create("pg_cron run rollups", 32, &info, hashFlags);
+	}
+
+	memset(&rollupKey, 0, sizeof(rollupKey));
+	rollupKey.jobId = jobId;
+	rollupKey.period = endTime - endTime % USECS_PER_MINUTE;
+
+	rollup = hash_search(JobRunRollups, &rollupKey, HASH_ENTER, &isPresent);
+	if (!isPresent)
+	{
+		rollup->succeeded = 0;
+		rollup->failed = 0;
+		rollup->totalDuration = 0;
+	}
+
+	if (failed)
+	{
+		rollup->failed++;
+	}
+	else
+	{
+		rollup->succeeded++;
+	}
+
+	if (startTime != 0 && endTime > startTime)
+	{
+		rollup->totalDuration += endTime - startTime;
+	}
+}
+
+
+/*
+ * FlushJobRunRollupsIfDue adds the counts of runs that finished in minutes
+ * before the current one to cron.job_run_rollups.
+ */
+void
+FlushJobRunRollupsIfDue(TimestampTz currentTime)
+{
+	TimestampTz currentPeriod = currentTime - currentTime % USECS_PER_MINUTE;
+	MemoryContext originalContext = CurrentMemoryContext;
+	HASH_SEQ_STATUS status;
+	JobRunRollup *rollup = NULL;
+	Datum *jobIds = NULL;
+	Datum *periods = NULL;
+	Datum *succeededCounts = NULL;
+	Datum *failedCounts = NULL;
+	Datum *totalDurations = NULL;
+	int rollupCount = 0;
+	int rollupIndex = 0;
+	Oid rollupsRelationId = InvalidOid;
+	StringInfoData querybuf;
+	Oid argTypes[5];
+	Datum argValues[5];
+
+	if (JobRunRollups == NULL || hash_get_num_entries(JobRunRollups) == 0)
+	{
+		return;
+	}
+
+	hash_seq_init(&status, JobRunRollups);
+	while ((rollup = hash_seq_search(&status)) != NULL)
+	{
+		if (rollup->key.period < currentPeriod)
+		{
+			rollupCount++;
+		}
+	}
+
+	if (rollupCount == 0)
+	{
+		return;
+	}
+
+	jobIds = palloc(rollupCount * sizeof(Datum));
+	periods = palloc(rollupCount * sizeof(Datum));
+	succeededCounts = palloc(rollupCount * sizeof(Datum));
+	failedCounts = palloc(rollupCount * sizeof(Datum));
+	totalDurations = palloc(rollupCount * sizeof(Datum));
+
+	/* take the finished minutes out of the hash */
+	hash_seq_init(&status, JobRunRollups);
+	while ((rollup = hash_seq_search(&status)) != NULL)
+	{
+		if (rollup->key.period >= currentPeriod)
+		{
+			continue;
+		}
+
+		jobIds[rollupIndex] = Int64GetDatum(rollup->key.jobId);
+		periods[rollupIndex] = TimestampTzGetDatum(rollup->key.period);
+		succeededCounts[rollupIndex] = Int64GetDatum(rollup->succeeded);
+		failedCounts[rollupIndex] = Int64GetDatum(rollup->failed);
+		totalDurations[rollupIndex] = MicrosecondsGetIntervalDatum(rollup->totalDuration);
+		rollupIndex++;
+
+		hash_search(JobRunRollups, &rollup->key, HASH_REMOVE, NULL);
+	}
+
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	if (PgCronHasBeenLoaded() && !RecoveryInProgress())
+	{
+		Oid cronSchemaId = get_namespace_oid(CRON_SCHEMA_NAME, false);
+
+		rollupsRelationId = get_relname_relid(JOB_RUN_ROLLUPS_TABLE_NAME,
+											  cronSchemaId);
+	}
+
+	if (rollupsRelationId == InvalidOid)
+	{
+		PopActiveSnapshot();
+		CommitTransactionCommand();
+		MemoryContextSwitchTo(originalContext);
+		return;
+	}
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "SPI_connect failed");
+
+	argTypes[0] = get_array_type(INT8OID);
+	argValues[0] = BuildRunDetailArray(jobIds, NULL, rollupCount, INT8OID);
+	argTypes[1] = get_array_type(TIMESTAMPTZOID);
+	argValues[1] = BuildRunDetailArray(periods, NULL, rollupCount, TIMESTAMPTZOID);
+	argTypes[2] = get_array_type(INT8OID);
+	argValues[2] = BuildRunDetailArray(succeededCounts, NULL, rollupCount, INT8OID);
+	argTypes[3] = get_array_type(INT8OID);
+	argValues[3] = BuildRunDetailArray(failedCounts, NULL, rollupCount, INT8OID);
+	argTypes[4] = get_array_type(INTERVALOID);
+	argValues[4] = BuildRunDetailArray(totalDurations, NULL, rollupCount, INTERVALOID);
+
+	/* runs that finished in the same minute may be written in two flushes */
+	initStringInfo(&querybuf);
+	appendStringInfo(&querybuf,
+					 "insert into %s.%s as r (jobid, period, succeeded, failed, total_duration) "
+					 "select * from pg_catalog.unnest($1, $2, $3, $4, $5) "
+					 "on conflict (jobid, period) do update set "
+					 "succeeded = r.succeeded operator(pg_catalog.+) excluded.succeeded, "
+					 "failed = r.failed operator(pg_catalog.+) excluded.failed, "
+					 "total_duration = r.total_duration operator(pg_catalog.+) excluded.total_duration",
+					 CRON_SCHEMA_NAME, JOB_RUN_ROLLUPS_TABLE_NAME);
+
+	if (SPI_execute_with_args(querybuf.data, 5, argTypes, argValues, NULL,
+							  false, 0) != SPI_OK_INSERT)
+		elog(ERROR, "SPI_exec failed: %s", querybuf.data);
+
+	pfree(querybuf.data);
+
+	SPI_finish();
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+	MemoryContextSwitchTo(originalContext);
+}
+
+
+/*
+ * ParseLogMode returns the log mode with the given name. Unknown names
+ * give an error if reportError is true, and are treated as 'all' otherwise.
+ */
+static CronLogMode
+ParseLogMode(char *logModeString, bool reportError)
+{
+	if (strcmp(logModeString, "all") == 0)
+	{
+		return CRON_LOG_MODE_ALL;
+	}
+	else if (strcmp(logModeString, "failures") == 0)
+	{
+		return CRON_LOG_MODE_FAILURES;
+	}
+	else if (strcmp(logModeString, "sample") == 0)
+	{
+		return CRON_LOG_MODE_SAMPLE;
+	}
+	else if (strcmp(logModeString, "rollup") == 0)
+	{
+		return CRON_LOG_MODE_ROLLUP;
+	}
+
+	if (reportError)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("invalid log mode: %s", logModeString),
+						errhint("Valid log modes are all, failures, sample and rollup.")));
+	}
+
+	return CRON_LOG_MODE_ALL;
+}
+
+
+/*
+ * UpdateJobRunDetail records a change in the state of a run. States between
+ * start and finish are only kept in shared memory, other changes are written
+ * to cron.job_run_details through the run logger if there is one.
+ */
+void
+UpdateJobRunDetail(int64 runId, int32 *job_pid, char *status, char *return_message, TimestampTz *start_time,
+                                                                        TimestampTz *end_time)
+{
+	CronStatus transientStatus = CRON_STATUS_STARTING;
+	int32 progressPid = 0;
+	TimestampTz progressStartTime = 0;
+	CronRunLatency progressLatency;
+	CronRunLatency *latency = NULL;
+
+	if (DeferredRuns != NULL)
+	{
+		DeferredRunDetail *deferredRun = hash_search(DeferredRuns, &runId,
+													 HASH_FIND, NULL);
+
+		if (deferredRun != NULL)
+		{
+			UpdateDeferredRunDetail(deferredRun, job_pid, status, return_message,
+									start_time, end_time);
+			return;
+		}
+	}
+
+	if (IsTransientRunStatus(status, &transientStatus))
+	{
+		/* states between start and finish only show in cron.job_run_progress */
+		if (SetRunProgress(runId, transientStatus, job_pid, start_time))
+		{
+			return;
+		}
+	}
+	else if (status != NULL &&
+			 GetRunProgress(runId, &progressPid, &progressStartTime,
+							&progressLatency))
+	{
+		/* write the PID, start time and latency along with the final state */
+		if (job_pid == NULL && progressPid != 0)
+		{
+			job_pid = &progressPid;
+		}
+
+		if (start_time == NULL && progressStartTime != 0)
+		{
+			start_time = &progressStartTime;
+		}
+
+		if (progressLatency.scheduledTime != 0)
+		{
+			latency = &progressLatency;
+		}
+	}
+
+	if (SendRunUpdateEvent(runId, job_pid, status, return_message, start_time,
+						   end_time, latency))
+	{
+		return;
+	}
+
+	WriteJobRunDetailUpdate(runId, job_pid, status, return_message, start_time,
+							end_time, latency);
+}
+
+
+/*
+ * WriteJobRunDetailUpdate changes a run in cron.job_run_details, or in the
+ * buffer of changes that are written together. Fields that are NULL keep
+ * their current value.
+ */
+void
+WriteJobRunDetailUpdate(int64 runId, int32 *job_pid, char *status,
+						char *return_message, TimestampTz *start_time,
+						TimestampTz *end_time, CronRunLatency *latency)
+{
+	StringInfoData querybuf;
+	Oid argTypes[10];
+	Datum argValues[10];
+	int i;
+	int columnMask = 0;
+	SPIPlanPtr plan = NULL;
+	MemoryContext originalContext = CurrentMemoryContext;
+
+	if (CronLogRunBatchSize > 0)
+	{
+		JobRunDetailEvent *event = NULL;
+
+		if (runId == 0)
+		{
+			return;
+		}
+
+		/* merge the change into the buffered insert or update of the run */
+		event = BufferJobRunDetail(runId);
+
+		if (job_pid != NULL)
+		{
+			event->jobPid = *job_pid;
+			event->hasJobPid = true;
+		}
+
+		if (status != NULL)
+		{
+			event->status = MemoryContextStrdup(JobRunDetailsBufferContext, status);
+		}
+
+		if (return_message != NULL)
+		{
+			event->returnMessage = MemoryContextStrdup(JobRunDetailsBufferContext,
+													   return_message);
+		}
+
+		if (start_time != NULL)
+		{
+			event->startTime = *start_time;
+			event->hasStartTime = true;
+		}
+
+		if (end_time != NULL)
+		{
+			event->endTime = *end_time;
+			event->hasEndTime = true;
+		}
+
+		if (latency != NULL)
+		{
+			event->latency = *latency;
+			event->hasLatency = true;
+		}
+
+		FlushJobRunDetailsIfFull();
+		return;
+	}
+
+	/* write buffered changes first, in case the batch size was just changed */
+	FlushJobRunDetails();
+
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	if (!PgCronHasBeenLoaded() || RecoveryInProgress() || !JobRunDetailsTableExists())
+	{
+		PopActiveSnapshot();
+		CommitTransactionCommand();
+		MemoryContextSwitchTo(originalContext);
+		return;
+	}
+
+	/* Open SPI context. */
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "SPI_connect failed");
+
+	if (!JobRunDetailsHaveLatency())
+	{
+		latency = NULL;
+	}
+
+	/*
+	 * Add the fields to be updated. Each combination of fields has its own
+	 * prepared statement, identified by a bit per field.
+	 */
+	i = 0;
+
+	if (job_pid != NULL)
+	{
+		argTypes[i] = INT4OID;
+		argValues[i] = Int32GetDatum(*job_pid);
+		i++;
+		columnMask |= 1 << 0;
+	}
+
+	if (status != NULL)
+	{
+		argTypes[i] = TEXTOID;
+		argValues[i] = CStringGetTextDatum(status);
+		i++;
+		columnMask |= 1 << 1;
+	}
+
+	if (return_message != NULL)
+	{
+		argTypes[i] = TEXTOID;
+		argValues[i] = CStringGetTextDatum(return_message);
+		i++;
+		columnMask |= 1 << 2;
+	}
+
+	if (start_time != NULL)
+	{
+		argTypes[i] = TIMESTAMPTZOID;
+		argValues[i] = TimestampTzGetDatum(*start_time);
+		i++;
+		columnMask |= 1 << 3;
+	}
+
+	if (end_time != NULL)
+	{
+		argTypes[i] = TIMESTAMPTZOID;
+		argValues[i] = TimestampTzGetDatum(*end_time);
+		i++;
+		columnMask |= 1 << 4;
+	}
+
+	/* the latency columns are always set together */
+	if (latency != NULL)
+	{
+		argTypes[i] = TIMESTAMPTZOID;
+		argValues[i] = TimestampTzGetDatum(latency->scheduledTime);
+		i++;
+		argTypes[i] = INTERVALOID;
+		argValues[i] = MicrosecondsGetIntervalDatum(latency->queueWait);
+		i++;
+		argTypes[i] = INTERVALOID;
+		argValues[i] = MicrosecondsGetIntervalDatum(latency->startupTime);
+		i++;
+		argTypes[i] = INTERVALOID;
+		argValues[i] = MicrosecondsGetIntervalDatum(latency->sendTime);
+		i++;
+		columnMask |= 1 << 5;
+	}
+
+	argTypes[i] = INT8OID;
+	argValues[i] = Int64GetDatum(runId);
+	i++;
+
+	if (columnMask == 0)
+	{
+		/* nothing to update */
+		SPI_finish();
+		PopActiveSnapshot();
+		CommitTransactionCommand();
+		MemoryContextSwitchTo(originalContext);
+		return;
+	}
+
+	plan = CachedRunDetailPlan(RUN_DETAIL_UPDATE_PLAN + columnMask);
+	if (plan == NULL)
+	{
+		const char *columnNames[] = {
+			"job_pid", "status", "return_message", "start_time", "end_time"
+		};
+		const char *latencyColumnNames[] = {
+			"scheduled_time", "queue_wait", "startup_time", "send_time"
+		};
+		int columnIndex = 0;
+		int paramIndex = 0;
+
+		initStringInfo(&querybuf);
+		appendStringInfo(&querybuf,
+			"update %s.%s set", CRON_SCHEMA_NAME, JOB_RUN_DETAILS_TABLE_NAME);
+
+		for (columnIndex = 0; columnIndex < lengthof(columnNames); columnIndex++)
+		{
+			if ((columnMask & (1 << columnIndex)) != 0)
+			{
+				paramIndex++;
+				appendStringInfo(&querybuf, "%s %s = $%d",
+								 paramIndex > 1 ? "," : "",
+								 columnNames[columnIndex], paramIndex);
+			}
+		}
+
+		if ((columnMask & (1 << 5)) != 0)
+		{
+			for (columnIndex = 0; columnIndex < lengthof(latencyColumnNames);
+				 columnIndex++)
+			{
+				paramIndex++;
+				appendStringInfo(&querybuf, "%s %s = $%d",
+								 paramIndex > 1 ? "," : "",
+								 latencyColumnNames[columnIndex], paramIndex);
+			}
+		}
+
+		/* and add the where clause */
+		appendStringInfo(&querybuf, " where runid = $%d", i);
+
+		plan = KeepRunDetailPlan(RUN_DETAIL_UPDATE_PLAN + columnMask,
+								 querybuf.data, i, argTypes);
+
+		pfree(querybuf.data);
+	}
+
+	if (SPI_execute_plan(plan, argValues, NULL, false, 1) != SPI_OK_UPDATE)
+		elog(ERROR, "could not update %s.%s",
+			 CRON_SCHEMA_NAME, JOB_RUN_DETAILS_TABLE_NAME);
+
+	SPI_finish();
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+	MemoryContextSwitchTo(originalContext);
+}
+
+
+/*
+ * IsTransientRunStatus returns whether the given status is one that a run
+ * passes through between starting and finishing, and sets cronStatus to it.
+ */
+static bool
+IsTransientRunStatus(char *status, CronStatus *cronStatus)
+{
+	CronStatus transientStatuses[] = {
+		CRON_STATUS_CONNECTING,
+		CRON_STATUS_SENDING,
+		CRON_STATUS_RUNNING
+	};
+	int statusIndex = 0;
+
+	if (status == NULL)
+	{
+		return false;
+	}
+
+	for (statusIndex = 0; statusIndex < lengthof(transientStatuses); statusIndex++)
+	{
+		if (strcmp(status, GetCronStatus(transientStatuses[statusIndex])) == 0)
+		{
+			*cronStatus = transientStatuses[statusIndex];
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * BufferJobRunDetail returns the buffered change to the cron.job_run_details
+ * row of the given run, creating it if needed.
+ */
+static JobRunDetailEvent *
+BufferJobRunDetail(int64 runId)
+{
+	JobRunDetailEvent *event = NULL;
+	bool isPresent = false;
+
+	if (JobRunDetailsBufferContext == NULL)
+	{
+		JobRunDetailsBufferContext = AllocSetContextCreate(TopMemoryContext,
+														   "pg_cron run details buffer",
+														   ALLOCSET_DEFAULT_MINSIZE,
+														   ALLOCSET_DEFAULT_INITSIZE,
+														   ALLOCSET_DEFAULT_MAXSIZE);
+	}
+
+	if (JobRunDetailsBuffer == NULL)
+	{
+		HASHCTL info;
+		int hashFlags = 0;
+
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(int64);
+		info.entrysize = sizeof(JobRunDetailEvent);
+		info.hash = tag_hash;
+		info.hcxt = JobRunDetailsBufferContext;
+		hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+
+		JobRunDetailsBuffer = hash_create("pg_cron run details buffer", 32,
+										  &info, hashFlags);
+	}
+
+	event = hash_search(JobRunDetailsBuffer, &runId, HASH_ENTER, &isPresent);
+	if (!isPresent)
+	{
+		memset(event, 0, sizeof(JobRunDetailEvent));
+		event->runId = runId;
+
+		if (FirstBufferedEventTime == 0)
+		{
+			FirstBufferedEventTime = GetCurrentTimestamp();
+		}
+	}
+
+	return event;
+}
+
+
+/*
+ * FlushJobRunDetailsIfFull writes the buffered changes once there are
+ * cron.log_run_batch_size of them.
+ */
+static void
+FlushJobRunDetailsIfFull(void)
+{
+	if (JobRunDetailsBuffer != NULL &&
+		hash_get_num_entries(JobRunDetailsBuffer) >= CronLogRunBatchSize)
+	{
+		FlushJobRunDetails();
+	}
+}
+
+
+/*
+ * JobRunDetailsFlushTime returns the time at which the buffered changes to
+ * cron.job_run_details should be written, or 0 if there are none.
+ */
+TimestampTz
+JobRunDetailsFlushTime(void)
+{
+	if (FirstBufferedEventTime == 0)
+	{
+		return 0;
+	}
+
+	return TimestampTzPlusMilliseconds(FirstBufferedEventTime,
+									   CronLogRunFlushInterval);
+}
+
+
+/*
+ * FlushJobRunDetailsIfDue writes the buffered changes to
+ * cron.job_run_details if they have been kept for cron.log_run_flush_interval.
+ */
+void
+FlushJobRunDetailsIfDue(TimestampTz currentTime)
+{
+	TimestampTz flushTime = JobRunDetailsFlushTime();
+
+	if (flushTime != 0 && TimestampDifferenceExceeds(flushTime, currentTime, 0))
+	{
+		FlushJobRunDetails();
+	}
+}
+
+
+/*
+ * FlushJobRunDetails writes all buffered changes to cron.job_run_details in
+ * a single transaction, using one insert for new runs and one update for
+ * runs that were inserted before.
+ */
+void
+FlushJobRunDetails(void)
+{
+	HASH_SEQ_STATUS status;
+	JobRunDetailEvent *event = NULL;
+	int eventCount = 0;
+	int insertCount = 0;
+	int updateCount = 0;
+	MemoryContext originalContext = CurrentMemoryContext;
+
+	/* columns of the inserted rows */
+	Datum *insertJobIds = NULL;
+	Datum *insertRunIds = NULL;
+	Datum *insertJobPids = NULL;
+	bool *insertJobPidNulls = NULL;
+	Datum *insertDatabases = NULL;
+	Datum *insertUsernames = NULL;
+	Datum *insertCommands = NULL;
+	Datum *insertStatuses = NULL;
+	bool *insertStatusNulls = NULL;
+	Datum *insertMessages = NULL;
+	bool *insertMessageNulls = NULL;
+	Datum *insertStartTimes = NULL;
+	bool *insertStartTimeNulls = NULL;
+	Datum *insertEndTimes = NULL;
+	bool *insertEndTimeNulls = NULL;
+	Datum *insertScheduledTimes = NULL;
+	Datum *insertQueueWaits = NULL;
+	Datum *insertStartupTimes = NULL;
+	Datum *insertSendTimes = NULL;
+	bool *insertLatencyNulls = NULL;
+
+	/* columns of the updated rows, NULL keeps the current value */
+	Datum *updateRunIds = NULL;
+	Datum *updateJobPids = NULL;
+	bool *updateJobPidNulls = NULL;
+	Datum *updateStatuses = NULL;
+	bool *updateStatusNulls = NULL;
+	Datum *updateMessages = NULL;
+	bool *updateMessageNulls = NULL;
+	Datum *updateStartTimes = NULL;
+	bool *updateStartTimeNulls = NULL;
+	Datum *updateEndTimes = NULL;
+	bool *updateEndTimeNulls = NULL;
+	Datum *updateScheduledTimes = NULL;
+	Datum *updateQueueWaits = NULL;
+	Datum *updateStartupTimes = NULL;
+	Datum *updateSendTimes = NULL;
+	bool *updateLatencyNulls = NULL;
+
+	if (JobRunDetailsBuffer == NULL)
+	{
+		return;
+	}
+
+	eventCount = hash_get_num_entries(JobRunDetailsBuffer);
+	if (eventCount == 0)
+	{
+		ResetJobRunDetailsBuffer();
+		return;
+	}
+
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	if (!PgCronHasBeenLoaded() || RecoveryInProgress() || !JobRunDetailsTableExists())
+	{
+		PopActiveSnapshot();
+		CommitTransactionCommand();
+		MemoryContextSwitchTo(originalContext);
+
+		ResetJobRunDetailsBuffer();
+		return;
+	}
+
+	if (!CronLogRunSynchronousCommit)
+	{
+		/* losing the last changes in a crash is fine, revert at commit */
+		(void) set_config_option("synchronous_commit", "off",
+								 PGC_SUSET, PGC_S_SESSION,
+								 GUC_ACTION_LOCAL, true, 0, false);
+	}
+
+	/* Open SPI context. */
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "SPI_connect failed");
+
+	insertJobIds = palloc0(eventCount * sizeof(Datum));
+	insertRunIds = palloc0(eventCount * sizeof(Datum));
+	insertJobPids = palloc0(eventCount * sizeof(Datum));
+	insertJobPidNulls = palloc0(eventCount * sizeof(bool));
+	insertDatabases = palloc0(eventCount * sizeof(Datum));
+	insertUsernames = palloc0(eventCount * sizeof(Datum));
+	insertCommands = palloc0(eventCount * sizeof(Datum));
+	insertStatuses = palloc0(eventCount * sizeof(Datum));
+	insertStatusNulls = palloc0(eventCount * sizeof(bool));
+	insertMessages = palloc0(eventCount * sizeof(Datum));
+	insertMessageNulls = palloc0(eventCount * sizeof(bool));
+	insertStartTimes = palloc0(eventCount * sizeof(Datum));
+	insertStartTimeNulls = palloc0(eventCount * sizeof(bool));
+	insertEndTimes = palloc0(eventCount * sizeof(Datum));
+	insertEndTimeNulls = palloc0(eventCount * sizeof(bool));
+	insertScheduledTimes = palloc0(eventCount * sizeof(Datum));
+	insertQueueWaits = palloc0(eventCount * sizeof(Datum));
+	insertStartupTimes = palloc0(eventCount * sizeof(Datum));
+	insertSendTimes = palloc0(eventCount * sizeof(Datum));
+	insertLatencyNulls = palloc0(eventCount * sizeof(bool));
+
+	updateRunIds = palloc0(eventCount * sizeof(Datum));
+	updateJobPids = palloc0(eventCount * sizeof(Datum));
+	updateJobPidNulls = palloc0(eventCount * sizeof(bool));
+	updateStatuses = palloc0(eventCount * sizeof(Datum));
+	updateStatusNulls = palloc0(eventCount * sizeof(bool));
+	updateMessages = palloc0(eventCount * sizeof(Datum));
+	updateMessageNulls = palloc0(eventCount * sizeof(bool));
+	updateStartTimes = palloc0(eventCount * sizeof(Datum));
+	updateStartTimeNulls = palloc0(eventCount * sizeof(bool));
+	updateEndTimes = palloc0(eventCount * sizeof(Datum));
+	updateEndTimeNulls = palloc0(eventCount * sizeof(bool));
+	updateScheduledTimes = palloc0(eventCount * sizeof(Datum));
+	updateQueueWaits = palloc0(eventCount * sizeof(Datum));
+	updateStartupTimes = palloc0(eventCount * sizeof(Datum));
+	updateSendTimes = palloc0(eventCount * sizeof(Datum));
+	updateLatencyNulls = palloc0(eventCount * sizeof(bool));
+
+	hash_seq_init(&status, JobRunDetailsBuffer);
+
+	while ((event = hash_seq_search(&status)) != NULL)
+	{
+		if (event->isInsert)
+		{
+			int i = insertCount++;
+
+			insertJobIds[i] = Int64GetDatum(event->jobId);
+			insertRunIds[i] = Int64GetDatum(event->runId);
+			insertJobPids[i] = Int32GetDatum(event->jobPid);
+			insertJobPidNulls[i] = !event->hasJobPid;
+			insertDatabases[i] = CStringGetTextDatum(event->database);
+			insertUsernames[i] = CStringGetTextDatum(event->username);
+			insertCommands[i] = CStringGetTextDatum(event->command);
+			insertStatusNulls[i] = event->status == NULL;
+			if (event->status != NULL)
+				insertStatuses[i] = CStringGetTextDatum(event->status);
+			insertMessageNulls[i] = event->returnMessage == NULL;
+			if (event->returnMessage != NULL)
+				insertMessages[i] = CStringGetTextDatum(event->returnMessage);
+			insertStartTimes[i] = TimestampTzGetDatum(event->startTime);
+			insertStartTimeNulls[i] = !event->hasStartTime;
+			insertEndTimes[i] = TimestampTzGetDatum(event->endTime);
+			insertEndTimeNulls[i] = !event->hasEndTime;
+			insertLatencyNulls[i] = !event->hasLatency;
+			if (event->hasLatency)
+			{
+				insertScheduledTimes[i] =
+					TimestampTzGetDatum(event->latency.scheduledTime);
+				insertQueueWaits[i] =
+					MicrosecondsGetIntervalDatum(event->latency.queueWait);
+				insertStartupTimes[i] =
+					MicrosecondsGetIntervalDatum(event->latency.startupTime);
+				insertSendTimes[i] =
+					MicrosecondsGetIntervalDatum(event->latency.sendTime);
+			}
+		}
+		else
+		{
+			int i = updateCount++;
+
+			updateRunIds[i] = Int64GetDatum(event->runId);
+			updateJobPids[i] = Int32GetDatum(event->jobPid);
+			updateJobPidNulls[i] = !event->hasJobPid;
+			updateStatusNulls[i] = event->status == NULL;
+			if (event->status != NULL)
+				updateStatuses[i] = CStringGetTextDatum(event->status);
+			updateMessageNulls[i] = event->returnMessage == NULL;
+			if (event->returnMessage != NULL)
+				updateMessages[i] = CStringGetTextDatum(event->returnMessage);
+			updateStartTimes[i] = TimestampTzGetDatum(event->startTime);
+			updateStartTimeNulls[i] = !event->hasStartTime;
+			updateEndTimes[i] = TimestampTzGetDatum(event->endTime);
+			updateEndTimeNulls[i] = !event->hasEndTime;
+			updateLatencyNulls[i] = !event->hasLatency;
+			if (event->hasLatency)
+			{
+				updateScheduledTimes[i] =
+					TimestampTzGetDatum(event->latency.scheduledTime);
+				updateQueueWaits[i] =
+					MicrosecondsGetIntervalDatum(event->latency.queueWait);
+				updateStartupTimes[i] =
+					MicrosecondsGetIntervalDatum(event->latency.startupTime);
+				updateSendTimes[i] =
+					MicrosecondsGetIntervalDatum(event->latency.sendTime);
+			}
+		}
+	}
+
+	if (insertCount > 0)
+	{
+		Oid argTypes[14];
+		Datum argValues[14];
+		int argCount = JobRunDetailsHaveLatency() ? 14 : 10;
+		SPIPlanPtr plan = NULL;
+
+		argTypes[0] = get_array_type(INT8OID);
+		argValues[0] = BuildRunDetailArray(insertJobIds, NULL, insertCount, INT8OID);
+		argTypes[1] = get_array_type(INT8OID);
+		argValues[1] = BuildRunDetailArray(insertRunIds, NULL, insertCount, INT8OID);
+		argTypes[2] = get_array_type(INT4OID);
+		argValues[2] = BuildRunDetailArray(insertJobPids, insertJobPidNulls,
+										   insertCount, INT4OID);
+		argTypes[3] = get_array_type(TEXTOID);
+		argValues[3] = BuildRunDetailArray(insertDatabases, NULL, insertCount, TEXTOID);
+		argTypes[4] = get_array_type(TEXTOID);
+		argValues[4] = BuildRunDetailArray(insertUsernames, NULL, insertCount, TEXTOID);
+		argTypes[5] = get_array_type(TEXTOID);
+		argValues[5] = BuildRunDetailArray(insertCommands, NULL, insertCount, TEXTOID);
+		argTypes[6] = get_array_type(TEXTOID);
+		argValues[6] = BuildRunDetailArray(insertStatuses, insertStatusNulls,
+										   insertCount, TEXTOID);
+		argTypes[7] = get_array_type(TEXTOID);
+		argValues[7] = BuildRunDetailArray(insertMessages, insertMessageNulls,
+										   insertCount, TEXTOID);
+		argTypes[8] = get_array_type(TIMESTAMPTZOID);
+		argValues[8] = BuildRunDetailArray(insertStartTimes, insertStartTimeNulls,
+										   insertCount, TIMESTAMPTZOID);
+		argTypes[9] = get_array_type(TIMESTAMPTZOID);
+		argValues[9] = BuildRunDetailArray(insertEndTimes, insertEndTimeNulls,
+										   insertCount, TIMESTAMPTZOID);
+		argTypes[10] = get_array_type(TIMESTAMPTZOID);
+		argValues[10] = BuildRunDetailArray(insertScheduledTimes, insertLatencyNulls,
+											insertCount, TIMESTAMPTZOID);
+		argTypes[11] = get_array_type(INTERVALOID);
+		argValues[11] = BuildRunDetailArray(insertQueueWaits, insertLatencyNulls,
+											insertCount, INTERVALOID);
+		argTypes[12] = get_array_type(INTERVALOID);
+		argValues[12] = BuildRunDetailArray(insertStartupTimes, insertLatencyNulls,
+											insertCount, INTERVALOID);
+		argTypes[13] = get_array_type(INTERVALOID);
+		argValues[13] = BuildRunDetailArray(insertSendTimes, insertLatencyNulls,
+											insertCount, INTERVALOID);
+
+		plan = CachedRunDetailPlan(RUN_DETAIL_FLUSH_INSERT_PLAN);
+		if (plan == NULL)
+		{
+			StringInfoData querybuf;
+
+			initStringInfo(&querybuf);
+
+			if (argCount == 14)
+			{
+				appendStringInfo(&querybuf,
+					"insert into %s.%s (jobid, runid, job_pid, database, username, "
+					"command, status, return_message, start_time, end_time, "
+					"scheduled_time, queue_wait, startup_time, send_time) "
+					"select * from pg_catalog.unnest($1, $2, $3, $4, $5, $6, $7, $8, "
+					"$9, $10, $11, $12, $13, $14)",
+					CRON_SCHEMA_NAME, JOB_RUN_DETAILS_TABLE_NAME);
+			}
+			else
+			{
+				appendStringInfo(&querybuf,
+					"insert into %s.%s (jobid, runid, job_pid, database, username, "
+					"command, status, return_message, start_time, end_time) "
+					"select * from pg_catalog.unnest($1, $2, $3, $4, $5, $6, $7, $8, "
+					"$9, $10)",
+					CRON_SCHEMA_NAME, JOB_RUN_DETAILS_TABLE_NAME);
+			}
+
+			plan = KeepRunDetailPlan(RUN_DETAIL_FLUSH_INSERT_PLAN, querybuf.data,
+									 argCount, argTypes);
+
+			pfree(querybuf.data);
+		}
+
+		if (SPI_execute_plan(plan, argValues, NULL, false, 0) != SPI_OK_INSERT)
+			elog(ERROR, "could not insert into %s.%s",
+				 CRON_SCHEMA_NAME, JOB_RUN_DETAILS_TABLE_NAME);
+	}
+
+	if (updateCount > 0)
+	{
+		Oid argTypes[10];
+		Datum argValues[10];
+		int argCount = JobRunDetailsHaveLatency() ? 10 : 6;
+		SPIPlanPtr plan = NULL;
+
+		argTypes[0] = get_array_type(INT8OID);
+		argValues[0] = BuildRunDetailArray(updateRunIds, NULL, updateCount, INT8OID);
+		argTypes[1] = get_array_type(INT4OID);
+		argValues[1] = BuildRunDetailArray(updateJobPids, updateJobPidNulls,
+										   updateCount, INT4OID);
+		argTypes[2] = get_array_type(TEXTOID);
+		argValues[2] = BuildRunDetailArray(updateStatuses, updateStatusNulls,
+										   updateCount, TEXTOID);
+		argTypes[3] = get_array_type(TEXTOID);
+		argValues[3] = BuildRunDetailArray(updateMessages, updateMessageNulls,
+										   updateCount, TEXTOID);
+		argTypes[4] = get_array_type(TIMESTAMPTZOID);
+		argValues[4] = BuildRunDetailArray(updateStartTimes, updateStartTimeNulls,
+										   updateCount, TIMESTAMPTZOID);
+		argTypes[5] = get_array_type(TIMESTAMPTZOID);
+		argValues[5] = BuildRunDetailArray(updateEndTimes, updateEndTimeNulls,
+										   updateCount, TIMESTAMPTZOID);
+		argTypes[6] = get_array_type(TIMESTAMPTZOID);
+		argValues[6] = BuildRunDetailArray(updateScheduledTimes, updateLatencyNulls,
+										   updateCount, TIMESTAMPTZOID);
+		argTypes[7] = get_array_type(INTERVALOID);
+		argValues[7] = BuildRunDetailArray(updateQueueWaits, updateLatencyNulls,
+										   updateCount, INTERVALOID);
+		argTypes[8] = get_array_type(INTERVALOID);
+		argValues[8] = BuildRunDetailArray(updateStartupTimes, updateLatencyNulls,
+										   updateCount, INTERVALOID);
+		argTypes[9] = get_array_type(INTERVALOID);
+		argValues[9] = BuildRunDetailArray(updateSendTimes, updateLatencyNulls,
+										   updateCount, INTERVALOID);
+
+		plan = CachedRunDetailPlan(RUN_DETAIL_FLUSH_UPDATE_PLAN);
+		if (plan == NULL)
+		{
+			StringInfoData querybuf;
+
+			initStringInfo(&querybuf);
+
+			if (argCount == 10)
+			{
+				appendStringInfo(&querybuf,
+					"update %s.%s d set "
+					"job_pid = coalesce(u.job_pid, d.job_pid), "
+					"status = coalesce(u.status, d.status), "
+					"return_message = coalesce(u.return_message, d.return_message), "
+					"start_time = coalesce(u.start_time, d.start_time), "
+					"end_time = coalesce(u.end_time, d.end_time), "
+					"scheduled_time = coalesce(u.scheduled_time, d.scheduled_time), "
+					"queue_wait = coalesce(u.queue_wait, d.queue_wait), "
+					"startup_time = coalesce(u.startup_time, d.startup_time), "
+					"send_time = coalesce(u.send_time, d.send_time) "
+					"from pg_catalog.unnest($1, $2, $3, $4, $5, $6, $7, $8, $9, $10) "
+					"u (runid, job_pid, status, return_message, start_time, end_time, "
+					"scheduled_time, queue_wait, startup_time, send_time) "
+					"where d.runid = u.runid",
+					CRON_SCHEMA_NAME, JOB_RUN_DETAILS_TABLE_NAME);
+			}
+			else
+			{
+				appendStringInfo(&querybuf,
+					"update %s.%s d set "
+					"job_pid = coalesce(u.job_pid, d.job_pid), "
+					"status = coalesce(u.status, d.status), "
+					"return_message = coalesce(u.return_message, d.return_message), "
+					"start_time = coalesce(u.start_time, d.start_time), "
+					"end_time = coalesce(u.end_time, d.end_time) "
+					"from pg_catalog.unnest($1, $2, $3, $4, $5, $6) "
+					"u (runid, job_pid, status, return_message, start_time, end_time) "
+					"where d.runid = u.runid",
+					CRON_SCHEMA_NAME, JOB_RUN_DETAILS_TABLE_NAME);
+			}
+
+			plan = KeepRunDetailPlan(RUN_DETAIL_FLUSH_UPDATE_PLAN, querybuf.data,
+									 argCount, argTypes);
+
+			pfree(querybuf.data);
+		}
+
+		if (SPI_execute_plan(plan, argValues, NULL, false, 0) != SPI_OK_UPDATE)
+			elog(ERROR, "could not update %s.%s",
+				 CRON_SCHEMA_NAME, JOB_RUN_DETAILS_TABLE_NAME);
+	}
+
+	SPI_finish();
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+	MemoryContextSwitchTo(originalContext);
+
+	ResetJobRunDetailsBuffer();
+}
+
+
+/*
+ * CachedRunDetailPlan returns the prepared statement with the given index for
+ * writing to cron.job_run_details, or NULL if it was not prepared yet. All
+ * statements are forgotten when the table is dropped and created again,
+ * e.g. when the extension is created again, or when the latency columns are
+ * added. Other changes to the table are handled by the plan cache.
+ */
+static SPIPlanPtr
+CachedRunDetailPlan(int planIndex)
+{
+	Oid relationId = JobRunDetailsRelationId();
+	bool haveLatency = JobRunDetailsHaveLatency();
+
+	Assert(planIndex >= 0 && planIndex < RUN_DETAIL_PLAN_COUNT);
+
+	if (relationId != RunDetailPlansRelationId ||
+		haveLatency != RunDetailPlansHaveLatency)
+	{
+		int otherIndex = 0;
+
+		for (otherIndex = 0; otherIndex < RUN_DETAIL_PLAN_COUNT; otherIndex++)
+		{
+			if (RunDetailPlans[otherIndex] != NULL)
+			{
+				SPI_freeplan(RunDetailPlans[otherIndex]);
+				RunDetailPlans[otherIndex] = NULL;
+			}
+		}
+
+		RunDetailPlansRelationId = relationId;
+		RunDetailPlansHaveLatency = haveLatency;
+	}
+
+	return RunDetailPlans[planIndex];
+}
+
+
+/*
+ * KeepRunDetailPlan prepares a statement for writing to cron.job_run_details
+ * and keeps it for later calls under the given index.
+ */
+static SPIPlanPtr
+KeepRunDetailPlan(int planIndex, char *query, int argCount, Oid *argTypes)
+{
+	SPIPlanPtr plan = SPI_prepare(query, argCount, argTypes);
+
+	if (plan == NULL)
+		elog(ERROR, "SPI_prepare failed: %s", query);
+
+	if (SPI_keepplan(plan) != 0)
+		elog(ERROR, "SPI_keepplan failed: %s", query);
+
+	RunDetailPlans[planIndex] = plan;
+
+	return plan;
+}
+
+
+/*
+ * MicrosecondsGetIntervalDatum returns an interval of the given number of
+ * microseconds.
+ */
+static Datum
+MicrosecondsGetIntervalDatum(int64 microseconds)
+{
+	Interval *interval = palloc0(sizeof(Interval));
+
+	interval->time = microseconds;
+
+	return IntervalPGetDatum(interval);
+}
+
+
+/*
+ * BuildRunDetailArray builds a one-dimensional array of the given element
+ * type from the values and NULL flags of a cron.job_run_details column.
+ */
+static Datum
+BuildRunDetailArray(Datum *values, bool *nulls, int count, Oid elementType)
+{
+	int dims[1];
+	int lbs[1];
+	int16 typeLength = 0;
+	bool typeByValue = false;
+	char typeAlignment = 0;
+
+	dims[0] = count;
+	lbs[0] = 1;
+
+	get_typlenbyvalalign(elementType, &typeLength, &typeByValue, &typeAlignment);
+
+	return PointerGetDatum(construct_md_array(values, nulls, 1, dims, lbs,
+											  elementType, typeLength,
+											  typeByValue, typeAlignment));
+}
+
+
+/*
+ * ResetJobRunDetailsBuffer forgets all buffered changes.
+ */
+static void
+ResetJobRunDetailsBuffer(void)
+{
+	JobRunDetailsBuffer = NULL;
+	FirstBufferedEventTime = 0;
+
+	if (JobRunDetailsBufferContext != NULL)
+	{
+		MemoryContextReset(JobRunDetailsBufferContext);
+	}
+}
+
+
+static void
+AlterJob(int64 jobId, text *scheduleText, text *commandText, text *databaseText, text *usernameText, bool *active,
+		 text *logModeText, int32 *logSampleRate)
+{
+	StringInfoData querybuf;
+	StringInfoData columnsbuf;
+	StringInfoData valuesbuf;
+	Oid argTypes[9];
+	Datum argValues[9];
+	int i;
+	Oid userId;
+	Oid userIdcheckacl;
+	Oid savedUserId;
+	int savedSecurityContext;
+	char *database_name;
+	char *schedule;
+	char *command;
+	char *username;
+	char *currentuser;
+	entry parsedSchedule;
+	int jobIdArgIndex = 0;
+	int64 unchangedJobId = 0;
+
+	userId = GetUserId();
+	userIdcheckacl = GetUserId();
+
+	currentuser = GetUserNameFromId(userId, false);
+	savedUserId = InvalidOid;
+	savedSecurityContext = 0;
+
+	if (!PgCronHasBeenLoaded() || RecoveryInProgress() || !JobTableExists())
+	{
+		return;
+	}
+
+	initStringInfo(&querybuf);
+	initStringInfo(&columnsbuf);
+	initStringInfo(&valuesbuf);
+	i = 0;
+
+	appendStringInfo(&querybuf,
+		"update %s.%s set", CRON_SCHEMA_NAME, JOBS_TABLE_NAME);
+
+	/* username has been provided */
+	if (usernameText != NULL)
+	{
+		if (!superuser())
+			elog(ERROR, "must be superuser to alter username");
+
+		username = text_to_cstring(usernameText);
+		userIdcheckacl = GetRoleOidIfCanLogin(username);
+	}
+	else
+	{
+		username = currentuser;
+	}
+
+	if (!EnableSuperuserJobs && superuser_arg(userIdcheckacl))
+	{
+		ereport(ERROR, (errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+						errmsg("cannot schedule jobs as superuser"),
+						errdetail("Scheduling jobs as superuser is disallowed when "
+								  "cron.enable_superuser_jobs is set to off.")));
+	}
+
+	/* add the fields to be updated */
+	/* database has been provided */
+	if (databaseText != NULL)
+	{
+		database_name = text_to_cstring(databaseText);
+		/* ensure the user that is used in the job can connect to the database */
+		EnsureCanConnect(userIdcheckacl, database_name);
+
+		argTypes[i] = TEXTOID;
+		argValues[i] = CStringGetTextDatum(database_name);
+		i++;
+		appendStringInfo(&querybuf, " database = $%d,", i);
+		appendStringInfoString(&columnsbuf, "database,");
+		appendStringInfo(&valuesbuf, "$%d,", i);
+	}
+
+	/* ensure schedule is valid */
+	if (scheduleText != NULL)
+	{
+		schedule = text_to_cstring(scheduleText);
+		if (!ParseSchedule(schedule, &parsedSchedule))
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					errmsg("invalid schedule: %s", schedule),
+					errhint("Use cron format (e.g. 5 4 * * *), or interval "
+							"format '[1-59] seconds'")));
+		}
+
+		argTypes[i] = TEXTOID;
+		argValues[i] = CStringGetTextDatum(schedule);
+		i++;
+		appendStringInfo(&querybuf, " schedule = $%d,", i);
+		appendStringInfoString(&columnsbuf, "schedule,");
+		appendStringInfo(&valuesbuf, "$%d,", i);
+	}
+
+	if (commandText != NULL)
+	{
+		argTypes[i] = TEXTOID;
+		command = text_to_cstring(commandText);
+		argValues[i] = CStringGetTextDatum(command);
+		i++;
+		appendStringInfo(&querybuf, " command = $%d,", i);
+		appendStringInfoString(&columnsbuf, "command,");
+		appendStringInfo(&valuesbuf, "$%d,", i);
+	}
+
+	if (usernameText != NULL)
+	{
+		argTypes[i] = TEXTOID;
+		argValues[i] = CStringGetTextDatum(username);
+		i++;
+		appendStringInfo(&querybuf, " username = $%d,", i);
+		appendStringInfoString(&columnsbuf, "username,");
+		appendStringInfo(&valuesbuf, "$%d,", i);
+	}
+
+	if (active != NULL)
+	{
+		argTypes[i] = BOOLOID;
+		argValues[i] = BoolGetDatum(*active);
+		i++;
+		appendStringInfo(&querybuf, " active = $%d,", i);
+		appendStringInfoString(&columnsbuf, "active,");
+		appendStringInfo(&valuesbuf, "$%d,", i);
+	}
+
+	if (logModeText != NULL)
+	{
+		argTypes[i] = TEXTOID;
+		argValues[i] = PointerGetDatum(logModeText);
+		i++;
+		appendStringInfo(&querybuf, " log_mode = $%d,", i);
+		appendStringInfoString(&columnsbuf, "log_mode,");
+		appendStringInfo(&valuesbuf, "$%d,", i);
+	}
+
+	if (logSampleRate != NULL)
+	{
+		argTypes[i] = INT4OID;
+		argValues[i] = Int32GetDatum(*logSampleRate);
+		i++;
+		appendStringInfo(&querybuf, " log_sample_rate = $%d,", i);
+		appendStringInfoString(&columnsbuf, "log_sample_rate,");
+		appendStringInfo(&valuesbuf, "$%d,", i);
+	}
+
+	/* remove the last comma */
+	querybuf.len--;
+	querybuf.data[querybuf.len] = '\0';
+
+	/* and add the where clause */
+	argTypes[i] = INT8OID;
+	argValues[i] = Int64GetDatum(jobId);
+	i++;
+	jobIdArgIndex = i;
+
+	appendStringInfo(&querybuf, " where jobid = $%d", i);
+
+	/* ensure the caller owns the row */
+	argTypes[i] = TEXTOID;
+	argValues[i] = CStringGetTextDatum(currentuser);
+	i++;
+
+	if (!superuser())
+		appendStringInfo(&querybuf, " and username = $%d", i);
+
+	if (i <= 2)
+		ereport(ERROR, (errmsg("no updates specified"),
+						errhint("You must specify at least one job attribute to change when calling alter_job")));
+
+	/* only update the job if that changes it, such that the cache stays valid */
+	columnsbuf.data[--columnsbuf.len] = '\0';
+	valuesbuf.data[--valuesbuf.len] = '\0';
+
+	appendStringInfo(&querybuf, " and (%s) is distinct from (%s)",
+					 columnsbuf.data, valuesbuf.data);
+
+	GetUserIdAndSecContext(&savedUserId, &savedSecurityContext);
+	SetUserIdAndSecContext(CronExtensionOwner(), SECURITY_LOCAL_USERID_CHANGE);
+
+	/* Open SPI context. */
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "SPI_connect failed");
+	if(SPI_execute_with_args(querybuf.data,
+		i, argTypes, argValues, NULL, false, 1) != SPI_OK_UPDATE)
+		elog(ERROR, "SPI_exec failed: %s", querybuf.data);
+
+	if (SPI_processed > 0)
+	{
+		pfree(querybuf.data);
+
+		SPI_finish();
+		SetUserIdAndSecContext(savedUserId, savedSecurityContext);
+		InvalidateJobCache();
+
+		return;
+	}
+
+	/* nothing was updated, check whether the job already had those values */
+	resetStringInfo(&querybuf);
+	appendStringInfo(&querybuf, "select jobid from %s.%s where jobid = $%d",
+					 CRON_SCHEMA_NAME, JOBS_TABLE_NAME, jobIdArgIndex);
+
+	if (!superuser())
+		appendStringInfo(&querybuf, " and username = $%d", i);
+
+	appendStringInfoString(&querybuf, " for update");
+
+	if (!JobIsUnchanged(querybuf.data, i, argTypes, argValues, &unchangedJobId))
+		elog(ERROR, "Job " INT64_FORMAT " does not exist or you don't own it", jobId);
+
+	pfree(querybuf.data);
+
+	SPI_finish();
+	SetUserIdAndSecContext(savedUserId, savedSecurityContext);
+
+	IncrementCronCounter(CRON_COUNTER_SKIPPED_NOOP_UPDATES, 1);
+}
+
+void
+MarkPendingRunsAsFailed(void)
+{
+	StringInfoData querybuf;
+	MemoryContext originalContext = CurrentMemoryContext;
+
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	if (!PgCronHasBeenLoaded() || RecoveryInProgress() || !JobRunDetailsTableExists())
+	{
+		PopActiveSnapshot();
+		CommitTransactionCommand();
+		MemoryContextSwitchTo(originalContext);
+		return;
+	}
+
+	initStringInfo(&querybuf);
+
+	/* Open SPI context. */
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "SPI_connect failed");
+
+
+	appendStringInfo(&querybuf,
+		"update %s.%s set status = '%s', return_message = 'server restarted' where status in ('%s','%s')"
+		, CRON_SCHEMA_NAME, JOB_RUN_DETAILS_TABLE_NAME, GetCronStatus(CRON_STATUS_FAILED), GetCronStatus(CRON_STATUS_STARTING), GetCronStatus(CRON_STATUS_RUNNING));
+
+
+	if (SPI_exec(querybuf.data, 0) != SPI_OK_UPDATE)
+		elog(ERROR, "SPI_exec failed: %s", querybuf.data);
+
+	pfree(querybuf.data);
+
+	SPI_finish();
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+	MemoryContextSwitchTo(originalContext);
+}
+
+
+/*
+ * PurgeJobRunDetailsIfDue removes a batch of runs that finished longer than
+ * cron.run_details_retention ago from cron.job_run_details, if the last
+ * batch was removed at least cron.run_details_purge_delay ago. When the
+ * table is partitioned, a purge round first drops a partition in which all
+ * runs expired, since that does not need to delete rows one by one.
+ */
+void
+PurgeJobRunDetailsIfDue(TimestampTz currentTime)
+{
+	MemoryContext originalContext = CurrentMemoryContext;
+	TimestampTz cutoffTime = 0;
+	Oid relationId = InvalidOid;
+	bool roundFinished = true;
+
+	if (CronRunDetailsRetention <= 0 || currentTime < NextRunDetailsPurgeTime)
+	{
+		return;
+	}
+
+	cutoffTime = currentTime -
+				 (TimestampTz) CronRunDetailsRetention * SECS_PER_MINUTE * USECS_PER_SEC;
+
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	if (!PgCronHasBeenLoaded() || RecoveryInProgress() || !JobRunDetailsTableExists())
+	{
+		PopActiveSnapshot();
+		CommitTransactionCommand();
+		MemoryContextSwitchTo(originalContext);
+
+		NextRunDetailsPurgeTime =
+			TimestampTzPlusMilliseconds(currentTime, RUN_DETAILS_PURGE_ROUND_INTERVAL);
+		return;
+	}
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "SPI_connect failed");
+
+	relationId = JobRunDetailsRelationId();
+
+	if (RunDetailsPurgePosition == 0 &&
+		get_rel_relkind(relationId) == RELKIND_PARTITIONED_TABLE &&
+		DropExpiredRunDetailsPartition(relationId, cutoffTime))
+	{
+		/* there may be more partitions to drop */
+		roundFinished = false;
+	}
+	else
+	{
+		roundFinished = DeleteExpiredRunDetails(cutoffTime);
+	}
+
+	SPI_finish();
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+	MemoryContextSwitchTo(originalContext);
+
+	NextRunDetailsPurgeTime =
+		TimestampTzPlusMilliseconds(currentTime,
+									roundFinished ? RUN_DETAILS_PURGE_ROUND_INTERVAL :
+									CronRunDetailsPurgeDelay);
+}
+
+
+/*
+ * DropExpiredRunDetailsPartition drops one partition of cron.job_run_details
+ * in which all runs finished before the cutoff time. Empty partitions and
+ * the partition with the latest run are kept, since new runs may go there.
+ * Only partitions whose range bound shows that they are old enough are
+ * read, such that we do not scan every partition on every purge round.
+ * Returns whether a partition was dropped. Gives up rather than waiting when
+ * a run is being written, such that the launcher never waits for the lock.
+ */
+static bool
+DropExpiredRunDetailsPartition(Oid relationId, TimestampTz cutoffTime)
+{
+	StringInfoData querybuf;
+	Oid argTypes[1];
+	Datum argValues[1];
+	Oid latestPartitionId = InvalidOid;
+	List *partitionIdList = NIL;
+	ListCell *partitionIdCell = NULL;
+
+	initStringInfo(&querybuf);
+	appendStringInfo(&querybuf,
+					 "select tableoid from %s.%s order by runid desc limit 1",
+					 CRON_SCHEMA_NAME, JOB_RUN_DETAILS_TABLE_NAME);
+
+	if (SPI_exec(querybuf.data, 1) != SPI_OK_SELECT)
+		elog(ERROR, "SPI_exec failed: %s", querybuf.data);
+
+	if (SPI_processed > 0)
+	{
+		bool isNull = false;
+
+		latestPartitionId = DatumGetObjectId(SPI_getbinval(SPI_tuptable->vals[0],
+														   SPI_tuptable->tupdesc,
+														   1, &isNull));
+	}
+
+	argTypes[0] = TIMESTAMPTZOID;
+	argValues[0] = TimestampTzGetDatum(cutoffTime);
+
+	partitionIdList = find_inheritance_children(relationId, NoLock);
+
+	foreach(partitionIdCell, partitionIdList)
+	{
+		Oid partitionId = lfirst_oid(partitionIdCell);
+		char *partitionName = NULL;
+		bool isNull = false;
+		bool expired = false;
+
+		if (partitionId == latestPartitionId ||
+			get_rel_relkind(partitionId) != RELKIND_RELATION ||
+			!PartitionBoundExpired(relationId, partitionId, cutoffTime))
+		{
+			continue;
+		}
+
+		partitionName = quote_qualified_identifier(get_namespace_name(get_rel_namespace(partitionId)),
+												   get_rel_name(partitionId));
+
+		resetStringInfo(&querybuf);
+		appendStringInfo(&querybuf,
+						 "select exists (select 1 from %s) and not exists ("
+						 "select 1 from %s where status in ('%s','%s','%s','%s') "
+						 "or coalesce(end_time, start_time) >= $1)",
+						 partitionName, partitionName,
+						 GetCronStatus(CRON_STATUS_STARTING),
+						 GetCronStatus(CRON_STATUS_CONNECTING),
+						 GetCronStatus(CRON_STATUS_SENDING),
+						 GetCronStatus(CRON_STATUS_RUNNING));
+
+		if (SPI_execute_with_args(querybuf.data, 1, argTypes, argValues, NULL,
+								  false, 1) != SPI_OK_SELECT)
+			elog(ERROR, "SPI_exec failed: %s", querybuf.data);
+
+		expired = DatumGetBool(SPI_getbinval(SPI_tuptable->vals[0],
+											 SPI_tuptable->tupdesc, 1, &isNull));
+		if (isNull || !expired)
+		{
+			continue;
+		}
+
+		if (!ConditionalLockRelationOid(relationId, AccessExclusiveLock) ||
+			!ConditionalLockRelationOid(partitionId, AccessExclusiveLock))
+		{
+			/* try again in the next round */
+			break;
+		}
+
+		resetStringInfo(&querybuf);
+		appendStringInfo(&querybuf, "drop table %s", partitionName);
+
+		if (SPI_exec(querybuf.data, 0) != SPI_OK_UTILITY)
+			elog(ERROR, "SPI_exec failed: %s", querybuf.data);
 
-	/* and add the where clause */
-	appendStringInfo(&querybuf, " where runid = $%d", i);
+		ereport(LOG, (errmsg("dropped partition %s of %s.%s, which only had "
+							 "expired runs", partitionName, CRON_SCHEMA_NAME,
+							 JOB_RUN_DETAILS_TABLE_NAME)));
 
-	if(SPI_execute_with_args(querybuf.data,
-		i, argTypes, argValues, NULL, false, 1) != SPI_OK_UPDATE)
-		elog(ERROR, "SPI_exec failed: %s", querybuf.data);
+		pfree(querybuf.data);
+		list_free(partitionIdList);
+
+		return true;
+	}
 
 	pfree(querybuf.data);
+	list_free(partitionIdList);
 
-	SPI_finish();
-	PopActiveSnapshot();
-	CommitTransactionCommand();
-	MemoryContextSwitchTo(originalContext);
+	return false;
 }
 
 
-static void
-AlterJob(int64 jobId, text *scheduleText, text *commandText, text *databaseText, text *usernameText, bool *active)
+/*
+ * PartitionBoundExpired returns whether the range bound of a partition of
+ * cron.job_run_details shows that its runs may all have expired. That is the
+ * case when the table is partitioned by a timestamp column and the upper
+ * bound is not after the cutoff time, or when it is partitioned by runid and
+ * the last run below the upper bound finished before the cutoff time. Other
+ * partitioning schemes are not dropped, their runs are deleted instead.
+ */
+static bool
+PartitionBoundExpired(Oid relationId, Oid partitionId, TimestampTz cutoffTime)
 {
-	StringInfoData querybuf;
-	Oid argTypes[7];
-	Datum argValues[7];
-	int i;
-	AclResult aclresult;
-	Oid userId;
-	Oid userIdcheckacl;
-	Oid savedUserId;
-	int savedSecurityContext;
-	char *database_name;
-	char *schedule;
-	char *command;
-	char *username;
-	char *currentuser;
-	entry *parsedSchedule = NULL;
-
-	userId = GetUserId();
-	userIdcheckacl = GetUserId();
-
-	currentuser = GetUserNameFromId(userId, false);
-	savedUserId = InvalidOid;
-	savedSecurityContext = 0;
+	HeapTuple heapTuple = NULL;
+	Form_pg_partitioned_table partitionedTable = NULL;
+	AttrNumber keyAttributeNumber = InvalidAttrNumber;
+	Datum boundDatum = 0;
+	bool isNull = false;
+	PartitionBoundSpec *boundSpec = NULL;
+	PartitionRangeDatum *upperDatum = NULL;
+	Const *upperBound = NULL;
 
-	if (!PgCronHasBeenLoaded() || RecoveryInProgress() || !JobTableExists())
+	heapTuple = SearchSysCache1(PARTRELID, ObjectIdGetDatum(relationId));
+	if (!HeapTupleIsValid(heapTuple))
 	{
-		return;
+		return false;
 	}
 
-	initStringInfo(&querybuf);
-	i = 0;
-
-	appendStringInfo(&querybuf,
-		"update %s.%s set", CRON_SCHEMA_NAME, JOBS_TABLE_NAME);
-
-	/* username has been provided */
-	if (usernameText != NULL)
+	partitionedTable = (Form_pg_partitioned_table) GETSTRUCT(heapTuple);
+	if (partitionedTable->partstrat == PARTITION_STRATEGY_RANGE &&
+		partitionedTable->partnatts == 1)
 	{
-		if (!superuser())
-			elog(ERROR, "must be superuser to alter username");
-
-		username = text_to_cstring(usernameText);
-		userIdcheckacl = GetRoleOidIfCanLogin(username);
+		/* 0 means that the key is an expression */
+		keyAttributeNumber = partitionedTable->partattrs.values[0];
 	}
-	else
+
+	ReleaseSysCache(heapTuple);
+
+	if (keyAttributeNumber <= 0)
 	{
-		username = currentuser;
+		return false;
 	}
 
-	if (!EnableSuperuserJobs && superuser_arg(userIdcheckacl))
+	heapTuple = SearchSysCache1(RELOID, ObjectIdGetDatum(partitionId));
+	if (!HeapTupleIsValid(heapTuple))
 	{
-		ereport(ERROR, (errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
-						errmsg("cannot schedule jobs as superuser"),
-						errdetail("Scheduling jobs as superuser is disallowed when "
-								  "cron.enable_superuser_jobs is set to off.")));
+		return false;
 	}
 
-	/* add the fields to be updated */
-	/* database has been provided */
-	if (databaseText != NULL)
+	boundDatum = SysCacheGetAttr(RELOID, heapTuple, Anum_pg_class_relpartbound,
+								 &isNull);
+	if (!isNull)
 	{
-		database_name = text_to_cstring(databaseText);
-		/* ensure the user that is used in the job can connect to the database */
-#if (PG_VERSION_NUM >= 160000)
-		aclresult = object_aclcheck(DatabaseRelationId,
-									get_database_oid(database_name, false),
-									userIdcheckacl, ACL_CONNECT);
-#else
-		aclresult = pg_database_aclcheck(get_database_oid(database_name, false),
-										 userIdcheckacl, ACL_CONNECT);
-#endif
+		boundSpec = (PartitionBoundSpec *) stringToNode(TextDatumGetCString(boundDatum));
+	}
 
-		if (aclresult != ACLCHECK_OK)
-			elog(ERROR, "User %s does not have CONNECT privilege on %s", GetUserNameFromId(userIdcheckacl, false), database_name);
+	ReleaseSysCache(heapTuple);
 
-		argTypes[i] = TEXTOID;
-		argValues[i] = CStringGetTextDatum(database_name);
-		i++;
-		appendStringInfo(&querybuf, " database = $%d,", i);
+	if (boundSpec == NULL || boundSpec->strategy != PARTITION_STRATEGY_RANGE ||
+		list_length(boundSpec->upperdatums) != 1)
+	{
+		/* e.g. the default partition */
+		return false;
 	}
 
-	/* ensure schedule is valid */
-	if (scheduleText != NULL)
+	upperDatum = castNode(PartitionRangeDatum, linitial(boundSpec->upperdatums));
+#if (PG_VERSION_NUM >= 110000)
+	if (upperDatum->kind != PARTITION_RANGE_DATUM_VALUE)
+#else
+	if (upperDatum->infinite)
+#endif
 	{
-		schedule = text_to_cstring(scheduleText);
-		parsedSchedule = ParseSchedule(schedule);
-
-		if (parsedSchedule == NULL)
-		{
-			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-					errmsg("invalid schedule: %s", schedule),
-					errhint("Use cron format (e.g. 5 4 * * *), or interval "
-							"format '[1-59] seconds'")));
-		}
-
-		free_entry(parsedSchedule);
-
-		argTypes[i] = TEXTOID;
-		argValues[i] = CStringGetTextDatum(schedule);
-		i++;
-		appendStringInfo(&querybuf, " schedule = $%d,", i);
+		return false;
 	}
 
-	if (commandText != NULL)
+	upperBound = castNode(Const, upperDatum->value);
+	if (upperBound->constisnull)
 	{
-		argTypes[i] = TEXTOID;
-		command = text_to_cstring(commandText);
-		argValues[i] = CStringGetTextDatum(command);
-		i++;
-		appendStringInfo(&querybuf, " command = $%d,", i);
+		return false;
 	}
 
-	if (usernameText != NULL)
+	if (get_atttype(relationId, keyAttributeNumber) == TIMESTAMPTZOID)
 	{
-		argTypes[i] = TEXTOID;
-		argValues[i] = CStringGetTextDatum(username);
-		i++;
-		appendStringInfo(&querybuf, " username = $%d,", i);
+		return DatumGetTimestampTz(upperBound->constvalue) <= cutoffTime;
 	}
-
-	if (active != NULL)
+	else if (keyAttributeNumber == get_attnum(relationId, "runid"))
 	{
-		argTypes[i] = BOOLOID;
-		argValues[i] = BoolGetDatum(*active);
-		i++;
-		appendStringInfo(&querybuf, " active = $%d,", i);
+		return RunBeforeExpired(DatumGetInt64(upperBound->constvalue), cutoffTime);
 	}
 
-	/* remove the last comma */
-	querybuf.len--;
-	querybuf.data[querybuf.len] = '\0';
-
-	/* and add the where clause */
-	argTypes[i] = INT8OID;
-	argValues[i] = Int64GetDatum(jobId);
-	i++;
+	return false;
+}
 
-	appendStringInfo(&querybuf, " where jobid = $%d", i);
 
-	/* ensure the caller owns the row */
-	argTypes[i] = TEXTOID;
-	argValues[i] = CStringGetTextDatum(currentuser);
-	i++;
+/*
+ * RunBeforeExpired returns whether the run with the highest run ID below the
+ * given one finished before the cutoff time, which is found through the
+ * primary key. Runs that never ran count as expired.
+ */
+static bool
+RunBeforeExpired(int64 runId, TimestampTz cutoffTime)
+{
+	StringInfoData querybuf;
+	Oid argTypes[2];
+	Datum argValues[2];
+	bool isNull = false;
+	bool expired = true;
 
-	if (!superuser())
-		appendStringInfo(&querybuf, " and username = $%d", i);
+	argTypes[0] = INT8OID;
+	argValues[0] = Int64GetDatum(runId);
 
-	if (i <= 2)
-		ereport(ERROR, (errmsg("no updates specified"),
-						errhint("You must specify at least one job attribute to change when calling alter_job")));
+	argTypes[1] = TIMESTAMPTZOID;
+	argValues[1] = TimestampTzGetDatum(cutoffTime);
 
-	GetUserIdAndSecContext(&savedUserId, &savedSecurityContext);
-	SetUserIdAndSecContext(CronExtensionOwner(), SECURITY_LOCAL_USERID_CHANGE);
+	initStringInfo(&querybuf);
+	appendStringInfo(&querybuf,
+					 "select coalesce(end_time, start_time) < $2 from %s.%s "
+					 "where runid < $1 order by runid desc limit 1",
+					 CRON_SCHEMA_NAME, JOB_RUN_DETAILS_TABLE_NAME);
 
-	/* Open SPI context. */
-	if (SPI_connect() != SPI_OK_CONNECT)
-		elog(ERROR, "SPI_connect failed");
-	if(SPI_execute_with_args(querybuf.data,
-		i, argTypes, argValues, NULL, false, 1) != SPI_OK_UPDATE)
+	if (SPI_execute_with_args(querybuf.data, 2, argTypes, argValues, NULL,
+							  false, 1) != SPI_OK_SELECT)
 		elog(ERROR, "SPI_exec failed: %s", querybuf.data);
 
-	pfree(querybuf.data);
+	if (SPI_processed > 0)
+	{
+		Datum expiredDatum = SPI_getbinval(SPI_tuptable->vals[0],
+										   SPI_tuptable->tupdesc, 1, &isNull);
 
-	if (SPI_processed <= 0)
-		elog(ERROR, "Job " INT64_FORMAT " does not exist or you don't own it", jobId);
+		if (!isNull)
+		{
+			expired = DatumGetBool(expiredDatum);
+		}
+	}
 
-	SPI_finish();
-	SetUserIdAndSecContext(savedUserId, savedSecurityContext);
-	InvalidateJobCache();
+	pfree(querybuf.data);
+
+	return expired;
 }
 
-void
-MarkPendingRunsAsFailed(void)
+
+/*
+ * DeleteExpiredRunDetails deletes the runs that finished before the cutoff
+ * time among the next cron.run_details_purge_batch_size runs of the purge
+ * round, which are found through the primary key. Runs that are still in
+ * progress are skipped. Returns whether the round finished, because there
+ * are no more runs or a run finished after the cutoff time.
+ */
+static bool
+DeleteExpiredRunDetails(TimestampTz cutoffTime)
 {
 	StringInfoData querybuf;
-	MemoryContext originalContext = CurrentMemoryContext;
+	Oid argTypes[3];
+	Datum argValues[3];
+	Datum *expiredRunIds = NULL;
+	int expiredRunCount = 0;
+	uint64 rowCount = 0;
+	uint64 rowIndex = 0;
+	bool roundFinished = false;
+
+	/* last run ID of the previous batch */
+	argTypes[0] = INT8OID;
+	argValues[0] = Int64GetDatum(RunDetailsPurgePosition);
 
-	SetCurrentStatementStartTimestamp();
-	StartTransactionCommand();
-	PushActiveSnapshot(GetTransactionSnapshot());
+	argTypes[1] = TIMESTAMPTZOID;
+	argValues[1] = TimestampTzGetDatum(cutoffTime);
 
-	if (!PgCronHasBeenLoaded() || RecoveryInProgress() || !JobRunDetailsTableExists())
-	{
-		PopActiveSnapshot();
-		CommitTransactionCommand();
-		MemoryContextSwitchTo(originalContext);
-		return;
-	}
+	argTypes[2] = INT4OID;
+	argValues[2] = Int32GetDatum(CronRunDetailsPurgeBatchSize);
 
 	initStringInfo(&querybuf);
+	appendStringInfo(&querybuf,
+					 "select runid, coalesce(status in ('%s','%s','%s','%s'), false), "
+					 "coalesce(end_time, start_time) >= $2 "
+					 "from %s.%s where runid > $1 order by runid limit $3",
+					 GetCronStatus(CRON_STATUS_STARTING),
+					 GetCronStatus(CRON_STATUS_CONNECTING),
+					 GetCronStatus(CRON_STATUS_SENDING),
+					 GetCronStatus(CRON_STATUS_RUNNING),
+					 CRON_SCHEMA_NAME, JOB_RUN_DETAILS_TABLE_NAME);
+
+	if (SPI_execute_with_args(querybuf.data, 3, argTypes, argValues, NULL,
+							  false, 0) != SPI_OK_SELECT)
+		elog(ERROR, "SPI_exec failed: %s", querybuf.data);
 
-	/* Open SPI context. */
-	if (SPI_connect() != SPI_OK_CONNECT)
-		elog(ERROR, "SPI_connect failed");
+	rowCount = SPI_processed;
+	roundFinished = rowCount < (uint64) CronRunDetailsPurgeBatchSize;
+	expiredRunIds = palloc0(Max(rowCount, 1) * sizeof(Datum));
 
+	for (rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		HeapTuple heapTuple = SPI_tuptable->vals[rowIndex];
+		TupleDesc tupleDescriptor = SPI_tuptable->tupdesc;
+		bool isNull = false;
+		int64 runId = DatumGetInt64(SPI_getbinval(heapTuple, tupleDescriptor, 1,
+												  &isNull));
+		bool inProgress = DatumGetBool(SPI_getbinval(heapTuple, tupleDescriptor,
+													 2, &isNull));
+		bool recent = DatumGetBool(SPI_getbinval(heapTuple, tupleDescriptor, 3,
+												 &isNull));
+
+		/* runs without a start or end time never ran, they count as expired */
+		if (isNull)
+		{
+			recent = false;
+		}
 
-	appendStringInfo(&querybuf,
-		"update %s.%s set status = '%s', return_message = 'server restarted' where status in ('%s','%s')"
-		, CRON_SCHEMA_NAME, JOB_RUN_DETAILS_TABLE_NAME, GetCronStatus(CRON_STATUS_FAILED), GetCronStatus(CRON_STATUS_STARTING), GetCronStatus(CRON_STATUS_RUNNING));
+		if (inProgress)
+		{
+			RunDetailsPurgePosition = runId;
+			continue;
+		}
 
+		if (recent)
+		{
+			/* later runs are generally more recent as well */
+			roundFinished = true;
+			break;
+		}
 
-	if (SPI_exec(querybuf.data, 0) != SPI_OK_UPDATE)
-		elog(ERROR, "SPI_exec failed: %s", querybuf.data);
+		expiredRunIds[expiredRunCount++] = Int64GetDatum(runId);
+		RunDetailsPurgePosition = runId;
+	}
+
+	if (expiredRunCount > 0)
+	{
+		argTypes[0] = get_array_type(INT8OID);
+		argValues[0] = BuildRunDetailArray(expiredRunIds, NULL, expiredRunCount,
+										   INT8OID);
+
+		resetStringInfo(&querybuf);
+		appendStringInfo(&querybuf,
+						 "delete from %s.%s where runid operator(pg_catalog.=) any ($1)",
+						 CRON_SCHEMA_NAME, JOB_RUN_DETAILS_TABLE_NAME);
+
+		if (SPI_execute_with_args(querybuf.data, 1, argTypes, argValues, NULL,
+								  false, 0) != SPI_OK_DELETE)
+			elog(ERROR, "SPI_exec failed: %s", querybuf.data);
+	}
 
+	if (roundFinished)
+	{
+		RunDetailsPurgePosition = 0;
+	}
+
+	pfree(expiredRunIds);
 	pfree(querybuf.data);
 
-	SPI_finish();
-	PopActiveSnapshot();
-	CommitTransactionCommand();
-	MemoryContextSwitchTo(originalContext);
+	return roundFinished;
 }
 
 char *
@@ -1494,94 +4828,85 @@ GetCronStatus(CronStatus cronstatus)
  */
 static bool
 JobRunDetailsTableExists(void)
+{
+	return JobRunDetailsRelationId() != InvalidOid;
+}
+
+
+/*
+ * JobRunDetailsRelationId returns the oid of the cron.job_run_details
+ * relation, or InvalidOid if it does not exist.
+ */
+static Oid
+JobRunDetailsRelationId(void)
 {
 	Oid cronSchemaId = get_namespace_oid(CRON_SCHEMA_NAME, false);
-	Oid jobRunDetailsTableOid = get_relname_relid(JOB_RUN_DETAILS_TABLE_NAME,
-												  cronSchemaId);
 
-	return jobRunDetailsTableOid != InvalidOid;
+	return get_relname_relid(JOB_RUN_DETAILS_TABLE_NAME, cronSchemaId);
 }
 
 /*
- * JobTableExists returns whether the job table exists.
+ * JobRunDetailsHaveLatency returns whether cron.job_run_details has the
+ * scheduled_time, queue_wait, startup_time and send_time columns. They are
+ * added in 1.7, and a launcher that was upgraded before the extension has
+ * to keep writing to the old table. The answer is kept until the table is
+ * invalidated.
  */
 static bool
-JobTableExists(void)
+JobRunDetailsHaveLatency(void)
 {
-	Oid cronSchemaId = get_namespace_oid(CRON_SCHEMA_NAME, false);
-	Oid jobTableOid = get_relname_relid(JOBS_TABLE_NAME,
-												cronSchemaId);
+	Oid relationId = JobRunDetailsRelationId();
 
-	return jobTableOid != InvalidOid;
+	if (relationId != LatencyCheckedRelationId)
+	{
+		RunDetailsHaveLatency = relationId != InvalidOid &&
+								get_attnum(relationId, "send_time") != InvalidAttrNumber;
+		LatencyCheckedRelationId = relationId;
+	}
+
+	return RunDetailsHaveLatency;
 }
 
 
 /*
- * ParseSchedule attempts to parse a cron schedule or an interval in seconds.
- * The returned pointer is allocated using malloc and should be freed by the
- * caller.
+ * JobChangesRelationId returns the oid of the cron.job_changes relation,
+ * or InvalidOid if it does not exist.
  */
-static entry *
-ParseSchedule(char *scheduleText)
+static Oid
+JobChangesRelationId(void)
 {
-	uint32 secondsInterval = 0;
-	entry *schedule;
+	Oid cronSchemaId = get_namespace_oid(CRON_SCHEMA_NAME, false);
 
-	/*
-	 * First try to parse as a cron schedule.
-	 */
-	schedule = parse_cron_entry(scheduleText);
-	if (schedule != NULL)
-	{
-		/* valid cron schedule */
-		return schedule;
-	}
+	return get_relname_relid(JOB_CHANGES_TABLE_NAME, cronSchemaId);
+}
 
-	/*
-	 * Parse as interval on seconds.
-	 */
-	if (TryParseInterval(scheduleText, &secondsInterval))
-	{
-		schedule = calloc(sizeof(entry), sizeof(char));
-		schedule->secondsInterval = secondsInterval;
-		return schedule;
-	}
+/*
+ * JobTableExists returns whether the job table exists.
+ */
+static bool
+JobTableExists(void)
+{
+	Oid cronSchemaId = get_namespace_oid(CRON_SCHEMA_NAME, false);
+	Oid jobTableOid = get_relname_relid(JOBS_TABLE_NAME,
+												cronSchemaId);
 
-	elog(LOG, "failed to parse schedule: %s", scheduleText);
-	return NULL;
+	return jobTableOid != InvalidOid;
 }
 
 
 /*
- * TryParseInterval returns whether scheduleText is of the form
- * <positive number> second[s].
+ * ParseSchedule attempts to parse a cron schedule or an interval in seconds
+ * into the given entry. If the schedule is invalid, it returns false and
+ * leaves a zeroed out entry.
  */
 static bool
-TryParseInterval(char *scheduleText, uint32 *secondsInterval)
+ParseSchedule(char *scheduleText, entry *schedule)
 {
-	char lastChar = '\0';
-	char plural = '\0';
-	char extra = '\0';
-	char *lowercaseSchedule = asc_tolower(scheduleText, strlen(scheduleText));
-
-	int numParts = sscanf(lowercaseSchedule, " %u secon%c%c %c", secondsInterval,
-						  &lastChar, &plural, &extra);
-	if (lastChar != 'd')
+	if (!ParseCronSchedule(scheduleText, schedule))
 	{
-		/* value did not have a "second" suffix */
+		elog(LOG, "failed to parse schedule: %s", scheduleText);
 		return false;
 	}
 
-	if (numParts == 2)
-	{
-		/* <number> second (allow "2 second") */
-		return 0 < *secondsInterval && *secondsInterval < 60;
-	}
-	else if (numParts == 3 && plural == 's')
-	{
-		/* <number> seconds (allow "1 seconds") */
-		return 0 < *secondsInterval && *secondsInterval < 60;
-	}
-
-	return false;
+	return true;
 }
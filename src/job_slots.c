@@ -0,0 +1,140 @@
+/*-------------------------------------------------------------------------
+ *
+ * src/job_slots.c
+ *
+ * Preallocated shared memory for background workers that run a single job.
+ *
+ * Every background worker needs shared memory for the arguments of its job
+ * and a queue for the messages it sends back. Creating a DSM segment for
+ * every run costs system calls, and fails when many jobs start at the same
+ * time and the number of DSM segments runs out. Instead, the launcher
+ * creates a single segment with cron.background_worker_job_slots slots when
+ * it starts, and gives each run a slot of its own. Workers attach to the
+ * segment and find their slot through the offset in bgw_extra.
+ *
+ * A slot is only reused after the worker that used it exited, since the
+ * next run recreates the table of contents and queue in the same memory.
+ * Runs whose command does not fit in a slot, or that start when all slots
+ * are in use, still get a segment of their own.
+ *
+ * The segment is not part of the main shared memory segment, because a
+ * worker can only send its messages over a queue in a DSM segment (see
+ * pq_redirect_to_shm_mq).
+ *
+ * Copyright (c) 2016, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "job_slots.h"
+#include "worker_pool.h"
+
+#include "utils/memutils.h"
+
+
+/* room for the database, user and command, next to the queue */
+#define JOB_SLOT_ARGUMENT_SIZE ((Size) 8192)
+#define JOB_SLOT_SIZE (JOB_SLOT_ARGUMENT_SIZE + QUEUE_SIZE)
+
+
+/* global settings */
+int CronJobSlotCount = -1;
+
+/* global variables */
+static dsm_segment *JobSlotsSegment = NULL;
+static bool *JobSlotInUse = NULL;
+static int JobSlotCount = 0;
+
+
+/*
+ * InitializeJobSlots creates the shared memory for the given number of job
+ * slots. If the segment cannot be created, all runs get a segment of their
+ * own.
+ */
+void
+InitializeJobSlots(int slotCount)
+{
+	if (slotCount <= 0)
+	{
+		return;
+	}
+
+	JobSlotsSegment = dsm_create(slotCount * JOB_SLOT_SIZE,
+								 DSM_CREATE_NULL_IF_MAXSEGMENTS);
+	if (JobSlotsSegment == NULL)
+	{
+		ereport(WARNING,
+				(errmsg("could not create shared memory for %d job slots",
+						slotCount)));
+		return;
+	}
+
+	/* keep the segment until the launcher exits */
+	dsm_pin_mapping(JobSlotsSegment);
+
+	JobSlotInUse = MemoryContextAllocZero(TopMemoryContext,
+										  slotCount * sizeof(bool));
+	JobSlotCount = slotCount;
+}
+
+
+/*
+ * AcquireJobSlot returns a free job slot that can hold the given number of
+ * bytes and marks it as used, or returns -1 if there is none.
+ */
+int
+AcquireJobSlot(Size size)
+{
+	int slot = 0;
+
+	if (size > JOB_SLOT_SIZE)
+	{
+		return -1;
+	}
+
+	for (slot = 0; slot < JobSlotCount; slot++)
+	{
+		if (!JobSlotInUse[slot])
+		{
+			JobSlotInUse[slot] = true;
+			return slot;
+		}
+	}
+
+	return -1;
+}
+
+
+/*
+ * ReleaseJobSlot marks a job slot as free. The caller should make sure the
+ * worker that used it exited.
+ */
+void
+ReleaseJobSlot(int slot)
+{
+	Assert(slot >= 0 && slot < JobSlotCount);
+
+	JobSlotInUse[slot] = false;
+}
+
+
+/*
+ * JobSlotSegment returns the segment that contains the job slots.
+ */
+dsm_segment *
+JobSlotSegment(void)
+{
+	return JobSlotsSegment;
+}
+
+
+/*
+ * JobSlotOffset returns the offset of a job slot within its segment.
+ */
+Size
+JobSlotOffset(int slot)
+{
+	return slot * JOB_SLOT_SIZE;
+}
@@ -0,0 +1,691 @@
+/*-------------------------------------------------------------------------
+ *
+ * src/job_stats.c
+ *
+ * Cumulative statistics of the runs of each job, kept in shared memory.
+ *
+ * cron.job_run_details only tells how individual runs went, and answering
+ * how a job does over time means scanning all of its runs, which may have
+ * been removed or never been written, depending on the log mode of the job.
+ * Instead, the launcher adds every run that finishes to the statistics of
+ * its job in shared memory, which can be read through cron.job_stats.
+ * Besides how long runs took, the statistics tell how late their commands
+ * started compared to when they were due, and why, which shows whether
+ * cron.max_running_jobs is too low for the jobs that are scheduled.
+ *
+ * There is room for the statistics of cron.max_job_stats jobs. When there
+ * is no room for another job, the statistics of the job that finished a
+ * run longest ago are removed. Like pg_stat_statements, the statistics are
+ * written to a file when the server shuts down cleanly and read back when
+ * it starts, and they are lost after a crash.
+ *
+ * Copyright (c) 2016, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+
+#include "job_stats.h"
+
+#include "catalog/pg_type.h"
+#include "storage/fd.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/tuplestore.h"
+
+
+/* file in which the statistics are kept while the server is down */
+#define JOB_STATS_FILE PGSTAT_STAT_PERMANENT_DIRECTORY "/pg_cron_job_stats.stat"
+
+/* identifies the format of the file, change when CronJobStats changes */
+#define JOB_STATS_FILE_HEADER 0x43524a32
+
+/* number of buckets in the histograms of run durations and latencies */
+#define JOB_STATS_BUCKET_COUNT 8
+
+
+/*
+ * Upper bounds of the buckets of the histograms of run durations and
+ * latencies, in ms. The last bucket holds the runs that took longer than an
+ * hour.
+ */
+static const double JobStatsBucketBounds[JOB_STATS_BUCKET_COUNT - 1] = {
+	10, 100, 1000, 10000, 60000, 600000, 3600000
+};
+
+
+/*
+ * CronJobStats are the statistics of the runs of a job that finished.
+ * Durations are in ms.
+ */
+typedef struct CronJobStats
+{
+	/* hash key */
+	int64 jobId;
+
+	/* user that ran the last run, to decide who can see the statistics */
+	NameData userName;
+
+	int64 runs;
+	int64 succeeded;
+	int64 failed;
+	int64 timedOut;
+	double totalTime;
+	double minTime;
+	double maxTime;
+	int64 durationHistogram[JOB_STATS_BUCKET_COUNT];
+	TimestampTz lastStartTime;
+	TimestampTz lastEndTime;
+	int64 rowCount;
+
+	/* runs whose command started, and how long after they were due */
+	int64 startedRuns;
+	double totalQueueWait;
+	double totalStartupTime;
+	double totalSendTime;
+	double maxStartLag;
+	int64 queueWaitHistogram[JOB_STATS_BUCKET_COUNT];
+	int64 startLagHistogram[JOB_STATS_BUCKET_COUNT];
+} CronJobStats;
+
+
+/*
+ * CronJobStatsState is the part of the statistics in shared memory that is
+ * not in the hash.
+ */
+typedef struct CronJobStatsState
+{
+	/* protects the hash, which is only changed by the launcher and resets */
+	LWLock *lock;
+} CronJobStatsState;
+
+
+/* forward declarations */
+static Size JobStatsShmemSize(void);
+static void JobStatsShmemShutdown(int code, Datum arg);
+static void LoadJobStats(void);
+static bool ReadJobStatsFile(FILE *file);
+static void EvictJobStats(void);
+static void RemoveAllJobStats(void);
+static int DurationBucket(double duration);
+static Datum BuildHistogramArray(int64 *histogram);
+
+/* SQL-callable functions */
+PG_FUNCTION_INFO_V1(cron_job_stats);
+PG_FUNCTION_INFO_V1(cron_job_stats_reset);
+
+
+/* global settings */
+int CronMaxJobStats = 1000;
+
+/* global variables */
+static CronJobStatsState *JobStats = NULL;
+static HTAB *JobStatsHash = NULL;
+
+
+/*
+ * JobStatsShmemSize returns the amount of shared memory used by the
+ * statistics of jobs.
+ */
+static Size
+JobStatsShmemSize(void)
+{
+	Size size = MAXALIGN(sizeof(CronJobStatsState));
+
+	size = add_size(size, hash_estimate_size(CronMaxJobStats, sizeof(CronJobStats)));
+
+	return size;
+}
+
+
+/*
+ * JobStatsShmemRequest requests the shared memory used by the statistics of
+ * cron.max_job_stats jobs, unless it is 0.
+ */
+void
+JobStatsShmemRequest(void)
+{
+	if (CronMaxJobStats <= 0)
+	{
+		return;
+	}
+
+	RequestAddinShmemSpace(JobStatsShmemSize());
+	RequestNamedLWLockTranche("pg_cron job stats", 1);
+}
+
+
+/*
+ * JobStatsShmemStartup attaches to the statistics of jobs. The first to do
+ * so, which is the postmaster, initializes them with the statistics that
+ * were saved when the server shut down.
+ */
+void
+JobStatsShmemStartup(void)
+{
+	HASHCTL info;
+	bool found = false;
+
+	if (CronMaxJobStats <= 0)
+	{
+		return;
+	}
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	JobStats = ShmemInitStruct("pg_cron job stats", sizeof(CronJobStatsState),
+							   &found);
+	if (!found)
+	{
+		JobStats->lock = &(GetNamedLWLockTranche("pg_cron job stats"))->lock;
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(int64);
+	info.entrysize = sizeof(CronJobStats);
+
+	JobStatsHash = ShmemInitHash("pg_cron job stats hash", CronMaxJobStats,
+								 CronMaxJobStats, &info, HASH_ELEM | HASH_BLOBS);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	/* the postmaster saves the statistics when it exits */
+	if (!IsUnderPostmaster)
+	{
+		on_shmem_exit(JobStatsShmemShutdown, (Datum) 0);
+	}
+
+	if (!found)
+	{
+		/* no other process uses the statistics yet, so no need for the lock */
+		LoadJobStats();
+	}
+}
+
+
+/*
+ * JobStatsShmemShutdown writes the statistics to a file when the server
+ * shuts down cleanly, such that they can be read back when it starts again.
+ */
+static void
+JobStatsShmemShutdown(int code, Datum arg)
+{
+	char *tempFileName = JOB_STATS_FILE ".tmp";
+	FILE *file = NULL;
+	uint32 header = JOB_STATS_FILE_HEADER;
+	int32 entryCount = 0;
+	HASH_SEQ_STATUS status;
+	CronJobStats *entry = NULL;
+
+	/* statistics may be inconsistent after a crash */
+	if (code != 0 || JobStats == NULL || JobStatsHash == NULL)
+	{
+		return;
+	}
+
+	file = AllocateFile(tempFileName, PG_BINARY_W);
+	if (file == NULL)
+	{
+		ereport(LOG, (errcode_for_file_access(),
+					  errmsg("could not write file \"%s\": %m", tempFileName)));
+		return;
+	}
+
+	entryCount = hash_get_num_entries(JobStatsHash);
+
+	if (fwrite(&header, sizeof(uint32), 1, file) != 1 ||
+		fwrite(&entryCount, sizeof(int32), 1, file) != 1)
+	{
+		ereport(LOG, (errcode_for_file_access(),
+					  errmsg("could not write file \"%s\": %m", tempFileName)));
+		FreeFile(file);
+		unlink(tempFileName);
+		return;
+	}
+
+	hash_seq_init(&status, JobStatsHash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		if (fwrite(entry, sizeof(CronJobStats), 1, file) != 1)
+		{
+			ereport(LOG, (errcode_for_file_access(),
+						  errmsg("could not write file \"%s\": %m", tempFileName)));
+			hash_seq_term(&status);
+			FreeFile(file);
+			unlink(tempFileName);
+			return;
+		}
+	}
+
+	if (FreeFile(file) != 0)
+	{
+		ereport(LOG, (errcode_for_file_access(),
+					  errmsg("could not write file \"%s\": %m", tempFileName)));
+		unlink(tempFileName);
+		return;
+	}
+
+	(void) durable_rename(tempFileName, JOB_STATS_FILE, LOG);
+}
+
+
+
+
+/*
+ * LoadJobStats reads the statistics that were saved when the server shut
+ * down, and removes the file such that they are not read again after a
+ * crash.
+ */
+static void
+LoadJobStats(void)
+{
+	FILE *file = AllocateFile(JOB_STATS_FILE, PG_BINARY_R);
+
+	if (file == NULL)
+	{
+		if (errno != ENOENT)
+		{
+			ereport(LOG, (errcode_for_file_access(),
+						  errmsg("could not read file \"%s\": %m", JOB_STATS_FILE)));
+		}
+
+		return;
+	}
+
+	if (!ReadJobStatsFile(file))
+	{
+		ereport(LOG, (errmsg("ignoring invalid job statistics in file \"%s\"",
+							 JOB_STATS_FILE)));
+
+		/* do not keep the part that was read */
+		RemoveAllJobStats();
+	}
+
+	FreeFile(file);
+	unlink(JOB_STATS_FILE);
+}
+
+
+/*
+ * ReadJobStatsFile adds the statistics in the given file to the hash.
+ * Returns false if the file is not a valid statistics file.
+ */
+static bool
+ReadJobStatsFile(FILE *file)
+{
+	uint32 header = 0;
+	int32 entryCount = 0;
+	int32 entryIndex = 0;
+
+	if (fread(&header, sizeof(uint32), 1, file) != 1 ||
+		fread(&entryCount, sizeof(int32), 1, file) != 1 ||
+		header != JOB_STATS_FILE_HEADER || entryCount < 0)
+	{
+		return false;
+	}
+
+	for (entryIndex = 0; entryIndex < entryCount; entryIndex++)
+	{
+		CronJobStats savedEntry;
+		CronJobStats *entry = NULL;
+
+		if (fread(&savedEntry, sizeof(CronJobStats), 1, file) != 1)
+		{
+			return false;
+		}
+
+		/* cron.max_job_stats may have been lowered */
+		if (hash_get_num_entries(JobStatsHash) >= CronMaxJobStats)
+		{
+			EvictJobStats();
+		}
+
+		entry = hash_search(JobStatsHash, &savedEntry.jobId, HASH_ENTER_NULL, NULL);
+		if (entry == NULL)
+		{
+			return false;
+		}
+
+		memcpy(entry, &savedEntry, sizeof(CronJobStats));
+	}
+
+	return true;
+}
+
+
+/*
+ * RecordJobRunStats adds a run of a job that finished to the statistics of
+ * the job. Runs that timed out also count as failed. The latency is NULL if
+ * the command of the run did not start. Only the launcher calls it.
+ */
+void
+RecordJobRunStats(int64 jobId, char *userName, TimestampTz startTime,
+				  TimestampTz endTime, bool failed, bool timedOut,
+				  int64 rowCount, CronRunLatency *latency)
+{
+	CronJobStats *entry = NULL;
+	double duration = 0.0;
+
+	if (JobStats == NULL)
+	{
+		return;
+	}
+
+	if (startTime != 0 && endTime > startTime)
+	{
+		duration = (double) (endTime - startTime) / 1000.0;
+	}
+
+	LWLockAcquire(JobStats->lock, LW_EXCLUSIVE);
+
+	entry = hash_search(JobStatsHash, &jobId, HASH_FIND, NULL);
+	if (entry == NULL)
+	{
+		if (hash_get_num_entries(JobStatsHash) >= CronMaxJobStats)
+		{
+			EvictJobStats();
+		}
+
+		entry = hash_search(JobStatsHash, &jobId, HASH_ENTER_NULL, NULL);
+		if (entry == NULL)
+		{
+			LWLockRelease(JobStats->lock);
+			return;
+		}
+
+		memset(entry, 0, sizeof(CronJobStats));
+		entry->jobId = jobId;
+		entry->minTime = duration;
+		entry->maxTime = duration;
+	}
+
+	namestrcpy(&entry->userName, userName);
+
+	entry->runs++;
+
+	if (failed || timedOut)
+	{
+		entry->failed++;
+	}
+	else
+	{
+		entry->succeeded++;
+	}
+
+	if (timedOut)
+	{
+		entry->timedOut++;
+	}
+
+	entry->totalTime += duration;
+	entry->minTime = Min(entry->minTime, duration);
+	entry->maxTime = Max(entry->maxTime, duration);
+	entry->durationHistogram[DurationBucket(duration)]++;
+	entry->lastStartTime = startTime;
+	entry->lastEndTime = endTime;
+	entry->rowCount += rowCount;
+
+	if (latency != NULL)
+	{
+		double queueWait = (double) latency->queueWait / 1000.0;
+		double startLag = (double) (latency->queueWait + latency->startupTime +
+									latency->sendTime) / 1000.0;
+
+		entry->startedRuns++;
+		entry->totalQueueWait += queueWait;
+		entry->totalStartupTime += (double) latency->startupTime / 1000.0;
+		entry->totalSendTime += (double) latency->sendTime / 1000.0;
+		entry->maxStartLag = Max(entry->maxStartLag, startLag);
+		entry->queueWaitHistogram[DurationBucket(queueWait)]++;
+		entry->startLagHistogram[DurationBucket(startLag)]++;
+	}
+
+	LWLockRelease(JobStats->lock);
+}
+
+
+/*
+ * EvictJobStats removes the statistics of the job that finished a run
+ * longest ago, to make room for another job. The caller should hold the
+ * lock in exclusive mode.
+ */
+static void
+EvictJobStats(void)
+{
+	HASH_SEQ_STATUS status;
+	CronJobStats *entry = NULL;
+	CronJobStats *oldestEntry = NULL;
+
+	hash_seq_init(&status, JobStatsHash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		if (oldestEntry == NULL || entry->lastEndTime < oldestEntry->lastEndTime)
+		{
+			oldestEntry = entry;
+		}
+	}
+
+	if (oldestEntry != NULL)
+	{
+		hash_search(JobStatsHash, &oldestEntry->jobId, HASH_REMOVE, NULL);
+	}
+}
+
+
+/*
+ * RemoveAllJobStats removes the statistics of all jobs. The caller should
+ * hold the lock in exclusive mode.
+ */
+static void
+RemoveAllJobStats(void)
+{
+	HASH_SEQ_STATUS status;
+	CronJobStats *entry = NULL;
+
+	hash_seq_init(&status, JobStatsHash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		hash_search(JobStatsHash, &entry->jobId, HASH_REMOVE, NULL);
+	}
+}
+
+
+/*
+ * DurationBucket returns the bucket of the histograms of run durations and
+ * latencies that the given duration in ms falls in.
+ */
+static int
+DurationBucket(double duration)
+{
+	int bucket = 0;
+
+	for (bucket = 0; bucket < JOB_STATS_BUCKET_COUNT - 1; bucket++)
+	{
+		if (duration < JobStatsBucketBounds[bucket])
+		{
+			break;
+		}
+	}
+
+	return bucket;
+}
+
+
+/*
+ * BuildHistogramArray returns the given histogram as a bigint array.
+ */
+static Datum
+BuildHistogramArray(int64 *histogram)
+{
+	Datum bucketValues[JOB_STATS_BUCKET_COUNT];
+	int bucket = 0;
+
+	for (bucket = 0; bucket < JOB_STATS_BUCKET_COUNT; bucket++)
+	{
+		bucketValues[bucket] = Int64GetDatum(histogram[bucket]);
+	}
+
+	return PointerGetDatum(construct_array(bucketValues, JOB_STATS_BUCKET_COUNT,
+										   INT8OID, sizeof(int64),
+										   FLOAT8PASSBYVAL, 'd'));
+}
+
+
+/*
+ * cron_job_stats returns the statistics of the runs of each job. Users
+ * other than superusers only see the statistics of jobs that ran as them,
+ * like in cron.job_run_details.
+ */
+Datum
+cron_job_stats(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *resultInfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc tupleDescriptor = NULL;
+	Tuplestorestate *tupleStore = NULL;
+	MemoryContext oldContext = NULL;
+	CronJobStats *entriesCopy = NULL;
+	CronJobStats *entry = NULL;
+	HASH_SEQ_STATUS status;
+	int entryCount = 0;
+	int entryIndex = 0;
+	char *currentUserName = GetUserNameFromId(GetUserId(), false);
+	bool isSuperuser = superuser();
+
+	if (resultInfo == NULL || !IsA(resultInfo, ReturnSetInfo) ||
+		(resultInfo->allowedModes & SFRM_Materialize) == 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("set-valued function called in context that cannot "
+							   "accept a set")));
+	}
+
+	if (get_call_result_type(fcinfo, NULL, &tupleDescriptor) != TYPEFUNC_COMPOSITE)
+	{
+		elog(ERROR, "return type must be a row type");
+	}
+
+	oldContext = MemoryContextSwitchTo(resultInfo->econtext->ecxt_per_query_memory);
+	tupleDescriptor = CreateTupleDescCopy(tupleDescriptor);
+	tupleStore = tuplestore_begin_heap(true, false, work_mem);
+	MemoryContextSwitchTo(oldContext);
+
+	resultInfo->returnMode = SFRM_Materialize;
+	resultInfo->setResult = tupleStore;
+	resultInfo->setDesc = tupleDescriptor;
+
+	if (JobStats == NULL)
+	{
+		return (Datum) 0;
+	}
+
+	/* copy the statistics, such that we do not hold the lock while building tuples */
+	LWLockAcquire(JobStats->lock, LW_SHARED);
+
+	entriesCopy = palloc(Max(hash_get_num_entries(JobStatsHash), 1) *
+						 sizeof(CronJobStats));
+
+	hash_seq_init(&status, JobStatsHash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		memcpy(&entriesCopy[entryCount], entry, sizeof(CronJobStats));
+		entryCount++;
+	}
+
+	LWLockRelease(JobStats->lock);
+
+	for (entryIndex = 0; entryIndex < entryCount; entryIndex++)
+	{
+		Datum values[19];
+		bool isNulls[19];
+
+		entry = &entriesCopy[entryIndex];
+
+		if (!isSuperuser &&
+			strcmp(NameStr(entry->userName), currentUserName) != 0)
+		{
+			continue;
+		}
+
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[0] = Int64GetDatum(entry->jobId);
+		values[1] = Int64GetDatum(entry->runs);
+		values[2] = Int64GetDatum(entry->succeeded);
+		values[3] = Int64GetDatum(entry->failed);
+		values[4] = Int64GetDatum(entry->timedOut);
+		values[5] = Float8GetDatum(entry->totalTime);
+		values[6] = Float8GetDatum(entry->minTime);
+		values[7] = Float8GetDatum(entry->maxTime);
+		values[8] = Float8GetDatum(entry->totalTime / entry->runs);
+		values[9] = BuildHistogramArray(entry->durationHistogram);
+		values[10] = TimestampTzGetDatum(entry->lastStartTime);
+		isNulls[10] = entry->lastStartTime == 0;
+		values[11] = TimestampTzGetDatum(entry->lastEndTime);
+		values[12] = Int64GetDatum(entry->rowCount);
+
+		/* latencies are only known for runs whose command started */
+		if (entry->startedRuns > 0)
+		{
+			values[13] = Float8GetDatum(entry->totalQueueWait / entry->startedRuns);
+			values[14] = Float8GetDatum(entry->totalStartupTime / entry->startedRuns);
+			values[15] = Float8GetDatum(entry->totalSendTime / entry->startedRuns);
+			values[16] = Float8GetDatum(entry->maxStartLag);
+		}
+		else
+		{
+			isNulls[13] = true;
+			isNulls[14] = true;
+			isNulls[15] = true;
+			isNulls[16] = true;
+		}
+
+		values[17] = BuildHistogramArray(entry->queueWaitHistogram);
+		values[18] = BuildHistogramArray(entry->startLagHistogram);
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	pfree(entriesCopy);
+
+	return (Datum) 0;
+}
+
+
+/*
+ * cron_job_stats_reset removes the statistics of the given job, or of all
+ * jobs if the job ID is NULL.
+ */
+Datum
+cron_job_stats_reset(PG_FUNCTION_ARGS)
+{
+	if (JobStats == NULL)
+	{
+		PG_RETURN_VOID();
+	}
+
+	LWLockAcquire(JobStats->lock, LW_EXCLUSIVE);
+
+	if (PG_ARGISNULL(0))
+	{
+		RemoveAllJobStats();
+	}
+	else
+	{
+		int64 jobId = PG_GETARG_INT64(0);
+
+		hash_search(JobStatsHash, &jobId, HASH_REMOVE, NULL);
+	}
+
+	LWLockRelease(JobStats->lock);
+
+	PG_RETURN_VOID();
+}
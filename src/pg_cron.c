@@ -45,21 +45,21 @@
 #define MAIN_PROGRAM
 
 #include "pg_cron.h"
+#include "connection_cache.h"
+#include "job_slots.h"
+#include "job_stats.h"
+#include "run_logger.h"
+#include "schedule.h"
+#include "schedule_index.h"
+#include "shared_state.h"
 #include "task_states.h"
 #include "job_metadata.h"
+#include "worker_pool.h"
 
 
-#ifdef HAVE_POLL_H
-#include <poll.h>
-#elif defined(HAVE_SYS_POLL_H)
-#include <sys/poll.h>
-#endif
-
 #if defined(_WIN32)
 #include <windows.h>
 #include <winsock2.h>
-
-#define poll WSAPoll
 #endif
 
 #include "sys/time.h"
@@ -76,6 +76,7 @@
 #include "catalog/namespace.h"
 #include "commands/async.h"
 #include "commands/dbcommands.h"
+#include "commands/discard.h"
 #include "commands/extension.h"
 #include "commands/sequence.h"
 #include "commands/trigger.h"
@@ -124,14 +125,6 @@ PG_MODULE_MAGIC;
 #define MAXINT8LEN 20
 #endif
 
-/* Table-of-contents constants for our dynamic shared memory segment. */
-#define PG_CRON_MAGIC			0x51028080
-#define PG_CRON_KEY_DATABASE	0
-#define PG_CRON_KEY_USERNAME	1
-#define PG_CRON_KEY_COMMAND		2
-#define PG_CRON_KEY_QUEUE		3
-#define PG_CRON_NKEYS			4
-
 /* ways in which the clock can change between main loop iterations */
 typedef enum
 {
@@ -146,49 +139,91 @@ void _PG_init(void);
 void _PG_fini(void);
 PGDLLEXPORT void PgCronLauncherMain(Datum arg);
 PGDLLEXPORT void CronBackgroundWorker(Datum arg);
+PGDLLEXPORT void CronPoolBackgroundWorker(Datum arg);
 
-static void StartAllPendingRuns(List *taskList, TimestampTz currentTime);
+static void StartAllPendingRuns(TimestampTz currentTime);
 static void StartPendingRuns(CronTask *task, ClockProgress clockProgress,
-							 TimestampTz lastMinute, TimestampTz currentTime);
+							 TimestampTz currentTime,
+							 CalendarMinute *calendarMinute);
+static void AddPendingRun(CronTask *task, TimestampTz runTime);
+static TimestampTz NextPendingRunTime(CronTask *task, TimestampTz currentTime);
 static int MinutesPassed(TimestampTz startTime, TimestampTz stopTime);
 static TimestampTz TimestampMinuteStart(TimestampTz time);
 static TimestampTz TimestampMinuteEnd(TimestampTz time);
-static bool ShouldRunTask(entry *schedule, TimestampTz currentMinute,
+static bool ShouldRunTask(entry *schedule, CalendarMinute *calendarMinute,
 						  bool doWild, bool doNonWild);
 
-static void WaitForCronTasks(List *taskList);
-static void WaitForLatch(int timeoutMs);
-static void PollForTasks(List *taskList);
+static bool WaitForCronTasks(void);
+static void WakeTimedOutTasks(TimestampTz currentTime);
+static void GetTaskWaitEvent(CronTask *task, pgsocket *socket, uint32 *events);
+static void RebuildWaitEventSet(void);
 static bool CanStartTask(CronTask *task);
-static void ManageCronTasks(List *taskList, TimestampTz currentTime);
+static void ManageCronTasks(TimestampTz currentTime, bool latchSet);
+static void WatchCronTask(CronTask *task);
 static void ManageCronTask(CronTask *task, TimestampTz currentTime);
 static void ExecuteSqlString(const char *sql);
 static void GetTaskFeedback(PGresult *result, CronTask *task);
-static void ProcessBgwTaskFeedback(CronTask *task, bool running);
+static bool ProcessBgwTaskFeedback(CronTask *task, bool running);
+static void RunCronCommand(const char *command);
 static void CronNoticeReceiver(void *arg, const PGresult *result);
 
 static bool jobCanceled(CronTask *task);
+static bool ShouldLogRun(CronTask *task, CronJob *cronJob);
+static void SetTaskRunLatency(CronTask *task);
 static bool jobStartupTimeout(CronTask *task, TimestampTz currentTime);
 static char* pg_cron_cmdTuples(char *msg);
 static void bgw_generate_returned_message(StringInfoData *display_msg, ErrorData edata);
+static bool CreateBgwTaskSegment(CronTask *task, CronJob *cronJob);
+static bool RegisterBgwTaskWorker(CronTask *task, BackgroundWorkerHandle **handle);
 static void CleanupCronTask(CronTask *task);
+static bool BgwTaskWorkerStopped(CronTask *task);
+static void RequestPgCronShmem(void);
+#if (PG_VERSION_NUM >= 150000)
+static void PgCronShmemRequest(void);
+#endif
+static void PgCronShmemStartup(void);
 
 /* global settings */
 char *CronTableDatabaseName = "postgres";
 static bool CronLogStatement = true;
 static bool CronLogRun = true;
-static bool CronDomDowAndLogic = false;
+bool CronDomDowAndLogic = false;
 
 /* global variables */
 static int CronTaskStartTimeout = 10000; /* maximum connection time */
-static const int MaxWait = 1000; /* maximum time in ms that poll() can block */
+static const int MaxWait = 1000; /* maximum time in ms that we can block */
+static const int MinStartRetryDelay = 10; /* first delay in ms before retrying to start a worker */
 static bool RebootJobsScheduled = false;
+static TimestampTz LastMinute = 0;
 static int RunningTaskCount = 0;
 static int MaxRunningTasks = 0;
 static int CronLogMinMessages = WARNING;
 static bool UseBackgroundWorkers = false;
 
-static char  *cron_timezone = NULL;
+/*
+ * The launcher waits for its latch, postmaster death and the sockets of
+ * running tasks using a single wait event set that is kept across loop
+ * iterations. Since sockets cannot be removed from a wait event set, it is
+ * rebuilt when tasks open or close connections.
+ */
+static WaitEventSet *CronWaitEventSet = NULL;
+static WaitEvent *CronWaitEvents = NULL;
+static int CronWaitEventCount = 0;
+static bool CronWaitEventSetChanged = true;
+
+/*
+ * Tasks whose socket is in the wait event set, or should be added to it on
+ * the next rebuild, and the first start deadline among them.
+ */
+static List *SocketTaskList = NIL;
+static TimestampTz NextStartDeadline = 0;
+
+#if (PG_VERSION_NUM >= 150000)
+static shmem_request_hook_type PrevShmemRequestHook = NULL;
+#endif
+static shmem_startup_hook_type PrevShmemStartupHook = NULL;
+
+char  *cron_timezone = NULL;
 
 #if PG_VERSION_NUM < 190000
 #define PG_SIG_IGN SIG_IGN
@@ -266,6 +301,110 @@ _PG_init(void)
 		GUC_SUPERUSER_ONLY,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"cron.log_run_batch_size",
+		gettext_noop("Maximum number of runs for which changes to the "
+					 "job_run_details table are kept in memory."),
+		gettext_noop("Changes are written in a single transaction once this "
+					 "many runs changed, or when cron.log_run_flush_interval "
+					 "passed. 0 writes every change in its own transaction."),
+		&CronLogRunBatchSize,
+		100,
+		0,
+		10000,
+		PGC_SIGHUP,
+		GUC_SUPERUSER_ONLY,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"cron.log_run_flush_interval",
+		gettext_noop("Maximum time for which changes to the job_run_details "
+					 "table are kept in memory."),
+		gettext_noop("0 writes the changes whenever the launcher is about to "
+					 "wait."),
+		&CronLogRunFlushInterval,
+		0,
+		0,
+		60000,
+		PGC_SIGHUP,
+		GUC_SUPERUSER_ONLY | GUC_UNIT_MS,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"cron.log_run_synchronous_commit",
+		gettext_noop("Wait for changes to the job_run_details table to be "
+					 "flushed to disk."),
+		gettext_noop("When off, the last changes may be lost in a crash."),
+		&CronLogRunSynchronousCommit,
+		true,
+		PGC_SIGHUP,
+		GUC_SUPERUSER_ONLY,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"cron.run_details_retention",
+		gettext_noop("Time for which runs are kept in the job_run_details table."),
+		gettext_noop("Runs that finished longer ago are removed in small batches. "
+					 "0 keeps all runs."),
+		&CronRunDetailsRetention,
+		0,
+		0,
+		INT_MAX,
+		PGC_SIGHUP,
+		GUC_SUPERUSER_ONLY | GUC_UNIT_MIN,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"cron.run_details_purge_batch_size",
+		gettext_noop("Maximum number of runs that are removed from the "
+					 "job_run_details table at once."),
+		NULL,
+		&CronRunDetailsPurgeBatchSize,
+		1000,
+		1,
+		100000,
+		PGC_SIGHUP,
+		GUC_SUPERUSER_ONLY,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"cron.run_details_purge_delay",
+		gettext_noop("Time to wait between removing batches of runs from the "
+					 "job_run_details table."),
+		NULL,
+		&CronRunDetailsPurgeDelay,
+		1000,
+		0,
+		3600000,
+		PGC_SIGHUP,
+		GUC_SUPERUSER_ONLY | GUC_UNIT_MS,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"cron.use_run_logger",
+		gettext_noop("Write changes to the job_run_details table from a separate "
+					 "background worker."),
+		gettext_noop("The scheduler queues changes in shared memory instead of "
+					 "writing them itself. Changes that do not fit in the queue "
+					 "are dropped."),
+		&CronUseRunLogger,
+		false,
+		PGC_POSTMASTER,
+		GUC_SUPERUSER_ONLY,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"cron.run_logger_queue_size",
+		gettext_noop("Size of the queue of changes to the job_run_details table."),
+		gettext_noop("Only used when cron.use_run_logger is on."),
+		&CronRunLoggerQueueSize,
+		1024,
+		64,
+		1048576,
+		PGC_POSTMASTER,
+		GUC_SUPERUSER_ONLY | GUC_UNIT_KB,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"cron.enable_superuser_jobs",
 		gettext_noop("Allow jobs to be scheduled as superuser"),
@@ -362,6 +501,115 @@ _PG_init(void)
 		GUC_SUPERUSER_ONLY,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"cron.job_refresh_delay",
+		gettext_noop("Time to wait for more job changes before reloading jobs."),
+		gettext_noop("Changes to cron.job that arrive within this time of each "
+					 "other are handled by a single reload, as long as the "
+					 "first change waited less than 10 times this long."),
+		&JobRefreshDelay,
+		0,
+		0,
+		60000,
+		PGC_SIGHUP,
+		GUC_SUPERUSER_ONLY | GUC_UNIT_MS,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"cron.connection_cache_timeout",
+		gettext_noop("Time for which connections of finished jobs are kept to "
+					 "run more jobs."),
+		gettext_noop("Only used when cron.use_background_workers is off. Cached "
+					 "connections are reset using DISCARD ALL and run jobs for "
+					 "the same host, port, database and user without connecting "
+					 "again. 0 disables the cache."),
+		&CronConnectionCacheTimeout,
+		0,
+		0,
+		86400000,
+		PGC_SIGHUP,
+		GUC_SUPERUSER_ONLY | GUC_UNIT_MS,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"cron.background_worker_pool_size",
+		gettext_noop("Maximum number of background workers that are kept to run "
+					 "more jobs."),
+		gettext_noop("Only used when cron.use_background_workers is on. Pooled "
+					 "workers run jobs for the same database and user without "
+					 "starting a new process."),
+		&CronWorkerPoolSize,
+		0,
+		0,
+		max_worker_processes,
+		PGC_SIGHUP,
+		GUC_SUPERUSER_ONLY,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"cron.background_worker_idle_timeout",
+		gettext_noop("Time after which an idle pooled background worker is stopped."),
+		NULL,
+		&CronWorkerIdleTimeout,
+		60000,
+		0,
+		86400000,
+		PGC_SIGHUP,
+		GUC_SUPERUSER_ONLY | GUC_UNIT_MS,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"cron.background_worker_job_slots",
+		gettext_noop("Number of preallocated shared memory slots for jobs that "
+					 "run in a background worker."),
+		gettext_noop("Only used when cron.use_background_workers is on. Jobs "
+					 "that do not get a slot use a shared memory segment of "
+					 "their own. -1 uses cron.max_running_jobs, 0 disables "
+					 "the slots."),
+		&CronJobSlotCount,
+		-1,
+		-1,
+		max_worker_processes,
+		PGC_POSTMASTER,
+		GUC_SUPERUSER_ONLY,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"cron.max_job_stats",
+		gettext_noop("Maximum number of jobs for which run statistics are kept."),
+		gettext_noop("When there is no room for another job, the statistics "
+					 "of the job that finished a run longest ago are removed. "
+					 "0 disables the statistics."),
+		&CronMaxJobStats,
+		1000,
+		0,
+		1000000,
+		PGC_POSTMASTER,
+		GUC_SUPERUSER_ONLY,
+		NULL, NULL, NULL);
+
+	if (!CronLogRun)
+	{
+		/* there is nothing to write */
+		CronUseRunLogger = false;
+	}
+
+	/*
+	 * Reserve shared memory for counters, runs in progress, statistics of
+	 * jobs and the queue of the run logger.
+	 */
+	InitializeSharedState(MaxRunningTasks);
+
+#if (PG_VERSION_NUM >= 150000)
+	PrevShmemRequestHook = shmem_request_hook;
+	shmem_request_hook = PgCronShmemRequest;
+#else
+	RequestPgCronShmem();
+#endif
+
+	PrevShmemStartupHook = shmem_startup_hook;
+	shmem_startup_hook = PgCronShmemStartup;
+
 	/* set up common data for all our workers */
 	worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
 	worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
@@ -379,6 +627,11 @@ _PG_init(void)
 #endif
 
 	RegisterBackgroundWorker(&worker);
+
+	if (CronUseRunLogger)
+	{
+		RegisterRunLogger();
+	}
 }
 
 
@@ -571,6 +824,57 @@ bgw_generate_returned_message(StringInfoData *display_msg, ErrorData edata)
 }
 
 
+/*
+ * RequestPgCronShmem requests the shared memory and locks of all parts of
+ * pg_cron.
+ */
+static void
+RequestPgCronShmem(void)
+{
+	CronSharedStateRequest();
+	JobStatsShmemRequest();
+	RunLoggerShmemRequest();
+}
+
+
+#if (PG_VERSION_NUM >= 150000)
+
+/*
+ * PgCronShmemRequest requests the shared memory of pg_cron once
+ * shared_preload_libraries are loaded.
+ */
+static void
+PgCronShmemRequest(void)
+{
+	if (PrevShmemRequestHook != NULL)
+	{
+		PrevShmemRequestHook();
+	}
+
+	RequestPgCronShmem();
+}
+
+#endif
+
+
+/*
+ * PgCronShmemStartup attaches to the shared memory of all parts of pg_cron,
+ * and initializes it if we are the first to do so.
+ */
+static void
+PgCronShmemStartup(void)
+{
+	if (PrevShmemStartupHook != NULL)
+	{
+		PrevShmemStartupHook();
+	}
+
+	CronSharedStateStartup();
+	JobStatsShmemStartup();
+	RunLoggerShmemStartup();
+}
+
+
 /*
  * PgCronLauncherMain is the main entry-point for the background worker
  * that performs tasks.
@@ -609,6 +913,7 @@ PgCronLauncherMain(Datum arg)
 	 * failed.
 	 */
 	MarkPendingRunsAsFailed();
+	ResetRunProgress();
 
 	/* Determine how many tasks we can run concurrently */
 	if (MaxConnections < MaxRunningTasks)
@@ -634,9 +939,15 @@ PgCronLauncherMain(Datum arg)
 	}
 	#endif
 
-	if (UseBackgroundWorkers && max_worker_processes - 1 < MaxRunningTasks)
+	if (UseBackgroundWorkers)
 	{
-		MaxRunningTasks = max_worker_processes - 1;
+		/* leave room for the launcher and the run logger */
+		int maxJobWorkers = max_worker_processes - (CronUseRunLogger ? 2 : 1);
+
+		if (maxJobWorkers < MaxRunningTasks)
+		{
+			MaxRunningTasks = maxJobWorkers;
+		}
 	}
 
 	if (MaxRunningTasks <= 0)
@@ -652,6 +963,14 @@ PgCronLauncherMain(Datum arg)
 											  ALLOCSET_DEFAULT_MAXSIZE);
 	InitializeJobMetadataCache();
 	InitializeTaskStateHash();
+	InitializeConnectionCache(MaxRunningTasks);
+
+	if (UseBackgroundWorkers)
+	{
+		InitializeJobSlots(CronJobSlotCount < 0 ? MaxRunningTasks : CronJobSlotCount);
+	}
+
+	LoadCronTimezone();
 
 	ereport(LOG, (errmsg("pg_cron scheduler started")));
 
@@ -663,8 +982,8 @@ PgCronLauncherMain(Datum arg)
 
 	for (;;)
 	{
-		List *taskList = NIL;
 		TimestampTz currentTime = 0;
+		bool latchSet = false;
 
 		CHECK_FOR_INTERRUPTS();
 
@@ -678,22 +997,50 @@ PgCronLauncherMain(Datum arg)
 												PGC_POSTMASTER, PGC_S_OVERRIDE);
 			ConfigReloadPending = false;
 
-			/* Some settings might have changed, force RefreshTaskHash() */
-			CronJobCacheValid = false;
+			LoadCronTimezone();
+
+			/* Some settings might have changed, force RefreshTaskHash() to reload all jobs */
+			ForceJobCacheReload();
+			ResetTaskRunTimes();
 		}
 
-		if (!CronJobCacheValid)
+		if (!CronJobCacheValid && JobCacheRefreshDue(GetCurrentTimestamp()))
 		{
-			RefreshTaskHash();
+			if (LastMinute == 0)
+			{
+				LastMinute = TimestampMinuteStart(GetCurrentTimestamp());
+			}
+
+			RefreshTaskHash(LastMinute);
 		}
 
-		taskList = CurrentTaskList();
 		currentTime = GetCurrentTimestamp();
 
-		StartAllPendingRuns(taskList, currentTime);
+		StartAllPendingRuns(currentTime);
+
+		/* write the changes to cron.job_run_details before we go to sleep */
+		FlushJobRunDetailsIfDue(GetCurrentTimestamp());
+		FlushJobRunRollupsIfDue(GetCurrentTimestamp());
+
+		latchSet = WaitForCronTasks();
+		ManageCronTasks(currentTime, latchSet);
+
+		if (UseBackgroundWorkers)
+		{
+			/* stop pooled workers that have been idle for too long */
+			RetireIdlePoolWorkers(GetCurrentTimestamp());
+		}
+		else
+		{
+			/* close cached connections that have been idle for too long */
+			CloseIdleConnections(GetCurrentTimestamp());
+		}
 
-		WaitForCronTasks(taskList);
-		ManageCronTasks(taskList, currentTime);
+		if (!CronUseRunLogger)
+		{
+			/* remove a batch of expired runs from cron.job_run_details */
+			PurgeJobRunDetailsIfDue(GetCurrentTimestamp());
+		}
 
 		MemoryContextReset(CronLoopContext);
 	}
@@ -706,36 +1053,43 @@ PgCronLauncherMain(Datum arg)
  * StartPendingRuns goes through the list of tasks and kicks of
  * runs for tasks that should start, taking clock changes into
  * into consideration.
+ *
+ * When the clock progresses normally, only the tasks at the front of the
+ * task queue are due, such that we do not need to look at every task on
+ * every minute. Interval jobs are kept on a separate list. Tasks that get
+ * a pending run are marked as ready for ManageCronTasks.
  */
 static void
-StartAllPendingRuns(List *taskList, TimestampTz currentTime)
+StartAllPendingRuns(TimestampTz currentTime)
 {
-	static TimestampTz lastMinute = 0;
-
 	int minutesPassed = 0;
 	ListCell *taskCell = NULL;
 	ClockProgress clockProgress;
+	TimestampTz currentMinute = TimestampMinuteStart(currentTime);
+	CalendarMinute calendarMinute;
 
 	if (!RebootJobsScheduled)
 	{
+		List *taskList = CurrentTaskList();
+
 		/* find jobs with @reboot as a schedule */
 		foreach(taskCell, taskList)
 		{
 			CronTask *task = (CronTask *) lfirst(taskCell);
-			CronJob *cronJob = GetCronJob(task->jobId);
-			entry *schedule = &cronJob->schedule;
+			entry *schedule = GetSlotSchedule(task->scheduleSlot);
 
 			if (schedule->flags & WHEN_REBOOT &&
 				task->isActive)
 			{
-				task->pendingRunCount += 1;
+				AddPendingRun(task, currentTime);
 			}
 		}
 
+		list_free(taskList);
 		RebootJobsScheduled = true;
 	}
 
-	foreach(taskCell, taskList)
+	foreach(taskCell, IntervalTaskList())
 	{
 		CronTask *task = (CronTask *) lfirst(taskCell);
 
@@ -751,17 +1105,19 @@ StartAllPendingRuns(List *taskList, TimestampTz currentTime)
 				TimestampDifferenceExceeds(task->lastStartTime, currentTime,
 										   task->secondsInterval * 1000))
 			{
-				task->pendingRunCount += 1;
+				AddPendingRun(task,
+							  TimestampTzPlusMilliseconds(task->lastStartTime,
+														  task->secondsInterval * 1000));
 			}
 		}
 	}
 
-	if (lastMinute == 0)
+	if (LastMinute == 0)
 	{
-		lastMinute = TimestampMinuteStart(currentTime);
+		LastMinute = currentMinute;
 	}
 
-	minutesPassed = MinutesPassed(lastMinute, currentTime);
+	minutesPassed = MinutesPassed(LastMinute, currentTime);
 	if (minutesPassed == 0)
 	{
 		/* wait for new minute */
@@ -795,21 +1151,71 @@ StartAllPendingRuns(List *taskList, TimestampTz currentTime)
 		clockProgress = CLOCK_CHANGE;
 	}
 
-	foreach(taskCell, taskList)
+	/* look up the wall clock once for all tasks that match on the minute */
+	GetCalendarMinute(currentMinute, &calendarMinute);
+
+	if (clockProgress == CLOCK_PROGRESSED ||
+		clockProgress == CLOCK_JUMP_FORWARD)
 	{
-		CronTask *task = (CronTask *) lfirst(taskCell);
+		List *dueTaskList = NIL;
+		CronTask *task = NULL;
 
-		if (!task->isActive)
+		/*
+		 * Every task that has a run time up to the current minute is due.
+		 * We take them all off the queue before putting them back with
+		 * their next run time, such that each task is handled once.
+		 */
+		while ((task = PopDueTask(currentMinute)) != NULL)
 		{
-			/*
-			 * The job has been unscheduled, so we should not schedule
-			 * new runs. The task will be safely removed on the next call
-			 * to ManageCronTask.
-			 */
-			continue;
+			dueTaskList = lappend(dueTaskList, task);
+		}
+
+		foreach(taskCell, dueTaskList)
+		{
+			task = (CronTask *) lfirst(taskCell);
+
+			StartPendingRuns(task, clockProgress, currentTime, &calendarMinute);
+			QueueTask(task, currentMinute);
+		}
+
+		list_free(dueTaskList);
+	}
+	else
+	{
+		/*
+		 * Only the wildcard jobs run after the clock jumped backwards, while
+		 * after a big clock change all jobs that match the current minute
+		 * run. Find them in the schedule index rather than checking every
+		 * task.
+		 */
+		List *matchingTaskList = MatchingTaskList(&calendarMinute, true,
+												  clockProgress == CLOCK_CHANGE);
+
+		foreach(taskCell, matchingTaskList)
+		{
+			CronTask *task = (CronTask *) lfirst(taskCell);
+
+			if (!task->isActive)
+			{
+				/*
+				 * The job has been unscheduled, so we should not schedule
+				 * new runs. The task will be safely removed on the next call
+				 * to ManageCronTask.
+				 */
+				continue;
+			}
+
+			StartPendingRuns(task, clockProgress, currentTime, &calendarMinute);
 		}
 
-		StartPendingRuns(task, clockProgress, lastMinute, currentTime);
+		list_free(matchingTaskList);
+
+		if (clockProgress == CLOCK_CHANGE)
+		{
+			/* skip over the run times we missed */
+			ResetTaskRunTimes();
+			RebuildTaskQueue(currentMinute);
+		}
 	}
 
 	/*
@@ -820,7 +1226,7 @@ StartAllPendingRuns(List *taskList, TimestampTz currentTime)
 	 */
 	if (clockProgress != CLOCK_JUMP_BACKWARD)
 	{
-		lastMinute = TimestampMinuteStart(currentTime);
+		LastMinute = currentMinute;
 	}
 }
 
@@ -828,15 +1234,21 @@ StartAllPendingRuns(List *taskList, TimestampTz currentTime)
 /*
  * StartPendingRuns kicks off pending runs for a task if it
  * should start, taking clock changes into consideration.
+ *
+ * For CLOCK_PROGRESSED and CLOCK_JUMP_FORWARD, the task should have been
+ * taken from the task queue, such that its nextRunTime is the first run
+ * time after the last minute we processed. For other clock changes, the
+ * task should match the current minute according to the schedule index.
+ * calendarMinute describes the current minute on the wall clock.
  */
 static void
 StartPendingRuns(CronTask *task, ClockProgress clockProgress,
-				 TimestampTz lastMinute, TimestampTz currentTime)
+				 TimestampTz currentTime, CalendarMinute *calendarMinute)
 {
-	CronJob *cronJob = GetCronJob(task->jobId);
-	entry *schedule = &cronJob->schedule;
-	TimestampTz virtualTime = lastMinute;
+	entry *schedule = GetSlotSchedule(task->scheduleSlot);
+	TimestampTz runTime = task->nextRunTime;
 	TimestampTz currentMinute = TimestampMinuteStart(currentTime);
+	bool isWildcard = (schedule->flags & (MIN_STAR | HR_STAR)) != 0;
 
 	switch (clockProgress)
 	{
@@ -847,17 +1259,12 @@ StartPendingRuns(CronTask *task, ClockProgress clockProgress,
 			 * run jobs for each virtual minute until caught up.
 			 */
 
-			do
+			while (runTime <= currentMinute)
 			{
-				virtualTime = TimestampTzPlusMilliseconds(virtualTime,
-														  60*1000);
+				AddPendingRun(task, runTime);
 
-				if (ShouldRunTask(schedule, virtualTime, true, true))
-				{
-					task->pendingRunCount += 1;
-				}
+				runTime = NextRunTime(schedule, runTime);
 			}
-			while (virtualTime < currentMinute);
 
 			break;
 		}
@@ -874,23 +1281,20 @@ StartPendingRuns(CronTask *task, ClockProgress clockProgress,
 			 * a chance to run, and we do our housekeeping
 			 */
 
-			/* run fixed-time jobs for each minute missed */
-			do
+			if (!isWildcard)
 			{
-				virtualTime = TimestampTzPlusMilliseconds(virtualTime,
-														  60*1000);
-
-				if (ShouldRunTask(schedule, virtualTime, false, true))
+				/* run fixed-time jobs for each minute missed */
+				while (runTime <= currentMinute)
 				{
-					task->pendingRunCount += 1;
-				}
-
-			} while (virtualTime < currentMinute);
+					AddPendingRun(task, runTime);
 
-			/* run wildcard jobs for current minute */
-			if (ShouldRunTask(schedule, currentMinute, true, false))
+					runTime = NextRunTime(schedule, runTime);
+				}
+			}
+			else if (ShouldRunTask(schedule, calendarMinute, true, false))
 			{
-				task->pendingRunCount += 1;
+				/* run wildcard jobs for current minute */
+				AddPendingRun(task, currentMinute);
 			}
 
 			break;
@@ -906,10 +1310,7 @@ StartPendingRuns(CronTask *task, ClockProgress clockProgress,
 			 * virtual time does not change until we are caught up
 			 */
 
-			if (ShouldRunTask(schedule, currentMinute, true, false))
-			{
-				task->pendingRunCount += 1;
-			}
+			AddPendingRun(task, currentMinute);
 
 			break;
 		}
@@ -921,15 +1322,58 @@ StartPendingRuns(CronTask *task, ClockProgress clockProgress,
 			 * intermediate fixed-time jobs and go back to
 			 * normal operation.
 			 */
-			if (ShouldRunTask(schedule, currentMinute, true, true))
-			{
-				task->pendingRunCount += 1;
-			}
+			AddPendingRun(task, currentMinute);
 		}
 	}
 }
 
 
+/*
+ * AddPendingRun adds a run of the task that was due at runTime. Pending runs
+ * are only counted, but the time at which the oldest one was due is kept to
+ * measure how late it starts.
+ */
+static void
+AddPendingRun(CronTask *task, TimestampTz runTime)
+{
+	if (task->pendingRunCount == 0)
+	{
+		task->pendingRunTime = runTime;
+	}
+
+	task->pendingRunCount += 1;
+
+	/* the launcher starts the run on its next pass */
+	MarkTaskReady(task);
+}
+
+
+/*
+ * NextPendingRunTime returns when the next pending run of a task was due,
+ * after the oldest one started. When the launcher catches up on a schedule,
+ * pending runs were added for consecutive run times of the schedule, in
+ * other cases the next run was due no later than now.
+ */
+static TimestampTz
+NextPendingRunTime(CronTask *task, TimestampTz currentTime)
+{
+	entry *schedule = NULL;
+
+	if (task->secondsInterval > 0)
+	{
+		return currentTime;
+	}
+
+	schedule = GetSlotSchedule(task->scheduleSlot);
+	if ((schedule->flags & WHEN_REBOOT) != 0)
+	{
+		return currentTime;
+	}
+
+	return Min(NextRunTime(schedule, task->pendingRunTime), currentTime);
+}
+
+
 /*
  * MinutesPassed returns the number of minutes between startTime and
  * stopTime rounded down to the closest integer.
@@ -989,34 +1433,26 @@ TimestampMinuteEnd(TimestampTz time)
 
 
 /*
- * ShouldRunTask returns whether a job should run in the current
- * minute according to its schedule.
+ * ShouldRunTask returns whether a job should run in the given minute
+ * according to its schedule.
  */
 static bool
-ShouldRunTask(entry *schedule, TimestampTz currentTime, bool doWild,
+ShouldRunTask(entry *schedule, CalendarMinute *calendarMinute, bool doWild,
 			  bool doNonWild)
 {
-	pg_time_t currentTime_t = timestamptz_to_time_t(currentTime);
-	pg_time_t tomorrowTime_t = timestamptz_to_time_t(currentTime + USECS_PER_DAY);
-	struct pg_tm* cur_tm = pg_localtime(&currentTime_t, pg_tzset(cron_timezone));
-
-	int minute = cur_tm->tm_min -FIRST_MINUTE;
-	int hour = cur_tm->tm_hour -FIRST_HOUR;
-	int dayOfMonth = cur_tm->tm_mday -FIRST_DOM;
-	int month = cur_tm->tm_mon +1 -FIRST_MONTH;
-	int dayOfWeek = cur_tm->tm_wday -FIRST_DOW;
-
-	/*
-	 * pg_localtime returns a pointer to a global struct,
-	 * so cur_tm cannot be used after this point.
-	 */
-	struct pg_tm* tomorrow_tm = pg_localtime(&tomorrowTime_t, pg_tzset(cron_timezone));
-	bool is_lastdom = tomorrow_tm->tm_mday == 1;
-	bool thisdom = bit_test(schedule->dom, dayOfMonth) != 0 || (is_lastdom && (schedule->flags & DOM_LAST) != 0);
-	bool thisdow = bit_test(schedule->dow, dayOfWeek);
-	if (bit_test(schedule->minute, minute) &&
-		bit_test(schedule->hour, hour) &&
-		bit_test(schedule->month, month) &&
+	int minute = calendarMinute->minute - FIRST_MINUTE;
+	int hour = calendarMinute->hour - FIRST_HOUR;
+	int dayOfMonth = calendarMinute->dayOfMonth - FIRST_DOM;
+	int month = calendarMinute->month - FIRST_MONTH;
+	int dayOfWeek = calendarMinute->dayOfWeek - FIRST_DOW;
+
+	bool thisdom = (schedule->dom & (UINT64CONST(1) << dayOfMonth)) != 0 ||
+				   (calendarMinute->isLastDayOfMonth &&
+					(schedule->flags & DOM_LAST) != 0);
+	bool thisdow = (schedule->dow & (UINT64CONST(1) << dayOfWeek)) != 0;
+	if ((schedule->minute & (UINT64CONST(1) << minute)) != 0 &&
+		(schedule->hour & (UINT64CONST(1) << hour)) != 0 &&
+		(schedule->month & (UINT64CONST(1) << month)) != 0 &&
 		((CronDomDowAndLogic || (schedule->flags & (DOM_STAR | DOW_STAR)) != 0)
 			 ? (thisdom && thisdow)
 			 : (thisdom || thisdow)))
@@ -1033,183 +1469,103 @@ ShouldRunTask(entry *schedule, TimestampTz currentTime, bool doWild,
 
 
 /*
- * WaitForCronTasks blocks waiting for any active task for at most
- * 1 second.
- */
-static void
-WaitForCronTasks(List *taskList)
-{
-	int taskCount = list_length(taskList);
-
-	if (taskCount > 0)
-	{
-		PollForTasks(taskList);
-	}
-	else
-	{
-		WaitForLatch(MaxWait);
-	}
-}
-
-
-/*
- * WaitForLatch waits for the given number of milliseconds unless a signal
- * is received or postmaster shuts down.
+ * WaitForCronTasks blocks until a task socket becomes ready, the latch is
+ * set, or a task needs attention because a timeout expired or a new minute
+ * started, but for at most 1 second. Tasks whose socket became ready are
+ * marked as ready. Returns whether the latch was set, which is assumed when
+ * there was work to be done without waiting.
  */
-static void
-WaitForLatch(int timeoutMs)
-{
-	int rc = 0;
-	int waitFlags = WL_LATCH_SET | WL_POSTMASTER_DEATH | WL_TIMEOUT;
-
-	/* nothing to do, wait for new jobs */
-#if (PG_VERSION_NUM >= 100000)
-	rc = WaitLatch(MyLatch, waitFlags, timeoutMs, PG_WAIT_EXTENSION);
-#else
-	rc = WaitLatch(MyLatch, waitFlags, timeoutMs);
-#endif
-
-	ResetLatch(MyLatch);
-
-	CHECK_FOR_INTERRUPTS();
-
-	if (rc & WL_POSTMASTER_DEATH)
-	{
-		/* postmaster died and we should bail out immediately */
-		proc_exit(1);
-	}
-}
-
-
-/*
- * PollForTasks calls poll() for the sockets of all tasks. It checks for
- * read or write events based on the pollingStatus of the task.
- */
-static void
-PollForTasks(List *taskList)
+static bool
+WaitForCronTasks(void)
 {
 	TimestampTz currentTime = 0;
 	TimestampTz nextEventTime = 0;
-	int pollTimeout = 0;
+	TimestampTz flushTime = 0;
+	int waitTimeout = 0;
 	long waitSeconds = 0;
 	int waitMicros = 0;
-	CronTask **polledTasks = NULL;
-	struct pollfd *pollFDs = NULL;
-	int pollResult = 0;
-
-	int taskIndex = 0;
-	int taskCount = list_length(taskList);
-	int activeTaskCount = 0;
+	int eventCount = 0;
+	int eventIndex = 0;
+	bool latchSet = false;
 	ListCell *taskCell = NULL;
 
-	polledTasks = (CronTask **) palloc0(taskCount * sizeof(CronTask *));
-	pollFDs = (struct pollfd *) palloc0(taskCount * sizeof(struct pollfd));
-
 	currentTime = GetCurrentTimestamp();
 
+	if (CronWaitEventSet == NULL || CronWaitEventSetChanged)
+	{
+		RebuildWaitEventSet();
+	}
+
+	if (NextStartDeadline != 0 && NextStartDeadline <= currentTime)
+	{
+		WakeTimedOutTasks(currentTime);
+	}
+
 	/*
 	 * At the latest, wake up when the next minute starts.
 	 */
 	nextEventTime = TimestampMinuteEnd(currentTime);
 
-	foreach(taskCell, taskList)
+	/* wake up when buffered changes to cron.job_run_details are due */
+	flushTime = JobRunDetailsFlushTime();
+	if (flushTime != 0 && TimestampDifferenceExceeds(flushTime, nextEventTime, 0))
 	{
-		CronTask *task = (CronTask *) lfirst(taskCell);
-		PostgresPollingStatusType pollingStatus = task->pollingStatus;
-		struct pollfd *pollFileDescriptor = &pollFDs[activeTaskCount];
+		nextEventTime = flushTime;
+	}
 
-		if (activeTaskCount >= MaxRunningTasks)
-		{
-			/* already polling the maximum number of tasks */
-			break;
-		}
+	/* wake up when a task that waits for its socket reaches its deadline */
+	if (NextStartDeadline != 0 &&
+		TimestampDifferenceExceeds(NextStartDeadline, nextEventTime, 0))
+	{
+		nextEventTime = NextStartDeadline;
+	}
+
+	foreach(taskCell, ReadyTaskList())
+	{
+		CronTask *task = (CronTask *) lfirst(taskCell);
 
 		if (task->state == CRON_TASK_ERROR || task->state == CRON_TASK_DONE ||
 			CanStartTask(task))
 		{
 			/* there is work to be done, don't wait */
-			pfree(polledTasks);
-			pfree(pollFDs);
-			return;
+			return true;
 		}
 
-		if (task->state == CRON_TASK_WAITING && task->pendingRunCount == 0)
+		if ((task->state == CRON_TASK_CONNECTING ||
+			 task->state == CRON_TASK_SENDING) &&
+			TimestampDifferenceExceeds(task->startDeadline, nextEventTime, 0))
 		{
-			/*
-			 * Make sure we do not wait past the next run time of an interval
-			 * job.
-			 */
-			if (task->secondsInterval > 0)
-			{
-				TimestampTz nextRunTime =
-					TimestampTzPlusMilliseconds(task->lastStartTime,
-												task->secondsInterval * 1000);
-
-				if (TimestampDifferenceExceeds(nextRunTime, nextEventTime, 0))
-				{
-					nextEventTime = nextRunTime;
-				}
-			}
-
-			/* don't poll idle tasks */
-			continue;
+			/* wake up when the start timeout of the task expires */
+			nextEventTime = task->startDeadline;
 		}
 
-		if (task->state == CRON_TASK_CONNECTING ||
-			task->state == CRON_TASK_SENDING)
+		if (task->state == CRON_TASK_BGW_START &&
+			TimestampDifferenceExceeds(task->nextStartAttempt, nextEventTime, 0))
 		{
-			/*
-			 * We need to wake up when a timeout expires.
-			 * Take the minimum of nextEventTime and task->startDeadline.
-			 */
-			if (TimestampDifferenceExceeds(task->startDeadline, nextEventTime, 0))
-			{
-				nextEventTime = task->startDeadline;
-			}
+			/* wake up to try starting the background worker again */
+			nextEventTime = task->nextStartAttempt;
 		}
+	}
 
-		/* we plan to poll this task */
-		pollFileDescriptor = &pollFDs[activeTaskCount];
-		polledTasks[activeTaskCount] = task;
+	foreach(taskCell, IntervalTaskList())
+	{
+		CronTask *task = (CronTask *) lfirst(taskCell);
 
-		if (task->state == CRON_TASK_CONNECTING ||
-			task->state == CRON_TASK_SENDING ||
-			task->state == CRON_TASK_BGW_RUNNING ||
-			task->state == CRON_TASK_RUNNING)
+		if (task->state == CRON_TASK_WAITING && task->pendingRunCount == 0)
 		{
-			PGconn *connection = task->connection;
-			int pollEventMask = 0;
-
 			/*
-			 * Set the appropriate mask for poll, based on the current polling
-			 * status of the task, controlled by ManageCronTask.
+			 * Make sure we do not wait past the next run time of an interval
+			 * job.
 			 */
+			TimestampTz nextRunTime =
+				TimestampTzPlusMilliseconds(task->lastStartTime,
+											task->secondsInterval * 1000);
 
-			if (pollingStatus == PGRES_POLLING_READING)
-			{
-				pollEventMask = POLLERR | POLLIN;
-			}
-			else if (pollingStatus == PGRES_POLLING_WRITING)
+			if (TimestampDifferenceExceeds(nextRunTime, nextEventTime, 0))
 			{
-				pollEventMask = POLLERR | POLLOUT;
+				nextEventTime = nextRunTime;
 			}
-
-			pollFileDescriptor->fd = PQsocket(connection);
-			pollFileDescriptor->events = pollEventMask;
-		}
-		else
-		{
-			/*
-			 * Task is not running.
-			 */
-
-			pollFileDescriptor->fd = -1;
-			pollFileDescriptor->events = 0;
 		}
-
-		pollFileDescriptor->revents = 0;
-
-		activeTaskCount++;
 	}
 
 	/*
@@ -1218,59 +1574,209 @@ PollForTasks(List *taskList)
 	 */
 	TimestampDifference(currentTime, nextEventTime, &waitSeconds, &waitMicros);
 
-	pollTimeout = waitSeconds * 1000 + waitMicros / 1000;
-	if (pollTimeout <= 0)
+	waitTimeout = waitSeconds * 1000 + waitMicros / 1000;
+	if (waitTimeout <= 0)
 	{
 		/*
 		 * Interval jobs might frequently be overdue, inject a small
 		 * 1ms wait to avoid getting into a tight loop.
 		 */
-		pollTimeout = 1;
+		waitTimeout = 1;
 	}
-	else if (pollTimeout > MaxWait)
+	else if (waitTimeout > MaxWait)
 	{
 		/*
 		 * We never wait more than 1 second, this gives us a chance to react
 		 * to external events like a TERM signal and job changes.
 		 */
 
-		pollTimeout = MaxWait;
+		waitTimeout = MaxWait;
 	}
 
-	if (activeTaskCount == 0)
+	eventCount = WaitEventSetWait(CronWaitEventSet, waitTimeout, CronWaitEvents,
+								  CronWaitEventCount, PG_WAIT_EXTENSION);
+
+	for (eventIndex = 0; eventIndex < eventCount; eventIndex++)
 	{
-		/* turns out there's nothing to do, just wait for something to happen */
-		WaitForLatch(pollTimeout);
+		WaitEvent *event = &CronWaitEvents[eventIndex];
+
+		if (event->events & WL_POSTMASTER_DEATH)
+		{
+			/* postmaster died and we should bail out immediately */
+			proc_exit(1);
+		}
+
+		if (event->events & WL_LATCH_SET)
+		{
+			ResetLatch(MyLatch);
+			latchSet = true;
+		}
+
+		if (event->events & (WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE))
+		{
+			CronTask *task = (CronTask *) event->user_data;
+
+			task->isSocketReady = true;
+			MarkTaskReady(task);
+		}
+	}
+
+	CHECK_FOR_INTERRUPTS();
+
+	return latchSet;
+}
+
+
+/*
+ * WakeTimedOutTasks marks the tasks that wait for their socket and reached
+ * their start deadline as ready, such that ManageCronTask fails them, and
+ * finds the next start deadline.
+ */
+static void
+WakeTimedOutTasks(TimestampTz currentTime)
+{
+	ListCell *taskCell = NULL;
+
+	NextStartDeadline = 0;
+
+	foreach(taskCell, SocketTaskList)
+	{
+		CronTask *task = (CronTask *) lfirst(taskCell);
+
+		if (task->startDeadline == 0)
+		{
+			continue;
+		}
+
+		if (task->startDeadline <= currentTime)
+		{
+			MarkTaskReady(task);
+		}
+		else if (NextStartDeadline == 0 || task->startDeadline < NextStartDeadline)
+		{
+			NextStartDeadline = task->startDeadline;
+		}
+	}
+}
+
 
-		pfree(polledTasks);
-		pfree(pollFDs);
+/*
+ * GetTaskWaitEvent determines the socket of a task and whether we should
+ * wait for it to become readable or writable, based on the pollingStatus
+ * of the task, controlled by ManageCronTask. If there is nothing to wait
+ * for, socket is set to PGINVALID_SOCKET.
+ */
+static void
+GetTaskWaitEvent(CronTask *task, pgsocket *socket, uint32 *events)
+{
+	*socket = PGINVALID_SOCKET;
+	*events = 0;
+
+	if (task->connection == NULL)
+	{
 		return;
 	}
 
-	pollResult = poll(pollFDs, activeTaskCount, pollTimeout);
-	if (pollResult < 0)
+	if (task->state != CRON_TASK_CONNECTING &&
+		task->state != CRON_TASK_SENDING &&
+		task->state != CRON_TASK_RUNNING)
 	{
-		/*
-		 * This typically happens in case of a signal, though we should
-		 * probably check errno in case something bad happened.
-		 */
+		return;
+	}
 
-		pfree(polledTasks);
-		pfree(pollFDs);
+	if (task->pollingStatus == PGRES_POLLING_READING)
+	{
+		*events = WL_SOCKET_READABLE;
+	}
+	else if (task->pollingStatus == PGRES_POLLING_WRITING)
+	{
+		*events = WL_SOCKET_WRITEABLE;
+	}
+	else
+	{
 		return;
 	}
 
-	for (taskIndex = 0; taskIndex < activeTaskCount; taskIndex++)
+	*socket = PQsocket(task->connection);
+	if (*socket == PGINVALID_SOCKET)
+	{
+		*events = 0;
+	}
+}
+
+
+/*
+ * RebuildWaitEventSet replaces the wait event set by one that contains the
+ * latch, postmaster death and the sockets of the tasks in SocketTaskList
+ * that still have one. Tasks that closed their socket are dropped from the
+ * list, as are duplicates.
+ */
+static void
+RebuildWaitEventSet(void)
+{
+	List *socketTaskList = NIL;
+	ListCell *taskCell = NULL;
+	MemoryContext oldContext = NULL;
+
+	if (CronWaitEventSet != NULL)
+	{
+		FreeWaitEventSet(CronWaitEventSet);
+		pfree(CronWaitEvents);
+	}
+
+	CronWaitEventCount = list_length(SocketTaskList) + 2;
+
+#if (PG_VERSION_NUM >= 170000)
+	CronWaitEventSet = CreateWaitEventSet(NULL, CronWaitEventCount);
+#else
+	CronWaitEventSet = CreateWaitEventSet(TopMemoryContext, CronWaitEventCount);
+#endif
+	CronWaitEvents = MemoryContextAlloc(TopMemoryContext,
+										CronWaitEventCount * sizeof(WaitEvent));
+
+	AddWaitEventToSet(CronWaitEventSet, WL_LATCH_SET, PGINVALID_SOCKET,
+					  MyLatch, NULL);
+	AddWaitEventToSet(CronWaitEventSet, WL_POSTMASTER_DEATH, PGINVALID_SOCKET,
+					  NULL, NULL);
+
+	foreach(taskCell, SocketTaskList)
 	{
-		CronTask *task = polledTasks[taskIndex];
-		struct pollfd *pollFileDescriptor = &pollFDs[taskIndex];
+		CronTask *task = (CronTask *) lfirst(taskCell);
 
-		task->isSocketReady = pollFileDescriptor->revents &
-							  pollFileDescriptor->events;
+		task->waitSocket = PGINVALID_SOCKET;
+		task->waitEvents = 0;
+		task->waitEventPosition = -1;
 	}
 
-	pfree(polledTasks);
-	pfree(pollFDs);
+	oldContext = MemoryContextSwitchTo(TopMemoryContext);
+
+	foreach(taskCell, SocketTaskList)
+	{
+		CronTask *task = (CronTask *) lfirst(taskCell);
+		pgsocket taskSocket = PGINVALID_SOCKET;
+		uint32 taskEvents = 0;
+
+		GetTaskWaitEvent(task, &taskSocket, &taskEvents);
+
+		if (taskSocket == PGINVALID_SOCKET || task->waitEventPosition >= 0)
+		{
+			/* the task closed its socket, or it was already added */
+			continue;
+		}
+
+		task->waitSocket = taskSocket;
+		task->waitEvents = taskEvents;
+		task->waitEventPosition = AddWaitEventToSet(CronWaitEventSet, taskEvents,
+													taskSocket, NULL, task);
+
+		socketTaskList = lappend(socketTaskList, task);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	list_free(SocketTaskList);
+	SocketTaskList = socketTaskList;
+	CronWaitEventSetChanged = false;
 }
 
 
@@ -1287,19 +1793,105 @@ CanStartTask(CronTask *task)
 
 
 /*
- * ManageCronTasks proceeds the state machines of the given list of tasks.
+ * ManageCronTasks proceeds the state machines of the tasks that are ready,
+ * which are the tasks whose socket became ready or whose job changed, and
+ * the tasks that are due or need to be handled again. Background workers
+ * set our latch when anything happens to them, so their tasks are only
+ * handled when latchSet is true.
  */
 static void
-ManageCronTasks(List *taskList, TimestampTz currentTime)
+ManageCronTasks(TimestampTz currentTime, bool latchSet)
 {
+	List *taskList = TakeReadyTaskList();
 	ListCell *taskCell = NULL;
 
 	foreach(taskCell, taskList)
 	{
 		CronTask *task = (CronTask *) lfirst(taskCell);
 
+		if (task->state == CRON_TASK_WAITING && !task->isActive)
+		{
+			/* the job has been removed, remove the task as well */
+			RemoveTask(task->jobId);
+			continue;
+		}
+
+		if (!latchSet && (task->isActive || task->terminating) &&
+			(task->state == CRON_TASK_BGW_STARTING ||
+			 task->state == CRON_TASK_BGW_RUNNING))
+		{
+			/* nothing happened to the background worker */
+			MarkTaskReady(task);
+			continue;
+		}
+
 		ManageCronTask(task, currentTime);
+
+		task->isSocketReady = false;
+		WatchCronTask(task);
+	}
+
+	list_free(taskList);
+}
+
+
+/*
+ * WatchCronTask determines when a task should be handled again after
+ * ManageCronTask proceeded its state machine. Tasks that wait for their
+ * socket are added to the wait event set, idle tasks wait until they are
+ * due, and other tasks are marked as ready.
+ */
+static void
+WatchCronTask(CronTask *task)
+{
+	pgsocket taskSocket = PGINVALID_SOCKET;
+	uint32 taskEvents = 0;
+
+	GetTaskWaitEvent(task, &taskSocket, &taskEvents);
+
+	if (taskSocket != task->waitSocket ||
+		(taskSocket == PGINVALID_SOCKET && task->waitEventPosition >= 0))
+	{
+		/* the task opened a new connection or closed its connection */
+		CronWaitEventSetChanged = true;
+
+		if (taskSocket != PGINVALID_SOCKET)
+		{
+			MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
+
+			SocketTaskList = lappend(SocketTaskList, task);
+			MemoryContextSwitchTo(oldContext);
+		}
 	}
+	else if (taskSocket != PGINVALID_SOCKET && taskEvents != task->waitEvents &&
+			 !CronWaitEventSetChanged)
+	{
+		/* the task now waits for reading instead of writing or vice versa */
+		ModifyWaitEvent(CronWaitEventSet, task->waitEventPosition,
+						taskEvents, NULL);
+		task->waitEvents = taskEvents;
+	}
+
+	if (taskSocket != PGINVALID_SOCKET)
+	{
+		/* wake up when the socket becomes ready or the deadline is reached */
+		if (task->startDeadline != 0 &&
+			(NextStartDeadline == 0 || task->startDeadline < NextStartDeadline))
+		{
+			NextStartDeadline = task->startDeadline;
+		}
+
+		return;
+	}
+
+	if (task->state == CRON_TASK_WAITING && task->pendingRunCount == 0 &&
+		task->isActive)
+	{
+		/* StartAllPendingRuns marks the task as ready when it is due */
+		return;
+	}
+
+	MarkTaskReady(task);
 }
 
 
@@ -1319,20 +1911,20 @@ ManageCronTask(CronTask *task, TimestampTz currentTime)
 	{
 		case CRON_TASK_WAITING:
 		{
-			/* check if job has been removed */
-			if (!task->isActive)
-			{
-				/* remove task as well */
-				RemoveTask(jobId);
-				break;
-			}
-
 			if (!CanStartTask(task))
 			{
 				break;
 			}
 
+			/* the oldest pending run starts now */
+			task->runScheduledTime = task->pendingRunTime != 0 ?
+									 task->pendingRunTime : currentTime;
+			task->runLaunchTime = currentTime;
+
 			task->pendingRunCount -= 1;
+			if (task->pendingRunCount > 0)
+				task->pendingRunTime = NextPendingRunTime(task, currentTime);
+
 			if (UseBackgroundWorkers)
 				task->state = CRON_TASK_BGW_START;
 			else
@@ -1344,11 +1936,18 @@ ManageCronTask(CronTask *task, TimestampTz currentTime)
 
 			/* Add new entry to audit table. */
 			task->runId = NextRunId();
-			if (CronLogRun)
+			task->logRun = ShouldLogRun(task, cronJob);
+			task->runCount++;
+
+			if (CronLogRun && task->logRun)
 				InsertJobRunDetail(task->runId, &cronJob->jobId,
 										cronJob->database,
 										cronJob->userName,
 										cronJob->command, GetCronStatus(CRON_STATUS_STARTING));
+			else if (CronLogRun)
+				DeferJobRunDetail(task->runId, cronJob->jobId, cronJob->database,
+								  cronJob->userName, cronJob->command,
+								  cronJob->logMode == CRON_LOG_MODE_ROLLUP);
 		}
 
 		case CRON_TASK_START:
@@ -1384,7 +1983,7 @@ ManageCronTask(CronTask *task, TimestampTz currentTime)
 
 				Assert(sizeof(keywordArray) == sizeof(valueArray));
 
-				if (CronLogStatement)
+				if (CronLogStatement && task->logRun)
 				{
 					char *command = cronJob->command;
 
@@ -1392,6 +1991,33 @@ ManageCronTask(CronTask *task, TimestampTz currentTime)
 									 jobId, GetCronStatus(CRON_STATUS_STARTING), command)));
 				}
 
+				startDeadline = TimestampTzPlusMilliseconds(currentTime,
+											CronTaskStartTimeout);
+
+				connection = GetCachedConnection(cronJob->nodeName,
+												 cronJob->nodePort,
+												 cronJob->database,
+												 cronJob->userName);
+				if (connection != NULL)
+				{
+					pid_t pid = (pid_t) PQbackendPID(connection);
+
+					/* an idle connection was reset, send the command right away */
+					task->startDeadline = startDeadline;
+					task->connection = connection;
+					task->pollingStatus = PGRES_POLLING_WRITING;
+					task->state = CRON_TASK_SENDING;
+					task->runConnectedTime = GetCurrentTimestamp();
+
+					/* make sure the socket is added to the wait event set */
+					task->waitSocket = PGINVALID_SOCKET;
+
+					if (CronLogRun)
+						UpdateJobRunDetail(task->runId, (int32 *) &pid, GetCronStatus(CRON_STATUS_SENDING), NULL, NULL, NULL);
+
+					break;
+				}
+
 				connection = PQconnectStartParams(keywordArray, valueArray, false);
 				PQsetnonblocking(connection, 1);
 				PQsetNoticeReceiver(connection, CronNoticeReceiver, (void *) task);
@@ -1408,14 +2034,14 @@ ManageCronTask(CronTask *task, TimestampTz currentTime)
 					break;
 				}
 
-				startDeadline = TimestampTzPlusMilliseconds(currentTime,
-											CronTaskStartTimeout);
-
 				task->startDeadline = startDeadline;
 				task->connection = connection;
 				task->pollingStatus = PGRES_POLLING_WRITING;
 				task->state = CRON_TASK_CONNECTING;
 
+				/* make sure the new socket is added to the wait event set */
+				task->waitSocket = PGINVALID_SOCKET;
+
 				if (CronLogRun)
 					UpdateJobRunDetail(task->runId, NULL, GetCronStatus(CRON_STATUS_CONNECTING), NULL, NULL, NULL);
 
@@ -1425,154 +2051,236 @@ ManageCronTask(CronTask *task, TimestampTz currentTime)
 
 		case CRON_TASK_BGW_START:
 		{
-
-			BackgroundWorker worker;
-			pid_t pid;
-			shm_toc_estimator e;
-			shm_toc *toc;
-			char *database;
-			char *username;
-			char *command;
-			MemoryContext oldcontext;
-			shm_mq *mq;
-			Size segsize;
-			BackgroundWorkerHandle *handle;
-			BgwHandleStatus status;
-			bool registered;
-			TimestampTz startDeadline = 0;
+			bool registered = false;
 
 			/* break in the previous case has not been reached
 			 * checking just for extra precaution
 			 */
 			Assert(UseBackgroundWorkers);
-			#if PG_VERSION_NUM < 100000
-				Assert(CurrentResourceOwner == NULL);
-				CurrentResourceOwner = ResourceOwnerCreate(NULL, "pg_cron_worker");
-			#endif
 
-			#define QUEUE_SIZE ((Size) 65536)
+			if (task->seg != NULL || task->poolWorker != NULL)
+			{
+				/*
+				 * We could not register a background worker before, check
+				 * whether the job was removed in the meantime and whether it
+				 * is time to try again.
+				 */
+				if (!task->isActive)
+				{
+					CleanupCronTask(task);
+					task->errorMessage = "job canceled";
+					task->state = CRON_TASK_ERROR;
+					break;
+				}
 
-			/*
-			 * Create the shared memory that we will pass to the background
-			 * worker process.  We use DSM_CREATE_NULL_IF_MAXSEGMENTS so that we
-			 * do not ERROR here.  This way, we can mark the job as failed and
-			 * keep the launcher process running normally.
-			 */
-			shm_toc_initialize_estimator(&e);
-			shm_toc_estimate_chunk(&e, strlen(cronJob->database) + 1);
-			shm_toc_estimate_chunk(&e, strlen(cronJob->userName) + 1);
-			shm_toc_estimate_chunk(&e, strlen(cronJob->command) + 1);
-			shm_toc_estimate_chunk(&e, QUEUE_SIZE);
-			shm_toc_estimate_keys(&e, PG_CRON_NKEYS);
-			segsize = shm_toc_estimate(&e);
-
-			task->seg = dsm_create(segsize, DSM_CREATE_NULL_IF_MAXSEGMENTS);
-			if (task->seg == NULL)
+				if (jobStartupTimeout(task, currentTime))
+				{
+					CleanupCronTask(task);
+					task->errorMessage = "could not start background process; more "
+										 "details may be available in the server log";
+					ereport(WARNING,
+						(errcode(ERRCODE_CONFIGURATION_LIMIT_EXCEEDED),
+						errmsg("out of background worker slots"),
+						errhint("You might need to increase max_worker_processes.")));
+					break;
+				}
+
+				if (!TimestampDifferenceExceeds(task->nextStartAttempt,
+												currentTime, 0))
+				{
+					break;
+				}
+			}
+			else
 			{
-				task->state = CRON_TASK_ERROR;
-				task->errorMessage = "unable to create a DSM segment; more "
-								"details may be available in the server log";
+				if (CronLogStatement && task->logRun)
+				{
+					ereport(LOG, (errmsg("cron job " INT64_FORMAT " %s: %s",
+											 jobId, GetCronStatus(CRON_STATUS_STARTING),
+											 cronJob->command)));
+				}
+
+				/*
+				 * If no background worker slots are currently available, we
+				 * keep trying until the start deadline.
+				 */
+				task->startDeadline = TimestampTzPlusMilliseconds(currentTime,
+											CronTaskStartTimeout);
+				task->startRetryDelay = 0;
 
-				ereport(WARNING,
-					(errmsg("max number of DSM segments may has been reached")));
+				/* prefer a pooled worker, which can run more than one job */
+				task->poolWorker = GetIdlePoolWorker(cronJob->database,
+													 cronJob->userName);
+				if (task->poolWorker == NULL)
+				{
+					task->poolWorker = CreatePoolWorker(cronJob->database,
+														cronJob->userName);
+				}
 
-				break;
+				if (task->poolWorker != NULL)
+				{
+					task->sharedMemoryQueue = task->poolWorker->responseQueue;
+				}
+				else if (!CreateBgwTaskSegment(task, cronJob))
+				{
+					break;
+				}
 			}
 
-			toc = shm_toc_create(PG_CRON_MAGIC, dsm_segment_address(task->seg), segsize);
+			if (task->poolWorker != NULL && task->poolWorker->registered)
+			{
+				/*
+				 * An idle pooled worker is already running, so we can send it
+				 * the command right away.
+				 */
+				task->startDeadline = 0;
+				task->handle = task->poolWorker->handle;
+				task->state = CRON_TASK_BGW_STARTING;
+			}
+			else
+			{
+				BackgroundWorkerHandle *handle = NULL;
 
-			database = shm_toc_allocate(toc, strlen(cronJob->database) + 1);
-			strcpy(database, cronJob->database);
-			shm_toc_insert(toc, PG_CRON_KEY_DATABASE, database);
+				/*
+				 * Start the worker process. The postmaster sets our latch once
+				 * it started the worker, so we do not wait for that here.
+				 */
+				if (task->poolWorker != NULL)
+				{
+					registered = RegisterPoolWorker(task->poolWorker);
+				}
+				else
+				{
+					registered = RegisterBgwTaskWorker(task, &handle);
+				}
 
-			username = shm_toc_allocate(toc, strlen(cronJob->userName) + 1);
-			strcpy(username, cronJob->userName);
-			shm_toc_insert(toc, PG_CRON_KEY_USERNAME, username);
+				if (!registered)
+				{
+					/*
+					 * All background worker slots are in use. Idle pooled
+					 * workers keep their slots, so stop the least recently
+					 * used one and try again soon. Otherwise, try again after
+					 * a delay that doubles on every attempt.
+					 */
+					if (RetireIdlePoolWorker() || task->startRetryDelay == 0)
+					{
+						task->startRetryDelay = MinStartRetryDelay;
+					}
+					else
+					{
+						task->startRetryDelay = Min(2 * task->startRetryDelay,
+													MaxWait);
+					}
 
-			command = shm_toc_allocate(toc, strlen(cronJob->command) + 1);
-			strcpy(command, cronJob->command);
-			shm_toc_insert(toc, PG_CRON_KEY_COMMAND, command);
+					task->nextStartAttempt =
+						TimestampTzPlusMilliseconds(currentTime,
+													task->startRetryDelay);
+					break;
+				}
 
-			mq = shm_mq_create(shm_toc_allocate(toc, QUEUE_SIZE), QUEUE_SIZE);
-			shm_toc_insert(toc, PG_CRON_KEY_QUEUE, mq);
-			shm_mq_set_receiver(mq, MyProc);
+				task->startDeadline = 0;
+				task->nextStartAttempt = 0;
+				task->startRetryDelay = 0;
 
-			/*
-			 * Attach the queue before launching a worker, so that we'll automatically
-			 * detach the queue if we error out.  (Otherwise, the worker might sit
-			 * there trying to write the queue long after we've gone away.)
-			 */
-			oldcontext = MemoryContextSwitchTo(TopMemoryContext);
-			task->sharedMemoryQueue = shm_mq_attach(mq, task->seg, NULL);
-			MemoryContextSwitchTo(oldcontext);
+				if (task->poolWorker != NULL)
+				{
+					task->handle = task->poolWorker->handle;
+				}
+				else
+				{
+					task->handle = *handle;
+					pfree(handle);
+				}
 
-			/*
-			 * Prepare the background worker.
-			 *
-			 */
-			memset(&worker, 0, sizeof(BackgroundWorker));
-			worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
-			worker.bgw_start_time = BgWorkerStart_ConsistentState;
-			worker.bgw_restart_time = BGW_NEVER_RESTART;
-			sprintf(worker.bgw_library_name, "pg_cron");
-			sprintf(worker.bgw_function_name, "CronBackgroundWorker");
-#if (PG_VERSION_NUM >= 110000)
-			snprintf(worker.bgw_type, BGW_MAXLEN, "pg_cron");
-#endif
-			snprintf(worker.bgw_name, BGW_MAXLEN, "pg_cron worker");
-			worker.bgw_main_arg = UInt32GetDatum(dsm_segment_handle(task->seg));
-			worker.bgw_notify_pid = MyProcPid;
+				task->state = CRON_TASK_BGW_STARTING;
+				break;
+			}
+		}
 
-			/*
-			 * Start the worker process.
-			 */
-			if (CronLogStatement)
+		case CRON_TASK_BGW_STARTING:
+		{
+			pid_t pid = 0;
+			BgwHandleStatus status;
+
+			Assert(UseBackgroundWorkers);
+
+			status = GetBackgroundWorkerPid(&task->handle, &pid);
+			if (task->terminating ||
+				(status == BGWH_NOT_YET_STARTED && !task->isActive))
 			{
-				ereport(LOG, (errmsg("cron job " INT64_FORMAT " %s: %s",
-										 jobId, GetCronStatus(CRON_STATUS_STARTING), command)));
-			}
+				/*
+				 * The worker of a canceled run exits as soon as it starts. Its
+				 * job slot may only be reused once the postmaster forgot about
+				 * it, so we keep the task in this state until then.
+				 */
+				if (BgwTaskWorkerStopped(task))
+				{
+					CleanupCronTask(task);
+					task->errorMessage = "job canceled";
+					task->state = CRON_TASK_ERROR;
+				}
 
-			/* If no no background worker slots are currently available
-			 * let's try until we reach jobStartupTimeout
-			 */
-			startDeadline = TimestampTzPlusMilliseconds(currentTime,
-										CronTaskStartTimeout);
-			task->startDeadline = startDeadline;
-			do
+				break;
+			}
+			else if (status == BGWH_NOT_YET_STARTED)
 			{
-				registered = RegisterDynamicBackgroundWorker(&worker, &handle);
+				/* still waiting for the postmaster to start the worker */
+				break;
 			}
-			while (!registered && !jobStartupTimeout(task, GetCurrentTimestamp()));
-
-			if (!registered)
+			else if (status == BGWH_POSTMASTER_DIED)
 			{
 				CleanupCronTask(task);
 				task->state = CRON_TASK_ERROR;
 				task->errorMessage = "could not start background process; more "
 									 "details may be available in the server log";
-				ereport(WARNING,
-					(errcode(ERRCODE_CONFIGURATION_LIMIT_EXCEEDED),
-					errmsg("out of background worker slots"),
-					errhint("You might need to increase max_worker_processes.")));
 				break;
 			}
 
-			task->startDeadline = 0;
-			task->handle = *handle;
-			status = WaitForBackgroundWorkerStartup(&task->handle, &pid);
-			if (status != BGWH_STARTED && status != BGWH_STOPPED)
+			/*
+			 * Pooled workers wait for a command. A command that does not fit
+			 * in the queue is sent in parts, and the worker sets our latch
+			 * when it read a part, so we stay in this state until it was
+			 * sent completely.
+			 */
+			if (task->poolWorker != NULL && status == BGWH_STARTED)
 			{
-				CleanupCronTask(task);
-				task->state = CRON_TASK_ERROR;
-				task->errorMessage = "could not start background process; more "
-									 "details may be available in the server log";
-				break;
+				shm_mq_result sendResult =
+					SendPoolWorkerCommand(task->poolWorker, cronJob->command);
+
+				if (sendResult == SHM_MQ_WOULD_BLOCK)
+				{
+					if (!task->isActive)
+					{
+						/* the pooled worker is stopped along with the task */
+						CleanupCronTask(task);
+						task->errorMessage = "job canceled";
+						task->state = CRON_TASK_ERROR;
+					}
+
+					break;
+				}
+				else if (sendResult != SHM_MQ_SUCCESS)
+				{
+					CleanupCronTask(task);
+					task->errorMessage = "background worker exited before "
+										 "receiving the command";
+					task->state = CRON_TASK_ERROR;
+					break;
+				}
 			}
 
 			task->lastStartTime = GetCurrentTimestamp();
 
+			/* the worker has its command as soon as it runs */
+			task->runConnectedTime = task->lastStartTime;
+			SetTaskRunLatency(task);
+
+			/* a worker that already stopped reports its result when running */
 			if (CronLogRun)
-				UpdateJobRunDetail(task->runId, (int32 *) &pid, GetCronStatus(CRON_STATUS_RUNNING), NULL, &task->lastStartTime, NULL);
+				UpdateJobRunDetail(task->runId,
+								   status == BGWH_STARTED ? (int32 *) &pid : NULL,
+								   GetCronStatus(CRON_STATUS_RUNNING), NULL,
+								   &task->lastStartTime, NULL);
 
 			task->state = CRON_TASK_BGW_RUNNING;
 			break;
@@ -1610,6 +2318,12 @@ ManageCronTask(CronTask *task, TimestampTz currentTime)
 
 			/* check whether a connection has been established */
 			pollingStatus = PQconnectPoll(connection);
+
+			/*
+			 * PQconnectPoll may close the socket and open a new one when it
+			 * tries the next address, which could get the same number.
+			 */
+			task->waitSocket = PGINVALID_SOCKET;
 			if (pollingStatus == PGRES_POLLING_OK)
 			{
 				pid_t pid;
@@ -1617,6 +2331,7 @@ ManageCronTask(CronTask *task, TimestampTz currentTime)
 				task->pollingStatus = PGRES_POLLING_WRITING;
 
 				task->state = CRON_TASK_SENDING;
+				task->runConnectedTime = GetCurrentTimestamp();
 
 				pid = (pid_t) PQbackendPID(connection);
 				if (CronLogRun)
@@ -1686,6 +2401,8 @@ ManageCronTask(CronTask *task, TimestampTz currentTime)
 				task->state = CRON_TASK_RUNNING;
 
 				task->lastStartTime = GetCurrentTimestamp();
+				SetTaskRunLatency(task);
+
 				if (CronLogRun)
 					UpdateJobRunDetail(task->runId, NULL, GetCronStatus(CRON_STATUS_RUNNING), NULL, &task->lastStartTime, NULL);
 			}
@@ -1737,11 +2454,15 @@ ManageCronTask(CronTask *task, TimestampTz currentTime)
 				GetTaskFeedback(result, task);
 			}
 
-			PQfinish(connection);
+			/* keep the connection for the next run, if enabled */
+			ReleaseConnection(connection, cronJob->nodeName, cronJob->nodePort,
+							  cronJob->database, cronJob->userName,
+							  GetCurrentTimestamp());
 
 			task->connection = NULL;
 			task->pollingStatus = 0;
 			task->isSocketReady = false;
+			task->runEndTime = GetCurrentTimestamp();
 
 			task->state = CRON_TASK_DONE;
 			RunningTaskCount--;
@@ -1755,12 +2476,17 @@ ManageCronTask(CronTask *task, TimestampTz currentTime)
 
 			Assert(UseBackgroundWorkers);
 
-			/* check if job has been removed */
-			if (jobCanceled(task))
+			/*
+			 * Check if job has been removed. We only fail the run once its
+			 * worker exited, such that its job slot is not reused too soon.
+			 */
+			if (!task->isActive || task->terminating)
 			{
-				TerminateBackgroundWorker(&task->handle);
-				WaitForBackgroundWorkerShutdown(&task->handle);
-				CleanupCronTask(task);
+				if (BgwTaskWorkerStopped(task))
+				{
+					jobCanceled(task);
+					CleanupCronTask(task);
+				}
 
 				break;
 			}
@@ -1769,9 +2495,24 @@ ManageCronTask(CronTask *task, TimestampTz currentTime)
 			if (GetBackgroundWorkerPid(&task->handle, &pid) != BGWH_STOPPED)
 			{
 				bool isRunning = true;
+				bool commandDone = false;
 
 				/* process notices and warnings */
-				ProcessBgwTaskFeedback(task, isRunning);
+				commandDone = ProcessBgwTaskFeedback(task, isRunning);
+
+				if (commandDone && task->poolWorker != NULL)
+				{
+					/* the pooled worker is ready for the next job */
+					ReleasePoolWorker(task->poolWorker, GetCurrentTimestamp());
+					task->poolWorker = NULL;
+					task->sharedMemoryQueue = NULL;
+					task->runEndTime = GetCurrentTimestamp();
+
+					task->state = CRON_TASK_DONE;
+
+					CleanupCronTask(task);
+					RunningTaskCount--;
+				}
 			}
 			else
 			{
@@ -1779,6 +2520,7 @@ ManageCronTask(CronTask *task, TimestampTz currentTime)
 
 				/* process remaining notices and final task result */
 				ProcessBgwTaskFeedback(task, isRunning);
+				task->runEndTime = GetCurrentTimestamp();
 
 				task->state = CRON_TASK_DONE;
 
@@ -1797,10 +2539,8 @@ ManageCronTask(CronTask *task, TimestampTz currentTime)
 				task->connection = NULL;
 			}
 
-			if (!task->isActive)
-			{
-				RemoveTask(jobId);
-			}
+			task->runFailed = true;
+			task->runEndTime = GetCurrentTimestamp();
 
 			if (task->errorMessage != NULL)
 			{
@@ -1824,6 +2564,8 @@ ManageCronTask(CronTask *task, TimestampTz currentTime)
 			}
 
 			task->startDeadline = 0;
+			task->nextStartAttempt = 0;
+			task->startRetryDelay = 0;
 			task->isSocketReady = false;
 			task->state = CRON_TASK_DONE;
 
@@ -1836,8 +2578,28 @@ ManageCronTask(CronTask *task, TimestampTz currentTime)
 		default:
 		{
 			int currentPendingRunCount = task->pendingRunCount;
+			TimestampTz currentPendingRunTime = task->pendingRunTime;
 			CronJob *job = GetCronJob(jobId);
 
+			/* write the run if it was only to be written when it failed */
+			FinishDeferredJobRunDetail(task->runId);
+
+			/* add the run to cron.job_stats, unless the job was removed */
+			if (job != NULL)
+			{
+				TimestampTz runEndTime = task->runEndTime != 0 ?
+										 task->runEndTime : GetCurrentTimestamp();
+
+				RecordJobRunStats(jobId, job->userName, task->lastStartTime,
+								  runEndTime, task->runFailed, task->runTimedOut,
+								  task->runRowCount,
+								  task->runLatency.scheduledTime != 0 ?
+								  &task->runLatency : NULL);
+			}
+
+			/* the run no longer shows up in cron.job_run_progress */
+			EndRunProgress(task->runId);
+
 			/*
 			 * It may happen that job was unscheduled during task execution.
 			 * In this case we keep task as-is. Otherwise, we should
@@ -1855,22 +2617,223 @@ ManageCronTask(CronTask *task, TimestampTz currentTime)
 			 * run immediately.
 			 */
 			task->pendingRunCount = currentPendingRunCount;
+			task->pendingRunTime = currentPendingRunTime;
+		}
+	}
+}
+
+
+/*
+ * SetTaskRunLatency records how long it took for the command of the current
+ * run of a task to start, once it started. The latency is written to
+ * cron.job_run_details along with the final state of the run, and added to
+ * cron.job_stats when the run is done.
+ */
+static void
+SetTaskRunLatency(CronTask *task)
+{
+	CronRunLatency *latency = &task->runLatency;
+
+	latency->scheduledTime = task->runScheduledTime;
+	latency->queueWait = Max(task->runLaunchTime - task->runScheduledTime, 0);
+	latency->startupTime = Max(task->runConnectedTime - task->runLaunchTime, 0);
+	latency->sendTime = Max(task->lastStartTime - task->runConnectedTime, 0);
+
+	(void) SetRunLatency(task->runId, latency);
+}
+
+
+/*
+ * ShouldLogRun returns whether the next run of a job is written to
+ * cron.job_run_details and the server log from the start, rather than only
+ * when it fails, based on the log mode of the job.
+ */
+static bool
+ShouldLogRun(CronTask *task, CronJob *cronJob)
+{
+	switch (cronJob->logMode)
+	{
+		case CRON_LOG_MODE_FAILURES:
+		case CRON_LOG_MODE_ROLLUP:
+		{
+			return false;
+		}
+
+		case CRON_LOG_MODE_SAMPLE:
+		{
+			return task->runCount % cronJob->logSampleRate == 0;
+		}
+
+		case CRON_LOG_MODE_ALL:
+		default:
+		{
+			return true;
 		}
 	}
 }
 
+
+/*
+ * CreateBgwTaskSegment creates the shared memory for a background worker
+ * that runs a single job. Returns false and marks the task as failed if the
+ * segment could not be created.
+ */
+static bool
+CreateBgwTaskSegment(CronTask *task, CronJob *cronJob)
+{
+	shm_toc_estimator e;
+	shm_toc *toc;
+	char *database;
+	char *username;
+	char *command;
+	MemoryContext oldcontext;
+	shm_mq *mq;
+	Size segsize;
+	void *address;
+
+#if PG_VERSION_NUM < 100000
+	Assert(CurrentResourceOwner == NULL);
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "pg_cron_worker");
+#endif
+
+	/*
+	 * Create the shared memory that we will pass to the background
+	 * worker process.  We use DSM_CREATE_NULL_IF_MAXSEGMENTS so that we
+	 * do not ERROR here.  This way, we can mark the job as failed and
+	 * keep the launcher process running normally.
+	 */
+	shm_toc_initialize_estimator(&e);
+	shm_toc_estimate_chunk(&e, strlen(cronJob->database) + 1);
+	shm_toc_estimate_chunk(&e, strlen(cronJob->userName) + 1);
+	shm_toc_estimate_chunk(&e, strlen(cronJob->command) + 1);
+	shm_toc_estimate_chunk(&e, QUEUE_SIZE);
+	shm_toc_estimate_keys(&e, PG_CRON_NKEYS);
+	segsize = shm_toc_estimate(&e);
+
+	/* use a preallocated job slot if there is one, to avoid creating a segment */
+	task->jobSlot = AcquireJobSlot(segsize);
+	if (task->jobSlot >= 0)
+	{
+		task->seg = JobSlotSegment();
+		address = (char *) dsm_segment_address(task->seg) +
+				  JobSlotOffset(task->jobSlot);
+	}
+	else
+	{
+		task->seg = dsm_create(segsize, DSM_CREATE_NULL_IF_MAXSEGMENTS);
+		if (task->seg == NULL)
+		{
+			task->state = CRON_TASK_ERROR;
+			task->errorMessage = "unable to create a DSM segment; more "
+							"details may be available in the server log";
+
+			ereport(WARNING,
+				(errmsg("max number of DSM segments may has been reached")));
+
+			return false;
+		}
+
+		address = dsm_segment_address(task->seg);
+	}
+
+	toc = shm_toc_create(PG_CRON_MAGIC, address, segsize);
+
+	database = shm_toc_allocate(toc, strlen(cronJob->database) + 1);
+	strcpy(database, cronJob->database);
+	shm_toc_insert(toc, PG_CRON_KEY_DATABASE, database);
+
+	username = shm_toc_allocate(toc, strlen(cronJob->userName) + 1);
+	strcpy(username, cronJob->userName);
+	shm_toc_insert(toc, PG_CRON_KEY_USERNAME, username);
+
+	command = shm_toc_allocate(toc, strlen(cronJob->command) + 1);
+	strcpy(command, cronJob->command);
+	shm_toc_insert(toc, PG_CRON_KEY_COMMAND, command);
+
+	mq = shm_mq_create(shm_toc_allocate(toc, QUEUE_SIZE), QUEUE_SIZE);
+	shm_toc_insert(toc, PG_CRON_KEY_QUEUE, mq);
+	shm_mq_set_receiver(mq, MyProc);
+
+	/*
+	 * Attach the queue before launching a worker, so that we'll automatically
+	 * detach the queue if we error out.  (Otherwise, the worker might sit
+	 * there trying to write the queue long after we've gone away.)
+	 */
+	oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+	task->sharedMemoryQueue = shm_mq_attach(mq, task->seg, NULL);
+	MemoryContextSwitchTo(oldcontext);
+
+	return true;
+}
+
+
+/*
+ * RegisterBgwTaskWorker asks the postmaster to start a background worker
+ * that runs a single job. Returns false if there are no background worker
+ * slots available.
+ */
+static bool
+RegisterBgwTaskWorker(CronTask *task, BackgroundWorkerHandle **handle)
+{
+	BackgroundWorker worker;
+	Size tocOffset = 0;
+
+	/*
+	 * Prepare the background worker.
+	 *
+	 */
+	memset(&worker, 0, sizeof(BackgroundWorker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_ConsistentState;
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	sprintf(worker.bgw_library_name, "pg_cron");
+	sprintf(worker.bgw_function_name, "CronBackgroundWorker");
+#if (PG_VERSION_NUM >= 110000)
+	snprintf(worker.bgw_type, BGW_MAXLEN, "pg_cron");
+#endif
+	snprintf(worker.bgw_name, BGW_MAXLEN, "pg_cron worker");
+	worker.bgw_main_arg = UInt32GetDatum(dsm_segment_handle(task->seg));
+	worker.bgw_notify_pid = MyProcPid;
+
+	/* tell the worker where its job slot starts within the segment */
+	if (task->jobSlot >= 0)
+	{
+		tocOffset = JobSlotOffset(task->jobSlot);
+	}
+	memcpy(worker.bgw_extra, &tocOffset, sizeof(Size));
+
+	return RegisterDynamicBackgroundWorker(&worker, handle);
+}
+
+
 static void
 CleanupCronTask(CronTask *task)
 {
 	if (task == NULL)
 		return;
 
+	if (task->poolWorker != NULL)
+	{
+		/* we do not know what the pooled worker was doing, so stop it */
+		RemovePoolWorker(task->poolWorker);
+		task->poolWorker = NULL;
+		task->sharedMemoryQueue = NULL;
+	}
+
 	if (task->sharedMemoryQueue != NULL)
 	{
 		shm_mq_detach(task->sharedMemoryQueue);
 		task->sharedMemoryQueue = NULL;
 	}
 
+	if (task->jobSlot >= 0)
+	{
+		/* the segment with the job slots stays around for the next job */
+		ReleaseJobSlot(task->jobSlot);
+		task->jobSlot = -1;
+		task->seg = NULL;
+	}
+
 	if (task->seg != NULL)
 	{
 		dsm_detach(task->seg);
@@ -1878,6 +2841,36 @@ CleanupCronTask(CronTask *task)
 	}
 }
 
+
+/*
+ * BgwTaskWorkerStopped tells the background worker of a canceled run to exit
+ * and returns whether it is gone. We do not wait for it, since that would
+ * hold up all other jobs, but check again on a later pass. The postmaster
+ * sets our latch once the worker exited.
+ */
+static bool
+BgwTaskWorkerStopped(CronTask *task)
+{
+	pid_t pid = 0;
+	BgwHandleStatus status;
+
+	if (!task->terminating)
+	{
+		TerminateBackgroundWorker(&task->handle);
+		task->terminating = true;
+	}
+
+	status = GetBackgroundWorkerPid(&task->handle, &pid);
+	if (status == BGWH_NOT_YET_STARTED || status == BGWH_STARTED)
+	{
+		return false;
+	}
+
+	task->terminating = false;
+
+	return true;
+}
+
 static void
 GetTaskFeedback(PGresult *result, CronTask *task)
 {
@@ -1895,10 +2888,12 @@ GetTaskFeedback(PGresult *result, CronTask *task)
 			char *cmdStatus = PQcmdStatus(result);
 			char *cmdTuples = PQcmdTuples(result);
 
+			task->runRowCount += strtoll(cmdTuples, NULL, 10);
+
 			if (CronLogRun)
 				UpdateJobRunDetail(task->runId, NULL, GetCronStatus(CRON_STATUS_SUCCEEDED), cmdStatus, NULL, &end_time);
 
-			if (CronLogStatement)
+			if (CronLogStatement && task->logRun)
 			{
 				ereport(LOG, (errmsg("cron job " INT64_FORMAT " COMMAND completed: %s %s",
 									 task->jobId, cmdStatus, cmdTuples)));
@@ -1910,6 +2905,12 @@ GetTaskFeedback(PGresult *result, CronTask *task)
 		case PGRES_BAD_RESPONSE:
 		case PGRES_FATAL_ERROR:
 		{
+			char *sqlState = PQresultErrorField(result, PG_DIAG_SQLSTATE);
+
+			/* e.g. statement_timeout */
+			if (sqlState != NULL && strcmp(sqlState, "57014") == 0)
+				task->runTimedOut = true;
+
 			task->errorMessage = strdup(PQresultErrorMessage(result));
 			task->freeErrorMessage = true;
 			task->pollingStatus = 0;
@@ -1955,10 +2956,12 @@ GetTaskFeedback(PGresult *result, CronTask *task)
 			pg_lltoa(tupleCount, rows);
 			snprintf(outputrows, sizeof(outputrows), "%s %s", rows, rowString);
 
+			task->runRowCount += tupleCount;
+
 			if (CronLogRun)
 				UpdateJobRunDetail(task->runId, NULL, GetCronStatus(CRON_STATUS_SUCCEEDED), outputrows, NULL, &end_time);
 
-			if (CronLogStatement)
+			if (CronLogStatement && task->logRun)
 			{
 				ereport(LOG, (errmsg("cron job " INT64_FORMAT " completed: "
 									 "%d %s",
@@ -1979,9 +2982,11 @@ GetTaskFeedback(PGresult *result, CronTask *task)
  * ProcessBgwTaskFeedback reads messages from a shared memory queue associated
  * with the background worker that is executing a given task. If the task is
  * still running, the function does not block if the queue is empty. Otherwise,
- * it reads until the end of the queue.
+ * it reads until the end of the queue. Returns true if the worker reported
+ * that it finished the command, after which pooled workers wait for the next
+ * one.
  */
-static void
+static bool
 ProcessBgwTaskFeedback(CronTask *task, bool running)
 {
 	shm_mq_handle *responseq = task->sharedMemoryQueue;
@@ -1992,6 +2997,7 @@ ProcessBgwTaskFeedback(CronTask *task, bool running)
 	char            msgtype;
 	StringInfoData  msg;
 	shm_mq_result res;
+	bool commandDone = false;
 
 	end_time = GetCurrentTimestamp();
 	/*
@@ -2028,6 +3034,15 @@ ProcessBgwTaskFeedback(CronTask *task, bool running)
 					initStringInfo(&display_msg);
 					bgw_generate_returned_message(&display_msg, edata);
 
+					if (edata.elevel >= ERROR)
+					{
+						task->runFailed = true;
+
+						/* e.g. statement_timeout */
+						if (edata.sqlerrcode == ERRCODE_QUERY_CANCELED)
+							task->runTimedOut = true;
+					}
+
 					if (CronLogRun)
 					{
 
@@ -2058,10 +3073,13 @@ ProcessBgwTaskFeedback(CronTask *task, bool running)
 
 					nonconst_tag = strdup(tag);
 
+					task->runRowCount += strtoll(pg_cron_cmdTuples(nonconst_tag),
+												 NULL, 10);
+
 					if (CronLogRun)
 						UpdateJobRunDetail(task->runId, NULL, GetCronStatus(CRON_STATUS_SUCCEEDED), nonconst_tag, NULL, &end_time);
 
-					if (CronLogStatement) {
+					if (CronLogStatement && task->logRun) {
 						cmdTuples = pg_cron_cmdTuples(nonconst_tag);
 						ereport(LOG, (errmsg("cron job " INT64_FORMAT " COMMAND completed: %s %s",
 											 task->jobId, nonconst_tag, cmdTuples)));
@@ -2075,7 +3093,9 @@ ProcessBgwTaskFeedback(CronTask *task, bool running)
 			case 'G':
 			case 'H':
 			case 'W':
+					break;
 			case 'Z':
+					commandDone = true;
 					break;
 			default:
 					elog(WARNING, "unknown message type: %c (%zu bytes)",
@@ -2083,7 +3103,13 @@ ProcessBgwTaskFeedback(CronTask *task, bool running)
 					break;
 		}
 		pfree(msg.data);
+
+		/* a pooled worker sends nothing more until it gets another command */
+		if (commandDone)
+			break;
 	}
+
+	return commandDone;
 }
 
 /*
@@ -2099,6 +3125,7 @@ CronBackgroundWorker(Datum main_arg)
 	char *command;
 	shm_mq *mq;
 	shm_mq_handle *responseq;
+	Size tocOffset = 0;
 
 	/* handle SIGTERM like regular backend */
 	pqsignal(SIGTERM, die);
@@ -2119,7 +3146,12 @@ CronBackgroundWorker(Datum main_arg)
 		ereport(ERROR,
 				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
 				 errmsg("unable to map dynamic shared memory segment")));
-	toc = shm_toc_attach(PG_CRON_MAGIC, dsm_segment_address(seg));
+
+	/* jobs in a preallocated job slot do not start at the beginning */
+	memcpy(&tocOffset, MyBgworkerEntry->bgw_extra, sizeof(Size));
+
+	toc = shm_toc_attach(PG_CRON_MAGIC,
+						 (char *) dsm_segment_address(seg) + tocOffset);
 	if (toc == NULL)
 		ereport(ERROR,
 				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
@@ -2147,6 +3179,134 @@ CronBackgroundWorker(Datum main_arg)
 	BackgroundWorkerInitializeConnection(database, username, 0);
 #endif
 
+	RunCronCommand(command);
+
+	/* Signal that we are done. */
+	ReadyForQuery(DestRemote);
+
+	dsm_detach(seg);
+	proc_exit(0);
+}
+
+
+/*
+ * CronPoolBackgroundWorker is the main function of a pooled background
+ * worker. It runs the commands that it receives over the command queue one
+ * at a time, until the launcher stops it or goes away. Errors end the worker
+ * in the same way as for a worker that runs a single job.
+ */
+void
+CronPoolBackgroundWorker(Datum main_arg)
+{
+	dsm_segment *seg;
+	shm_toc *toc;
+	char *database;
+	char *username;
+	shm_mq *commandMq;
+	shm_mq *responseMq;
+	shm_mq_handle *commandq;
+	shm_mq_handle *responseq;
+	MemoryContext commandContext;
+	DiscardStmt *discardStmt;
+
+	/* handle SIGTERM like regular backend */
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	/* Set up a memory context and resource owner. */
+	Assert(CurrentResourceOwner == NULL);
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "pg_cron");
+	CurrentMemoryContext = AllocSetContextCreate(TopMemoryContext,
+												 "pg_cron worker",
+												 ALLOCSET_DEFAULT_MINSIZE,
+												 ALLOCSET_DEFAULT_INITSIZE,
+												 ALLOCSET_DEFAULT_MAXSIZE);
+
+	/* Set up a dynamic shared memory segment. */
+	seg = dsm_attach(DatumGetUInt32(main_arg));
+	if (seg == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("unable to map dynamic shared memory segment")));
+	toc = shm_toc_attach(PG_CRON_MAGIC, dsm_segment_address(seg));
+	if (toc == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+			   errmsg("bad magic number in dynamic shared memory segment")));
+
+	#if PG_VERSION_NUM < 100000
+		database = shm_toc_lookup(toc, PG_CRON_KEY_DATABASE);
+		username = shm_toc_lookup(toc, PG_CRON_KEY_USERNAME);
+		commandMq = shm_toc_lookup(toc, PG_CRON_KEY_COMMAND_QUEUE);
+		responseMq = shm_toc_lookup(toc, PG_CRON_KEY_QUEUE);
+	#else
+		database = shm_toc_lookup(toc, PG_CRON_KEY_DATABASE, false);
+		username = shm_toc_lookup(toc, PG_CRON_KEY_USERNAME, false);
+		commandMq = shm_toc_lookup(toc, PG_CRON_KEY_COMMAND_QUEUE, false);
+		responseMq = shm_toc_lookup(toc, PG_CRON_KEY_QUEUE, false);
+	#endif
+
+	shm_mq_set_receiver(commandMq, MyProc);
+	commandq = shm_mq_attach(commandMq, seg, NULL);
+
+	shm_mq_set_sender(responseMq, MyProc);
+	responseq = shm_mq_attach(responseMq, seg, NULL);
+	pq_redirect_to_shm_mq(seg, responseq);
+
+#if (PG_VERSION_NUM < 110000)
+	BackgroundWorkerInitializeConnection(database, username);
+#else
+	BackgroundWorkerInitializeConnection(database, username, 0);
+#endif
+
+	commandContext = AllocSetContextCreate(TopMemoryContext,
+										   "pg_cron command",
+										   ALLOCSET_DEFAULT_MINSIZE,
+										   ALLOCSET_DEFAULT_INITSIZE,
+										   ALLOCSET_DEFAULT_MAXSIZE);
+
+	discardStmt = makeNode(DiscardStmt);
+	discardStmt->target = DISCARD_ALL;
+
+	for (;;)
+	{
+		Size nbytes = 0;
+		void *data = NULL;
+		char *command = NULL;
+		shm_mq_result res;
+
+		/* wait for the launcher to send the next command */
+		res = shm_mq_receive(commandq, &nbytes, &data, false);
+		if (res != SHM_MQ_SUCCESS)
+			break;
+
+		MemoryContextReset(commandContext);
+		command = MemoryContextStrdup(commandContext, (char *) data);
+
+		RunCronCommand(command);
+
+		/* Leave nothing behind for the next job, like DISCARD ALL. */
+		StartTransactionCommand();
+		DiscardCommand(discardStmt, true);
+		CommitTransactionCommand();
+
+		debug_query_string = NULL;
+
+		/* Signal that we are done. */
+		ReadyForQuery(DestRemote);
+	}
+
+	dsm_detach(seg);
+	proc_exit(0);
+}
+
+
+/*
+ * RunCronCommand executes the command of a job in its own transaction.
+ */
+static void
+RunCronCommand(const char *command)
+{
 	/* Prepare to execute the query. */
 	SetCurrentStatementStartTimestamp();
 	debug_query_string = command;
@@ -2165,12 +3325,6 @@ CronBackgroundWorker(Datum main_arg)
 	CommitTransactionCommand();
 	pgstat_report_activity(STATE_IDLE, command);
 	pgstat_report_stat(true);
-
-	/* Signal that we are done. */
-	ReadyForQuery(DestRemote);
-
-	dsm_detach(seg);
-	proc_exit(0);
 }
 
 /*
@@ -2350,6 +3504,9 @@ ExecuteSqlString(const char *sql)
 
 	/* Be sure to advance the command counter after the last script command */
 	CommandCounterIncrement();
+
+	/* Pooled workers execute many commands, so do not keep the parse trees */
+	MemoryContextDelete(parsecontext);
 }
 
 /*
@@ -2397,6 +3554,7 @@ jobStartupTimeout(CronTask *task, TimestampTz currentTime)
     if (TimestampDifferenceExceeds(task->startDeadline, currentTime, 0))
     {
         task->errorMessage = "job startup timeout";
+        task->runTimedOut = true;
         task->pollingStatus = 0;
         task->state = CRON_TASK_ERROR;
         return true;
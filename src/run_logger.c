@@ -0,0 +1,766 @@
+/*-------------------------------------------------------------------------
+ *
+ * src/run_logger.c
+ *
+ * Background worker that writes the changes to cron.job_run_details on
+ * behalf of the launcher.
+ *
+ * Writing cron.job_run_details from the launcher means that every start
+ * and end of a run waits for a transaction, and that the launcher stalls
+ * when the table is slow to write to, e.g. because it is locked or the
+ * disk is busy. When cron.use_run_logger is on, the launcher instead
+ * appends its changes to a queue in shared memory and a separate worker
+ * writes them, in batches of cron.log_run_batch_size changes when that is
+ * set.
+ *
+ * The launcher never waits for the queue. When the queue is full, changes
+ * are dropped and counted, and a warning is logged once until changes fit
+ * again. Changes that the logger read from the queue but did not write
+ * when it fails are lost as well.
+ *
+ * Copyright (c) 2016, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+
+#include "job_metadata.h"
+#include "pg_cron.h"
+#include "run_logger.h"
+#include "shared_state.h"
+
+#include "access/htup_details.h"
+#include "lib/stringinfo.h"
+#include "libpq/pqsignal.h"
+#include "mb/pg_wchar.h"
+#include "postmaster/bgworker.h"
+#if PG_VERSION_NUM >= 130000
+#include "postmaster/interrupt.h"
+#else
+#include "tcop/tcopprot.h"
+#define SignalHandlerForConfigReload PostgresSigHupHandler
+#endif
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lwlock.h"
+#include "storage/proc.h"
+#include "storage/shmem.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+
+
+/* fields of a CronRunEvent that are set */
+#define RUN_EVENT_JOB_PID			(1 << 0)
+#define RUN_EVENT_STATUS			(1 << 1)
+#define RUN_EVENT_RETURN_MESSAGE	(1 << 2)
+#define RUN_EVENT_START_TIME		(1 << 3)
+#define RUN_EVENT_END_TIME			(1 << 4)
+#define RUN_EVENT_LATENCY			(1 << 5)
+
+/* time in ms after which the logger checks for changes without a wake-up */
+#define RUN_LOGGER_MAX_WAIT 1000
+
+/* number of bytes of changes the logger copies out of the queue at once */
+#define RUN_LOGGER_COPY_SIZE ((Size) 1024 * 1024)
+
+
+/*
+ * CronRunEvent is a change to cron.job_run_details in the queue. It is
+ * followed by the strings of the change, each ending in a 0 byte: the
+ * database, user name and command for inserts, then the status and
+ * return message if they are set.
+ */
+typedef struct CronRunEvent
+{
+	/* size of the event including its strings, a multiple of MAXIMUM_ALIGNOF */
+	uint32 size;
+	bool isInsert;
+
+	/* RUN_EVENT_* flags */
+	int fields;
+
+	int64 runId;
+	int64 jobId;
+	int32 jobPid;
+	TimestampTz startTime;
+	TimestampTz endTime;
+	CronRunLatency latency;
+} CronRunEvent;
+
+
+/*
+ * CronRunLoggerState is a ring buffer of changes to cron.job_run_details,
+ * which the launcher writes and the logger reads. Positions only go up,
+ * the offset in the queue is the position modulo the queue size.
+ */
+typedef struct CronRunLoggerState
+{
+	LWLock *lock;
+
+	/* latch of the logger, NULL if it is not running */
+	Latch *loggerLatch;
+
+	uint64 readPosition;
+	uint64 writePosition;
+	Size queueSize;
+	char queue[FLEXIBLE_ARRAY_MEMBER];
+} CronRunLoggerState;
+
+
+/* forward declarations */
+static Size RunLoggerStateSize(void);
+static void SendRunEvent(StringInfo eventData);
+static void AppendEventString(StringInfo eventData, char *string);
+static void CopyToQueue(uint64 position, const char *data, Size size);
+static void CopyFromQueue(uint64 position, char *data, Size size);
+static void CronRunLoggerSigterm(SIGNAL_ARGS);
+static void DetachRunLogger(int code, Datum arg);
+static int WriteQueuedRunEvents(void);
+static void WriteRunEvent(CronRunEvent *event, char *strings);
+
+/* SQL-callable functions */
+PG_FUNCTION_INFO_V1(cron_run_logger_stats);
+
+/* entry point of the run logger */
+PGDLLEXPORT void CronRunLoggerMain(Datum arg);
+
+
+/* global settings */
+bool CronUseRunLogger = false;
+int CronRunLoggerQueueSize = 1024;
+
+/* global variables */
+static CronRunLoggerState *RunLogger = NULL;
+static volatile sig_atomic_t RunLoggerTerminating = false;
+
+/* whether the launcher dropped changes since the last one that fit */
+static bool DroppingRunEvents = false;
+
+
+/*
+ * RegisterRunLogger registers the background worker that writes the
+ * changes in the queue.
+ */
+void
+RegisterRunLogger(void)
+{
+	BackgroundWorker worker = {0,};
+
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+	worker.bgw_restart_time = 1;
+	worker.bgw_main_arg = Int32GetDatum(0);
+	worker.bgw_notify_pid = 0;
+	sprintf(worker.bgw_library_name, "pg_cron");
+	sprintf(worker.bgw_function_name, "CronRunLoggerMain");
+	snprintf(worker.bgw_name, BGW_MAXLEN, "pg_cron run logger");
+#if (PG_VERSION_NUM >= 110000)
+	snprintf(worker.bgw_type, BGW_MAXLEN, "pg_cron run logger");
+#endif
+
+	RegisterBackgroundWorker(&worker);
+}
+
+
+/*
+ * RunLoggerStateSize returns the amount of shared memory used by the run
+ * logger.
+ */
+static Size
+RunLoggerStateSize(void)
+{
+	Size size = offsetof(CronRunLoggerState, queue);
+
+	size = add_size(size, mul_size(CronRunLoggerQueueSize, 1024));
+
+	return MAXALIGN(size);
+}
+
+
+/*
+ * RunLoggerShmemRequest requests the shared memory used by the queue of the
+ * run logger, if it is used.
+ */
+void
+RunLoggerShmemRequest(void)
+{
+	if (!CronUseRunLogger)
+	{
+		return;
+	}
+
+	RequestAddinShmemSpace(RunLoggerStateSize());
+	RequestNamedLWLockTranche("pg_cron run logger", 1);
+}
+
+
+/*
+ * RunLoggerShmemStartup attaches to the queue of the run logger, and
+ * initializes it if we are the first to do so.
+ */
+void
+RunLoggerShmemStartup(void)
+{
+	bool found = false;
+
+	if (!CronUseRunLogger)
+	{
+		return;
+	}
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	RunLogger = ShmemInitStruct("pg_cron run logger", RunLoggerStateSize(),
+								&found);
+	if (!found)
+	{
+		RunLogger->lock = &(GetNamedLWLockTranche("pg_cron run logger"))->lock;
+		RunLogger->loggerLatch = NULL;
+		RunLogger->readPosition = 0;
+		RunLogger->writePosition = 0;
+		RunLogger->queueSize = (Size) CronRunLoggerQueueSize * 1024;
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+}
+
+
+/*
+ * SendRunInsertEvent queues the insert of a run into cron.job_run_details
+ * for the run logger. Returns false if there is no run logger, in which
+ * case the caller should write the run itself.
+ */
+bool
+SendRunInsertEvent(int64 runId, int64 jobId, char *database, char *userName,
+				   char *command, char *status)
+{
+	StringInfoData eventData;
+	CronRunEvent event;
+
+	/* a run ID of 0 means there is no cron.job_run_details table */
+	if (RunLogger == NULL || runId == 0)
+	{
+		return false;
+	}
+
+	memset(&event, 0, sizeof(event));
+	event.isInsert = true;
+	event.runId = runId;
+	event.jobId = jobId;
+
+	if (status != NULL)
+	{
+		event.fields |= RUN_EVENT_STATUS;
+	}
+
+	initStringInfo(&eventData);
+	appendBinaryStringInfo(&eventData, (char *) &event, sizeof(event));
+	AppendEventString(&eventData, database);
+	AppendEventString(&eventData, userName);
+	AppendEventString(&eventData, command);
+
+	if (status != NULL)
+	{
+		AppendEventString(&eventData, status);
+	}
+
+	SendRunEvent(&eventData);
+	pfree(eventData.data);
+
+	return true;
+}
+
+
+/*
+ * SendRunUpdateEvent queues a change of a run in cron.job_run_details for
+ * the run logger. Fields that are NULL keep their current value. Returns
+ * false if there is no run logger, in which case the caller should write
+ * the change itself.
+ */
+bool
+SendRunUpdateEvent(int64 runId, int32 *jobPid, char *status,
+				   char *returnMessage, TimestampTz *startTime,
+				   TimestampTz *endTime, CronRunLatency *latency)
+{
+	StringInfoData eventData;
+	CronRunEvent event;
+
+	if (RunLogger == NULL || runId == 0)
+	{
+		return false;
+	}
+
+	memset(&event, 0, sizeof(event));
+	event.isInsert = false;
+	event.runId = runId;
+
+	if (jobPid != NULL)
+	{
+		event.jobPid = *jobPid;
+		event.fields |= RUN_EVENT_JOB_PID;
+	}
+
+	if (status != NULL)
+	{
+		event.fields |= RUN_EVENT_STATUS;
+	}
+
+	if (returnMessage != NULL)
+	{
+		event.fields |= RUN_EVENT_RETURN_MESSAGE;
+	}
+
+	if (startTime != NULL)
+	{
+		event.startTime = *startTime;
+		event.fields |= RUN_EVENT_START_TIME;
+	}
+
+	if (endTime != NULL)
+	{
+		event.endTime = *endTime;
+		event.fields |= RUN_EVENT_END_TIME;
+	}
+
+	if (latency != NULL)
+	{
+		event.latency = *latency;
+		event.fields |= RUN_EVENT_LATENCY;
+	}
+
+	initStringInfo(&eventData);
+	appendBinaryStringInfo(&eventData, (char *) &event, sizeof(event));
+
+	if (status != NULL)
+	{
+		AppendEventString(&eventData, status);
+	}
+
+	if (returnMessage != NULL)
+	{
+		AppendEventString(&eventData, returnMessage);
+	}
+
+	SendRunEvent(&eventData);
+	pfree(eventData.data);
+
+	return true;
+}
+
+
+/*
+ * AppendEventString appends a string to a queued change, including its 0
+ * byte. Strings are cut off at 1/16th of the queue, such that a few large
+ * commands or messages cannot fill it.
+ */
+static void
+AppendEventString(StringInfo eventData, char *string)
+{
+	int maxLength = (int) Min(RunLogger->queueSize / 16, MaxAllocSize / 2);
+	int length = strlen(string);
+
+	if (length > maxLength)
+	{
+		length = pg_mbcliplen(string, length, maxLength);
+	}
+
+	appendBinaryStringInfo(eventData, string, length);
+	appendStringInfoChar(eventData, '\0');
+}
+
+
+/*
+ * SendRunEvent appends a change to the queue and wakes up the logger, or
+ * drops the change if it does not fit.
+ */
+static void
+SendRunEvent(StringInfo eventData)
+{
+	CronRunEvent *event = (CronRunEvent *) eventData->data;
+	Size eventSize = MAXALIGN(eventData->len);
+	Latch *loggerLatch = NULL;
+	bool dropped = false;
+
+	/* pad the event, such that the next one is aligned */
+	while (eventData->len < eventSize)
+	{
+		appendStringInfoChar(eventData, '\0');
+	}
+
+	/* appending may have moved the data */
+	event = (CronRunEvent *) eventData->data;
+	event->size = eventSize;
+
+	LWLockAcquire(RunLogger->lock, LW_EXCLUSIVE);
+
+	if (RunLogger->writePosition - RunLogger->readPosition + eventSize >
+		RunLogger->queueSize)
+	{
+		dropped = true;
+	}
+	else
+	{
+		CopyToQueue(RunLogger->writePosition, eventData->data, eventSize);
+		RunLogger->writePosition += eventSize;
+	}
+
+	loggerLatch = RunLogger->loggerLatch;
+
+	LWLockRelease(RunLogger->lock);
+
+	if (dropped)
+	{
+		IncrementCronCounter(CRON_COUNTER_DROPPED_RUN_EVENTS, 1);
+
+		if (!DroppingRunEvents)
+		{
+			ereport(WARNING,
+					(errmsg("cron.job_run_details queue is full, dropping changes"),
+					 errhint("Increase cron.run_logger_queue_size, or check whether "
+							 "the pg_cron run logger is running.")));
+			DroppingRunEvents = true;
+		}
+	}
+	else if (DroppingRunEvents)
+	{
+		ereport(LOG, (errmsg("cron.job_run_details queue accepts changes again")));
+		DroppingRunEvents = false;
+	}
+
+	if (loggerLatch != NULL)
+	{
+		SetLatch(loggerLatch);
+	}
+}
+
+
+/*
+ * CopyToQueue copies data to the queue at the given position, wrapping
+ * around at the end of the queue.
+ */
+static void
+CopyToQueue(uint64 position, const char *data, Size size)
+{
+	Size offset = position % RunLogger->queueSize;
+	Size firstPartSize = Min(size, RunLogger->queueSize - offset);
+
+	memcpy(RunLogger->queue + offset, data, firstPartSize);
+	memcpy(RunLogger->queue, data + firstPartSize, size - firstPartSize);
+}
+
+
+/*
+ * CopyFromQueue copies data from the queue at the given position, wrapping
+ * around at the end of the queue.
+ */
+static void
+CopyFromQueue(uint64 position, char *data, Size size)
+{
+	Size offset = position % RunLogger->queueSize;
+	Size firstPartSize = Min(size, RunLogger->queueSize - offset);
+
+	memcpy(data, RunLogger->queue + offset, firstPartSize);
+	memcpy(data + firstPartSize, RunLogger->queue, size - firstPartSize);
+}
+
+
+/*
+ * CronRunLoggerSigterm asks the logger to write the remaining changes and
+ * exit.
+ */
+static void
+CronRunLoggerSigterm(SIGNAL_ARGS)
+{
+	int save_errno = errno;
+
+	RunLoggerTerminating = true;
+	SetLatch(MyLatch);
+
+	errno = save_errno;
+}
+
+
+/*
+ * CronRunLoggerMain is the main entry-point for the background worker that
+ * writes changes to cron.job_run_details.
+ */
+void
+CronRunLoggerMain(Datum arg)
+{
+	MemoryContext loggerContext = NULL;
+
+	/* Establish signal handlers before unblocking signals. */
+	pqsignal(SIGHUP, SignalHandlerForConfigReload);
+	pqsignal(SIGTERM, CronRunLoggerSigterm);
+
+	/* We're now ready to receive signals */
+	BackgroundWorkerUnblockSignals();
+
+	/* Connect to our database */
+#if (PG_VERSION_NUM < 110000)
+	BackgroundWorkerInitializeConnection(CronTableDatabaseName, NULL);
+#else
+	BackgroundWorkerInitializeConnection(CronTableDatabaseName, NULL, 0);
+#endif
+
+	/* Make the logger recognisable in pg_stat_activity */
+	pgstat_report_appname("pg_cron run logger");
+
+	if (RunLogger == NULL)
+	{
+		ereport(ERROR, (errmsg("pg_cron run logger has no shared memory")));
+	}
+
+	/* tell the launcher where to wake us up */
+	LWLockAcquire(RunLogger->lock, LW_EXCLUSIVE);
+	RunLogger->loggerLatch = MyLatch;
+	LWLockRelease(RunLogger->lock);
+
+	before_shmem_exit(DetachRunLogger, (Datum) 0);
+
+	loggerContext = AllocSetContextCreate(CurrentMemoryContext,
+										  "pg_cron run logger context",
+										  ALLOCSET_DEFAULT_MINSIZE,
+										  ALLOCSET_DEFAULT_INITSIZE,
+										  ALLOCSET_DEFAULT_MAXSIZE);
+
+	MemoryContextSwitchTo(loggerContext);
+
+	for (;;)
+	{
+		bool terminating = RunLoggerTerminating;
+		TimestampTz flushTime = 0;
+		long waitTimeout = RUN_LOGGER_MAX_WAIT;
+		int eventCount = 0;
+		int rc = 0;
+
+		ResetLatch(MyLatch);
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (ConfigReloadPending)
+		{
+			ConfigReloadPending = false;
+			ProcessConfigFile(PGC_SIGHUP);
+		}
+
+		eventCount = WriteQueuedRunEvents();
+		IncrementCronCounter(CRON_COUNTER_LOGGED_RUN_EVENTS, eventCount);
+
+		if (terminating)
+		{
+			/* write what is left, the launcher is stopped as well */
+			FlushJobRunDetails();
+			proc_exit(0);
+		}
+
+		FlushJobRunDetailsIfDue(GetCurrentTimestamp());
+
+		/* remove expired runs here, such that the launcher does not wait */
+		PurgeJobRunDetailsIfDue(GetCurrentTimestamp());
+
+		flushTime = JobRunDetailsFlushTime();
+		if (flushTime != 0)
+		{
+			long secs = 0;
+			int microsecs = 0;
+
+			TimestampDifference(GetCurrentTimestamp(), flushTime, &secs, &microsecs);
+			waitTimeout = Min(waitTimeout, secs * 1000 + microsecs / 1000);
+		}
+
+		MemoryContextReset(loggerContext);
+
+		rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+					   waitTimeout, PG_WAIT_EXTENSION);
+
+		if (rc & WL_POSTMASTER_DEATH)
+		{
+			/* postmaster died and we should bail out immediately */
+			proc_exit(1);
+		}
+	}
+}
+
+
+/*
+ * DetachRunLogger makes sure the launcher does not wake up a logger that
+ * exited.
+ */
+static void
+DetachRunLogger(int code, Datum arg)
+{
+	LWLockAcquire(RunLogger->lock, LW_EXCLUSIVE);
+	RunLogger->loggerLatch = NULL;
+	LWLockRelease(RunLogger->lock);
+}
+
+
+/*
+ * WriteQueuedRunEvents removes the changes that are in the queue and writes
+ * them to cron.job_run_details, or to the buffer of changes that are written
+ * together. The queue may be larger than we can allocate at once, so changes
+ * are copied out in parts of about RUN_LOGGER_COPY_SIZE. Changes that are
+ * added in the meantime are left for the next call. Returns the number of
+ * changes.
+ */
+static int
+WriteQueuedRunEvents(void)
+{
+	uint64 endPosition = 0;
+	int eventCount = 0;
+
+	LWLockAcquire(RunLogger->lock, LW_SHARED);
+	endPosition = RunLogger->writePosition;
+	LWLockRelease(RunLogger->lock);
+
+	for (;;)
+	{
+		char *queuedData = NULL;
+		Size queuedSize = 0;
+		Size offset = 0;
+
+		/* copy the changes, such that the launcher does not wait for us */
+		LWLockAcquire(RunLogger->lock, LW_EXCLUSIVE);
+
+		while (RunLogger->readPosition + queuedSize < endPosition)
+		{
+			CronRunEvent event;
+
+			CopyFromQueue(RunLogger->readPosition + queuedSize, (char *) &event,
+						  sizeof(event));
+
+			/* a change is never split, and the first one always fits */
+			if (queuedSize > 0 && queuedSize + event.size > RUN_LOGGER_COPY_SIZE)
+			{
+				break;
+			}
+
+			queuedSize += event.size;
+		}
+
+		if (queuedSize > 0)
+		{
+			queuedData = palloc(queuedSize);
+			CopyFromQueue(RunLogger->readPosition, queuedData, queuedSize);
+			RunLogger->readPosition += queuedSize;
+		}
+
+		LWLockRelease(RunLogger->lock);
+
+		if (queuedSize == 0)
+		{
+			break;
+		}
+
+		while (offset < queuedSize)
+		{
+			CronRunEvent event;
+
+			memcpy(&event, queuedData + offset, sizeof(event));
+
+			WriteRunEvent(&event, queuedData + offset + sizeof(event));
+
+			offset += event.size;
+			eventCount++;
+		}
+
+		pfree(queuedData);
+	}
+
+	return eventCount;
+}
+
+
+/*
+ * WriteRunEvent writes a change that was read from the queue.
+ */
+static void
+WriteRunEvent(CronRunEvent *event, char *strings)
+{
+	char *status = NULL;
+
+	if (event->isInsert)
+	{
+		char *database = strings;
+		char *userName = database + strlen(database) + 1;
+		char *command = userName + strlen(userName) + 1;
+
+		if (event->fields & RUN_EVENT_STATUS)
+		{
+			status = command + strlen(command) + 1;
+		}
+
+		WriteJobRunDetailInsert(event->runId, &event->jobId, database, userName,
+								command, status);
+	}
+	else
+	{
+		char *returnMessage = NULL;
+		char *nextString = strings;
+
+		if (event->fields & RUN_EVENT_STATUS)
+		{
+			status = nextString;
+			nextString += strlen(nextString) + 1;
+		}
+
+		if (event->fields & RUN_EVENT_RETURN_MESSAGE)
+		{
+			returnMessage = nextString;
+		}
+
+		WriteJobRunDetailUpdate(event->runId,
+								(event->fields & RUN_EVENT_JOB_PID) ?
+								&event->jobPid : NULL,
+								status, returnMessage,
+								(event->fields & RUN_EVENT_START_TIME) ?
+								&event->startTime : NULL,
+								(event->fields & RUN_EVENT_END_TIME) ?
+								&event->endTime : NULL,
+								(event->fields & RUN_EVENT_LATENCY) ?
+								&event->latency : NULL);
+	}
+}
+
+
+/*
+ * cron_run_logger_stats returns the amount of queued changes to
+ * cron.job_run_details and how many changes were written or dropped.
+ */
+Datum
+cron_run_logger_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDescriptor = NULL;
+	Datum values[3];
+	bool isNulls[3];
+	HeapTuple heapTuple = NULL;
+	uint64 queuedBytes = 0;
+
+	if (get_call_result_type(fcinfo, NULL, &tupleDescriptor) != TYPEFUNC_COMPOSITE)
+	{
+		elog(ERROR, "return type must be a row type");
+	}
+
+	if (RunLogger != NULL)
+	{
+		LWLockAcquire(RunLogger->lock, LW_SHARED);
+		queuedBytes = RunLogger->writePosition - RunLogger->readPosition;
+		LWLockRelease(RunLogger->lock);
+	}
+
+	memset(isNulls, false, sizeof(isNulls));
+
+	values[0] = Int64GetDatum((int64) queuedBytes);
+	values[1] = Int64GetDatum(ReadCronCounter(CRON_COUNTER_LOGGED_RUN_EVENTS));
+	values[2] = Int64GetDatum(ReadCronCounter(CRON_COUNTER_DROPPED_RUN_EVENTS));
+
+	heapTuple = heap_form_tuple(tupleDescriptor, values, isNulls);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heapTuple));
+}
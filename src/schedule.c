@@ -0,0 +1,398 @@
+/*-------------------------------------------------------------------------
+ *
+ * src/schedule.c
+ *
+ * Functions for computing when a cron schedule fires next.
+ *
+ * Copyright (c) 2016, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "cron.h"
+#include "pg_cron.h"
+#include "schedule.h"
+
+#include "pgtime.h"
+#if (PG_VERSION_NUM >= 120000)
+#include "port/pg_bitutils.h"
+#endif
+#include "utils/datetime.h"
+#include "utils/timestamp.h"
+
+
+/*
+ * The Gregorian calendar repeats every 400 years, so a schedule that does not
+ * match within that time never matches. Schedules can go decades without a
+ * match, e.g. Feb 29 on a Monday with cron.match_dom_and_dow matches in 2072
+ * and next in 2112.
+ */
+#define MAX_SEARCH_YEARS 400
+
+/* upper bound on the number of UTC offset changes we follow per search */
+#define MAX_OFFSET_CHANGES (4 * MAX_SEARCH_YEARS)
+
+
+/* wall clock time in the cron timezone at minute granularity */
+typedef struct CivilMinute
+{
+	int year;
+	int month;
+	int day;
+	int hour;
+	int minute;
+} CivilMinute;
+
+
+/* forward declarations */
+static pg_tz * GetCronTimezone(void);
+static bool NextMatchingMinute(entry *schedule, bool matchDomAndDow,
+							   CivilMinute *time, int lastYear);
+static uint64 MatchingDaysOfMonth(entry *schedule, bool matchDomAndDow,
+								  int year, int month);
+static int DaysInMonth(int year, int month);
+static pg_time_t CivilMinuteToTime(CivilMinute *time);
+static TimestampTz TimestampMinuteFloor(TimestampTz time);
+
+
+/* cron.timezone as resolved by the last call to LoadCronTimezone */
+static pg_tz *CronTimezone = NULL;
+
+
+/*
+ * LoadCronTimezone looks up cron.timezone, such that we do not need to
+ * resolve the name every time we compute a local time. It should be called
+ * again after the configuration is reloaded.
+ */
+void
+LoadCronTimezone(void)
+{
+	CronTimezone = pg_tzset(cron_timezone);
+}
+
+
+/*
+ * GetCronTimezone returns the time zone in which schedules are evaluated.
+ */
+static pg_tz *
+GetCronTimezone(void)
+{
+	if (CronTimezone == NULL)
+	{
+		LoadCronTimezone();
+	}
+
+	return CronTimezone;
+}
+
+
+/*
+ * GetCalendarMinute fills calendarMinute with the wall clock fields of the
+ * given time in cron.timezone.
+ */
+void
+GetCalendarMinute(TimestampTz time, CalendarMinute *calendarMinute)
+{
+	pg_time_t unixTime = timestamptz_to_time_t(time);
+	struct pg_tm *localTime = pg_localtime(&unixTime, GetCronTimezone());
+	int year = localTime->tm_year + 1900;
+	int month = localTime->tm_mon + 1;
+
+	calendarMinute->minute = localTime->tm_min;
+	calendarMinute->hour = localTime->tm_hour;
+	calendarMinute->dayOfMonth = localTime->tm_mday;
+	calendarMinute->month = month;
+	calendarMinute->dayOfWeek = localTime->tm_wday;
+	calendarMinute->isLastDayOfMonth =
+		localTime->tm_mday == DaysInMonth(year, month);
+}
+
+
+/*
+ * NextRunTime returns the start of the first minute after afterTime in
+ * which the given schedule fires, or DT_NOEND if it never fires.
+ *
+ * The schedule is matched against the wall clock in cron.timezone. We search
+ * the wall clock directly and only fall back to the UTC offset that applies
+ * at the start of the search until the next offset change. If the match lies
+ * beyond that change, the search restarts at the transition, such that
+ * skipped wall clock minutes never fire and repeated minutes fire twice, as
+ * if every minute were checked one by one.
+ */
+TimestampTz
+NextRunTime(entry *schedule, TimestampTz afterTime)
+{
+	pg_tz *timezone = GetCronTimezone();
+	bool matchDomAndDow = CronDomDowAndLogic ||
+						  (schedule->flags & (DOM_STAR | DOW_STAR)) != 0;
+	pg_time_t searchTime = 0;
+	int lastYear = 0;
+	int offsetChange = 0;
+
+	searchTime = timestamptz_to_time_t(TimestampMinuteFloor(afterTime)) +
+				 SECS_PER_MINUTE;
+
+	for (offsetChange = 0; offsetChange < MAX_OFFSET_CHANGES; offsetChange++)
+	{
+		struct pg_tm *localTime = NULL;
+		CivilMinute civilTime;
+		long int utcOffset = 0;
+		pg_time_t runTime = 0;
+		pg_time_t boundary = 0;
+		long int beforeOffset = 0;
+		long int afterOffset = 0;
+		int beforeIsDst = 0;
+		int afterIsDst = 0;
+		int boundaryFound = 0;
+
+		localTime = pg_localtime(&searchTime, timezone);
+		if (localTime == NULL)
+		{
+			return DT_NOEND;
+		}
+
+		/* pg_localtime returns a pointer to a global struct, copy it */
+		civilTime.year = localTime->tm_year + 1900;
+		civilTime.month = localTime->tm_mon + 1;
+		civilTime.day = localTime->tm_mday;
+		civilTime.hour = localTime->tm_hour;
+		civilTime.minute = localTime->tm_min;
+		utcOffset = localTime->tm_gmtoff;
+
+		if (lastYear == 0)
+		{
+			lastYear = civilTime.year + MAX_SEARCH_YEARS;
+		}
+
+		boundaryFound = pg_next_dst_boundary(&searchTime, &beforeOffset,
+											 &beforeIsDst, &boundary,
+											 &afterOffset, &afterIsDst,
+											 timezone);
+
+		if (!NextMatchingMinute(schedule, matchDomAndDow, &civilTime, lastYear))
+		{
+			return DT_NOEND;
+		}
+
+		runTime = CivilMinuteToTime(&civilTime) - utcOffset;
+		if (boundaryFound != 1 || runTime < boundary)
+		{
+			return time_t_to_timestamptz(runTime);
+		}
+
+		/* UTC offset changes before the match, continue from the change */
+		searchTime = boundary +
+					 (SECS_PER_MINUTE - boundary % SECS_PER_MINUTE) % SECS_PER_MINUTE;
+	}
+
+	return DT_NOEND;
+}
+
+
+/*
+ * NextMatchingMinute advances time to the first wall clock minute at or
+ * after time that matches the schedule. It returns false if there is no
+ * such minute before the end of lastYear.
+ *
+ * Each field jumps straight to its next set bit. When a field runs past its
+ * last value (e.g. minute 60), NextSetBit finds nothing and we move on to
+ * the next value of the enclosing field, so we do not need to normalize.
+ */
+static bool
+NextMatchingMinute(entry *schedule, bool matchDomAndDow, CivilMinute *time,
+				   int lastYear)
+{
+	while (time->year <= lastYear)
+	{
+		int month = NextSetBit(schedule->month, time->month - FIRST_MONTH);
+		int day = 0;
+		int hour = 0;
+		int minute = 0;
+
+		if (month < 0)
+		{
+			/* no more matching months this year */
+			time->year++;
+			time->month = FIRST_MONTH;
+			time->day = FIRST_DOM;
+			time->hour = FIRST_HOUR;
+			time->minute = FIRST_MINUTE;
+			continue;
+		}
+
+		if (month + FIRST_MONTH != time->month)
+		{
+			time->month = month + FIRST_MONTH;
+			time->day = FIRST_DOM;
+			time->hour = FIRST_HOUR;
+			time->minute = FIRST_MINUTE;
+		}
+
+		day = NextSetBit(MatchingDaysOfMonth(schedule, matchDomAndDow,
+											 time->year, time->month),
+						 time->day - FIRST_DOM);
+		if (day < 0)
+		{
+			/* no more matching days this month */
+			time->month++;
+			time->day = FIRST_DOM;
+			time->hour = FIRST_HOUR;
+			time->minute = FIRST_MINUTE;
+			continue;
+		}
+
+		if (day + FIRST_DOM != time->day)
+		{
+			time->day = day + FIRST_DOM;
+			time->hour = FIRST_HOUR;
+			time->minute = FIRST_MINUTE;
+		}
+
+		hour = NextSetBit(schedule->hour, time->hour - FIRST_HOUR);
+		if (hour < 0)
+		{
+			/* no more matching hours this day */
+			time->day++;
+			time->hour = FIRST_HOUR;
+			time->minute = FIRST_MINUTE;
+			continue;
+		}
+
+		if (hour + FIRST_HOUR != time->hour)
+		{
+			time->hour = hour + FIRST_HOUR;
+			time->minute = FIRST_MINUTE;
+		}
+
+		minute = NextSetBit(schedule->minute, time->minute - FIRST_MINUTE);
+		if (minute < 0)
+		{
+			/* no more matching minutes this hour */
+			time->hour++;
+			time->minute = FIRST_MINUTE;
+			continue;
+		}
+
+		time->minute = minute + FIRST_MINUTE;
+		return true;
+	}
+
+	return false;
+}
+
+
+/*
+ * MatchingDaysOfMonth returns a mask of the days in the given month on which
+ * the schedule fires, using the same day-of-month and day-of-week logic as
+ * ShouldRunTask. Bit 0 is the first day of the month.
+ */
+static uint64
+MatchingDaysOfMonth(entry *schedule, bool matchDomAndDow, int year, int month)
+{
+	int dayCount = DaysInMonth(year, month);
+	int firstWeekday = j2day(date2j(year, month, FIRST_DOM));
+	uint64 monthDays = (UINT64CONST(1) << dayCount) - 1;
+	uint64 domDays = schedule->dom;
+	uint64 dowDays = 0;
+	uint64 weekdays = 0;
+
+	/* Sunday is both 0 and 7, we only need 0 */
+	uint64 scheduleWeekdays = schedule->dow & 0x7F;
+
+	if ((schedule->flags & DOM_LAST) != 0)
+	{
+		domDays |= UINT64CONST(1) << (dayCount - 1);
+	}
+
+	/* rotate the weekdays such that bit 0 is the first day of the month */
+	weekdays = ((scheduleWeekdays >> firstWeekday) |
+				(scheduleWeekdays << (7 - firstWeekday))) & 0x7F;
+
+	/* repeat the week for the whole month */
+	dowDays = weekdays | (weekdays << 7) | (weekdays << 14) |
+			  (weekdays << 21) | (weekdays << 28);
+
+	if (matchDomAndDow)
+	{
+		return domDays & dowDays & monthDays;
+	}
+
+	return (domDays | dowDays) & monthDays;
+}
+
+
+/*
+ * NextSetBit returns the position of the first bit at or after position
+ * that is set in mask, or -1 if there is none.
+ */
+int
+NextSetBit(uint64 mask, int position)
+{
+	if (position >= 64)
+	{
+		return -1;
+	}
+
+	mask &= ~UINT64CONST(0) << position;
+	if (mask == 0)
+	{
+		return -1;
+	}
+
+#if (PG_VERSION_NUM >= 120000)
+	return pg_rightmost_one_pos64(mask);
+#else
+	position = 0;
+	while ((mask & 1) == 0)
+	{
+		mask >>= 1;
+		position++;
+	}
+
+	return position;
+#endif
+}
+
+
+/*
+ * DaysInMonth returns the number of days in the given month.
+ */
+static int
+DaysInMonth(int year, int month)
+{
+	return day_tab[isleap(year)][month - 1];
+}
+
+
+/*
+ * CivilMinuteToTime returns the number of seconds between the epoch and
+ * the given wall clock time, as if the wall clock were UTC.
+ */
+static pg_time_t
+CivilMinuteToTime(CivilMinute *time)
+{
+	pg_time_t days = date2j(time->year, time->month, time->day) - UNIX_EPOCH_JDATE;
+
+	return days * SECS_PER_DAY + time->hour * SECS_PER_HOUR +
+		   time->minute * SECS_PER_MINUTE;
+}
+
+
+/*
+ * TimestampMinuteFloor returns the start of the minute that contains the
+ * given time, also for times before the PostgreSQL epoch.
+ */
+static TimestampTz
+TimestampMinuteFloor(TimestampTz time)
+{
+	TimestampTz remainder = time % USECS_PER_MINUTE;
+
+	if (remainder < 0)
+	{
+		remainder += USECS_PER_MINUTE;
+	}
+
+	return time - remainder;
+}
@@ -0,0 +1,330 @@
+/*-------------------------------------------------------------------------
+ *
+ * src/schedule_index.c
+ *
+ * Inverted index from wall clock values to the schedules that match them.
+ *
+ * Every schedule gets a slot number. For every value of every schedule
+ * field (e.g. minute 5, or Tuesday) the index keeps a bitmap with a bit
+ * for each slot whose schedule contains the value. The schedules that
+ * match a given minute can then be found by combining a handful of bitmaps
+ * a word at a time, rather than by looking at each schedule.
+ *
+ * The index also keeps a copy of each schedule in an array ordered by slot,
+ * such that code that needs the schedules of many tasks reads them from
+ * consecutive memory instead of looking up each job.
+ *
+ * Copyright (c) 2016, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "cron.h"
+#include "pg_cron.h"
+#include "schedule.h"
+#include "schedule_index.h"
+
+#include "utils/memutils.h"
+
+
+#define SLOTS_PER_WORD 64
+
+/* offsets of the bitmaps for each schedule field value */
+#define MINUTE_BITMAPS 0
+#define HOUR_BITMAPS (MINUTE_BITMAPS + MINUTE_COUNT)
+#define DOM_BITMAPS (HOUR_BITMAPS + HOUR_COUNT)
+#define MONTH_BITMAPS (DOM_BITMAPS + DOM_COUNT)
+#define DOW_BITMAPS (MONTH_BITMAPS + MONTH_COUNT)
+
+/* slots of schedules that run on the last day of the month ($) */
+#define LAST_DOM_BITMAP (DOW_BITMAPS + DOW_COUNT)
+
+/* slots of schedules with a * day-of-month or day-of-week */
+#define DOM_DOW_STAR_BITMAP (LAST_DOM_BITMAP + 1)
+
+/* slots of schedules with a * minute or hour */
+#define WILDCARD_BITMAP (DOM_DOW_STAR_BITMAP + 1)
+
+/* slots that are in use */
+#define USED_SLOTS_BITMAP (WILDCARD_BITMAP + 1)
+
+#define BITMAP_COUNT (USED_SLOTS_BITMAP + 1)
+
+
+/* forward declarations */
+static uint64 * GetBitmap(int bitmapIndex);
+static void SetSlotBit(int bitmapIndex, int slot);
+static void ClearSlotBit(int bitmapIndex, int slot);
+static void IndexField(int firstBitmap, uint64 mask, int slot);
+static void GrowScheduleIndex(void);
+
+
+/* global variables */
+static MemoryContext ScheduleIndexContext = NULL;
+
+/* BITMAP_COUNT bitmaps of SlotWordCount words each, one after the other */
+static uint64 *ScheduleBitmaps = NULL;
+static int SlotWordCount = 0;
+
+/* schedules by slot, SlotWordCount * SLOTS_PER_WORD in total */
+static entry *SlotSchedules = NULL;
+
+
+/*
+ * InitializeScheduleIndex initializes an empty schedule index.
+ */
+void
+InitializeScheduleIndex(void)
+{
+	ScheduleIndexContext = AllocSetContextCreate(CurrentMemoryContext,
+												 "pg_cron schedule index context",
+												 ALLOCSET_DEFAULT_MINSIZE,
+												 ALLOCSET_DEFAULT_INITSIZE,
+												 ALLOCSET_DEFAULT_MAXSIZE);
+
+	SlotWordCount = 1;
+	ScheduleBitmaps = MemoryContextAllocZero(ScheduleIndexContext,
+											 BITMAP_COUNT * SlotWordCount *
+											 sizeof(uint64));
+	SlotSchedules = MemoryContextAllocZero(ScheduleIndexContext,
+										   SlotWordCount * SLOTS_PER_WORD *
+										   sizeof(entry));
+}
+
+
+/*
+ * AddScheduleSlot reserves a slot for a schedule and returns its number.
+ * The slot does not match anything until IndexSchedule is called.
+ */
+int
+AddScheduleSlot(void)
+{
+	uint64 *usedSlots = GetBitmap(USED_SLOTS_BITMAP);
+	int wordIndex = 0;
+	int slot = 0;
+
+	for (wordIndex = 0; wordIndex < SlotWordCount; wordIndex++)
+	{
+		if (usedSlots[wordIndex] != ~UINT64CONST(0))
+		{
+			break;
+		}
+	}
+
+	if (wordIndex == SlotWordCount)
+	{
+		/* all slots are in use, the first new one is at the end */
+		GrowScheduleIndex();
+	}
+
+	usedSlots = GetBitmap(USED_SLOTS_BITMAP);
+	slot = wordIndex * SLOTS_PER_WORD + NextSetBit(~usedSlots[wordIndex], 0);
+
+	SetSlotBit(USED_SLOTS_BITMAP, slot);
+
+	return slot;
+}
+
+
+/*
+ * IndexSchedule replaces the schedule in the given slot. Only cron schedules
+ * are indexed, a NULL, interval or @reboot schedule never matches.
+ */
+void
+IndexSchedule(int slot, entry *schedule)
+{
+	int bitmapIndex = 0;
+
+	for (bitmapIndex = 0; bitmapIndex < USED_SLOTS_BITMAP; bitmapIndex++)
+	{
+		ClearSlotBit(bitmapIndex, slot);
+	}
+
+	if (schedule == NULL)
+	{
+		memset(&SlotSchedules[slot], 0, sizeof(entry));
+		return;
+	}
+
+	SlotSchedules[slot] = *schedule;
+
+	if (schedule->secondsInterval > 0 || (schedule->flags & WHEN_REBOOT) != 0)
+	{
+		return;
+	}
+
+	IndexField(MINUTE_BITMAPS, schedule->minute, slot);
+	IndexField(HOUR_BITMAPS, schedule->hour, slot);
+	IndexField(DOM_BITMAPS, schedule->dom, slot);
+	IndexField(MONTH_BITMAPS, schedule->month, slot);
+	IndexField(DOW_BITMAPS, schedule->dow, slot);
+
+	if ((schedule->flags & DOM_LAST) != 0)
+	{
+		SetSlotBit(LAST_DOM_BITMAP, slot);
+	}
+
+	if ((schedule->flags & (DOM_STAR | DOW_STAR)) != 0)
+	{
+		SetSlotBit(DOM_DOW_STAR_BITMAP, slot);
+	}
+
+	if ((schedule->flags & (MIN_STAR | HR_STAR)) != 0)
+	{
+		SetSlotBit(WILDCARD_BITMAP, slot);
+	}
+}
+
+
+/*
+ * GetSlotSchedule returns the schedule in the given slot.
+ */
+entry *
+GetSlotSchedule(int slot)
+{
+	return &SlotSchedules[slot];
+}
+
+
+/*
+ * RemoveScheduleSlot clears the given slot, such that it can be reused.
+ */
+void
+RemoveScheduleSlot(int slot)
+{
+	IndexSchedule(slot, NULL);
+	ClearSlotBit(USED_SLOTS_BITMAP, slot);
+}
+
+
+/*
+ * MatchingScheduleSlots returns a bitmap of the slots whose schedule matches
+ * the given minute, using the same logic as ShouldRunTask. Schedules with a
+ * * minute or hour are only included if doWild is set and other schedules
+ * only if doNonWild is set. The bitmap is allocated in the current memory
+ * context and its length in words is written to wordCount.
+ */
+uint64 *
+MatchingScheduleSlots(CalendarMinute *calendarMinute, bool doWild,
+					  bool doNonWild, int *wordCount)
+{
+	uint64 *matchingSlots = palloc0(SlotWordCount * sizeof(uint64));
+	uint64 *minutes = GetBitmap(MINUTE_BITMAPS + calendarMinute->minute - FIRST_MINUTE);
+	uint64 *hours = GetBitmap(HOUR_BITMAPS + calendarMinute->hour - FIRST_HOUR);
+	uint64 *days = GetBitmap(DOM_BITMAPS + calendarMinute->dayOfMonth - FIRST_DOM);
+	uint64 *months = GetBitmap(MONTH_BITMAPS + calendarMinute->month - FIRST_MONTH);
+	uint64 *weekdays = GetBitmap(DOW_BITMAPS + calendarMinute->dayOfWeek - FIRST_DOW);
+	uint64 *lastDays = GetBitmap(LAST_DOM_BITMAP);
+	uint64 *domDowStars = GetBitmap(DOM_DOW_STAR_BITMAP);
+	uint64 *wildcards = GetBitmap(WILDCARD_BITMAP);
+	uint64 *usedSlots = GetBitmap(USED_SLOTS_BITMAP);
+	uint64 lastDayMask = calendarMinute->isLastDayOfMonth ? ~UINT64CONST(0) : 0;
+	uint64 andLogicMask = CronDomDowAndLogic ? ~UINT64CONST(0) : 0;
+	uint64 wildMask = doWild ? ~UINT64CONST(0) : 0;
+	uint64 nonWildMask = doNonWild ? ~UINT64CONST(0) : 0;
+	int wordIndex = 0;
+
+	for (wordIndex = 0; wordIndex < SlotWordCount; wordIndex++)
+	{
+		uint64 timeMatches = minutes[wordIndex] & hours[wordIndex] &
+							 months[wordIndex];
+		uint64 domMatches = days[wordIndex] | (lastDays[wordIndex] & lastDayMask);
+		uint64 dowMatches = weekdays[wordIndex];
+		uint64 andSlots = domDowStars[wordIndex] | andLogicMask;
+		uint64 dayMatches = (andSlots & domMatches & dowMatches) |
+							(~andSlots & (domMatches | dowMatches));
+		uint64 kindMatches = (wildcards[wordIndex] & wildMask) |
+							 (~wildcards[wordIndex] & nonWildMask);
+
+		matchingSlots[wordIndex] = timeMatches & dayMatches & kindMatches &
+								   usedSlots[wordIndex];
+	}
+
+	*wordCount = SlotWordCount;
+
+	return matchingSlots;
+}
+
+
+/*
+ * GetBitmap returns the first word of the bitmap with the given index.
+ */
+static uint64 *
+GetBitmap(int bitmapIndex)
+{
+	return ScheduleBitmaps + bitmapIndex * SlotWordCount;
+}
+
+
+/*
+ * SetSlotBit sets the bit for the given slot in a bitmap.
+ */
+static void
+SetSlotBit(int bitmapIndex, int slot)
+{
+	uint64 *bitmap = GetBitmap(bitmapIndex);
+
+	bitmap[slot / SLOTS_PER_WORD] |= UINT64CONST(1) << (slot % SLOTS_PER_WORD);
+}
+
+
+/*
+ * ClearSlotBit clears the bit for the given slot in a bitmap.
+ */
+static void
+ClearSlotBit(int bitmapIndex, int slot)
+{
+	uint64 *bitmap = GetBitmap(bitmapIndex);
+
+	bitmap[slot / SLOTS_PER_WORD] &= ~(UINT64CONST(1) << (slot % SLOTS_PER_WORD));
+}
+
+
+/*
+ * IndexField sets the bit for the given slot in the bitmaps of the values
+ * that are set in a schedule field.
+ */
+static void
+IndexField(int firstBitmap, uint64 mask, int slot)
+{
+	int bitIndex = -1;
+
+	while ((bitIndex = NextSetBit(mask, bitIndex + 1)) >= 0)
+	{
+		SetSlotBit(firstBitmap + bitIndex, slot);
+	}
+}
+
+
+/*
+ * GrowScheduleIndex doubles the number of slots in the index.
+ */
+static void
+GrowScheduleIndex(void)
+{
+	int oldWordCount = SlotWordCount;
+	int newWordCount = 2 * SlotWordCount;
+	uint64 *oldBitmaps = ScheduleBitmaps;
+	uint64 *newBitmaps = MemoryContextAllocZero(ScheduleIndexContext,
+												BITMAP_COUNT * newWordCount *
+												sizeof(uint64));
+	int bitmapIndex = 0;
+
+	for (bitmapIndex = 0; bitmapIndex < BITMAP_COUNT; bitmapIndex++)
+	{
+		memcpy(newBitmaps + bitmapIndex * newWordCount,
+			   oldBitmaps + bitmapIndex * oldWordCount,
+			   oldWordCount * sizeof(uint64));
+	}
+
+	ScheduleBitmaps = newBitmaps;
+	SlotSchedules = repalloc(SlotSchedules, newWordCount * SLOTS_PER_WORD *
+							 sizeof(entry));
+	memset(SlotSchedules + oldWordCount * SLOTS_PER_WORD, 0,
+		   (newWordCount - oldWordCount) * SLOTS_PER_WORD * sizeof(entry));
+	SlotWordCount = newWordCount;
+
+	pfree(oldBitmaps);
+}
@@ -0,0 +1,460 @@
+/*-------------------------------------------------------------------------
+ *
+ * src/shared_state.c
+ *
+ * Shared memory for state that pg_cron processes share with each other and
+ * with regular backends.
+ *
+ * Copyright (c) 2016, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#include "cron.h"
+#include "job_metadata.h"
+#include "shared_state.h"
+
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/builtins.h"
+#include "utils/tuplestore.h"
+
+
+/* forward declarations */
+static Size CronSharedStateSize(void);
+static CronRunProgress * FindRunProgress(int64 runId);
+
+
+/* SQL-callable functions */
+PG_FUNCTION_INFO_V1(cron_job_run_progress);
+
+
+/* global variables */
+static CronSharedState *CronShared = NULL;
+
+/* number of runs in progress that fit in shared memory */
+static int RunProgressCount = 0;
+
+
+/*
+ * InitializeSharedState sets the number of runs in progress that fit in the
+ * shared state. It must be called from _PG_init in every process, before the
+ * shared memory is requested or attached to.
+ */
+void
+InitializeSharedState(int maxRunningJobs)
+{
+	RunProgressCount = maxRunningJobs;
+}
+
+
+/*
+ * CronSharedStateSize returns the amount of shared memory used by pg_cron.
+ */
+static Size
+CronSharedStateSize(void)
+{
+	Size size = offsetof(CronSharedState, runProgress);
+
+	size = add_size(size, mul_size(RunProgressCount, sizeof(CronRunProgress)));
+
+	return MAXALIGN(size);
+}
+
+
+/*
+ * CronSharedStateRequest requests the shared memory used by the shared state.
+ */
+void
+CronSharedStateRequest(void)
+{
+	RequestAddinShmemSpace(CronSharedStateSize());
+	RequestNamedLWLockTranche("pg_cron", 1);
+}
+
+
+/*
+ * CronSharedStateStartup attaches to the shared state, and initializes it
+ * if we are the first to do so.
+ */
+void
+CronSharedStateStartup(void)
+{
+	bool found = false;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	CronShared = ShmemInitStruct("pg_cron shared state", CronSharedStateSize(),
+								 &found);
+	if (!found)
+	{
+		int counter = 0;
+		int gauge = 0;
+
+		for (counter = 0; counter < CRON_COUNTER_COUNT; counter++)
+		{
+			pg_atomic_init_u64(&CronShared->counters[counter], 0);
+		}
+
+		for (gauge = 0; gauge < CRON_GAUGE_COUNT; gauge++)
+		{
+			pg_atomic_init_u64(&CronShared->gauges[gauge], 0);
+		}
+
+		CronShared->runProgressLock = &(GetNamedLWLockTranche("pg_cron"))->lock;
+		CronShared->runProgressCount = RunProgressCount;
+		memset(CronShared->runProgress, 0,
+			   RunProgressCount * sizeof(CronRunProgress));
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+}
+
+
+/*
+ * IncrementCronCounter adds amount to one of the shared counters. It does
+ * nothing if pg_cron did not set up shared memory, e.g. in binary upgrade
+ * mode.
+ */
+void
+IncrementCronCounter(CronCounter counter, uint64 amount)
+{
+	if (CronShared == NULL || amount == 0)
+	{
+		return;
+	}
+
+	pg_atomic_fetch_add_u64(&CronShared->counters[counter], (int64) amount);
+}
+
+
+/*
+ * ReadCronCounter returns the current value of one of the shared counters.
+ */
+uint64
+ReadCronCounter(CronCounter counter)
+{
+	if (CronShared == NULL)
+	{
+		return 0;
+	}
+
+	return pg_atomic_read_u64(&CronShared->counters[counter]);
+}
+
+
+/*
+ * SetCronGauge sets one of the shared gauges. Gauges are only set by the
+ * launcher, so they are simply overwritten.
+ */
+void
+SetCronGauge(CronGauge gauge, uint64 value)
+{
+	if (CronShared == NULL)
+	{
+		return;
+	}
+
+	pg_atomic_write_u64(&CronShared->gauges[gauge], value);
+}
+
+
+/*
+ * ReadCronGauge returns the current value of one of the shared gauges.
+ */
+uint64
+ReadCronGauge(CronGauge gauge)
+{
+	if (CronShared == NULL)
+	{
+		return 0;
+	}
+
+	return pg_atomic_read_u64(&CronShared->gauges[gauge]);
+}
+
+
+/*
+ * ResetRunProgress forgets all runs in progress. The launcher calls it when
+ * it starts, since runs of a previous launcher are not running anymore.
+ */
+void
+ResetRunProgress(void)
+{
+	if (CronShared == NULL)
+	{
+		return;
+	}
+
+	LWLockAcquire(CronShared->runProgressLock, LW_EXCLUSIVE);
+	memset(CronShared->runProgress, 0,
+		   CronShared->runProgressCount * sizeof(CronRunProgress));
+	LWLockRelease(CronShared->runProgressLock);
+}
+
+
+/*
+ * StartRunProgress starts keeping track of a run in shared memory. Returns
+ * false if there is no room for it, in which case the caller needs to
+ * record the progress of the run elsewhere.
+ */
+bool
+StartRunProgress(int64 runId, int64 jobId, char *database, char *userName,
+				 int status)
+{
+	CronRunProgress *runProgress = NULL;
+
+	if (CronShared == NULL || runId == 0)
+	{
+		return false;
+	}
+
+	runProgress = FindRunProgress(0);
+	if (runProgress == NULL)
+	{
+		return false;
+	}
+
+	LWLockAcquire(CronShared->runProgressLock, LW_EXCLUSIVE);
+	runProgress->runId = runId;
+	runProgress->jobId = jobId;
+	namestrcpy(&runProgress->database, database);
+	namestrcpy(&runProgress->userName, userName);
+	runProgress->status = status;
+	runProgress->jobPid = 0;
+	runProgress->startTime = 0;
+	memset(&runProgress->latency, 0, sizeof(CronRunLatency));
+	LWLockRelease(CronShared->runProgressLock);
+
+	return true;
+}
+
+
+/*
+ * SetRunProgress changes the state of a run in progress, and the PID and
+ * start time if they are given. Returns false if the run is not kept in
+ * shared memory.
+ */
+bool
+SetRunProgress(int64 runId, int status, int32 *jobPid, TimestampTz *startTime)
+{
+	CronRunProgress *runProgress = FindRunProgress(runId);
+
+	if (runProgress == NULL)
+	{
+		return false;
+	}
+
+	LWLockAcquire(CronShared->runProgressLock, LW_EXCLUSIVE);
+	runProgress->status = status;
+
+	if (jobPid != NULL)
+	{
+		runProgress->jobPid = *jobPid;
+	}
+
+	if (startTime != NULL)
+	{
+		runProgress->startTime = *startTime;
+	}
+	LWLockRelease(CronShared->runProgressLock);
+
+	return true;
+}
+
+
+/*
+ * SetRunLatency sets how long it took for the command of a run in progress
+ * to start, such that it is written along with the final state of the run.
+ * Returns false if the run is not kept in shared memory.
+ */
+bool
+SetRunLatency(int64 runId, CronRunLatency *latency)
+{
+	CronRunProgress *runProgress = NULL;
+
+	/* a run ID of 0 would find a free slot */
+	if (runId == 0)
+	{
+		return false;
+	}
+
+	runProgress = FindRunProgress(runId);
+	if (runProgress == NULL)
+	{
+		return false;
+	}
+
+	LWLockAcquire(CronShared->runProgressLock, LW_EXCLUSIVE);
+	runProgress->latency = *latency;
+	LWLockRelease(CronShared->runProgressLock);
+
+	return true;
+}
+
+
+/*
+ * GetRunProgress gets the PID, start time and latency of a run in progress,
+ * which are 0 if they are not known yet. Returns false if the run is not
+ * kept in shared memory. Only the launcher changes runs, so it reads them
+ * without taking the lock.
+ */
+bool
+GetRunProgress(int64 runId, int32 *jobPid, TimestampTz *startTime,
+			   CronRunLatency *latency)
+{
+	CronRunProgress *runProgress = FindRunProgress(runId);
+
+	if (runProgress == NULL)
+	{
+		return false;
+	}
+
+	*jobPid = runProgress->jobPid;
+	*startTime = runProgress->startTime;
+	*latency = runProgress->latency;
+
+	return true;
+}
+
+
+/*
+ * EndRunProgress stops keeping track of a run that finished.
+ */
+void
+EndRunProgress(int64 runId)
+{
+	CronRunProgress *runProgress = FindRunProgress(runId);
+
+	if (runProgress == NULL)
+	{
+		return;
+	}
+
+	LWLockAcquire(CronShared->runProgressLock, LW_EXCLUSIVE);
+	runProgress->runId = 0;
+	LWLockRelease(CronShared->runProgressLock);
+}
+
+
+/*
+ * FindRunProgress returns the shared memory slot of a run in progress, or a
+ * free slot if runId is 0. Returns NULL if there is no such slot.
+ */
+static CronRunProgress *
+FindRunProgress(int64 runId)
+{
+	int slot = 0;
+
+	if (CronShared == NULL)
+	{
+		return NULL;
+	}
+
+	for (slot = 0; slot < CronShared->runProgressCount; slot++)
+	{
+		if (CronShared->runProgress[slot].runId == runId)
+		{
+			return &CronShared->runProgress[slot];
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * cron_job_run_progress returns the runs that are in progress. Users other
+ * than superusers only see their own runs, like in cron.job_run_details.
+ */
+Datum
+cron_job_run_progress(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *resultInfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc tupleDescriptor = NULL;
+	Tuplestorestate *tupleStore = NULL;
+	MemoryContext oldContext = NULL;
+	CronRunProgress *runProgressCopy = NULL;
+	int runProgressCount = 0;
+	char *currentUserName = GetUserNameFromId(GetUserId(), false);
+	bool isSuperuser = superuser();
+	int slot = 0;
+
+	if (resultInfo == NULL || !IsA(resultInfo, ReturnSetInfo) ||
+		(resultInfo->allowedModes & SFRM_Materialize) == 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("set-valued function called in context that cannot "
+							   "accept a set")));
+	}
+
+	if (get_call_result_type(fcinfo, NULL, &tupleDescriptor) != TYPEFUNC_COMPOSITE)
+	{
+		elog(ERROR, "return type must be a row type");
+	}
+
+	oldContext = MemoryContextSwitchTo(resultInfo->econtext->ecxt_per_query_memory);
+	tupleDescriptor = CreateTupleDescCopy(tupleDescriptor);
+	tupleStore = tuplestore_begin_heap(true, false, work_mem);
+	MemoryContextSwitchTo(oldContext);
+
+	resultInfo->returnMode = SFRM_Materialize;
+	resultInfo->setResult = tupleStore;
+	resultInfo->setDesc = tupleDescriptor;
+
+	if (CronShared == NULL)
+	{
+		return (Datum) 0;
+	}
+
+	/* copy the runs, such that we do not hold the lock while building tuples */
+	runProgressCount = CronShared->runProgressCount;
+	runProgressCopy = palloc(runProgressCount * sizeof(CronRunProgress));
+
+	LWLockAcquire(CronShared->runProgressLock, LW_SHARED);
+	memcpy(runProgressCopy, CronShared->runProgress,
+		   runProgressCount * sizeof(CronRunProgress));
+	LWLockRelease(CronShared->runProgressLock);
+
+	for (slot = 0; slot < runProgressCount; slot++)
+	{
+		CronRunProgress *runProgress = &runProgressCopy[slot];
+		Datum values[7];
+		bool isNulls[7];
+
+		if (runProgress->runId == 0)
+		{
+			continue;
+		}
+
+		if (!isSuperuser &&
+			strcmp(NameStr(runProgress->userName), currentUserName) != 0)
+		{
+			continue;
+		}
+
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[0] = Int64GetDatum(runProgress->jobId);
+		values[1] = Int64GetDatum(runProgress->runId);
+		values[2] = Int32GetDatum(runProgress->jobPid);
+		isNulls[2] = runProgress->jobPid == 0;
+		values[3] = CStringGetTextDatum(NameStr(runProgress->database));
+		values[4] = CStringGetTextDatum(NameStr(runProgress->userName));
+		values[5] = CStringGetTextDatum(GetCronStatus(runProgress->status));
+		values[6] = TimestampTzGetDatum(runProgress->startTime);
+		isNulls[6] = runProgress->startTime == 0;
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	pfree(runProgressCopy);
+
+	return (Datum) 0;
+}
@@ -15,21 +15,67 @@
 
 #include "cron.h"
 #include "pg_cron.h"
+#include "schedule.h"
+#include "schedule_index.h"
 #include "task_states.h"
 
 #include "access/hash.h"
+#include "lib/binaryheap.h"
 #include "utils/hsearch.h"
 #include "utils/memutils.h"
 
 
+/*
+ * CronQueueEntry is a run time of a task in the task queue. Entries are not
+ * removed from the queue when a task changes, instead the task gets a new
+ * entry and the old one is skipped because its version no longer matches
+ * the one of the task.
+ */
+typedef struct CronQueueEntry
+{
+	int64 jobId;
+	uint64 version;
+	TimestampTz nextRunTime;
+} CronQueueEntry;
+
+
 /* forward declarations */
 static HTAB * CreateCronTaskHash(void);
 static CronTask * GetCronTask(int64 jobId);
+static void RefreshAllTasks(void);
+static void RefreshChangedTasks(List *changedJobIdList);
+static void UpdateTask(CronTask *task, CronJob *job);
+static bool IsQueuedTask(CronTask *task, entry *schedule);
+static TimestampTz ScheduleNextRunTime(CronSchedule *cronSchedule,
+									   TimestampTz lastMinute);
+static void RequeueChangedTasks(List *changedJobIdList, TimestampTz lastMinute);
+static void AddQueueEntry(CronTask *task);
+static bool IsCurrentQueueEntry(CronQueueEntry *queueEntry);
+static void CompactTaskQueue(void);
+static int CompareTaskRunTimes(Datum a, Datum b, void *arg);
+static void SetSlotTask(int slot, CronTask *task);
 
 /* global variables */
 static MemoryContext CronTaskContext = NULL;
 static HTAB *CronTaskHash = NULL;
 
+/* cron-scheduled tasks ordered by their next run time */
+static MemoryContext CronTaskQueueContext = NULL;
+static binaryheap *CronTaskQueue = NULL;
+
+/* last version given to a queue entry */
+static uint64 CronTaskQueueVersion = 0;
+
+/* tasks by the slot of their schedule in the schedule index */
+static CronTask **SlotTasks = NULL;
+static int SlotTaskCount = 0;
+
+/* tasks of jobs that run every few seconds */
+static List *IntervalTasks = NIL;
+
+/* tasks that the launcher should handle on its next pass */
+static List *ReadyTasks = NIL;
+
 /* settings */
 bool LaunchActiveJobs = true;
 
@@ -46,7 +92,15 @@ InitializeTaskStateHash(void)
 											  ALLOCSET_DEFAULT_INITSIZE,
 											  ALLOCSET_DEFAULT_MAXSIZE);
 
+	CronTaskQueueContext = AllocSetContextCreate(CronTaskContext,
+												 "pg_cron task queue context",
+												 ALLOCSET_DEFAULT_MINSIZE,
+												 ALLOCSET_DEFAULT_INITSIZE,
+												 ALLOCSET_DEFAULT_MAXSIZE);
+
 	CronTaskHash = CreateCronTaskHash();
+
+	InitializeScheduleIndex();
 }
 
 
@@ -77,9 +131,41 @@ CreateCronTaskHash(void)
  * RefreshTaskHash reloads the cron jobs from the cron.job table.
  * If a job that has an active task has been removed, the task
  * is marked as inactive by this function.
+ *
+ * Normally only the jobs that changed since the last refresh are reloaded,
+ * and only their tasks are queued again. The task queue is only rebuilt
+ * when all jobs are reloaded.
  */
 void
-RefreshTaskHash(void)
+RefreshTaskHash(TimestampTz lastMinute)
+{
+	List *changedJobIdList = NIL;
+
+	/* changes committed while we load the jobs invalidate the cache again */
+	MarkJobCacheValid();
+
+	if (CronTaskQueue != NULL && LoadChangedCronJobs(&changedJobIdList))
+	{
+		RefreshChangedTasks(changedJobIdList);
+		RequeueChangedTasks(changedJobIdList, lastMinute);
+	}
+	else
+	{
+		RefreshAllTasks();
+		RebuildTaskQueue(lastMinute);
+	}
+}
+
+
+/*
+ * RefreshAllTasks reloads all jobs and updates the tasks accordingly.
+ *
+ * Tasks point to the interned schedule of their job, which is only valid
+ * until the next reset of the job metadata cache, so we clear the pointer
+ * for tasks whose job was removed.
+ */
+static void
+RefreshAllTasks(void)
 {
 	List *jobList = NIL;
 	ListCell *jobCell = NULL;
@@ -94,6 +180,7 @@ RefreshTaskHash(void)
 	while ((task = hash_seq_search(&status)) != NULL)
 	{
 		task->isActive = false;
+		task->schedule = NULL;
 	}
 
 	jobList = LoadCronJobList();
@@ -104,11 +191,468 @@ RefreshTaskHash(void)
 		CronJob *job = (CronJob *) lfirst(jobCell);
 
 		task = GetCronTask(job->jobId);
-		task->isActive = LaunchActiveJobs && job->active;
-		task->secondsInterval = job->schedule.secondsInterval;
+		UpdateTask(task, job);
 	}
 
-	CronJobCacheValid = true;
+	hash_seq_init(&status, CronTaskHash);
+
+	/* the launcher stops or removes the tasks of removed jobs */
+	while ((task = hash_seq_search(&status)) != NULL)
+	{
+		if (!task->isActive)
+		{
+			MarkTaskReady(task);
+		}
+	}
+}
+
+
+/*
+ * RefreshChangedTasks updates the tasks of the jobs with the given IDs,
+ * which were reloaded by LoadChangedCronJobs.
+ */
+static void
+RefreshChangedTasks(List *changedJobIdList)
+{
+	ListCell *jobIdCell = NULL;
+
+	foreach(jobIdCell, changedJobIdList)
+	{
+		int64 jobId = *((int64 *) lfirst(jobIdCell));
+		CronJob *job = GetCronJob(jobId);
+		CronTask *task = NULL;
+		bool isPresent = false;
+
+		if (job != NULL)
+		{
+			task = GetCronTask(jobId);
+			UpdateTask(task, job);
+			continue;
+		}
+
+		task = hash_search(CronTaskHash, &jobId, HASH_FIND, &isPresent);
+		if (task != NULL)
+		{
+			/* the job was removed */
+			task->isActive = false;
+			task->schedule = NULL;
+			MarkTaskReady(task);
+		}
+	}
+}
+
+
+/*
+ * UpdateTask copies the settings of a job that was (re)loaded into its task.
+ */
+static void
+UpdateTask(CronTask *task, CronJob *job)
+{
+	uint32 secondsInterval = job->schedule->schedule.secondsInterval;
+
+	task->isActive = LaunchActiveJobs && job->active;
+	task->schedule = job->schedule;
+
+	if (!task->isActive)
+	{
+		/* the launcher stops or removes the task */
+		MarkTaskReady(task);
+	}
+
+	/* interval jobs are not in the task queue, so keep track of their tasks */
+	if (secondsInterval > 0 && task->secondsInterval == 0)
+	{
+		MemoryContext oldContext = MemoryContextSwitchTo(CronTaskContext);
+
+		IntervalTasks = lappend(IntervalTasks, task);
+		MemoryContextSwitchTo(oldContext);
+	}
+	else if (secondsInterval == 0 && task->secondsInterval > 0)
+	{
+		IntervalTasks = list_delete_ptr(IntervalTasks, task);
+	}
+
+	task->secondsInterval = secondsInterval;
+
+	if (task->scheduleText == NULL ||
+		strcmp(task->scheduleText, job->scheduleText) != 0)
+	{
+		if (task->scheduleText != NULL)
+		{
+			pfree(task->scheduleText);
+		}
+
+		task->scheduleText = MemoryContextStrdup(CronTaskContext,
+												 job->scheduleText);
+
+		/* force RebuildTaskQueue to compute a new run time */
+		task->nextRunTime = 0;
+
+		IndexSchedule(task->scheduleSlot, &job->schedule->schedule);
+	}
+}
+
+
+/*
+ * ResetTaskRunTimes forgets the next run time of all tasks, such that they
+ * are recomputed on the next call to RebuildTaskQueue. This is needed when
+ * the settings that affect schedules change.
+ */
+void
+ResetTaskRunTimes(void)
+{
+	CronTask *task = NULL;
+	HASH_SEQ_STATUS status;
+
+	hash_seq_init(&status, CronTaskHash);
+
+	while ((task = hash_seq_search(&status)) != NULL)
+	{
+		task->nextRunTime = 0;
+
+		if (task->schedule != NULL)
+		{
+			task->schedule->runTimeAfter = 0;
+		}
+	}
+}
+
+
+/*
+ * RebuildTaskQueue rebuilds the queue of cron-scheduled tasks ordered by
+ * their next run time from all tasks. Tasks whose run time is unknown or
+ * has passed (e.g. because they were inactive) get the first run time
+ * after lastMinute.
+ */
+void
+RebuildTaskQueue(TimestampTz lastMinute)
+{
+	CronTask *task = NULL;
+	HASH_SEQ_STATUS status;
+	MemoryContext oldContext = NULL;
+	int queueSize = hash_get_num_entries(CronTaskHash) + 1;
+
+	/* frees the queue and all its entries */
+	MemoryContextReset(CronTaskQueueContext);
+
+	oldContext = MemoryContextSwitchTo(CronTaskQueueContext);
+	CronTaskQueue = binaryheap_allocate(queueSize, CompareTaskRunTimes, NULL);
+	MemoryContextSwitchTo(oldContext);
+
+	hash_seq_init(&status, CronTaskHash);
+
+	while ((task = hash_seq_search(&status)) != NULL)
+	{
+		entry *schedule = GetSlotSchedule(task->scheduleSlot);
+
+		/* entries of the task from before the rebuild are gone */
+		task->queueVersion = 0;
+
+		if (!IsQueuedTask(task, schedule))
+		{
+			continue;
+		}
+
+		if (task->nextRunTime <= lastMinute)
+		{
+			task->nextRunTime = ScheduleNextRunTime(task->schedule, lastMinute);
+		}
+
+		if (task->nextRunTime != DT_NOEND)
+		{
+			CronQueueEntry *queueEntry =
+				MemoryContextAlloc(CronTaskQueueContext, sizeof(CronQueueEntry));
+
+			queueEntry->jobId = task->jobId;
+			queueEntry->version = ++CronTaskQueueVersion;
+			queueEntry->nextRunTime = task->nextRunTime;
+			task->queueVersion = queueEntry->version;
+
+			binaryheap_add_unordered(CronTaskQueue, PointerGetDatum(queueEntry));
+		}
+	}
+
+	binaryheap_build(CronTaskQueue);
+}
+
+
+/*
+ * RequeueChangedTasks queues the tasks of the jobs with the given IDs again
+ * after they were refreshed. Their earlier entries in the queue become
+ * stale and are skipped by PopDueTask, so the rest of the queue does not
+ * need to change.
+ */
+static void
+RequeueChangedTasks(List *changedJobIdList, TimestampTz lastMinute)
+{
+	ListCell *jobIdCell = NULL;
+
+	foreach(jobIdCell, changedJobIdList)
+	{
+		int64 jobId = *((int64 *) lfirst(jobIdCell));
+		bool isPresent = false;
+		CronTask *task = hash_search(CronTaskHash, &jobId, HASH_FIND, &isPresent);
+		entry *schedule = NULL;
+
+		if (task == NULL)
+		{
+			continue;
+		}
+
+		/* the earlier entry of the task, if any, is stale */
+		task->queueVersion = 0;
+
+		schedule = GetSlotSchedule(task->scheduleSlot);
+		if (!IsQueuedTask(task, schedule))
+		{
+			continue;
+		}
+
+		if (task->nextRunTime <= lastMinute)
+		{
+			task->nextRunTime = ScheduleNextRunTime(task->schedule, lastMinute);
+		}
+
+		AddQueueEntry(task);
+	}
+}
+
+
+/*
+ * PopDueTask removes and returns the task with the earliest run time from
+ * the queue if that run time is at or before currentMinute, or returns
+ * NULL if no task is due. The caller should return the task to the queue
+ * using QueueTask once its pending runs are accounted for.
+ */
+CronTask *
+PopDueTask(TimestampTz currentMinute)
+{
+	if (CronTaskQueue == NULL)
+	{
+		return NULL;
+	}
+
+	while (!binaryheap_empty(CronTaskQueue))
+	{
+		CronQueueEntry *queueEntry =
+			(CronQueueEntry *) DatumGetPointer(binaryheap_first(CronTaskQueue));
+		CronTask *task = NULL;
+		bool isPresent = false;
+
+		if (!IsCurrentQueueEntry(queueEntry))
+		{
+			/* the task changed or was removed since it was queued */
+			binaryheap_remove_first(CronTaskQueue);
+			pfree(queueEntry);
+			continue;
+		}
+
+		if (queueEntry->nextRunTime > currentMinute)
+		{
+			return NULL;
+		}
+
+		binaryheap_remove_first(CronTaskQueue);
+
+		task = hash_search(CronTaskHash, &queueEntry->jobId, HASH_FIND,
+						   &isPresent);
+		task->queueVersion = 0;
+		pfree(queueEntry);
+
+		return task;
+	}
+
+	return NULL;
+}
+
+
+/*
+ * QueueTask adds a task that was removed by PopDueTask back into the queue
+ * with its first run time after lastMinute.
+ */
+void
+QueueTask(CronTask *task, TimestampTz lastMinute)
+{
+	entry *schedule = GetSlotSchedule(task->scheduleSlot);
+
+	if (!IsQueuedTask(task, schedule))
+	{
+		return;
+	}
+
+	task->nextRunTime = ScheduleNextRunTime(task->schedule, lastMinute);
+
+	AddQueueEntry(task);
+}
+
+
+/*
+ * AddQueueEntry adds the next run time of a task to the queue, unless it
+ * never runs again. Any earlier entry of the task becomes stale.
+ */
+static void
+AddQueueEntry(CronTask *task)
+{
+	CronQueueEntry *queueEntry = NULL;
+
+	if (task->nextRunTime == DT_NOEND)
+	{
+		return;
+	}
+
+	if (CronTaskQueue->bh_size >= CronTaskQueue->bh_space)
+	{
+		CompactTaskQueue();
+	}
+
+	queueEntry = MemoryContextAlloc(CronTaskQueueContext, sizeof(CronQueueEntry));
+	queueEntry->jobId = task->jobId;
+	queueEntry->version = ++CronTaskQueueVersion;
+	queueEntry->nextRunTime = task->nextRunTime;
+	task->queueVersion = queueEntry->version;
+
+	binaryheap_add(CronTaskQueue, PointerGetDatum(queueEntry));
+}
+
+
+/*
+ * IsCurrentQueueEntry returns whether the given queue entry is the latest
+ * one of its task.
+ */
+static bool
+IsCurrentQueueEntry(CronQueueEntry *queueEntry)
+{
+	bool isPresent = false;
+	CronTask *task = hash_search(CronTaskHash, &queueEntry->jobId, HASH_FIND,
+								 &isPresent);
+
+	return task != NULL && task->queueVersion == queueEntry->version;
+}
+
+
+/*
+ * CompactTaskQueue replaces a full task queue by one without stale
+ * entries, with room for at least as many entries as there are tasks.
+ */
+static void
+CompactTaskQueue(void)
+{
+	binaryheap *oldQueue = CronTaskQueue;
+	int queueSize = Max(2 * oldQueue->bh_size,
+						hash_get_num_entries(CronTaskHash) + 1);
+	int nodeIndex = 0;
+	MemoryContext oldContext = MemoryContextSwitchTo(CronTaskQueueContext);
+
+	CronTaskQueue = binaryheap_allocate(queueSize, CompareTaskRunTimes, NULL);
+
+	MemoryContextSwitchTo(oldContext);
+
+	for (nodeIndex = 0; nodeIndex < oldQueue->bh_size; nodeIndex++)
+	{
+		CronQueueEntry *queueEntry =
+			(CronQueueEntry *) DatumGetPointer(oldQueue->bh_nodes[nodeIndex]);
+
+		if (IsCurrentQueueEntry(queueEntry))
+		{
+			binaryheap_add_unordered(CronTaskQueue, PointerGetDatum(queueEntry));
+		}
+		else
+		{
+			pfree(queueEntry);
+		}
+	}
+
+	binaryheap_build(CronTaskQueue);
+	binaryheap_free(oldQueue);
+}
+
+
+/*
+ * MatchingTaskList returns the tasks whose schedule matches the given
+ * minute according to the schedule index. The list can include inactive
+ * tasks.
+ */
+List *
+MatchingTaskList(CalendarMinute *calendarMinute, bool doWild, bool doNonWild)
+{
+	List *taskList = NIL;
+	int wordCount = 0;
+	int wordIndex = 0;
+	uint64 *matchingSlots = MatchingScheduleSlots(calendarMinute, doWild,
+												  doNonWild, &wordCount);
+
+	for (wordIndex = 0; wordIndex < wordCount; wordIndex++)
+	{
+		int bitIndex = -1;
+
+		while ((bitIndex = NextSetBit(matchingSlots[wordIndex], bitIndex + 1)) >= 0)
+		{
+			int slot = wordIndex * 64 + bitIndex;
+
+			taskList = lappend(taskList, SlotTasks[slot]);
+		}
+	}
+
+	pfree(matchingSlots);
+
+	return taskList;
+}
+
+
+/*
+ * IsQueuedTask returns whether the task belongs in the queue, namely when
+ * it is active and has a regular cron schedule. Tasks whose job was removed
+ * are never active.
+ */
+static bool
+IsQueuedTask(CronTask *task, entry *schedule)
+{
+	return task->isActive && schedule->secondsInterval == 0 &&
+		   (schedule->flags & WHEN_REBOOT) == 0;
+}
+
+
+/*
+ * ScheduleNextRunTime returns the first run time of the schedule after
+ * lastMinute. Many tasks usually share the same schedule and become due in
+ * the same minute, so we remember the last result for each schedule and
+ * compute it only once for all of them.
+ */
+static TimestampTz
+ScheduleNextRunTime(CronSchedule *cronSchedule, TimestampTz lastMinute)
+{
+	if (cronSchedule->runTimeAfter != lastMinute ||
+		cronSchedule->nextRunTime == 0)
+	{
+		cronSchedule->nextRunTime = NextRunTime(&cronSchedule->schedule,
+												lastMinute);
+		cronSchedule->runTimeAfter = lastMinute;
+	}
+
+	return cronSchedule->nextRunTime;
+}
+
+
+/*
+ * CompareTaskRunTimes orders queue entries by next run time. binaryheap
+ * keeps the largest element on top, so earlier run times compare as larger.
+ */
+static int
+CompareTaskRunTimes(Datum a, Datum b, void *arg)
+{
+	CronQueueEntry *entryA = (CronQueueEntry *) DatumGetPointer(a);
+	CronQueueEntry *entryB = (CronQueueEntry *) DatumGetPointer(b);
+
+	if (entryA->nextRunTime < entryB->nextRunTime)
+	{
+		return 1;
+	}
+	else if (entryA->nextRunTime > entryB->nextRunTime)
+	{
+		return -1;
+	}
+
+	return 0;
 }
 
 
@@ -133,12 +677,51 @@ GetCronTask(int64 jobId)
 		 * interval job starts when pg_cron first learns about the job.
 		 */
 		task->lastStartTime = GetCurrentTimestamp();
+		task->nextRunTime = 0;
+		task->queueVersion = 0;
+		task->runCount = 0;
+		task->scheduleText = NULL;
+		task->schedule = NULL;
+		task->secondsInterval = 0;
+		task->isReady = false;
+		task->scheduleSlot = AddScheduleSlot();
+
+		SetSlotTask(task->scheduleSlot, task);
 	}
 
 	return task;
 }
 
 
+/*
+ * SetSlotTask remembers which task the given schedule slot belongs to.
+ */
+static void
+SetSlotTask(int slot, CronTask *task)
+{
+	if (slot >= SlotTaskCount)
+	{
+		int newSlotTaskCount = Max(2 * SlotTaskCount, slot + 64);
+
+		if (SlotTasks == NULL)
+		{
+			SlotTasks = MemoryContextAllocZero(CronTaskContext,
+											   newSlotTaskCount * sizeof(CronTask *));
+		}
+		else
+		{
+			SlotTasks = repalloc(SlotTasks, newSlotTaskCount * sizeof(CronTask *));
+			memset(SlotTasks + SlotTaskCount, 0,
+				   (newSlotTaskCount - SlotTaskCount) * sizeof(CronTask *));
+		}
+
+		SlotTaskCount = newSlotTaskCount;
+	}
+
+	SlotTasks[slot] = task;
+}
+
+
 /*
  * InitializeCronTask intializes a CronTask struct.
  */
@@ -149,15 +732,33 @@ InitializeCronTask(CronTask *task, int64 jobId)
 	task->jobId = jobId;
 	task->state = CRON_TASK_WAITING;
 	task->pendingRunCount = 0;
+	task->pendingRunTime = 0;
+	task->logRun = true;
+	task->runFailed = false;
+	task->runTimedOut = false;
+	task->runRowCount = 0;
+	task->runEndTime = 0;
+	task->runScheduledTime = 0;
+	task->runLaunchTime = 0;
+	task->runConnectedTime = 0;
+	memset(&task->runLatency, 0, sizeof(CronRunLatency));
 	task->connection = NULL;
 	task->pollingStatus = 0;
 	task->startDeadline = 0;
+	task->nextStartAttempt = 0;
+	task->startRetryDelay = 0;
 	task->isSocketReady = false;
+	task->waitSocket = PGINVALID_SOCKET;
+	task->waitEvents = 0;
+	task->waitEventPosition = -1;
 	task->isActive = true;
 	task->errorMessage = NULL;
 	task->freeErrorMessage = false;
 	task->seg = NULL;
+	task->jobSlot = -1;
+	task->terminating = false;
 	task->sharedMemoryQueue = NULL;
+	task->poolWorker = NULL;
 }
 
 
@@ -183,6 +784,73 @@ CurrentTaskList(void)
 }
 
 
+/*
+ * IntervalTaskList returns the list of tasks of jobs that run every few
+ * seconds, which should not be modified by the caller.
+ */
+List *
+IntervalTaskList(void)
+{
+	return IntervalTasks;
+}
+
+
+/*
+ * ReadyTaskList returns the list of tasks that the launcher should handle on
+ * its next pass, which should not be modified by the caller.
+ */
+List *
+ReadyTaskList(void)
+{
+	return ReadyTasks;
+}
+
+
+/*
+ * TakeReadyTaskList returns the list of tasks that the launcher should handle
+ * on its next pass and starts a new one. The caller should free the list.
+ */
+List *
+TakeReadyTaskList(void)
+{
+	List *taskList = ReadyTasks;
+	ListCell *taskCell = NULL;
+
+	foreach(taskCell, taskList)
+	{
+		CronTask *task = (CronTask *) lfirst(taskCell);
+
+		task->isReady = false;
+	}
+
+	ReadyTasks = NIL;
+
+	return taskList;
+}
+
+
+/*
+ * MarkTaskReady adds a task to the list of tasks that the launcher should
+ * handle on its next pass, unless it is already on it.
+ */
+void
+MarkTaskReady(CronTask *task)
+{
+	MemoryContext oldContext = NULL;
+
+	if (task->isReady)
+	{
+		return;
+	}
+
+	oldContext = MemoryContextSwitchTo(CronTaskContext);
+	ReadyTasks = lappend(ReadyTasks, task);
+	MemoryContextSwitchTo(oldContext);
+
+	task->isReady = true;
+}
+
+
 /*
  * RemoveTask remove the task for the given job ID.
  */
@@ -190,6 +858,28 @@ void
 RemoveTask(int64 jobId)
 {
 	bool isPresent = false;
+	CronTask *task = hash_search(CronTaskHash, &jobId, HASH_FIND, &isPresent);
+
+	if (task != NULL)
+	{
+		if (task->scheduleText != NULL)
+		{
+			pfree(task->scheduleText);
+		}
+
+		RemoveScheduleSlot(task->scheduleSlot);
+		SlotTasks[task->scheduleSlot] = NULL;
+
+		if (task->secondsInterval > 0)
+		{
+			IntervalTasks = list_delete_ptr(IntervalTasks, task);
+		}
+
+		if (task->isReady)
+		{
+			ReadyTasks = list_delete_ptr(ReadyTasks, task);
+		}
+	}
 
 	hash_search(CronTaskHash, &jobId, HASH_REMOVE, &isPresent);
 }
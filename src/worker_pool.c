@@ -0,0 +1,467 @@
+/*-------------------------------------------------------------------------
+ *
+ * src/worker_pool.c
+ *
+ * Pool of background workers that run the commands of many jobs.
+ *
+ * Starting a background worker for every run means forking a process,
+ * connecting to a database and warming up its caches, which can take longer
+ * than the command of a frequent job. When cron.background_worker_pool_size
+ * is set, the launcher keeps the workers it started after their job
+ * finishes, and hands them the next job for the same database and user.
+ * Workers that stay idle for longer than cron.background_worker_idle_timeout
+ * are stopped, and when the pool is full the least recently used idle
+ * worker makes room for a new one.
+ *
+ * The pool is only used by the launcher, the shared gauges and counters
+ * allow other backends to inspect it.
+ *
+ * Copyright (c) 2016, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#include "cron.h"
+#include "pg_cron.h"
+#include "shared_state.h"
+#include "worker_pool.h"
+
+#include "access/htup_details.h"
+#include "nodes/pg_list.h"
+#include "storage/latch.h"
+#include "storage/proc.h"
+#include "storage/shm_toc.h"
+#include "utils/memutils.h"
+
+
+/* forward declarations */
+static CronPoolWorker * LeastRecentlyUsedIdleWorker(void);
+static void UpdatePoolGauges(void);
+
+/* SQL-callable functions */
+PG_FUNCTION_INFO_V1(cron_worker_pool_stats);
+
+
+/* global settings */
+int CronWorkerPoolSize = 0;
+int CronWorkerIdleTimeout = 60000;
+
+/* global variables */
+static MemoryContext WorkerPoolContext = NULL;
+static List *PoolWorkers = NIL;
+
+
+/*
+ * GetIdlePoolWorker returns an idle pooled worker for the given database and
+ * user and marks it as busy, or returns NULL if there is none.
+ */
+CronPoolWorker *
+GetIdlePoolWorker(char *database, char *userName)
+{
+	CronPoolWorker *idleWorker = NULL;
+	ListCell *workerCell = NULL;
+
+	if (CronWorkerPoolSize <= 0)
+	{
+		return NULL;
+	}
+
+	foreach(workerCell, PoolWorkers)
+	{
+		CronPoolWorker *poolWorker = (CronPoolWorker *) lfirst(workerCell);
+		pid_t pid = 0;
+
+		if (poolWorker->busy ||
+			strcmp(poolWorker->database, database) != 0 ||
+			strcmp(poolWorker->userName, userName) != 0)
+		{
+			continue;
+		}
+
+		/* workers that exited are removed by RetireIdlePoolWorkers */
+		if (GetBackgroundWorkerPid(&poolWorker->handle, &pid) != BGWH_STARTED)
+		{
+			continue;
+		}
+
+		idleWorker = poolWorker;
+		break;
+	}
+
+	if (idleWorker == NULL)
+	{
+		IncrementCronCounter(CRON_COUNTER_POOL_MISSES, 1);
+		return NULL;
+	}
+
+	idleWorker->busy = true;
+
+	IncrementCronCounter(CRON_COUNTER_POOL_HITS, 1);
+	UpdatePoolGauges();
+
+	return idleWorker;
+}
+
+
+/*
+ * CreatePoolWorker adds a busy worker for the given database and user to the
+ * pool and sets up its shared memory. The worker still needs to be started
+ * using RegisterPoolWorker. If the pool is full, the least recently used idle
+ * worker is stopped to make room. Returns NULL if all pooled workers are busy
+ * or the shared memory could not be created.
+ */
+CronPoolWorker *
+CreatePoolWorker(char *database, char *userName)
+{
+	CronPoolWorker *poolWorker = NULL;
+	MemoryContext oldContext = NULL;
+	shm_toc_estimator estimator;
+	shm_toc *toc = NULL;
+	dsm_segment *seg = NULL;
+	char *sharedDatabase = NULL;
+	char *sharedUserName = NULL;
+	shm_mq *commandQueue = NULL;
+	shm_mq *responseQueue = NULL;
+	Size segmentSize = 0;
+
+	if (CronWorkerPoolSize <= 0)
+	{
+		return NULL;
+	}
+
+	if (list_length(PoolWorkers) >= CronWorkerPoolSize)
+	{
+		CronPoolWorker *leastRecentlyUsed = LeastRecentlyUsedIdleWorker();
+
+		if (leastRecentlyUsed == NULL)
+		{
+			return NULL;
+		}
+
+		RemovePoolWorker(leastRecentlyUsed);
+		IncrementCronCounter(CRON_COUNTER_POOL_RETIRED_WORKERS, 1);
+	}
+
+	shm_toc_initialize_estimator(&estimator);
+	shm_toc_estimate_chunk(&estimator, strlen(database) + 1);
+	shm_toc_estimate_chunk(&estimator, strlen(userName) + 1);
+	shm_toc_estimate_chunk(&estimator, QUEUE_SIZE);
+	shm_toc_estimate_chunk(&estimator, QUEUE_SIZE);
+	shm_toc_estimate_keys(&estimator, PG_CRON_NKEYS);
+	segmentSize = shm_toc_estimate(&estimator);
+
+	seg = dsm_create(segmentSize, DSM_CREATE_NULL_IF_MAXSEGMENTS);
+	if (seg == NULL)
+	{
+		return NULL;
+	}
+
+	/* the segment outlives the job that caused us to create it */
+	dsm_pin_mapping(seg);
+
+	toc = shm_toc_create(PG_CRON_MAGIC, dsm_segment_address(seg), segmentSize);
+
+	sharedDatabase = shm_toc_allocate(toc, strlen(database) + 1);
+	strcpy(sharedDatabase, database);
+	shm_toc_insert(toc, PG_CRON_KEY_DATABASE, sharedDatabase);
+
+	sharedUserName = shm_toc_allocate(toc, strlen(userName) + 1);
+	strcpy(sharedUserName, userName);
+	shm_toc_insert(toc, PG_CRON_KEY_USERNAME, sharedUserName);
+
+	commandQueue = shm_mq_create(shm_toc_allocate(toc, QUEUE_SIZE), QUEUE_SIZE);
+	shm_toc_insert(toc, PG_CRON_KEY_COMMAND_QUEUE, commandQueue);
+	shm_mq_set_sender(commandQueue, MyProc);
+
+	responseQueue = shm_mq_create(shm_toc_allocate(toc, QUEUE_SIZE), QUEUE_SIZE);
+	shm_toc_insert(toc, PG_CRON_KEY_QUEUE, responseQueue);
+	shm_mq_set_receiver(responseQueue, MyProc);
+
+	if (WorkerPoolContext == NULL)
+	{
+		WorkerPoolContext = AllocSetContextCreate(TopMemoryContext,
+												  "pg_cron worker pool context",
+												  ALLOCSET_DEFAULT_MINSIZE,
+												  ALLOCSET_DEFAULT_INITSIZE,
+												  ALLOCSET_DEFAULT_MAXSIZE);
+	}
+
+	oldContext = MemoryContextSwitchTo(WorkerPoolContext);
+
+	poolWorker = palloc0(sizeof(CronPoolWorker));
+	poolWorker->database = pstrdup(database);
+	poolWorker->userName = pstrdup(userName);
+	poolWorker->seg = seg;
+	poolWorker->commandQueue = shm_mq_attach(commandQueue, seg, NULL);
+	poolWorker->responseQueue = shm_mq_attach(responseQueue, seg, NULL);
+	poolWorker->registered = false;
+	poolWorker->busy = true;
+	poolWorker->lastUsedTime = 0;
+
+	PoolWorkers = lappend(PoolWorkers, poolWorker);
+
+	MemoryContextSwitchTo(oldContext);
+
+	UpdatePoolGauges();
+
+	return poolWorker;
+}
+
+
+/*
+ * RegisterPoolWorker asks the postmaster to start a pooled worker. The
+ * postmaster sets our latch once the worker started. Returns false if there
+ * are no background worker slots available.
+ */
+bool
+RegisterPoolWorker(CronPoolWorker *poolWorker)
+{
+	BackgroundWorker worker;
+	BackgroundWorkerHandle *handle = NULL;
+
+	Assert(!poolWorker->registered);
+
+	memset(&worker, 0, sizeof(BackgroundWorker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_ConsistentState;
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	sprintf(worker.bgw_library_name, "pg_cron");
+	sprintf(worker.bgw_function_name, "CronPoolBackgroundWorker");
+#if (PG_VERSION_NUM >= 110000)
+	snprintf(worker.bgw_type, BGW_MAXLEN, "pg_cron");
+#endif
+	snprintf(worker.bgw_name, BGW_MAXLEN, "pg_cron pool worker");
+	worker.bgw_main_arg = UInt32GetDatum(dsm_segment_handle(poolWorker->seg));
+	worker.bgw_notify_pid = MyProcPid;
+
+	if (!RegisterDynamicBackgroundWorker(&worker, &handle))
+	{
+		return false;
+	}
+
+	poolWorker->handle = *handle;
+	poolWorker->registered = true;
+	pfree(handle);
+
+	/* do not wait for a worker that exited when sending or receiving */
+	shm_mq_set_handle(poolWorker->commandQueue, &poolWorker->handle);
+	shm_mq_set_handle(poolWorker->responseQueue, &poolWorker->handle);
+
+	return true;
+}
+
+
+/*
+ * SendPoolWorkerCommand sends the command of a job to a pooled worker that
+ * started, without waiting. It returns SHM_MQ_WOULD_BLOCK if the command is
+ * larger than the free space in the queue, in which case it should be called
+ * again with the same command once the worker read part of it, and
+ * SHM_MQ_DETACHED if the worker exited.
+ */
+shm_mq_result
+SendPoolWorkerCommand(CronPoolWorker *poolWorker, char *command)
+{
+#if (PG_VERSION_NUM >= 150000)
+	return shm_mq_send(poolWorker->commandQueue, strlen(command) + 1, command,
+					   true, true);
+#else
+	return shm_mq_send(poolWorker->commandQueue, strlen(command) + 1, command,
+					   true);
+#endif
+}
+
+
+/*
+ * ReleasePoolWorker returns a worker that finished its job to the pool, or
+ * stops it if the pool became smaller in the meantime.
+ */
+void
+ReleasePoolWorker(CronPoolWorker *poolWorker, TimestampTz currentTime)
+{
+	poolWorker->busy = false;
+	poolWorker->lastUsedTime = currentTime;
+
+	if (list_length(PoolWorkers) > CronWorkerPoolSize)
+	{
+		RemovePoolWorker(poolWorker);
+		IncrementCronCounter(CRON_COUNTER_POOL_RETIRED_WORKERS, 1);
+		return;
+	}
+
+	UpdatePoolGauges();
+}
+
+
+/*
+ * RemovePoolWorker stops a pooled worker and removes it from the pool.
+ */
+void
+RemovePoolWorker(CronPoolWorker *poolWorker)
+{
+	if (poolWorker->registered)
+	{
+		TerminateBackgroundWorker(&poolWorker->handle);
+	}
+
+	shm_mq_detach(poolWorker->commandQueue);
+	shm_mq_detach(poolWorker->responseQueue);
+	dsm_detach(poolWorker->seg);
+
+	PoolWorkers = list_delete_ptr(PoolWorkers, poolWorker);
+
+	pfree(poolWorker->database);
+	pfree(poolWorker->userName);
+	pfree(poolWorker);
+
+	UpdatePoolGauges();
+}
+
+
+/*
+ * RetireIdlePoolWorker stops the least recently used idle worker, such that
+ * its background worker slot can be used by a job for another database or
+ * user once it exited. Returns false if all pooled workers are busy.
+ */
+bool
+RetireIdlePoolWorker(void)
+{
+	CronPoolWorker *leastRecentlyUsed = LeastRecentlyUsedIdleWorker();
+
+	if (leastRecentlyUsed == NULL)
+	{
+		return false;
+	}
+
+	RemovePoolWorker(leastRecentlyUsed);
+	IncrementCronCounter(CRON_COUNTER_POOL_RETIRED_WORKERS, 1);
+
+	return true;
+}
+
+
+/*
+ * RetireIdlePoolWorkers stops idle workers that were not used for
+ * cron.background_worker_idle_timeout, or that no longer fit in the pool,
+ * and removes workers that exited from the pool.
+ */
+void
+RetireIdlePoolWorkers(TimestampTz currentTime)
+{
+	List *poolWorkers = list_copy(PoolWorkers);
+	ListCell *workerCell = NULL;
+
+	foreach(workerCell, poolWorkers)
+	{
+		CronPoolWorker *poolWorker = (CronPoolWorker *) lfirst(workerCell);
+		pid_t pid = 0;
+
+		if (poolWorker->busy)
+		{
+			continue;
+		}
+
+		if (GetBackgroundWorkerPid(&poolWorker->handle, &pid) == BGWH_STOPPED)
+		{
+			RemovePoolWorker(poolWorker);
+		}
+		else if (list_length(PoolWorkers) > CronWorkerPoolSize ||
+				 TimestampDifferenceExceeds(poolWorker->lastUsedTime, currentTime,
+											CronWorkerIdleTimeout))
+		{
+			RemovePoolWorker(poolWorker);
+			IncrementCronCounter(CRON_COUNTER_POOL_RETIRED_WORKERS, 1);
+		}
+	}
+
+	list_free(poolWorkers);
+}
+
+
+/*
+ * LeastRecentlyUsedIdleWorker returns the idle worker that finished its last
+ * job the longest time ago, or NULL if all pooled workers are busy.
+ */
+static CronPoolWorker *
+LeastRecentlyUsedIdleWorker(void)
+{
+	CronPoolWorker *leastRecentlyUsed = NULL;
+	ListCell *workerCell = NULL;
+
+	foreach(workerCell, PoolWorkers)
+	{
+		CronPoolWorker *poolWorker = (CronPoolWorker *) lfirst(workerCell);
+
+		if (poolWorker->busy)
+		{
+			continue;
+		}
+
+		if (leastRecentlyUsed == NULL ||
+			poolWorker->lastUsedTime < leastRecentlyUsed->lastUsedTime)
+		{
+			leastRecentlyUsed = poolWorker;
+		}
+	}
+
+	return leastRecentlyUsed;
+}
+
+
+/*
+ * UpdatePoolGauges publishes the size of the pool in shared memory.
+ */
+static void
+UpdatePoolGauges(void)
+{
+	uint64 idleWorkerCount = 0;
+	ListCell *workerCell = NULL;
+
+	foreach(workerCell, PoolWorkers)
+	{
+		CronPoolWorker *poolWorker = (CronPoolWorker *) lfirst(workerCell);
+
+		if (!poolWorker->busy)
+		{
+			idleWorkerCount++;
+		}
+	}
+
+	SetCronGauge(CRON_GAUGE_POOL_WORKERS, list_length(PoolWorkers));
+	SetCronGauge(CRON_GAUGE_IDLE_POOL_WORKERS, idleWorkerCount);
+}
+
+
+/*
+ * cron_worker_pool_stats returns the size of the pool of background workers
+ * and how often it could be used.
+ */
+Datum
+cron_worker_pool_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDescriptor = NULL;
+	Datum values[5];
+	bool isNulls[5];
+	HeapTuple heapTuple = NULL;
+
+	if (get_call_result_type(fcinfo, NULL, &tupleDescriptor) != TYPEFUNC_COMPOSITE)
+	{
+		elog(ERROR, "return type must be a row type");
+	}
+
+	memset(isNulls, false, sizeof(isNulls));
+
+	values[0] = Int32GetDatum((int32) ReadCronGauge(CRON_GAUGE_POOL_WORKERS));
+	values[1] = Int32GetDatum((int32) ReadCronGauge(CRON_GAUGE_IDLE_POOL_WORKERS));
+	values[2] = Int64GetDatum(ReadCronCounter(CRON_COUNTER_POOL_HITS));
+	values[3] = Int64GetDatum(ReadCronCounter(CRON_COUNTER_POOL_MISSES));
+	values[4] = Int64GetDatum(ReadCronCounter(CRON_COUNTER_POOL_RETIRED_WORKERS));
+
+	heapTuple = heap_form_tuple(tupleDescriptor, values, isNulls);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heapTuple));
+}